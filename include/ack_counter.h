@@ -0,0 +1,87 @@
+#ifndef ACK_COUNTER_H
+#define ACK_COUNTER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+namespace kvstore
+{
+    // 等待一组异步确认的计数器：pending 个确认中有 needed 个成功即成功，剩余的不足 needed 个即失败，
+    // 到达 deadline 仍未完成时由调用方按失败处理。副本写入的确认和租约失效通知的发出都用它表示。
+    // 同步调用方用 wait 阻塞；CQ 上的调用不能阻塞轮询线程，用 notify 登记回调，在完成时唤醒自己
+    class AckCounter
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        AckCounter(int needed, int pending, Clock::time_point deadline) : needed_(needed), pending_(pending), deadline_(deadline)
+        {
+        }
+
+        void complete(bool ok)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_--;
+            if (ok)
+                acked_++;
+            if (finished() && callback_)
+            {
+                // 在锁内调用并清除，cancel_notify 返回后回调不会再运行
+                auto callback = std::move(callback_);
+                callback_ = nullptr;
+                callback();
+            }
+            cv_.notify_all();
+        }
+
+        // 等到完成或 deadline，返回是否成功
+        bool wait()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait_until(lock, deadline_, [this]()
+                           { return finished(); });
+            return acked_ >= needed_;
+        }
+
+        // 尚未完成时登记 callback 并返回 true，完成时在内部锁内调用一次，callback 不能再访问本对象；
+        // 已经完成时不登记并返回 false
+        bool notify(std::function<void()> callback)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (finished())
+                return false;
+            callback_ = std::move(callback);
+            return true;
+        }
+
+        // 撤销 notify 登记的回调，返回后回调不会再被调用
+        void cancel_notify()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            callback_ = nullptr;
+        }
+
+        bool succeeded()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return acked_ >= needed_;
+        }
+
+        Clock::time_point deadline() const { return deadline_; }
+
+    private:
+        bool finished() const { return acked_ >= needed_ || acked_ + pending_ < needed_; }
+
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::function<void()> callback_;
+        int needed_;
+        int pending_;
+        int acked_ = 0;
+        Clock::time_point deadline_;
+    };
+}
+
+#endif
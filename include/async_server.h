@@ -0,0 +1,60 @@
+#ifndef ASYNC_SERVER_H
+#define ASYNC_SERVER_H
+
+#include <grpcpp/grpcpp.h>
+#include "kvstore.grpc.pb.h"
+#include "server.h"
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace kvstore
+{
+    // Put/Get/Del 和副本写入走异步接口，批量接口、扫描、失效通知订阅和节点间的成员/迁移接口仍由 gRPC 同步线程池处理并委托给 KVStoreServiceImpl
+    class KVStoreHybridService final : public KVStoreRPC::WithAsyncMethod_Put<KVStoreRPC::WithAsyncMethod_Get<KVStoreRPC::WithAsyncMethod_Del<KVStoreRPC::WithAsyncMethod_Replicate<KVStoreRPC::Service>>>>
+    {
+    public:
+        explicit KVStoreHybridService(KVStoreServiceImpl &impl);
+        grpc::Status MultiGet(grpc::ServerContext *context, const MultiGetRequest *request, MultiGetResponse *response) override;
+        grpc::Status MultiPut(grpc::ServerContext *context, const MultiPutRequest *request, MultiPutResponse *response) override;
+        grpc::Status MultiDel(grpc::ServerContext *context, const MultiDeleteRequest *request, MultiDeleteResponse *response) override;
+        grpc::Status Scan(grpc::ServerContext *context, const ScanRequest *request, grpc::ServerWriter<ScanResponse> *writer) override;
+        grpc::Status Subscribe(grpc::ServerContext *context, const SubscribeRequest *request, grpc::ServerWriter<Invalidation> *writer) override;
+        grpc::Status Heartbeat(grpc::ServerContext *context, const HeartbeatRequest *request, HeartbeatResponse *response) override;
+        grpc::Status Join(grpc::ServerContext *context, const JoinRequest *request, MembershipResponse *response) override;
+        grpc::Status Leave(grpc::ServerContext *context, const LeaveRequest *request, MembershipResponse *response) override;
+        grpc::Status Migrate(grpc::ServerContext *context, grpc::ServerReader<MigrateEntry> *reader, MigrateResponse *response) override;
+
+    private:
+        KVStoreServiceImpl &impl_;
+    };
+
+    // 基于 ServerCompletionQueue 的异步服务端：每个 CQ 由一个轮询线程驱动，每个调用是一个状态机。
+    // 需要转发的请求和副本读取同样以异步方式发给对端，写入的副本确认和租约失效通知也在 CQ 上等待，轮询线程不会阻塞在对端节点上
+    class KVStoreAsyncServer
+    {
+    public:
+        // cq_count 为 0 时每个核心一个 CQ
+        KVStoreAsyncServer(KVStoreServiceImpl &impl, int cq_count = 0);
+        ~KVStoreAsyncServer();
+
+        // 在 BuildAndStart 之前调用：注册服务并创建 CQ
+        void register_with(grpc::ServerBuilder &builder);
+        // 在 BuildAndStart 之后调用：投递等待请求的调用并启动轮询线程
+        void start();
+        // 在 server->Shutdown() 之后调用：关闭 CQ 并等待轮询线程退出
+        void shutdown();
+
+    private:
+        void poll(grpc::ServerCompletionQueue *cq);
+
+        KVStoreServiceImpl &impl_;
+        KVStoreHybridService service_;
+        int cq_count_;
+        std::vector<std::unique_ptr<grpc::ServerCompletionQueue>> cqs_;
+        std::vector<std::thread> threads_;
+        bool shutdown_ = false;
+    };
+}
+
+#endif
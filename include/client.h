@@ -1,27 +1,284 @@
 #ifndef CLIENT_H
 #define CLIENT_H
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 #include <grpcpp/grpcpp.h>
 #include "kvstore.grpc.pb.h"
 #include "client_cache.h"
+#include "consistency_hash.h"
+#include <condition_variable>
 
 namespace kvstore
 {
+    // 批量读取中单个键的结果
+    struct GetResult
+    {
+        bool found = false;
+        std::string value;
+        int64_t version = -1;
+    };
+
+    // 扫描结果中的一项
+    struct ScanItem
+    {
+        std::string key;
+        std::string value;
+        int64_t version = -1;
+    };
+
+    // 单键请求的一致性参数，quorum 为 0 时使用服务端配置的默认值
+    struct ConsistencyOptions
+    {
+        int replicas = 1;         // 服务端的副本数，允许读旧值时客户端在这些副本之间轮流选择读取的节点
+        int write_quorum = 0;     // 写操作返回前需要确认的副本数
+        int read_quorum = 0;      // 读操作比较版本的副本数
+        bool allow_stale = false; // 允许由备份副本响应读请求，分散热点键的读负载，但可能读到旧值
+    };
+
+    // 写操作的版本参数
+    struct WriteOptions
+    {
+        bool server_versions = false;    // 由主副本以键的当前版本 + 1 写入，写入之间不会冲突，按到达主副本的顺序生效
+        int conflict_retries = 0;        // 版本冲突时按服务端返回的版本自动重试的次数，0 表示把冲突交给调用方
+        int64_t retry_backoff_us = 1000; // 第一次重试前的等待，之后每次翻倍，实际等待在 [0.5, 1.5) 倍之间随机
+    };
+
+    // 写操作的版本冲突统计
+    struct WriteStats
+    {
+        uint64_t conflicts = 0; // 服务端因版本过旧拒绝的写入次数（含重试）
+        uint64_t retries = 0;   // 因冲突自动重发的写入次数
+    };
+
+    // 对冲读：首选节点在延迟内没有响应时，向另一个持有该键的节点再发一份请求，先到的响应胜出，另一个被取消。
+    // 延迟取最近读请求延迟的 percentile 分位数，限制在 [min_delay_us, max_delay_us] 内；样本不足时使用 max_delay_us
+    struct HedgeOptions
+    {
+        bool enabled = false;
+        double percentile = 95.0;
+        int64_t min_delay_us = 500;
+        int64_t max_delay_us = 20000;
+    };
+
+    // 对冲读的统计
+    struct HedgeStats
+    {
+        uint64_t reads = 0;       // 可以对冲的读请求数
+        uint64_t hedges_sent = 0; // 发出的对冲请求数
+        uint64_t hedge_wins = 0;  // 对冲请求先于首选请求返回的次数
+        int64_t delay_us = 0;     // 当前的对冲延迟
+    };
+
+    // 最近若干次读请求的延迟样本，每积累一批样本重新计算一次分位数
+    class LatencyWindow
+    {
+    public:
+        void reset(double percentile);
+        void record(int64_t us);
+        // 样本不足时返回 -1
+        int64_t percentile() const { return cached_.load(std::memory_order_relaxed); }
+
+    private:
+        static const size_t kCapacity = 1024;
+        static const size_t kRefreshEvery = 64;
+
+        std::mutex mutex_;
+        std::vector<int64_t> samples_;
+        size_t next_ = 0;
+        size_t pending_ = 0;
+        double percentile_ = 95.0;
+        std::atomic<int64_t> cached_{-1};
+    };
+
+    // 客户端记住的各键最近版本，写入时取该键的版本 + 1，不同键的写入互不影响。
+    // 按键的哈希直接映射到固定数量的槽，映射到同一槽的键互相覆盖，内存有上界；
+    // 不在表中的键使用本客户端见过的最大版本 + 1，不会低于本客户端之前写过的版本
+    class VersionTable
+    {
+    public:
+        explicit VersionTable(size_t slots = 4096);
+        // 返回写入 key 使用的版本，并记为该键的最新版本，并发写同一个键得到不同的版本
+        int64_t next(const std::string &key);
+        // 记录从服务端得知的版本，只会增大
+        void observe(const std::string &key, int64_t version);
+        int64_t max_version() const { return max_version_.load(std::memory_order_relaxed); }
+
+    private:
+        static const size_t kStripes = 64;
+
+        struct Slot
+        {
+            size_t hash = 0;
+            int64_t version = -1; // -1 表示空槽
+        };
+
+        std::vector<Slot> slots_;
+        std::array<std::mutex, kStripes> stripes_;
+        std::atomic<int64_t> max_version_{0};
+    };
+
+    // 集群成员，name 必须与服务端节点名一致，客户端据此构建与服务端相同的哈希环
+    struct ClusterNode
+    {
+        std::string name;
+        std::string address;
+    };
+
+    // 异步接口的完成回调，在客户端的 reactor 线程上执行，不应长时间阻塞
+    using StatusCallback = std::function<void(const grpc::Status &)>;
+    using GetCallback = std::function<void(const grpc::Status &, const GetResult &)>;
+
     class KVClient
     {
     public:
-        KVClient(std::shared_ptr<grpc::Channel> channel, size_t cache_capacity);
+        // cache_bytes 为本地缓存的字节预算；reactor_threads 为驱动异步接口的 CQ 轮询线程数，首次发起异步请求时才创建
+        KVClient(std::shared_ptr<grpc::Channel> channel, size_t cache_bytes, int reactor_threads = 1);
+        // 客户端路由：每个节点一个 channel，单键请求直接发给负责节点。
+        // 负责节点不可用时改发给其他节点，由服务端转发；客户端视图过期时服务端同样会转发，结果仍然正确
+        KVClient(const std::vector<ClusterNode> &nodes, size_t cache_bytes, int reactor_threads = 1);
+        // cache_bytes 大于 0 时向每个节点订阅失效通知，Get 向主副本申请读租约；
+        // 缓存只在租约期内命中，键被写入或删除时服务端推送失效通知，订阅断开时丢弃全部缓存
+        ~KVClient();
         grpc::Status put(const std::string &key, const std::string &value);
+        // 写入带存活时间的键：ttl 之后服务端自动删除，不需要再发 Del；再次写入时按新的 ttl 重新计时，不带 ttl 的写入使键不再过期
+        grpc::Status put(const std::string &key, const std::string &value, std::chrono::milliseconds ttl);
         grpc::Status get(const std::string &key, std::string &value, int64_t &version);
         grpc::Status del(const std::string &key);
+
+        // 批量接口：一次 RPC 发给入口节点，由服务端按负责节点拆分并行处理，结果与输入一一对应。
+        // 某一项在服务端出错时只有它的结果为未找到或失败，其余各项照常返回
+        grpc::Status multi_get(const std::vector<std::string> &keys, std::vector<GetResult> &results);
+        grpc::Status multi_put(const std::vector<std::pair<std::string, std::string>> &entries, std::vector<bool> &success);
+        grpc::Status multi_del(const std::vector<std::string> &keys, std::vector<bool> &deleted);
+        // 有序扫描：发给入口节点，由它并行扫描所有节点并按键归并。一页至多 limit 项（0 使用服务端默认值），按键的字节序排列。
+        // continuation 传入上一页返回的令牌（第一页为空），返回时写入下一页的令牌，扫描完整个区间后为空
+        grpc::Status scan(const std::string &start, const std::string &end, size_t limit, std::vector<ScanItem> &items, std::string &continuation);
+        grpc::Status prefix_scan(const std::string &prefix, size_t limit, std::vector<ScanItem> &items, std::string &continuation);
+        // 下一次写入本客户端没有记录的键时使用的版本
         int64_t getVersion();
 
+        // 在发出请求之前调用，之后的单键请求都带上这些参数
+        void set_consistency(const ConsistencyOptions &options);
+        // 在发出请求之前调用，之后的 put、multi_put 和 async_put 都使用这些参数
+        void set_write_options(const WriteOptions &options);
+        WriteStats write_stats() const;
+        // 在发出请求之前调用；只有配置了多个节点时才会对冲。
+        // 配置了多副本时对冲请求带 allow_stale，由备份副本直接响应，可能读到旧值
+        void set_hedging(const HedgeOptions &options);
+        HedgeStats hedge_stats() const;
+        // 本地缓存的命中率与内存占用，用于按服务调整 cache_bytes
+        CacheStats cache_stats() const;
+
+        // 非阻塞接口：请求发出后立即返回，完成时更新缓存和版本号，再调用回调。
+        // 同一个客户端上可以同时挂起任意多个请求；析构时会等待所有已发出的请求完成
+        void async_put(const std::string &key, const std::string &value, StatusCallback done);
+        void async_get(const std::string &key, GetCallback done);
+        void async_del(const std::string &key, StatusCallback done);
+
+        // future 形式，async_get 的结果在 future 就绪前写入 result
+        std::future<grpc::Status> async_put(const std::string &key, const std::string &value);
+        std::future<grpc::Status> async_get(const std::string &key, GetResult &result);
+        std::future<grpc::Status> async_del(const std::string &key);
+
     private:
-        std::unique_ptr<kvstore::KVStoreRPC::Stub> stub_;
-        int64_t current_version = 0;
-        std::mutex version_mutex;
-        KVCacheLRU cache_; // LRU 缓存实例
+        // 发出 Get 时记下的状态：响应带回租约时，只有期间该键所在分组没有收到失效通知才写入缓存，
+        // 租约从发出请求时开始计时，不会晚于服务端的到期时间
+        struct LeaseTicket
+        {
+            uint64_t stamp = 0;
+            std::chrono::steady_clock::time_point sent;
+        };
+        LeaseTicket request_lease(const std::string &key, GetRequest &request);
+
+        // 按写入参数填写请求的版本
+        void stamp_version(PutRequest &request);
+        // 记录冲突响应中的版本；还有重试次数时返回 true，调用方等待 conflict_backoff 后以新版本重发
+        bool retry_conflict(const std::string &key, const grpc::Status &status, const PutResponse &response, int attempt);
+        std::chrono::microseconds conflict_backoff(int attempt);
+        void send_put(PutRequest request, int attempt, StatusCallback done);
+
+        // 同步与异步接口共用的响应处理：更新缓存和版本号，并给出返回给调用方的状态
+        grpc::Status finish_put(const std::string &key, const grpc::Status &status, const PutResponse &response);
+        grpc::Status finish_get(const std::string &key, const grpc::Status &status, GetResponse &response, GetResult &result, const LeaseTicket &ticket);
+        grpc::Status finish_del(const std::string &key, const grpc::Status &status, const DeleteResponse &response);
+        grpc::Status run_scan(const ScanRequest &request, std::vector<ScanItem> &items, std::string &continuation);
+
+        // 单键请求依次尝试的节点：从负责节点开始沿 stubs_ 循环，其余节点作为不可用时的后备
+        struct RouteTargets
+        {
+            KVStoreRPC::Stub *const *stubs;
+            size_t count;
+            size_t first;
+            KVStoreRPC::Stub *at(size_t attempt) const { return stubs[(first + attempt) % count]; }
+        };
+        RouteTargets targets_for(const std::string &key) const;
+        // 读请求的目标：允许读旧值时从键的各个副本中轮流选择第一个尝试的节点
+        RouteTargets read_targets_for(const std::string &key);
+
+        // 对冲读的共享状态，两次尝试和定时器都持有它，最后一个完成时释放
+        struct HedgedRead;
+        bool hedging_enabled() const { return hedging_.enabled && stubs_.size() > 1; }
+        // 在 reactor 上发起对冲读，done 在第一个有效响应（或全部失败）时调用一次
+        void hedged_get(const std::string &key, GetRequest request, std::function<void(const grpc::Status &, GetResponse &)> done);
+        void send_attempt(const std::shared_ptr<HedgedRead> &read, int slot);
+        void attempt_done(const std::shared_ptr<HedgedRead> &read, int slot, const grpc::Status &status, GetResponse &response);
+        void send_hedge(const std::shared_ptr<HedgedRead> &read);
+        int64_t hedge_delay_us() const;
+
+        // 每个节点一个订阅线程，断开后按退避重连
+        void subscribe(KVStoreRPC::Stub *stub);
+        void on_invalidation(const Invalidation &message);
+        std::atomic<uint64_t> &invalidation_counter(const std::string &key);
+        void drop_leases();
+
+        grpc::CompletionQueue *reactor();
+        void poll();
+        void begin_async();
+        void end_async();
+
+        std::unique_ptr<kvstore::KVStoreRPC::Stub> stub_; // 入口节点，批量请求和未配置集群时的单键请求都发给它
+        ConsistencyHash hash_ring_;
+        std::vector<std::unique_ptr<KVStoreRPC::Stub>> node_stubs_;
+        std::vector<KVStoreRPC::Stub *> stubs_; // 下标为哈希环上的节点编号；未配置集群时只有入口节点
+        VersionTable versions_;
+        WriteOptions write_options_;
+        std::atomic<uint64_t> conflicts_{0};
+        std::atomic<uint64_t> conflict_retries_{0};
+        KVCache cache_; // W-TinyLFU 缓存实例
+        bool leases_enabled_;
+        std::string client_id_;
+        std::array<std::atomic<uint64_t>, 64> invalidations_{}; // 按键的哈希分组的失效通知计数
+        std::vector<std::thread> subscriber_threads_;
+        std::vector<grpc::ClientContext *> subscriptions_; // 进行中的订阅，析构时取消
+        bool stopping_ = false;
+        std::mutex subscribe_mutex_;
+        std::condition_variable subscribe_cv_;
+        ConsistencyOptions consistency_;
+        std::atomic<uint32_t> next_replica_{0};
+
+        HedgeOptions hedging_;
+        LatencyWindow latency_;
+        std::atomic<uint64_t> hedge_reads_{0};
+        std::atomic<uint64_t> hedges_sent_{0};
+        std::atomic<uint64_t> hedge_wins_{0};
+
+        // 异步请求共用一个 CQ，由 reactor_threads_ 个线程轮询
+        int reactor_count_;
+        std::once_flag reactor_once_;
+        grpc::CompletionQueue cq_;
+        std::vector<std::thread> reactor_threads_;
+        // 尚未完成的异步操作数，析构时等待其归零后再关闭 CQ，避免重试请求投递到已关闭的 CQ
+        int in_flight_ = 0;
+        std::mutex in_flight_mutex_;
+        std::condition_variable in_flight_cv_;
     };
 
 } // namespace kvstore
@@ -1,34 +1,155 @@
-#ifndef KVCACHELRU_H
-#define KVCACHELRU_H
+#ifndef KVCACHE_H
+#define KVCACHE_H
 
-#include <unordered_map>
-#include <list>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
 #include <string>
-#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 namespace kvstore
 {
-    class KVCacheLRU
+    // 客户端缓存的统计，bytes 与 capacity_bytes 都按条目的实际占用（含索引开销的估计）计算
+    struct CacheStats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;  // 为腾出空间淘汰的条目数
+        uint64_t rejections = 0; // 频率低于主区淘汰候选、未被准入的条目数
+        size_t entries = 0;
+        size_t bytes = 0;
+        size_t capacity_bytes = 0;
+        size_t sketch_bytes = 0; // 频率草图占用的内存
+
+        double hit_ratio() const { return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / (hits + misses); }
+    };
+
+    // 客户端缓存，容量按字节计算，采用 W-TinyLFU 准入：新条目先进入约占 1% 容量的窗口区，
+    // 被挤出窗口时与主区的淘汰候选比较 count-min 草图估计的访问频率，频率更高才进入主区，
+    // 否则直接丢弃。扫描产生的只访问一次的键停留在窗口区，不会挤掉主区的热点数据。
+    // 按键的哈希分成若干段，每段一把读写锁，窗口区和主区各用 CLOCK 近似 LRU：
+    // 命中时只在共享锁内设置访问位并累加草图计数，并发读者互不阻塞。
+    // 每个条目的键和值存放在同一次分配中，索引以指向条目内键的 string_view 为键
+    class KVCache
     {
     public:
-        // 构造函数，接受缓存的最大容量
-        KVCacheLRU(size_t capacity);
+        // capacity_bytes 为缓存可使用的总字节数，超过单段容量的条目不缓存
+        KVCache(size_t capacity_bytes);
+        ~KVCache();
+
+        KVCache(const KVCache &) = delete;
+        KVCache &operator=(const KVCache &) = delete;
 
-        // 获取缓存中的数据，返回值为 true 表示找到缓存并赋值
+        // 获取缓存中的数据，返回值为 true 表示找到未过期的缓存并赋值
         bool get(const std::string &key, std::string &value, int64_t &version);
 
-        // 设置缓存项
-        void set(const std::string &key, const std::string &value, int64_t version);
+        // 设置缓存项，到达 expires 后 get 不再返回该项
+        void set(const std::string &key, const std::string &value, int64_t version,
+                 std::chrono::steady_clock::time_point expires = std::chrono::steady_clock::time_point::max());
 
         // 清除指定键的缓存
         void clear(const std::string &key);
+        // 清除所有缓存项
+        void clear_all();
+
+        CacheStats stats() const;
+
+        // 一个条目计入容量的字节数
+        static size_t charge(size_t key_size, size_t value_size);
 
     private:
-        size_t capacity_;                                                                                                         // 缓存容量
-        std::list<std::string> cache_list_;                                                                                       // 用于按访问顺序排列的键
-        std::unordered_map<std::string, std::pair<std::pair<std::string, int64_t>, std::list<std::string>::iterator>> cache_map_; // 键与缓存条目的映射
-        std::mutex mutex_;                                                                                                        // 保护缓存的线程安全
+        enum Region : uint8_t
+        {
+            kWindow = 0,
+            kMain = 1,
+        };
+
+        // 条目头部之后紧跟键和值的字节
+        struct Entry
+        {
+            std::atomic<bool> referenced;
+            Region region;
+            int64_t version;
+            std::chrono::steady_clock::time_point expires;
+            uint32_t key_size;
+            uint32_t value_size;
+            size_t slot; // 在所属区域 ring 中的位置
+            size_t hash;
+
+            const char *key_data() const { return reinterpret_cast<const char *>(this + 1); }
+            char *value_data() { return reinterpret_cast<char *>(this + 1) + key_size; }
+            std::string_view key() const { return std::string_view(key_data(), key_size); }
+            size_t charge() const { return KVCache::charge(key_size, value_size); }
+        };
+
+        // CLOCK 的环
+        struct Ring
+        {
+            std::vector<Entry *> slots;
+            size_t hand = 0;
+            size_t bytes = 0;
+            size_t capacity = 0;
+        };
+
+        // 4 行、每个计数器 4 位饱和的 count-min 草图，计数累加次数达到 sample_size 时全部减半，
+        // 让频率随时间衰减。并发累加在共享锁内用 relaxed 原子操作完成，偶尔丢失一次累加不影响估计
+        class FrequencySketch
+        {
+        public:
+            void reset(size_t width);
+            void increment(size_t hash);
+            uint32_t frequency(size_t hash) const;
+            size_t bytes() const { return width_ * kDepth; }
+
+        private:
+            static const size_t kDepth = 4;
+            size_t index(size_t hash, size_t row) const;
+
+            std::unique_ptr<std::atomic<uint8_t>[]> table_;
+            size_t width_ = 0;
+            size_t sample_size_ = 0;
+            std::atomic<size_t> additions_{0};
+        };
+
+        struct alignas(64) Segment
+        {
+            mutable std::shared_mutex mutex;
+            std::unordered_map<std::string_view, Entry *> index;
+            Ring window;
+            Ring main;
+            FrequencySketch sketch;
+            std::atomic<uint64_t> hits{0};
+            std::atomic<uint64_t> misses{0};
+            uint64_t evictions = 0;
+            uint64_t rejections = 0;
+
+            Ring &ring(Region region) { return region == kWindow ? window : main; }
+            size_t capacity() const { return window.capacity + main.capacity; }
+        };
+
+        static Entry *make_entry(const std::string &key, const std::string &value, int64_t version, std::chrono::steady_clock::time_point expires, size_t hash);
+        static void free_entry(Entry *entry);
+
+        static size_t hash_of(std::string_view key);
+        Segment &segment_for(size_t hash) const;
+        // 把条目放进环的末尾 / 从环中取出，只维护 slots 与字节数，不改动索引
+        static void attach(Ring &ring, Entry *entry);
+        static void detach(Ring &ring, Entry *entry);
+        // 用时钟算法选出一个最近未访问的条目，不从环中取出
+        static Entry *victim(Ring &ring);
+        // 从索引和所在环中删除条目并释放
+        void remove(Segment &segment, Entry *entry);
+        // 窗口区超出容量时把候选条目移入主区或丢弃，主区超出容量时淘汰
+        void rebalance(Segment &segment);
+
+        size_t capacity_; // 缓存容量（字节）
+        size_t segment_count_;
+        std::unique_ptr<Segment[]> segments_;
     };
 }
 
-#endif // KVCACHELRU_H
+#endif // KVCACHE_H
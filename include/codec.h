@@ -0,0 +1,105 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace kvstore
+{
+    // 持久化文件（WAL、快照）使用的定长编码和校验工具，统一按小端序存储
+    namespace codec
+    {
+        inline void put_fixed32(std::string &dst, uint32_t value)
+        {
+            char buf[sizeof(value)];
+            std::memcpy(buf, &value, sizeof(value));
+            dst.append(buf, sizeof(buf));
+        }
+
+        inline void put_fixed64(std::string &dst, uint64_t value)
+        {
+            char buf[sizeof(value)];
+            std::memcpy(buf, &value, sizeof(value));
+            dst.append(buf, sizeof(buf));
+        }
+
+        // 写入 4 字节长度前缀和数据本身
+        inline void put_bytes(std::string &dst, std::string_view bytes)
+        {
+            put_fixed32(dst, static_cast<uint32_t>(bytes.size()));
+            dst.append(bytes);
+        }
+
+        inline uint32_t decode_fixed32(const char *p)
+        {
+            uint32_t value;
+            std::memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+        inline uint64_t decode_fixed64(const char *p)
+        {
+            uint64_t value;
+            std::memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+        // 从 [p, end) 中读取定长整数，成功时前移 p；剩余数据不足时返回 false
+        inline bool get_fixed32(const char *&p, const char *end, uint32_t &value)
+        {
+            if (end - p < static_cast<std::ptrdiff_t>(sizeof(value)))
+                return false;
+            value = decode_fixed32(p);
+            p += sizeof(value);
+            return true;
+        }
+
+        inline bool get_fixed64(const char *&p, const char *end, uint64_t &value)
+        {
+            if (end - p < static_cast<std::ptrdiff_t>(sizeof(value)))
+                return false;
+            value = decode_fixed64(p);
+            p += sizeof(value);
+            return true;
+        }
+
+        inline bool get_bytes(const char *&p, const char *end, std::string &bytes)
+        {
+            uint32_t size;
+            if (!get_fixed32(p, end, size) || end - p < static_cast<std::ptrdiff_t>(size))
+                return false;
+            bytes.assign(p, size);
+            p += size;
+            return true;
+        }
+
+        // CRC-32 (IEEE 802.3)，用于检测文件尾部的半写记录和磁盘损坏
+        inline uint32_t crc32(const char *data, size_t size, uint32_t crc = 0)
+        {
+            struct Table
+            {
+                uint32_t entries[256];
+                Table()
+                {
+                    for (uint32_t i = 0; i < 256; i++)
+                    {
+                        uint32_t c = i;
+                        for (int k = 0; k < 8; k++)
+                            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                        entries[i] = c;
+                    }
+                }
+            };
+            static const Table table;
+            crc = ~crc;
+            for (size_t i = 0; i < size; i++)
+                crc = table.entries[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+            return ~crc;
+        }
+    }
+}
+
+#endif
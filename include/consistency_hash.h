@@ -1,21 +1,44 @@
 #ifndef CONSISTENCY_HASH_H
 #define CONSISTENCY_HASH_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
-#include <map>
 
+// 一致性哈希环。节点按添加顺序编号，每个节点在环上放置 num_replicas * weight 个虚拟节点，
+// 环是按哈希值排序的数组，查找时二分定位第一个不小于键哈希值的虚拟节点。
+// 使用 xxHash64，同样的节点集合在任何构建和进程中都会得到同样的环，客户端与服务端可以各自构建
 class ConsistencyHash {
 public:
-    ConsistencyHash(int num_replicas = 3);
-    void addNode(const std::string& node);
-    std::string getNode(const std::string& key);
+    ConsistencyHash(int num_replicas = 160);
+    // weight 为相对权重，虚拟节点数按比例放大；重复添加同名节点会先移除旧的虚拟节点
+    void addNode(const std::string& node, int weight = 1);
+    void removeNode(const std::string& node);
+    // 返回负责 key 的节点编号，环为空时返回 -1。编号在节点集合变化前保持不变，
+    // 调用方可以用它直接索引预先构建好的路由表，查找过程不分配内存
+    int getNode(const std::string& key) const;
+    // 从负责节点开始沿环顺时针取 count 个不同的节点，编号依次写入 out，返回实际个数（不超过节点数）。
+    // out[0] 与 getNode 相同，其余为副本节点
+    int getNodes(const std::string& key, int count, int* out) const;
+    const std::string& getNodeName(int id) const { return nodes[id]; }
+    size_t size() const { return nodes.size(); }
+
+    // 64 位 xxHash (XXH64)
+    static uint64_t hash(const char* data, size_t size, uint64_t seed = 0);
+    static uint64_t hash(const std::string& key) { return hash(key.data(), key.size()); }
 
 private:
+    struct Point {
+        uint64_t hash;
+        uint32_t node; // nodes 中的下标
+    };
+
+    void rebuild();
+
     std::vector<std::string> nodes;
-    std::map<int, std::string> ring;
+    std::vector<int> weights;
+    std::vector<Point> ring;
     int num_replicas;
-    unsigned int hash(const std::string& key);
 };
 
 #endif
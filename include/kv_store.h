@@ -2,10 +2,21 @@
 #define KV_STORE_H
 
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <functional>
+#include <thread>
+#include <memory>
 #include <utility> // for std::pair
 #include <stdexcept>
+#include <atomic>
+#include "ordered_keys.h"
+#include "record.h"
+#include "timer_wheel.h"
+#include "value_log.h"
+#include "wal.h"
 
 namespace kvstore
 {
@@ -14,31 +25,242 @@ namespace kvstore
     public:
         NodeInfo(const std::string& node_name, const std::string& node_address);
         ~NodeInfo();
-        std::string get_name();
-        std::string get_address();
+        const std::string &get_name() const;
+        const std::string &get_address() const;
 
     private:
         std::string node_name_;
         std::string node_address_;
     };
 
+    // 记账内存超过上限时的处理方式
+    enum class EvictionPolicy
+    {
+        kNoEviction,    // 不淘汰，拒绝写入（抛出 MemoryLimitExceeded），删除仍然可以进行
+        kAllKeysLru,    // 在随机采样的键中淘汰最久未访问的，访问时间精确到秒
+        kAllKeysLfu,    // 在随机采样的键中淘汰访问频率最低的，频率为对数计数，每分钟衰减 1
+        kAllKeysRandom, // 随机淘汰
+        kVolatileTtl    // 只淘汰带过期时间的键，最先过期的先淘汰；没有这样的键时拒绝写入
+    };
+
+    // 按名称（noeviction、allkeys-lru、allkeys-lfu、allkeys-random、volatile-ttl）解析淘汰策略，名称无效时返回 false
+    bool parse_eviction_policy(const std::string &name, EvictionPolicy &policy);
+
+    // 内存达到上限且无法淘汰时写入抛出的异常
+    class MemoryLimitExceeded : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    // KVStore 的构造参数
+    struct KVStoreOptions
+    {
+        size_t shard_count = 16; // 分片数量，每个分片拥有独立的读写锁
+        std::string data_dir;    // WAL 所在目录，为空时只保存在内存中
+        WalSyncMode sync_mode = WalSyncMode::kAlways;
+        int sync_interval_ms = 10;
+        int snapshot_interval_s = 0;                 // 定期快照的间隔，0 表示不按时间触发
+        uint64_t snapshot_wal_bytes = 64ull << 20;   // 当前日志段超过该大小时触发快照，0 表示不按大小触发
+        unsigned recovery_threads = 0;               // 启动时并行加载快照的线程数，0 表示使用全部核心
+        size_t max_memory_bytes = 0;                 // 记账内存（MemoryStats::used_bytes）的上限，0 表示不限
+        EvictionPolicy eviction_policy = EvictionPolicy::kNoEviction;
+        int eviction_samples = 5;                    // 近似 LRU/LFU 每次淘汰采样的键数，越大越接近精确但每次淘汰越慢
+        size_t max_hot_value_bytes = 0;              // 内存中值的总字节数上限，超过时把冷值移到值日志，0 表示不分层
+        std::string value_log_dir;                   // 值日志目录，为空时使用 data_dir 下的 vlog 子目录
+        uint64_t value_log_segment_bytes = 64ull << 20;
+    };
+
+    // put_if_newer 的结果：applied 表示是否写入，current_version 为操作完成后该键的版本
+    struct PutResult
+    {
+        bool applied;
+        int64_t current_version;
+    };
+
+    // KVStore 的内存占用，各分片之和
+    struct MemoryStats
+    {
+        size_t keys = 0;
+        size_t data_bytes = 0;     // 键和值本身的字节数
+        size_t record_bytes = 0;   // 正在使用的 slab 块
+        size_t slab_bytes = 0;     // 向系统申请的 slab，包括空闲块和未切分的部分
+        size_t external_bytes = 0; // 不内联在记录中的大值
+        size_t index_bytes = 0;    // 哈希索引的槽位
+        size_t ordered_bytes = 0;  // 有序键集合
+        size_t timer_bytes = 0;    // 过期时间轮
+        size_t timers = 0;         // 时间轮中的计时器数，包括键被覆盖或删除后尚未到期的旧计时器
+
+        // 内存上限按记账内存计算：每条记录的 slab 块（含记录头和按级别取整的部分）、单独存放的大值、
+        // 有序键集合中的键和偏移、时间轮中的计时器，加上哈希索引的槽位；不含仍被读者持有的已删除记录
+        size_t used_bytes = 0;
+        size_t max_bytes = 0;         // 0 表示不限
+        uint64_t evicted_keys = 0;    // 因内存上限淘汰的键数
+        uint64_t evicted_bytes = 0;   // 淘汰释放的记账内存
+        uint64_t rejected_writes = 0; // 因内存上限拒绝的写入数
+
+        size_t hot_value_bytes = 0;   // 内存中的值的字节数，分层存储时不超过 max_hot_value_bytes（后台移出有延迟）
+        size_t spilled_keys = 0;      // 值在值日志中的键数
+        size_t spilled_bytes = 0;     // 值日志中仍有效的值的字节数
+        uint64_t value_log_bytes = 0; // 值日志文件的总字节数，包括尚未整理的无效条目
+
+        size_t total_bytes() const { return slab_bytes + external_bytes + index_bytes + ordered_bytes + timer_bytes; }
+        double bytes_per_key() const { return keys > 0 ? static_cast<double>(total_bytes()) / keys : 0; }
+    };
+
+    // 键可以带绝对过期时间（wall_clock_ms 的毫秒数，0 表示不过期）。过期的键对读、扫描、删除和迁移都不可见；
+    // 读到过期的键时顺带删除，其余由后台线程按分片的时间轮分批回收，不扫描整个索引。
+    // 过期删除不写日志：恢复时已过期的条目直接丢弃，各副本也按同一个过期时间各自删除。
+    // 设置了内存上限时，写入前发现超限会按淘汰策略删除若干个键，每次写入淘汰的键数有上限，
+    // 后台线程每个刻度也淘汰一批，单次写入不会因为需要腾出大量内存而停顿。
+    // 设置了 max_hot_value_bytes 时启用分层存储：内存中的值超过上限后，后台线程按淘汰策略的访问信息（默认为最近访问时间）
+    // 采样挑出冷值写入值日志，记录换成只含键和位置的溢出记录；读到溢出的值时在锁外 pread，
+    // 短时间内再次读到的值重新放回内存。值日志中无效条目过多的段由同一个后台线程整理
     class KVStore
     {
     public:
-        KVStore(const NodeInfo &node_info);
+        KVStore(const NodeInfo &node_info, const KVStoreOptions &options = KVStoreOptions());
         ~KVStore();
         bool put(const std::string &key, const std::string &value, int64_t version);
+        // 在同一把锁内完成查找和比较：键不存在（含已过期）或 version 更新时写入，value 按值传入以便调用方 move。
+        // written 非空且写入成功时取得写入的值，用于复制给其他副本
+        PutResult put_if_newer(const std::string &key, std::string value, int64_t version, ValueRef *written = nullptr, int64_t expire_at_ms = 0);
+        // 以该键当前版本 + 1（键不存在或已过期时为 1）写入，总是成功，返回分配的版本
+        PutResult put_next_version(const std::string &key, std::string value, ValueRef *written = nullptr, int64_t expire_at_ms = 0);
         bool get(const std::string &key, std::string &value, int64_t &version);
-        bool del(const std::string &key);
+        // 取得值的引用而不复制值
+        bool get(const std::string &key, ValueRef &value, int64_t &version);
+        // 同 get，但不更新访问信息，也不把溢出的值放回内存，迁移等后台读取用
+        bool peek(const std::string &key, ValueRef &value);
+        // deleted_version 非空时写入被删除条目的版本
+        bool del(const std::string &key, int64_t *deleted_version = nullptr);
 
         int64_t getVersion(const std::string& key);
 
-        NodeInfo get_nodeinfo();
+        // 仅当键的当前版本仍为 version 时删除，迁移完成后清理本地副本用，避免删掉迁移期间写入的新值
+        bool del_if_version(const std::string &key, int64_t version);
+        // 仅当键的当前版本不超过 version 时删除，副本应用主副本的删除时用，避免删掉乱序先到的新值
+        bool del_if_not_newer(const std::string &key, int64_t version);
+
+        // 在第 shard 个分片的共享锁内逐个访问未过期的键及其版本，不读取值，fn 不能再访问本 KVStore
+        void for_each_key_in_shard(size_t shard, const std::function<void(std::string_view, int64_t)> &fn);
+
+        // 按键的字节序取 [start, end) 中的前 limit 项追加到 out，end 为空表示不限。
+        // 每个分片只在收集自己的至多 limit 项时持有共享锁，各分片的结果在锁外归并
+        void scan(const std::string &start, const std::string &end, size_t limit, std::vector<ValueRef> &out);
+
+        MemoryStats memory_stats() const;
+
+        // 将当前数据写成快照并删除已被快照覆盖的日志段，未启用持久化或失败时返回 false
+        bool snapshot();
+
+        const NodeInfo &get_nodeinfo() const;
+        size_t shard_count() const;
 
     private:
+        // 按缓存行对齐，避免相邻分片的锁落在同一缓存行上产生伪共享
+        struct alignas(64) Shard
+        {
+            mutable std::shared_mutex mutex; // get 只取共享锁，读操作之间互不阻塞
+            SlabAllocator allocator;         // 本分片记录的内存，不与其他分片争用
+            RecordIndex index;
+            OrderedKeys keys; // 与 index 中的键相同，只在新增和删除键时变化
+            TimerWheel timers; // 带过期时间的记录在发布时登记
+            std::atomic<size_t> timer_count{0}; // timers.size()，后台线程不取锁即可跳过没有计时器的分片
+            size_t data_bytes = 0;
+            size_t external_bytes = 0;
+            size_t record_charge = 0;             // 索引中各记录的记账内存之和
+            std::atomic<size_t> charged_bytes{0}; // 本分片的记账内存，写锁内更新，检查上限时不取锁读取
+            std::atomic<size_t> hot_value_bytes{0}; // 内存中的值的字节数，写锁内更新
+            size_t spilled_keys = 0;
+            size_t spilled_bytes = 0;
+            ValueLog *value_log = nullptr; // 分层存储时移出索引的溢出记录在值日志中计为无效
+
+            ~Shard();
+            // 一条记录计入内存上限的字节数
+            static size_t charge(const Record *record);
+            // 在写锁内重新计算 charged_bytes 和 timer_count
+            void update_charge();
+            // 把记录放入索引并登记过期时间，返回被替换的旧记录（没有时为空），在写锁内调用
+            Record *publish(size_t pos, Record *record, size_t hash);
+            // 从索引中移除记录，在写锁内调用，记录由调用方在锁外释放
+            Record *remove(size_t pos);
+            // 用同一个键、版本和过期时间的记录替换 pos 处的记录（值移入或移出值日志），返回旧记录，在写锁内调用
+            Record *replace(size_t pos, Record *record);
+            // 把记录计入或移出本分片的统计
+            void account(const Record *record, bool added);
+        };
+
+        Shard &shard_for(size_t hash);
+        void recover(const KVStoreOptions &options);
+        void apply_record(const WalRecord &record); // 重放日志时直接修改内存，不再写日志
+        void load_entry(std::string &&key, std::string &&value, int64_t version, int64_t expire_at_ms);
+        // 仅当 keep 对当前记录返回 false 时删除，已删除时写入被删除记录的版本
+        bool del_where(const std::string &key, const std::function<bool(int64_t)> &keep, int64_t *deleted_version);
+        void sync_wal(uint64_t lsn);
+        void snapshot_loop();
+        // 读到已过期的键后在写锁内删除它
+        void expire_key(Shard &shard, const std::string &key, size_t hash);
+        // 删除分片中到期的键，每批在写锁内处理有限个计时器，返回删除的键数
+        size_t expire_shard(Shard &shard, int64_t now_ms);
+        void expiry_loop();
+
+        // 内存超过上限时淘汰至多 max_evictions 个键，返回淘汰的键数
+        size_t evict(size_t max_evictions);
+        // 写入前调用：超过上限时淘汰一批，仍然超限且一个键也没有淘汰时拒绝写入
+        void make_room();
+        // 从分片中按策略选一个键淘汰，返回释放的记账内存，没有可淘汰的键时返回 0
+        size_t evict_from(Shard &shard);
+        size_t used_memory() const;
+        // 新记录的访问信息，覆盖写时 LFU 沿用旧记录的频率
+        void init_access(Record *record, const Record *previous) const;
+        // 刚移到值日志的记录的访问信息：LFU 沿用原记录的频率，否则视为很久没有读过，下一次读取不会立即放回内存
+        void init_spilled_access(Record *record, const Record *previous) const;
+        // 读取时更新访问信息，在共享锁内调用
+        void touch(Record *record) const;
+        // 按访问信息估计记录有多冷，越大越冷
+        int coldness(const Record *record, uint32_t now_s) const;
+
+        // 把 ref 中溢出的值从值日志读入内存。段在锁外读取之前已被整理删除时重新查找这个键，键已不存在时返回 false
+        bool load_value(ValueRef &ref);
+        // 读到溢出的值后，如果它在此之前不久也被读过，把值放回内存
+        void promote(Shard &shard, size_t hash, const ValueRef &ref);
+        // 从分片中采样挑出至多 max_values 个冷值写入值日志，返回移出的值的个数
+        size_t demote(Shard &shard, size_t max_values);
+        // 把段中仍有效的值追加到当前段并删除这个段
+        void compact(uint32_t segment);
+        size_t hot_value_bytes() const;
+        void tiering_loop();
+
         NodeInfo node_info_;
-        std::unordered_map<std::string, std::pair<std::string, int64_t>> store_;
-        std::mutex store_mutex;
+        size_t shard_count_;
+        std::unique_ptr<Shard[]> shards_;
+        std::unique_ptr<WriteAheadLog> wal_;
+
+        std::string data_dir_;
+        int snapshot_interval_s_;
+        uint64_t snapshot_wal_bytes_;
+        std::mutex snapshot_mutex_; // 同一时间只允许一个快照在写
+        std::mutex loop_mutex_;
+        std::condition_variable loop_cv_;
+        bool stop_ = false;
+        std::thread snapshot_thread_;
+        std::thread expiry_thread_;
+
+        size_t max_memory_bytes_;
+        EvictionPolicy eviction_policy_;
+        int eviction_samples_;
+        std::atomic<uint32_t> clock_s_{0}; // 单调时钟的秒数，后台线程每个刻度更新，访问信息以它为时钟
+        std::atomic<size_t> evict_cursor_{0}; // 下一次淘汰从哪个分片开始
+        std::atomic<uint64_t> evicted_keys_{0};
+        std::atomic<uint64_t> evicted_bytes_{0};
+        std::atomic<uint64_t> rejected_writes_{0};
+
+        size_t max_hot_value_bytes_;
+        bool track_access_;                  // 淘汰或分层需要访问信息时，读取才更新记录的 access
+        std::unique_ptr<ValueLog> value_log_; // 未启用分层存储时为空
+        std::atomic<size_t> demote_cursor_{0};
+        std::thread tiering_thread_;
     };
 
     // Function to parse host and port from a string in "host:port" format
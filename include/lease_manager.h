@@ -0,0 +1,76 @@
+#ifndef LEASE_MANAGER_H
+#define LEASE_MANAGER_H
+
+#include <grpcpp/grpcpp.h>
+#include "kvstore.grpc.pb.h"
+#include "ack_counter.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace kvstore
+{
+    struct LeaseOptions
+    {
+        int lease_ms = 2000; // 读租约的时长，0 表示不授予租约，客户端缓存不再命中
+    };
+
+    // 客户端缓存的读租约。只有主副本授予租约，且只授予通过 Subscribe 订阅了失效通知的客户端。
+    // 键被写入或删除后，撤销其上的全部租约并通过订阅流通知持有者，写操作等到通知发出
+    // （或租约到期、订阅断开）后才返回；客户端在租约到期前可以直接使用缓存的值。
+    // invalidate 不阻塞，返回的计数在通知全部发出时完成，由调用方同步等待或在 CQ 上等待。
+    // 订阅流在客户端断开前不会结束，停止服务前应先让客户端断开
+    class LeaseManager
+    {
+    public:
+        explicit LeaseManager(const LeaseOptions &options);
+        ~LeaseManager();
+
+        // 在读取之前调用，先登记再读取，读取与写入交错时写入一定能撤销这次的租约。
+        // 返回租约时长（毫秒），客户端未订阅或未开启租约时返回 0
+        int64_t grant(const std::string &client_id, const std::string &key);
+        // 写入生效之后调用：撤销 key 上的全部租约并把通知排进持有者的订阅流。
+        // 返回的计数在通知全部发出（或订阅断开）时完成，截止时间为最晚的租约到期时间；没有需要等待的持有者时返回空
+        std::shared_ptr<AckCounter> invalidate(const std::string &key);
+        // 路由表变化后调用：键的主副本可能已经换到别的节点，撤销所有租约
+        void revoke_all();
+
+        // Subscribe 的处理函数，客户端断开或 shutdown 后返回
+        grpc::Status serve(const std::string &client_id, grpc::ServerContext *context, grpc::ServerWriter<Invalidation> *writer);
+        void shutdown();
+
+    private:
+        struct Subscriber;
+        using Clock = std::chrono::steady_clock;
+
+        struct Holder
+        {
+            std::shared_ptr<Subscriber> subscriber;
+            Clock::time_point expires;
+        };
+
+        struct alignas(64) Shard
+        {
+            std::mutex mutex;
+            std::unordered_map<std::string, std::vector<Holder>> leases;
+            Clock::time_point next_sweep;
+        };
+
+        Shard &shard_for(const std::string &key);
+        // 清理分片中已过期或订阅已断开的租约，每个租约时长最多执行一次
+        void sweep(Shard &shard, Clock::time_point now);
+
+        LeaseOptions options_;
+        std::shared_mutex subscribers_mutex_;
+        std::unordered_map<std::string, std::shared_ptr<Subscriber>> subscribers_;
+        std::unique_ptr<Shard[]> shards_;
+        bool shutdown_ = false;
+    };
+}
+
+#endif
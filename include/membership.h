@@ -0,0 +1,110 @@
+#ifndef MEMBERSHIP_H
+#define MEMBERSHIP_H
+
+#include <grpcpp/grpcpp.h>
+#include "kvstore.grpc.pb.h"
+#include "kv_store.h"
+#include "consistency_hash.h"
+#include "peer_pool.h"
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace kvstore
+{
+    // 成员管理与数据迁移的配置
+    struct MembershipOptions
+    {
+        int heartbeat_interval_ms = 500;               // 向其他成员发送心跳的间隔
+        int failure_timeout_ms = 3000;                 // 超过该时间没有心跳往来的成员被移出集群，0 表示不自动移除
+        std::string seed;                              // 非空时以空集群启动，并向该地址的节点申请加入
+        uint64_t migration_bytes_per_sec = 8ull << 20; // 迁移数据的限速，0 表示不限速
+    };
+
+    // 路由表项，下标即哈希环上的节点编号
+    struct Route
+    {
+        std::string name;
+        std::string address;
+        PeerChannelPool::Peer *peer = nullptr; // 本节点或未知节点为 nullptr
+        bool is_self = false;
+    };
+
+    // 某个成员视图对应的路由表，构建后只读，成员变化时整体替换
+    struct RoutingTable
+    {
+        ClusterView view;
+        ConsistencyHash ring;
+        std::vector<Route> routes;
+        // 上一个视图的环，迁移尚未完成时新负责节点可以向旧负责节点回读
+        ConsistencyHash previous_ring;
+        std::vector<Route> previous_routes;
+
+        // 环为空时返回 nullptr
+        const Route *owner(const std::string &key) const;
+        const Route *previous_owner(const std::string &key) const;
+    };
+
+    // 集群成员管理：节点之间定期互发心跳并交换成员视图，视图按 (epoch, origin) 排序，
+    // 各节点总是采用较大的那个，因此所有节点最终使用同一个哈希环。
+    // 超时未响应的成员由发现它的节点移除；被误判移除的节点收到新视图后会自动重新加入
+    class Membership
+    {
+    public:
+        // on_change 在路由表替换后调用，不持有内部锁
+        Membership(const NodeInfo &self, const std::vector<NodeInfo> &nodes, PeerChannelPool &peers,
+                   const MembershipOptions &options, std::function<void()> on_change);
+        ~Membership();
+
+        void start();
+        void stop();
+
+        // 当前路由表，请求路径上只有一次原子的引用计数操作
+        std::shared_ptr<const RoutingTable> table() const { return std::atomic_load(&table_); }
+
+        // RPC 处理
+        void on_heartbeat(const HeartbeatRequest &request, HeartbeatResponse *response);
+        grpc::Status join(const Member &node, ClusterView *view);
+        grpc::Status leave(const std::string &name, ClusterView *view);
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        // 视图较新时替换路由表并返回 true，调用方须持有 mutex_
+        bool adopt(const ClusterView &view);
+        // 以本节点为 origin 生成下一个 epoch 的视图，调用方须持有 mutex_
+        void publish(std::vector<Member> members);
+        void install(const ClusterView &view);
+
+        void heartbeat_loop();
+        void heartbeat_round();
+        bool join_via(KVStoreRPC::Stub *stub);
+        void notify_change();
+
+        NodeInfo self_;
+        PeerChannelPool &peers_;
+        MembershipOptions options_;
+        std::function<void()> on_change_;
+
+        std::mutex mutex_; // 保护视图的修改和 last_seen_
+        std::shared_ptr<const RoutingTable> table_;
+        std::unordered_map<std::string, Clock::time_point> last_seen_;
+        bool joined_;          // 已经是集群成员
+        bool leaving_ = false; // 主动离开后不再重新加入
+        bool changed_ = false; // 视图已变化，待通知 on_change_
+
+        std::mutex loop_mutex_;
+        std::condition_variable loop_cv_;
+        bool wake_ = false; // 视图变化后立即发一轮心跳，加快传播
+        bool stop_ = false;
+        std::thread thread_;
+    };
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef ORDERED_KEYS_H
+#define ORDERED_KEYS_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace kvstore
+{
+    // 分片内按字节序排列的键集合，供范围扫描使用，值和版本仍通过哈希索引查找。
+    // 键按序紧凑地拼接在叶子中（每个叶子至多 kMaxKeys 个键或 kMaxBytes 字节），叶子按下界键放在 std::map 中，
+    // 相当于两层的 B+ 树：每个键只多占自身长度加 4 字节的偏移，不随值的覆盖写改变，只有新增和删除键时才需要维护。
+    // 调用方负责加锁
+    class OrderedKeys
+    {
+    public:
+        OrderedKeys();
+
+        // key 不能已经存在
+        void insert(std::string_view key);
+        void erase(std::string_view key);
+
+        // 依次访问 [start, end) 中的键，end 为空表示不限，fn 返回 false 时停止
+        template <typename Fn>
+        void scan(std::string_view start, std::string_view end, Fn &&fn) const
+        {
+            auto it = leaf_for(start);
+            size_t i = it->second.lower_bound(start);
+            for (; it != leaves_.end(); ++it, i = 0)
+            {
+                const Leaf &leaf = it->second;
+                for (; i < leaf.size(); i++)
+                {
+                    std::string_view key = leaf.key(i);
+                    if (!end.empty() && key >= end)
+                        return;
+                    if (!fn(key))
+                        return;
+                }
+            }
+        }
+
+        size_t bytes() const;
+
+    private:
+        static constexpr size_t kMaxKeys = 128;
+        static constexpr size_t kMaxBytes = 4096;
+
+        struct Leaf
+        {
+            std::string data;                 // 按序拼接的键
+            std::vector<uint32_t> offsets{0}; // 第 i 个键从 offsets[i] 开始，末尾一项为 data 的长度
+
+            size_t size() const { return offsets.size() - 1; }
+            std::string_view key(size_t i) const { return std::string_view(data).substr(offsets[i], offsets[i + 1] - offsets[i]); }
+            // 第一个不小于 key 的位置
+            size_t lower_bound(std::string_view key) const;
+        };
+
+        // 叶子以其下界为键：叶子中的键都不小于下界且小于下一个叶子的下界，第一个叶子的下界为空串
+        using Leaves = std::map<std::string, Leaf, std::less<>>;
+
+        Leaves::const_iterator leaf_for(std::string_view key) const { return std::prev(leaves_.upper_bound(key)); }
+        Leaves::iterator leaf_for(std::string_view key) { return std::prev(leaves_.upper_bound(key)); }
+
+        Leaves leaves_;
+    };
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef PEER_POOL_H
+#define PEER_POOL_H
+
+#include <grpcpp/grpcpp.h>
+#include "kvstore.grpc.pb.h"
+#include "kv_store.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace kvstore
+{
+    // 节点间转发通道的配置
+    struct ChannelOptions
+    {
+        int channels_per_peer = 2;                // 每个对端节点建立的长连接数量
+        int keepalive_time_ms = 10000;            // keepalive ping 间隔
+        int keepalive_timeout_ms = 5000;          // keepalive ping 超时，超时后断开并重连
+        int initial_reconnect_backoff_ms = 100;   // 断线后首次重连的等待时间
+        int max_reconnect_backoff_ms = 2000;      // 重连退避的上限
+        int forward_timeout_ms = 5000;            // 客户端请求没有截止时间时，转发给其他节点的请求的超时
+    };
+
+    // 每个对端节点预先建立的一组 channel/stub，供转发请求复用
+    class PeerChannelPool
+    {
+    public:
+        struct Peer
+        {
+            std::string address;
+            std::vector<std::shared_ptr<grpc::Channel>> channels;
+            std::vector<std::unique_ptr<KVStoreRPC::Stub>> stubs;
+            std::atomic<size_t> next{0};
+        };
+
+        PeerChannelPool(const std::vector<NodeInfo> &nodes, const std::string &self_name, const ChannelOptions &options = ChannelOptions());
+
+        // 按轮询方式返回目标节点的一个 stub，节点不存在时返回 nullptr
+        KVStoreRPC::Stub *get_stub(const std::string &node_name);
+
+        // 路由表预先用 find 解析出对端，请求路径上只需 next_stub，不再按节点名查找
+        Peer *find(const std::string &node_name);
+        static KVStoreRPC::Stub *next_stub(Peer *peer);
+
+        // 为新加入集群的节点建立连接，节点已存在且地址不变时直接返回；节点换了地址（重启后重新加入）时连接新地址。
+        // Peer 建立后不会被释放，换下的 Peer 仍然保留，旧路由表中的指针始终有效
+        Peer *add(const std::string &node_name, const std::string &address);
+
+        // 让服务端接受客户端的 keepalive ping，否则会被当作 ping 风暴而断开连接
+        static void apply_server_keepalive(grpc::ServerBuilder &builder, const ChannelOptions &options = ChannelOptions());
+
+    private:
+        std::unique_ptr<Peer> connect(const std::string &address) const;
+
+        std::mutex mutex_; // 保护 peers_ 的增删，next_stub 不需要加锁
+        std::unordered_map<std::string, std::unique_ptr<Peer>> peers_;
+        std::vector<std::unique_ptr<Peer>> retired_; // 地址变更后换下的 Peer
+        ChannelOptions options_;
+    };
+}
+
+#endif
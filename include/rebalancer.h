@@ -0,0 +1,59 @@
+#ifndef REBALANCER_H
+#define REBALANCER_H
+
+#include "kv_store.h"
+#include "membership.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace kvstore
+{
+    // 成员变化后在后台把不再由本节点负责的键迁移给新的负责节点，并给新加入副本集合的节点补发副本。
+    // 按分片扫描本地数据的键，每个目标节点一条 Migrate 流，值在发送时逐个读出，按字节限速；
+    // 对端确认后才删除本地副本，且只删除版本未变的键。失败或视图在迁移中再次变化时整轮重做
+    class Rebalancer
+    {
+    public:
+        // replicas 为每个键的副本数，本节点在键的副本集合内时保留本地数据
+        Rebalancer(KVStore &store, Membership &membership, uint64_t bytes_per_sec, int replicas = 1);
+        ~Rebalancer();
+
+        void start();
+        void stop();
+
+        // 路由表变化时调用，唤醒后台线程开始新一轮迁移
+        void notify();
+
+        uint64_t migrated_keys() const { return migrated_keys_.load(std::memory_order_relaxed); }
+
+    private:
+        void loop();
+        // 迁移全部分片，全部成功返回 true
+        bool run_pass();
+        // 把 keys 中下标为 indexes 的键逐个读出当前值后发给对端
+        bool stream(KVStoreRPC::Stub *stub, const std::vector<std::pair<std::string, int64_t>> &keys, const std::vector<size_t> &indexes);
+        // 按已发送的字节数限速，被 stop 打断时返回 false
+        bool throttle(size_t bytes);
+        bool stopping();
+
+        KVStore &store_;
+        Membership &membership_;
+        uint64_t bytes_per_sec_;
+        int replicas_;
+
+        std::chrono::steady_clock::time_point pass_start_;
+        uint64_t pass_bytes_ = 0;
+        std::atomic<uint64_t> migrated_keys_{0};
+
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        bool pending_ = true; // 启动时先检查一遍，恢复出来的数据可能已不归本节点负责
+        bool stop_ = false;
+        std::thread thread_;
+    };
+}
+
+#endif
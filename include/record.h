@@ -0,0 +1,248 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include "slab_allocator.h"
+#include "value_log.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace kvstore
+{
+    // KVStore 中的一条记录：记录头、键和值依次放在同一个 slab 块中，一条记录只占一次分配。
+    // 值超过 kInlineValueLimit 时块内只放一个指针，值留在从请求中接管来的 std::string 里，大值写入时不再复制。
+    // 带过期时间的记录在记录头之后多放 8 字节的过期时间，不过期的记录不占这部分空间。
+    // 值移到值日志的记录（spilled）块内只放 ValueLocator，value_size 仍是值的长度。
+    // 记录创建后只读（版本在发布到索引之前确定），只有供淘汰使用的访问信息 access 会在读时更新。
+    // 索引持有一个引用，在锁外使用值的读者各持有一个，最后一个引用释放时归还块
+    struct Record
+    {
+        static constexpr size_t kInlineValueLimit = 1024;
+
+        std::atomic<uint32_t> refs;
+        uint32_t key_size;
+        uint32_t value_size;
+        uint8_t size_class;
+        bool external : 1;
+        bool expiring : 1;
+        bool spilled : 1;
+        std::atomic<uint16_t> access; // 由 KVStore 的淘汰策略解释：最近访问的时钟或访问频率，读者在共享锁内更新
+        int64_t version;
+
+        // expire_at_ms 为 0 表示不过期
+        static Record *create(SlabAllocator &allocator, std::string_view key, std::string &&value, int64_t version, int64_t expire_at_ms = 0);
+        // 值已经写入值日志的记录
+        static Record *create_spilled(SlabAllocator &allocator, std::string_view key, const ValueLocator &locator, uint32_t value_size, int64_t version,
+                                      int64_t expire_at_ms = 0);
+        static void release(Record *record, SlabAllocator &allocator);
+
+        std::string_view key() const { return std::string_view(body(), key_size); }
+        // 溢出记录的值不在内存中，返回空，调用方通过 locator() 读取
+        std::string_view value() const
+        {
+            if (spilled)
+            {
+                return std::string_view();
+            }
+            if (external)
+            {
+                return *external_value();
+            }
+            return std::string_view(body() + key_size, value_size);
+        }
+        int64_t expire_at_ms() const
+        {
+            int64_t expire_at_ms = 0;
+            if (expiring)
+            {
+                std::memcpy(&expire_at_ms, this + 1, sizeof(expire_at_ms));
+            }
+            return expire_at_ms;
+        }
+        bool expired(int64_t now_ms) const { return expiring && expire_at_ms() <= now_ms; }
+        ValueLocator locator() const
+        {
+            ValueLocator locator;
+            std::memcpy(&locator, body() + key_size, sizeof(locator));
+            return locator;
+        }
+
+        // 块内记录头、过期时间、键和值（或指针、位置）的字节数
+        size_t block_size() const
+        {
+            return sizeof(Record) + (expiring ? sizeof(int64_t) : 0) + key_size + (spilled ? sizeof(ValueLocator) : external ? sizeof(std::string *) : value_size);
+        }
+        // 单独存放的大值占用的堆内存
+        size_t external_bytes() const { return external ? external_value()->capacity() + 1 : 0; }
+
+    private:
+        const char *body() const { return reinterpret_cast<const char *>(this + 1) + (expiring ? sizeof(int64_t) : 0); }
+        const std::string *external_value() const
+        {
+            const std::string *value;
+            std::memcpy(&value, body() + key_size, sizeof(value));
+            return value;
+        }
+    };
+
+    static_assert(sizeof(Record) == 24, "Record header should stay 24 bytes");
+
+    // 存储中的值：持有记录的一个引用，读取在分片锁内只增加引用计数，值的复制在锁外完成；
+    // 覆盖写只替换索引中的记录，仍被读者持有的旧记录在最后一个引用释放时回收。
+    // 溢出记录的值由 KVStore 在锁外从值日志读出后交给 ValueRef 持有。
+    // 不能在 KVStore 析构之后继续持有
+    class ValueRef
+    {
+    public:
+        ValueRef() = default;
+        ValueRef(Record *record, SlabAllocator *allocator) : record_(record), allocator_(allocator)
+        {
+            record_->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        ValueRef(const ValueRef &other) : ValueRef()
+        {
+            if (other.record_ != nullptr)
+            {
+                *this = ValueRef(other.record_, other.allocator_);
+                loaded_ = other.loaded_;
+            }
+        }
+        ValueRef(ValueRef &&other) noexcept : record_(other.record_), allocator_(other.allocator_), loaded_(std::move(other.loaded_))
+        {
+            other.record_ = nullptr;
+        }
+        ValueRef &operator=(ValueRef other) noexcept
+        {
+            std::swap(record_, other.record_);
+            std::swap(allocator_, other.allocator_);
+            std::swap(loaded_, other.loaded_);
+            return *this;
+        }
+        ~ValueRef()
+        {
+            if (record_ != nullptr)
+            {
+                Record::release(record_, *allocator_);
+            }
+        }
+
+        explicit operator bool() const { return record_ != nullptr; }
+        std::string_view view() const { return loaded_ ? std::string_view(*loaded_) : record_->value(); }
+        std::string_view key() const { return record_->key(); }
+        int64_t version() const { return record_->version; }
+        int64_t expire_at_ms() const { return record_->expire_at_ms(); }
+        const char *data() const { return view().data(); }
+        size_t size() const { return record_->value_size; }
+
+        const Record *record() const { return record_; }
+        // 值在值日志中且尚未读出
+        bool needs_load() const { return record_->spilled && !loaded_; }
+        void set_loaded(std::shared_ptr<const std::string> value) { loaded_ = std::move(value); }
+
+    private:
+        Record *record_ = nullptr;
+        SlabAllocator *allocator_ = nullptr;
+        std::shared_ptr<const std::string> loaded_; // 从值日志读出的值
+    };
+
+    // 分片内的开放寻址哈希索引，按 Swiss table 的方式组织。每个槽位对应一个控制字节（空、已删除，
+    // 或占用时键哈希的低 7 位），查找时一次比较一组控制字节（SSE2 每组 16 个，AVX2 每组 32 个），
+    // 只有控制字节匹配的槽位才继续比较保存的 32 位哈希，哈希也相同才访问记录比较键，几乎不会比较到不相等的键。
+    // 扩容是增量的：新表分配后旧表保留，每次插入和删除顺带迁移几组，查找依次检查新表和旧表，
+    // 单次请求不会因为整张表的重新散列停顿。调用方负责加锁
+    class RecordIndex
+    {
+    public:
+        static constexpr size_t npos = SIZE_MAX;
+
+        static size_t hash(std::string_view key) { return std::hash<std::string_view>{}(key); }
+        // 当前编译使用的组匹配实现
+        static const char *probe_kind();
+
+        RecordIndex() = default;
+        RecordIndex(const RecordIndex &) = delete;
+        RecordIndex &operator=(const RecordIndex &) = delete;
+
+        // 返回键所在的槽位，不存在时返回 npos
+        size_t find(std::string_view key, size_t hash) const;
+        Record *at(size_t pos) const { return table_of(pos).slots[pos & ~kOldTable].record; }
+        // 替换槽位中的记录，返回旧记录
+        Record *replace(size_t pos, Record *record);
+        // 插入索引中尚不存在的键。插入和删除都可能迁移旧表，之前取得的槽位随之失效
+        void insert(Record *record, size_t hash);
+        // 删除槽位中的记录并返回它
+        Record *erase(size_t pos);
+        // 按 random 随机选一条记录的槽位，索引为空时返回 npos，用于淘汰时的随机采样。
+        // 先试几个随机槽位，都为空时才从最后一个向后找第一条记录：只顺序查找的话，紧跟在空槽位之后的记录更容易被选中，
+        // 淘汰留下的空槽位会让采样集中到没被淘汰的记录上
+        size_t sample(uint64_t random) const;
+
+        // 预留 count 个键的容量，同步完成扩容，恢复数据前调用
+        void reserve(size_t count);
+        size_t size() const { return size_; }
+        size_t capacity() const { return current_.capacity; }
+        double load_factor() const { return current_.capacity > 0 ? static_cast<double>(current_.used) / current_.capacity : 0; }
+        size_t bytes() const { return current_.bytes() + old_.bytes(); }
+        bool resizing() const { return old_.capacity > 0; }
+
+        template <typename Fn>
+        void for_each(Fn &&fn) const
+        {
+            for (const Table *table : {&current_, &old_})
+            {
+                for (size_t slot = 0; slot < table->capacity; slot++)
+                {
+                    if (table->ctrl[slot] >= 0)
+                        fn(table->slots[slot].record);
+                }
+            }
+        }
+
+    private:
+        static constexpr size_t kOldTable = size_t(1) << 63; // 槽位编号的最高位表示旧表
+        static constexpr size_t kMigrateGroups = 4;          // 每次写操作迁移的组数
+
+        // 哈希和记录指针放在一起，控制字节匹配后只需再访问一条缓存行
+        struct __attribute__((packed)) Slot
+        {
+            Record *record;
+            uint32_t hash;
+        };
+
+        struct Table
+        {
+            std::unique_ptr<int8_t[]> ctrl; // 控制字节，负数表示空或已删除
+            std::unique_ptr<Slot[]> slots;
+            size_t capacity = 0; // 组宽的整数倍，组数为 2 的幂
+            size_t used = 0;
+            size_t deleted = 0;
+
+            explicit Table(size_t slot_count = 0);
+            size_t find(std::string_view key, uint32_t hash) const;
+            size_t find_free(uint32_t hash) const;
+            void set(size_t slot, Record *record, uint32_t hash);
+            void clear(size_t slot);
+            bool full() const { return used + deleted >= capacity - capacity / 8; }
+            size_t bytes() const { return capacity * (sizeof(int8_t) + sizeof(Slot)); }
+        };
+
+        // 分片由哈希对分片数取模选出，表内用乘法散列后的高 32 位，二者互不相关
+        static uint32_t mix(size_t hash) { return static_cast<uint32_t>((static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ull) >> 32); }
+        const Table &table_of(size_t pos) const { return (pos & kOldTable) ? old_ : current_; }
+        Table &table_of(size_t pos) { return (pos & kOldTable) ? old_ : current_; }
+        void grow(size_t capacity);
+        void migrate(size_t groups);
+
+        Table current_;
+        Table old_;                  // 增量扩容期间尚未迁移完的旧表
+        size_t migrated_groups_ = 0; // 旧表中已经迁移的组数
+        size_t size_ = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef REPLICATOR_H
+#define REPLICATOR_H
+
+#include <grpcpp/grpcpp.h>
+#include "kvstore.grpc.pb.h"
+#include "ack_counter.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace kvstore
+{
+    // 单个键最多的副本数，查找副本节点时使用栈上数组
+    const int kMaxReplicas = 8;
+
+    // 主备复制的配置。每个键保存在哈希环上从负责节点（主副本）开始的 replicas 个不同节点上
+    struct ReplicationOptions
+    {
+        int replicas = 1;           // 每个键的副本数（含主副本），1 表示不复制
+        int write_quorum = 1;       // 写操作返回前需要确认的副本数（含主副本）
+        int read_quorum = 1;        // 读操作比较版本的副本数，大于 1 时由接收请求的节点并行读取多个副本
+        bool stale_reads = false;   // 持有副本的节点直接用本地数据响应读请求，可能读到旧值
+        int replica_timeout_ms = 1000; // 等待副本确认或副本读取的超时
+    };
+
+    // 一次并行读取键的多个副本：各副本的读取准备好后由调用方决定在哪个 CQ 上、用什么 tag 启动，
+    // 每个读取完成时调用 complete。凑够 quorum 个响应后其余读取被取消，全部完成后由 result 给出版本最新的值
+    class ReplicaReads
+    {
+    public:
+        struct Read
+        {
+            grpc::ClientContext context;
+            GetResponse response;
+            grpc::Status status;
+            std::unique_ptr<grpc::ClientAsyncResponseReader<GetResponse>> reader;
+        };
+
+        explicit ReplicaReads(GetResponse *response) : response_(response)
+        {
+        }
+
+        // 准备阶段：reader 已经 Prepare 但尚未启动的远端读取，或本节点上的副本直接读到的结果
+        void add(std::unique_ptr<Read> read) { reads_.push_back(std::move(read)); }
+        void merge(const grpc::Status &status, GetResponse &reply);
+        // 参与读取的副本数少于 quorum 时以实际副本数为准
+        void set_quorum(int quorum, int replicas) { quorum_ = std::min(quorum, replicas); }
+
+        // 启动准备好的读取，tag 给出每个读取在 CQ 上的 tag；本地副本已凑够 quorum 时不发出远端读取
+        void start(const std::function<void *(Read *)> &tag);
+        // 一个读取完成，返回 true 表示所有已启动的读取都已完成，此后才能调用 result
+        bool complete(Read *read);
+        bool finished() const { return pending_ == 0; }
+        grpc::Status result();
+
+    private:
+        GetResponse *response_;
+        std::vector<std::unique_ptr<Read>> reads_;
+        int quorum_ = 0;
+        int responded_ = 0;
+        size_t pending_ = 0;
+        bool found_ = false;
+    };
+
+    // 把主副本上已生效的写入异步发给备份副本。请求发出后立即返回，
+    // 同一个副本上的多个写入在同一条 HTTP/2 连接上并发传输，不等待前一个写入的确认
+    class Replicator
+    {
+    public:
+        explicit Replicator(int timeout_ms);
+        ~Replicator();
+
+        void start();
+        void stop();
+
+        // acks 在写入完成（成功、失败或超时）时更新。写入同时发给所有备份副本，调用方只等待其中 needed 个确认，
+        // 其余副本的响应在后台继续到达，最后一个引用释放时 acks 销毁
+        void send(KVStoreRPC::Stub *stub, const ReplicateRequest &request, const std::shared_ptr<AckCounter> &acks);
+
+        uint64_t failures() const { return failures_.load(std::memory_order_relaxed); }
+
+    private:
+        void poll();
+
+        int timeout_ms_;
+        grpc::CompletionQueue cq_;
+        std::thread thread_;
+        std::atomic<uint64_t> failures_{0};
+    };
+}
+
+#endif
@@ -5,6 +5,11 @@
 #include "kvstore.grpc.pb.h"
 #include "kv_store.h"
 #include "consistency_hash.h"
+#include "peer_pool.h"
+#include "membership.h"
+#include "rebalancer.h"
+#include "replicator.h"
+#include "lease_manager.h"
 #include <vector>
 
 namespace kvstore
@@ -12,17 +17,110 @@ namespace kvstore
     class KVStoreServiceImpl final : public KVStoreRPC::Service
     {
     public:
-        KVStoreServiceImpl(const NodeInfo& node_info, const std::vector<NodeInfo>& nodes_map = {});
+        KVStoreServiceImpl(const NodeInfo& node_info, const std::vector<NodeInfo>& nodes_map = {}, const ChannelOptions& channel_options = ChannelOptions(), const KVStoreOptions& store_options = KVStoreOptions(), const MembershipOptions& membership_options = MembershipOptions(), const ReplicationOptions& replication_options = ReplicationOptions(), const LeaseOptions& lease_options = LeaseOptions());
         ~KVStoreServiceImpl();
+        // 在 server->Shutdown() 之前调用：结束所有 Subscribe 流，否则 Shutdown 会一直等待仍在订阅的客户端
+        void shutdown();
         grpc::Status Put(grpc::ServerContext *context, const PutRequest *request, PutResponse *response) override;
         grpc::Status Get(grpc::ServerContext *context, const GetRequest *request, GetResponse *response) override;
         grpc::Status Del(grpc::ServerContext *context, const DeleteRequest *request, DeleteResponse *response) override;
+        grpc::Status MultiGet(grpc::ServerContext *context, const MultiGetRequest *request, MultiGetResponse *response) override;
+        grpc::Status MultiPut(grpc::ServerContext *context, const MultiPutRequest *request, MultiPutResponse *response) override;
+        grpc::Status MultiDel(grpc::ServerContext *context, const MultiDeleteRequest *request, MultiDeleteResponse *response) override;
+        // 集群范围的有序扫描：本节点作为协调节点向所有节点并行发出本地扫描，按键归并后分块流式返回
+        grpc::Status Scan(grpc::ServerContext *context, const ScanRequest *request, grpc::ServerWriter<ScanResponse> *writer) override;
+        grpc::Status Subscribe(grpc::ServerContext *context, const SubscribeRequest *request, grpc::ServerWriter<Invalidation> *writer) override;
+        grpc::Status Heartbeat(grpc::ServerContext *context, const HeartbeatRequest *request, HeartbeatResponse *response) override;
+        grpc::Status Join(grpc::ServerContext *context, const JoinRequest *request, MembershipResponse *response) override;
+        grpc::Status Leave(grpc::ServerContext *context, const LeaveRequest *request, MembershipResponse *response) override;
+        grpc::Status Migrate(grpc::ServerContext *context, grpc::ServerReader<MigrateEntry> *reader, MigrateResponse *response) override;
+        grpc::Status Replicate(grpc::ServerContext *context, const ReplicateRequest *request, ReplicateResponse *response) override;
+
+        // 在本节点的存储上执行单个操作，写入和删除生效后撤销键上的读租约。flush 为空时等到失效通知发出才返回，
+        // 否则把等待交给调用方（*flush 为空表示不需要等待）
+        // put_local 把 value 移入存储，request 只提供键、版本和 TTL，其中的值不再使用；写入生效且 written 非空时返回存储中的值缓冲区
+        grpc::Status put_local(const PutRequest &request, std::string value, PutResponse *response, ValueRef *written = nullptr, std::shared_ptr<AckCounter> *flush = nullptr);
+        grpc::Status get_local(const GetRequest &request, GetResponse *response);
+        grpc::Status del_local(const DeleteRequest &request, DeleteResponse *response, int64_t *deleted_version = nullptr, std::shared_ptr<AckCounter> *flush = nullptr);
+
+        // 本节点作为负责节点处理 Get/Del：迁移期间本地未命中时，再到上一任负责节点上查找或删除。
+        // 请求带 client_id 时 Get 先为该客户端登记读租约再读取
+        grpc::Status get_owned(const GetRequest &request, GetResponse *response);
+        grpc::Status del_owned(const DeleteRequest &request, DeleteResponse *response, int64_t *deleted_version = nullptr);
+        // 上面两步分开执行，供异步服务端在 CQ 上向上一任负责节点发出请求：start_* 只在本地查找或删除，
+        // 本地未命中且键可能还在上一任负责节点上时 *previous 返回它的 stub；调用方用 previous_request 和
+        // previous_owner_deadline 发出请求，再把对端的结果交给 finish_*
+        grpc::Status start_get_owned(const GetRequest &request, GetResponse *response, KVStoreRPC::Stub **previous);
+        grpc::Status finish_get_owned(const grpc::Status &status, const grpc::Status &previous_status, GetResponse *response);
+        grpc::Status start_del_owned(const DeleteRequest &request, DeleteResponse *response, int64_t *deleted_version, KVStoreRPC::Stub **previous,
+                                     std::shared_ptr<AckCounter> *flush = nullptr);
+        grpc::Status finish_del_owned(const grpc::Status &status, const grpc::Status &previous_status, const DeleteResponse &previous_response,
+                                      DeleteResponse *response, int64_t *deleted_version);
+        template <typename Request>
+        static Request previous_request(const Request &request)
+        {
+            Request previous;
+            previous.set_key(request.key());
+            previous.set_local_only(true);
+            return previous;
+        }
+        static std::chrono::system_clock::time_point previous_owner_deadline();
+
+        // 本节点作为主副本处理写操作：本地生效后复制给备份副本，等到写 quorum 确认后返回；
+        // quorum 不足时返回 DEADLINE_EXCEEDED，写入仍在本地生效
+        grpc::Status put_primary(const PutRequest &request, std::string value, PutResponse *response);
+        grpc::Status del_primary(const DeleteRequest &request, DeleteResponse *response);
+        // 同上，但发出复制后不等待：*acks 非空时调用方等它完成或到达截止时间，再用 quorum_status 得到结果，
+        // *flush 为租约失效通知的计数。异步服务端借此在 CQ 上等待，不阻塞轮询线程；删除由 start_del_owned 和 replicate_delete 组成
+        grpc::Status start_put_primary(const PutRequest &request, std::string value, PutResponse *response, std::shared_ptr<AckCounter> *acks, std::shared_ptr<AckCounter> *flush);
+        static grpc::Status quorum_status(bool acked);
+        // 删除已在本地生效后复制给备份副本
+        std::shared_ptr<AckCounter> replicate_delete(const DeleteRequest &request, int64_t deleted_version);
+        // 备份副本应用主副本发来的写入或删除，写入时把 value 移入存储
+        grpc::Status apply_replica(const ReplicateRequest &request, std::string value, ReplicateResponse *response);
+
+        // 不需要经过主副本的读取（读 quorum 大于 1，或允许读旧值且本节点持有副本）在本节点完成并返回 true
+        bool read_here(const GetRequest &request, GetResponse *response, grpc::Status *status);
+        // 请求实际使用的读 quorum，大于 1 时由本节点并行读取各副本
+        int read_quorum(const GetRequest &request) const;
+        // 允许读旧值且本节点是备份副本时读本地数据，读到时返回 true
+        bool read_stale(const GetRequest &request, GetResponse *response, grpc::Status *status);
+        // 并行读取键的各个副本（skip_primary 时跳过主副本），等到 quorum 个副本响应后返回其中版本最新的值
+        grpc::Status read_replicas(const GetRequest &request, int quorum, bool skip_primary, GetResponse *response);
+        // 为 read_replicas 准备各副本的读取：远端读取在 cq 上 Prepare，本节点的副本直接合并
+        void prepare_reads(const GetRequest &request, int quorum, bool skip_primary, grpc::CompletionQueue *cq, ReplicaReads &reads);
+        // 转发给主副本失败后改读备份副本，没有可读的备份副本时返回 false
+        bool read_backup(const GetRequest &request, GetResponse *response, grpc::Status *status);
+        bool has_backups() const { return replication_.replicas > 1; }
+
+        // 查找键的负责节点：本节点负责时 local 为 true；否则返回转发用的 stub，节点未知时返回 nullptr
+        KVStoreRPC::Stub *route(const std::string &key, bool &local);
+
+        Membership &membership() { return membership_; }
+        LeaseManager &leases() { return leases_; }
+        const Rebalancer &rebalancer() const { return rebalancer_; }
 
     private:
+        // 把已在本地生效的写入发给 key 的备份副本，返回的确认计数已扣除主副本自身
+        std::shared_ptr<AckCounter> replicate(const ReplicateRequest &request, int write_quorum);
+        // 迁移期间键的上一任负责节点，没有或就是本节点时返回 nullptr
+        KVStoreRPC::Stub *previous_owner(const std::string &key);
+        // 撤销 key 上的读租约，flush 为空时等到失效通知发出
+        void invalidate(const std::string &key, std::shared_ptr<AckCounter> *flush);
+        grpc::Status wait_quorum(AckCounter &acks);
+        // 转发请求的截止时间：沿用客户端的截止时间，客户端没有设置时为 forward_timeout_ms 之后
+        std::chrono::system_clock::time_point forward_deadline(const grpc::ServerContext &context) const;
+
         KVStore store_;
         std::mutex store_mutex;
         std::vector<NodeInfo> nodes_map_;
-        ConsistencyHash hash_ring_;
+        PeerChannelPool peers_; // 预先建立的节点间长连接，转发请求时复用
+        Membership membership_; // 持有当前路由表，成员变化时整体替换
+        Rebalancer rebalancer_;
+        ReplicationOptions replication_;
+        Replicator replicator_;
+        LeaseManager leases_;
+        int forward_timeout_ms_;
     };
 
 }
@@ -0,0 +1,64 @@
+#ifndef SLAB_ALLOCATOR_H
+#define SLAB_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace kvstore
+{
+    // 按大小分级的 slab 分配器。每一级的块大小固定（256 字节以内按 8 字节递增，之后按约 1.25 倍递增），
+    // 块从 kSlabBytes 大小的 slab 中顺序切分，释放的块挂到本级的空闲链表上供之后的分配复用。
+    // 大量小对象不再各自经过 malloc，没有每次分配的头部开销，也不会在堆上留下零散的空洞。
+    // slab 不归还给系统，内存占用随数据量的峰值增长；超过 kMaxChunk 的分配直接向系统申请
+    class SlabAllocator
+    {
+    public:
+        static constexpr size_t kSlabBytes = 64 << 10;
+        static constexpr size_t kMaxChunk = 4096;
+        static constexpr uint8_t kOversize = 0xff; // 不经过 slab 的分配
+
+        SlabAllocator();
+        ~SlabAllocator();
+
+        SlabAllocator(const SlabAllocator &) = delete;
+        SlabAllocator &operator=(const SlabAllocator &) = delete;
+
+        // 返回至少 size 字节、按 8 字节对齐的块，size_class 写入块所在的级别，释放时原样传回
+        void *allocate(size_t size, uint8_t &size_class);
+        void free(void *chunk, uint8_t size_class, size_t size);
+
+        // 块实际占用的字节数
+        static size_t chunk_size(uint8_t size_class, size_t size);
+
+        // reserved 为向系统申请的总量（slab 与超大分配），used 为正在使用的块的总量
+        size_t reserved_bytes() const;
+        size_t used_bytes() const;
+
+    private:
+        struct FreeChunk
+        {
+            FreeChunk *next;
+        };
+
+        struct SizeClass
+        {
+            FreeChunk *free = nullptr;
+            char *cursor = nullptr; // 当前 slab 中尚未切分的部分
+            char *end = nullptr;
+        };
+
+        static const std::vector<size_t> &class_sizes();
+        static uint8_t class_for(size_t size);
+
+        mutable std::mutex mutex_;
+        std::vector<SizeClass> classes_;
+        std::vector<std::unique_ptr<char[]>> slabs_;
+        size_t used_bytes_ = 0;
+        size_t oversize_bytes_ = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace kvstore
+{
+    // 快照文件格式:
+    //   文件头: magic(8) | 格式版本(4) | 保留(4)
+    //   数据块: crc32(4) | payload 长度(4) | payload = 条目数(4) + 条目 * [key 长度(4) | key | value 长度(4) | value | version(8) | 过期时间(8)]
+    //   文件尾: 各数据块偏移(8 * n) | 块数 n(4) | 总条目数(8) | WAL 段号(8) | crc32(4) | magic(8)
+    // 文件尾记录了所有块的位置，加载时可以按块并行解码。过期时间为 0 表示不过期；
+    // 格式版本 1 的条目没有过期时间，仍可加载
+    class SnapshotWriter
+    {
+    public:
+        explicit SnapshotWriter(const std::string &path);
+        ~SnapshotWriter();
+
+        SnapshotWriter(const SnapshotWriter &) = delete;
+        SnapshotWriter &operator=(const SnapshotWriter &) = delete;
+
+        void add(std::string_view key, std::string_view value, int64_t version, int64_t expire_at_ms);
+
+        // 写入文件尾并 fsync。wal_segment 为快照之后需要重放的第一个日志段
+        void finish(uint64_t wal_segment);
+
+    private:
+        void flush_block();
+        void write(const std::string &data);
+
+        std::string path_;
+        int fd_ = -1;
+        std::string block_;
+        uint32_t block_entries_ = 0;
+        uint64_t total_entries_ = 0;
+        uint64_t offset_ = 0;
+        std::vector<uint64_t> block_offsets_;
+    };
+
+    struct SnapshotInfo
+    {
+        uint64_t wal_segment = 0;
+        uint64_t entries = 0;
+    };
+
+    // 读取快照文件尾，不解码数据块
+    SnapshotInfo read_snapshot_info(const std::string &path);
+
+    // 以 mmap 方式加载快照，用 threads 个线程并行解码数据块。
+    // reserve 在解码前以总条目数调用一次；apply 会被多个线程同时调用。校验失败时抛出 std::runtime_error
+    SnapshotInfo load_snapshot(const std::string &path, unsigned threads,
+                               const std::function<void(uint64_t)> &reserve,
+                               const std::function<void(std::string &&, std::string &&, int64_t, int64_t)> &apply);
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace kvstore
+{
+    // 过期时间使用的时钟：自 Unix 纪元起的毫秒数。过期时间以绝对时间保存和复制，重启和副本之间含义不变
+    inline int64_t wall_clock_ms()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    // 分层时间轮，记录带过期时间的键。每层 64 个槽位，第 0 层一个槽位为一个刻度（kTickMs），
+    // 第 n 层一个槽位覆盖 64^n 个刻度，6 层覆盖约 21 年，更远的时间先放在最上层，下移时重新计算。
+    // 登记是 O(1) 的；时间前进到上层槽位的起点时，槽位中的计时器整体取出，再逐个放回更低的层。
+    // 取出到期键和下移都按调用方给的预算分批进行，单次调用的工作量有上限，不会因为大量键同时过期而长时间占用锁。
+    // 时间轮只记录键和到期时间，不感知键后来是否被覆盖或删除，调用方在计时器到期时按当前记录判断是否真的过期。
+    // 调用方负责加锁
+    class TimerWheel
+    {
+    public:
+        static constexpr int64_t kTickMs = 10;
+
+        struct Timer
+        {
+            std::string key;
+            int64_t expire_at_ms;
+        };
+
+        // 登记 key 在 expire_at_ms 过期，now_ms 为当前时间
+        void schedule(std::string_view key, int64_t expire_at_ms, int64_t now_ms);
+
+        // 把到期时间不晚于 now_ms 的计时器追加到 out，包括下移在内至多处理 budget 项。
+        // 预算用完时还有到期的计时器未处理返回 true
+        bool advance(int64_t now_ms, size_t budget, std::vector<Timer> &out);
+
+        // 取出近似最早到期的一个计时器：按层和槽位的顺序找到第一个非空槽位，在其中最先登记的 samples 个计时器里取最早的。
+        // 上层槽位覆盖的时间跨度较大，比较范围有上限，不会因为一个槽位中有大量计时器而变慢。时间轮为空时返回 false
+        bool pop_earliest(Timer &timer, size_t samples);
+
+        size_t size() const { return size_; }
+        size_t bytes() const;
+
+    private:
+        static constexpr int kLevels = 6;
+        static constexpr int kSlotBits = 6;
+        static constexpr size_t kSlots = size_t(1) << kSlotBits;
+
+        static int64_t tick_of(int64_t expire_at_ms) { return (expire_at_ms + kTickMs - 1) / kTickMs; }
+        static size_t heap_bytes(const std::string &key) { return key.capacity() > 15 ? key.capacity() + 1 : 0; }
+        // 按相对于 tick_ 的距离放入对应层的槽位，已经到期的放入 due_
+        void place(Timer &&timer);
+
+        std::vector<Timer> slots_[kLevels][kSlots];
+        std::vector<Timer> due_;       // 已经到期、尚未取走的计时器
+        std::vector<Timer> cascading_; // 从上层槽位取出、尚未放回低层的计时器
+        int64_t tick_ = 0;             // 已经处理到的刻度
+        size_t size_ = 0;
+        size_t key_bytes_ = 0;         // 键在堆上占用的字节数
+    };
+}
+
+#endif
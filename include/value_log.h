@@ -0,0 +1,96 @@
+#ifndef VALUE_LOG_H
+#define VALUE_LOG_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace kvstore
+{
+    // 值在值日志中的位置，溢出记录在块内保存它代替值本身
+    struct ValueLocator
+    {
+        uint64_t offset;  // 条目在段中的偏移
+        uint32_t segment; // 段号
+        uint32_t crc;     // 值的 crc32，读取时校验
+    };
+
+    struct ValueLogOptions
+    {
+        std::string dir;                     // 值日志所在目录
+        uint64_t segment_bytes = 64ull << 20; // 当前段超过这个大小后切换到新段
+        double compact_garbage_ratio = 0.5;  // 已写满的段中无效字节超过这个比例时整理
+    };
+
+    // 存放冷值的追加写日志（Bitcask/WiscKey 的做法），按段存放为 vlog-<段号>.log。每个条目格式为:
+    //   key 长度(4) | value 长度(4) | crc32(value)(4) | key | value
+    // 内存中的记录只保留键和 ValueLocator，读取时按偏移 pread 值。条目中的键供整理时找回对应的记录。
+    // 值日志只是内存的延伸，持久化仍由 WAL 和快照负责：不做 fsync，打开时清除上次留下的段。
+    // 值被覆盖或删除后由调用方 discard，段中无效字节的比例足够高时由调用方把仍有效的值重新追加到当前段，再删除旧段。
+    // 读取只在查找段时持有锁，段被删除后正在进行的读取仍然可以完成（文件描述符在最后一个读者结束后关闭）
+    class ValueLog
+    {
+    public:
+        explicit ValueLog(const ValueLogOptions &options);
+        ~ValueLog();
+
+        ValueLog(const ValueLog &) = delete;
+        ValueLog &operator=(const ValueLog &) = delete;
+
+        // 把一批 (key, value) 追加到当前段，一次 write 写入，locators 依次对应每个条目。写入失败时抛出 std::runtime_error
+        void append(const std::vector<std::pair<std::string_view, std::string_view>> &entries, std::vector<ValueLocator> &locators);
+
+        // 读取 key_size 长的键对应的 value_size 字节的值。段已经被删除时返回 false，读取失败或校验不通过时抛出 std::runtime_error
+        bool read(const ValueLocator &locator, size_t key_size, size_t value_size, std::string &value) const;
+
+        // 条目不再被引用，计入所在段的无效字节
+        void discard(const ValueLocator &locator, size_t key_size, size_t value_size);
+
+        // 无效字节比例最高且超过阈值的已写满段，没有时返回 0
+        uint32_t pick_compaction() const;
+
+        // 按写入顺序访问段中的条目
+        void for_each(uint32_t segment, const std::function<void(std::string_view, std::string_view, const ValueLocator &)> &fn) const;
+
+        // 删除段，之后对其中条目的 read 返回 false
+        void remove(uint32_t segment);
+
+        // 所有段的总字节数和其中仍有效的字节数
+        uint64_t bytes() const;
+        uint64_t live_bytes() const;
+
+        static size_t entry_size(size_t key_size, size_t value_size) { return kHeaderSize + key_size + value_size; }
+
+    private:
+        static constexpr size_t kHeaderSize = 12;
+
+        struct Segment
+        {
+            uint32_t id;
+            int fd;
+            std::string path;
+            uint64_t size = 0;
+            uint64_t live = 0;
+
+            Segment(uint32_t id, int fd, std::string path) : id(id), fd(fd), path(std::move(path)) {}
+            ~Segment();
+        };
+
+        std::string segment_path(uint32_t segment) const;
+        // 在锁内调用
+        void open_segment(uint32_t segment);
+
+        ValueLogOptions options_;
+        mutable std::mutex mutex_;
+        std::map<uint32_t, std::shared_ptr<Segment>> segments_;
+        std::shared_ptr<Segment> active_;
+    };
+}
+
+#endif
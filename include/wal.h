@@ -0,0 +1,104 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace kvstore
+{
+    // WAL 的刷盘策略
+    enum class WalSyncMode
+    {
+        kAlways,   // 每次写入都等待 fdatasync 完成，并发写入合并为一次刷盘（group commit）
+        kInterval, // 写入交给操作系统后即返回，后台每隔 sync_interval_ms 刷盘一次
+        kNone      // 只交给操作系统，由操作系统决定何时落盘
+    };
+
+    struct WalOptions
+    {
+        std::string dir;                           // 日志所在目录
+        WalSyncMode sync_mode = WalSyncMode::kAlways;
+        int sync_interval_ms = 10;                 // kInterval 模式下的刷盘间隔
+    };
+
+    enum class WalOp : uint8_t
+    {
+        kPut = 1,
+        kDel = 2
+    };
+
+    struct WalRecord
+    {
+        WalOp op;
+        std::string key;
+        std::string value;
+        int64_t version;
+        int64_t expire_at_ms = 0; // 0 表示不过期
+    };
+
+    // 对目录执行 fsync，使其中新建、重命名和删除的文件项落盘
+    bool sync_directory(const std::string &dir);
+
+    // 追加写的预写日志，按段存放为 wal-<段号>.log。每条记录格式为:
+    //   crc32(4) | payload 长度(4) | op(1) | version(8) | key 长度(4) | key | value 长度(4) | value
+    // 带过期时间的写入以 op = 3 记录，version 之后多一个过期时间(8)；不带过期时间的记录格式不变，旧的日志仍可重放
+    class WriteAheadLog
+    {
+    public:
+        explicit WriteAheadLog(const WalOptions &options);
+        ~WriteAheadLog();
+
+        WriteAheadLog(const WriteAheadLog &) = delete;
+        WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+        // 按写入顺序重放段号不小于 first_segment 的日志，返回重放的条数。最后一段尾部半写的记录会被截掉
+        size_t replay(uint64_t first_segment, const std::function<void(const WalRecord &)> &apply);
+
+        // 将记录放入待写缓冲区并返回其序号，不阻塞；调用方随后用 wait 等待其持久化
+        uint64_t append(WalOp op, std::string_view key, std::string_view value, int64_t version, int64_t expire_at_ms = 0);
+
+        // 等待序号不超过 lsn 的记录按刷盘策略完成持久化，写盘失败时返回 false。
+        // 一次写盘失败后日志不再写入，此后追加的记录都返回 false
+        bool wait(uint64_t lsn);
+
+        // 切换到新的日志段并返回新段号。返回前已追加的记录都落在旧段中
+        uint64_t rotate();
+
+        // 删除段号小于 segment 的日志段（它们的内容已经包含在快照中）
+        void remove_segments_before(uint64_t segment);
+
+        // 当前日志段已写入的字节数
+        uint64_t segment_bytes();
+
+    private:
+        void flush_loop();
+        std::string segment_path(uint64_t segment) const;
+        std::vector<uint64_t> list_segments() const;
+        void open_segment(uint64_t segment);
+
+        WalOptions options_;
+        int fd_ = -1;
+        uint64_t segment_ = 0;            // 当前写入的段号
+
+        std::mutex mutex_;
+        std::condition_variable work_cv_; // 通知刷盘线程有新数据
+        std::condition_variable done_cv_; // 通知写入方刷盘进度
+        std::string buffer_;              // 尚未写入文件的记录
+        uint64_t next_lsn_ = 0;           // 最后分配的序号
+        uint64_t written_lsn_ = 0;        // 已经 write 到操作系统的序号
+        uint64_t synced_lsn_ = 0;         // 已经 fdatasync 的序号
+        uint64_t segment_bytes_ = 0;
+        bool rotate_requested_ = false;
+        bool failed_ = false;
+        bool stop_ = false;
+        std::thread flusher_;
+    };
+}
+
+#endif
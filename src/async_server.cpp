@@ -0,0 +1,573 @@
+#include "async_server.h"
+#include <grpcpp/alarm.h>
+#include <google/protobuf/arena.h>
+#include <functional>
+#include <spdlog/spdlog.h>
+
+namespace kvstore
+{
+    namespace
+    {
+        using AsyncService = KVStoreHybridService;
+
+        // 每个 CQ 上为每种方法预先投递的等待调用数，决定了单个 CQ 能同时接收多少新请求
+        const int kCallsPerMethod = 16;
+
+        // CQ 中的 tag 都指向 CallBase，轮询线程只需调用 proceed
+        class CallBase
+        {
+        public:
+            virtual ~CallBase() = default;
+            virtual void proceed(bool ok) = 0;
+        };
+
+        // 调用在等待请求、转发之外的完成事件（副本确认、租约失效通知、并行的副本读取）各用一个 Event 作为 tag，
+        // 事件到达时回到所属调用的状态机，随后销毁
+        class Event final : public CallBase
+        {
+        public:
+            explicit Event(std::function<void(bool)> handler) : handler_(std::move(handler))
+            {
+            }
+
+            void proceed(bool ok) override
+            {
+                handler_(ok);
+                delete this;
+            }
+
+        private:
+            std::function<void(bool)> handler_;
+        };
+
+        // 调用在处理过程中向其他节点发出的请求，随完成事件一起销毁
+        template <typename Reply>
+        struct PeerCall
+        {
+            grpc::ClientContext context;
+            grpc::Status status;
+            std::unique_ptr<grpc::ClientAsyncResponseReader<Reply>> reader;
+        };
+
+        // 各方法的处理步骤。需要等待的步骤（副本确认、租约失效通知、副本读取、向上一任负责节点的回读/删除）交给调用的
+        // wait_for/read_replicas/call_peer，
+        // 在事件到达时继续，最终都以 call.finish 结束
+        struct PutMethod
+        {
+            using Request = PutRequest;
+            using Response = PutResponse;
+            static void request(AsyncService *service, grpc::ServerContext *ctx, Request *request, grpc::ServerAsyncResponseWriter<Response> *responder, grpc::ServerCompletionQueue *cq, void *tag)
+            {
+                service->RequestPut(ctx, request, responder, cq, cq, tag);
+            }
+            static bool local_only(const Request &)
+            {
+                return false;
+            }
+            template <typename Call>
+            static bool serve(Call &)
+            {
+                return false;
+            }
+            template <typename Call>
+            static void local(Call &call)
+            {
+                std::shared_ptr<AckCounter> acks;
+                std::shared_ptr<AckCounter> flush;
+                grpc::Status status = call.impl().start_put_primary(*call.request(), std::move(*call.request()->mutable_value()), call.response(), &acks, &flush);
+                call.finish_write(status, std::move(acks), std::move(flush));
+            }
+            template <typename Call>
+            static bool recover(Call &)
+            {
+                return false;
+            }
+            static std::unique_ptr<grpc::ClientAsyncResponseReader<Response>> forward(KVStoreRPC::Stub *stub, grpc::ClientContext *ctx, const Request &request, grpc::CompletionQueue *cq)
+            {
+                return stub->PrepareAsyncPut(ctx, request, cq);
+            }
+        };
+
+        struct GetMethod
+        {
+            using Request = GetRequest;
+            using Response = GetResponse;
+            static void request(AsyncService *service, grpc::ServerContext *ctx, Request *request, grpc::ServerAsyncResponseWriter<Response> *responder, grpc::ServerCompletionQueue *cq, void *tag)
+            {
+                service->RequestGet(ctx, request, responder, cq, cq, tag);
+            }
+            static bool local_only(const Request &request)
+            {
+                return request.local_only();
+            }
+            // 读 quorum 大于 1 时并行读取各副本，允许读旧值时读本地的备份副本
+            template <typename Call>
+            static bool serve(Call &call)
+            {
+                int quorum = call.impl().read_quorum(*call.request());
+                if (quorum > 1)
+                {
+                    call.read_replicas(quorum, false, [&call](const grpc::Status &status)
+                                       { call.finish(status); });
+                    return true;
+                }
+                grpc::Status status;
+                if (!call.impl().read_stale(*call.request(), call.response(), &status))
+                {
+                    return false;
+                }
+                call.finish(status);
+                return true;
+            }
+            template <typename Call>
+            static void local(Call &call)
+            {
+                const Request &request = *call.request();
+                if (request.local_only())
+                {
+                    call.finish(call.impl().get_local(request, call.response()));
+                    return;
+                }
+                KVStoreRPC::Stub *previous = nullptr;
+                grpc::Status status = call.impl().start_get_owned(request, call.response(), &previous);
+                if (previous == nullptr)
+                {
+                    call.finish(status);
+                    return;
+                }
+                // 迁移期间本地未命中，到上一任负责节点上查找，响应直接写入本调用的 response
+                call.call_peer([previous, &request](grpc::ClientContext *ctx, grpc::CompletionQueue *cq)
+                               { return previous->PrepareAsyncGet(ctx, KVStoreServiceImpl::previous_request(request), cq); },
+                               call.response(), [&call, status](const grpc::Status &previous_status)
+                               { call.finish(call.impl().finish_get_owned(status, previous_status, call.response())); });
+            }
+            // 负责节点不可用时改读备份副本
+            template <typename Call>
+            static bool recover(Call &call)
+            {
+                if (!call.impl().has_backups())
+                {
+                    return false;
+                }
+                call.read_replicas(1, true, [&call](const grpc::Status &status)
+                                   {
+                    if (status.ok() || status.error_code() == grpc::StatusCode::NOT_FOUND)
+                        call.finish(status);
+                    else
+                        call.forward_failed(); });
+                return true;
+            }
+            static std::unique_ptr<grpc::ClientAsyncResponseReader<Response>> forward(KVStoreRPC::Stub *stub, grpc::ClientContext *ctx, const Request &request, grpc::CompletionQueue *cq)
+            {
+                return stub->PrepareAsyncGet(ctx, request, cq);
+            }
+        };
+
+        struct DelMethod
+        {
+            using Request = DeleteRequest;
+            using Response = DeleteResponse;
+            static void request(AsyncService *service, grpc::ServerContext *ctx, Request *request, grpc::ServerAsyncResponseWriter<Response> *responder, grpc::ServerCompletionQueue *cq, void *tag)
+            {
+                service->RequestDel(ctx, request, responder, cq, cq, tag);
+            }
+            static bool local_only(const Request &request)
+            {
+                return request.local_only();
+            }
+            template <typename Call>
+            static bool serve(Call &)
+            {
+                return false;
+            }
+            template <typename Call>
+            static void local(Call &call)
+            {
+                const Request &request = *call.request();
+                std::shared_ptr<AckCounter> flush;
+                if (request.local_only())
+                {
+                    grpc::Status status = call.impl().del_local(request, call.response(), nullptr, &flush);
+                    call.finish_write(status, nullptr, std::move(flush));
+                    return;
+                }
+                int64_t deleted_version = 0;
+                KVStoreRPC::Stub *previous = nullptr;
+                grpc::Status status = call.impl().start_del_owned(request, call.response(), &deleted_version, &previous, &flush);
+                if (previous == nullptr)
+                {
+                    replicate(call, status, deleted_version, std::move(flush));
+                    return;
+                }
+                // 迁移期间同时删除上一任负责节点上尚未迁移的副本，完成后再复制给备份副本
+                auto *previous_response = google::protobuf::Arena::CreateMessage<Response>(call.arena());
+                call.call_peer([previous, &request](grpc::ClientContext *ctx, grpc::CompletionQueue *cq)
+                               { return previous->PrepareAsyncDel(ctx, KVStoreServiceImpl::previous_request(request), cq); },
+                               previous_response, [&call, status, deleted_version, previous_response, flush](const grpc::Status &previous_status) mutable
+                               {
+                    grpc::Status result = call.impl().finish_del_owned(status, previous_status, *previous_response, call.response(), &deleted_version);
+                    replicate(call, result, deleted_version, std::move(flush)); });
+            }
+            template <typename Call>
+            static void replicate(Call &call, const grpc::Status &status, int64_t deleted_version, std::shared_ptr<AckCounter> flush)
+            {
+                std::shared_ptr<AckCounter> acks = status.ok() ? call.impl().replicate_delete(*call.request(), deleted_version) : nullptr;
+                call.finish_write(status, std::move(acks), std::move(flush));
+            }
+            template <typename Call>
+            static bool recover(Call &)
+            {
+                return false;
+            }
+            static std::unique_ptr<grpc::ClientAsyncResponseReader<Response>> forward(KVStoreRPC::Stub *stub, grpc::ClientContext *ctx, const Request &request, grpc::CompletionQueue *cq)
+            {
+                return stub->PrepareAsyncDel(ctx, request, cq);
+            }
+        };
+
+        // 主副本发来的复制请求总是在本节点应用，值从调用自己的请求中移入存储
+        struct ReplicateMethod
+        {
+            using Request = ReplicateRequest;
+            using Response = ReplicateResponse;
+            static void request(AsyncService *service, grpc::ServerContext *ctx, Request *request, grpc::ServerAsyncResponseWriter<Response> *responder, grpc::ServerCompletionQueue *cq, void *tag)
+            {
+                service->RequestReplicate(ctx, request, responder, cq, cq, tag);
+            }
+            static bool local_only(const Request &)
+            {
+                return true;
+            }
+            template <typename Call>
+            static bool serve(Call &)
+            {
+                return false;
+            }
+            template <typename Call>
+            static void local(Call &call)
+            {
+                call.finish(call.impl().apply_replica(*call.request(), std::move(*call.request()->mutable_value()), call.response()));
+            }
+            template <typename Call>
+            static bool recover(Call &)
+            {
+                return false;
+            }
+            static std::unique_ptr<grpc::ClientAsyncResponseReader<Response>> forward(KVStoreRPC::Stub *stub, grpc::ClientContext *ctx, const Request &request, grpc::CompletionQueue *cq)
+            {
+                return stub->PrepareAsyncReplicate(ctx, request, cq);
+            }
+        };
+
+        // 一元调用的状态机: 等待请求 -> (本地处理 | 异步转发 -> 等待对端响应) -> 等待发送完成 -> 销毁。
+        // 本地处理中等待副本确认或副本读取时，轮询线程不阻塞，处理在对应的 Event 到达时继续
+        template <typename Method>
+        class UnaryCall final : public CallBase
+        {
+        public:
+            UnaryCall(AsyncService *service, grpc::ServerCompletionQueue *cq, KVStoreServiceImpl &impl)
+                : service_(service), cq_(cq), impl_(impl),
+                  request_(google::protobuf::Arena::CreateMessage<typename Method::Request>(&arena_)),
+                  response_(google::protobuf::Arena::CreateMessage<typename Method::Response>(&arena_)), responder_(&ctx_)
+            {
+                Method::request(service_, &ctx_, request_, &responder_, cq_, this);
+            }
+
+            void proceed(bool ok) override
+            {
+                switch (state_)
+                {
+                case State::kWaiting:
+                    if (!ok)
+                    {
+                        delete this; // CQ 正在关闭
+                        return;
+                    }
+                    new UnaryCall<Method>(service_, cq_, impl_); // 继续接收下一个请求
+                    dispatch();
+                    return;
+                case State::kForwarding:
+                    if (forward_status_.ok())
+                    {
+                        finish(grpc::Status::OK);
+                    }
+                    else if (forward_status_.error_code() == grpc::StatusCode::NOT_FOUND)
+                    {
+                        finish(grpc::Status(grpc::StatusCode::NOT_FOUND, "Key not found"));
+                    }
+                    else if (!Method::recover(*this))
+                    {
+                        forward_failed();
+                    }
+                    return;
+                case State::kFinishing:
+                    delete this;
+                    return;
+                }
+            }
+
+            KVStoreServiceImpl &impl() { return impl_; }
+            typename Method::Request *request() { return request_; }
+            typename Method::Response *response() { return response_; }
+            google::protobuf::Arena *arena() { return &arena_; }
+
+            void finish(const grpc::Status &status)
+            {
+                state_ = State::kFinishing;
+                responder_.Finish(*response_, status, this);
+            }
+
+            // 写入已在本节点生效：先等租约失效通知发出，再等副本确认（为空的不等待），然后返回
+            void finish_write(const grpc::Status &status, std::shared_ptr<AckCounter> acks, std::shared_ptr<AckCounter> flush = nullptr)
+            {
+                if (flush)
+                {
+                    wait_for(std::move(flush), [this, status, acks](bool)
+                             { finish_write(status, acks); });
+                    return;
+                }
+                if (!acks)
+                {
+                    finish(status);
+                    return;
+                }
+                wait_for(std::move(acks), [this](bool acked)
+                         { finish(KVStoreServiceImpl::quorum_status(acked)); });
+            }
+
+            // 在 CQ 上等待 acks 完成或到达截止时间：定时器在截止时间触发，计数完成时由给出确认的线程提前取消，
+            // 两种情况下事件都会回到本调用
+            void wait_for(std::shared_ptr<AckCounter> acks, std::function<void(bool)> next)
+            {
+                alarm_ = std::make_unique<grpc::Alarm>();
+                grpc::Alarm *alarm = alarm_.get();
+                auto *event = new Event([this, acks, next](bool)
+                                        {
+                    acks->cancel_notify();
+                    alarm_.reset();
+                    next(acks->succeeded()); });
+                auto remaining = std::chrono::duration_cast<std::chrono::system_clock::duration>(acks->deadline() - AckCounter::Clock::now());
+                alarm->Set(cq_, std::chrono::system_clock::now() + remaining, event);
+                if (!acks->notify([alarm]()
+                                  { alarm->Cancel(); }))
+                {
+                    alarm->Cancel();
+                }
+            }
+
+            // 在本调用的 CQ 上向其他节点发出一个请求，reply 在完成事件到达前必须保持有效
+            template <typename Reply, typename Prepare>
+            void call_peer(Prepare prepare, Reply *reply, std::function<void(const grpc::Status &)> next)
+            {
+                auto peer = std::make_shared<PeerCall<Reply>>();
+                peer->context.set_deadline(KVStoreServiceImpl::previous_owner_deadline());
+                peer->reader = prepare(&peer->context, cq_);
+                peer->reader->StartCall();
+                peer->reader->Finish(reply, &peer->status, new Event([peer, next](bool)
+                                                                     { next(peer->status); }));
+            }
+
+            // 并行读取键的各个副本，每个读取用自己的 Event 回到本调用；所有读取的事件都到达后才调用 next
+            void read_replicas(int quorum, bool skip_primary, std::function<void(const grpc::Status &)> next)
+            {
+                reads_ = std::make_unique<ReplicaReads>(response_);
+                impl_.prepare_reads(*request_, quorum, skip_primary, cq_, *reads_);
+                reads_->start([this, next](ReplicaReads::Read *read) -> void *
+                              { return new Event([this, read, next](bool)
+                                                 {
+                        if (reads_->complete(read))
+                            finish_reads(next); }); });
+                if (reads_->finished())
+                {
+                    finish_reads(next);
+                }
+            }
+
+            // 转发失败且无法改读备份副本
+            void forward_failed()
+            {
+                if (forward_status_.error_code() == grpc::StatusCode::UNAVAILABLE ||
+                    forward_status_.error_code() == grpc::StatusCode::DEADLINE_EXCEEDED)
+                {
+                    finish(forward_status_); // 对端不可达时客户端改试其他节点；写 quorum 不足或超时时写入可能已生效，不改试
+                }
+                else
+                {
+                    finish(grpc::Status(grpc::StatusCode::INTERNAL, "Forwarding request failed"));
+                }
+            }
+
+        private:
+            enum class State
+            {
+                kWaiting,
+                kForwarding,
+                kFinishing
+            };
+
+            void dispatch()
+            {
+                bool local = Method::local_only(*request_);
+                if (!local && Method::serve(*this))
+                {
+                    return;
+                }
+                KVStoreRPC::Stub *stub = local ? nullptr : impl_.route(request_->key(), local);
+                if (local)
+                {
+                    Method::local(*this);
+                    return;
+                }
+                if (stub == nullptr)
+                {
+                    finish(grpc::Status(grpc::StatusCode::NOT_FOUND, "Target node not found"));
+                    return;
+                }
+                // 转发调用继承客户端的截止时间和取消状态，响应直接写入本调用的 response_
+                state_ = State::kForwarding;
+                client_ctx_ = grpc::ClientContext::FromServerContext(ctx_);
+                forward_reader_ = Method::forward(stub, client_ctx_.get(), *request_, cq_);
+                forward_reader_->StartCall();
+                forward_reader_->Finish(response_, &forward_status_, this);
+            }
+
+            void finish_reads(const std::function<void(const grpc::Status &)> &next)
+            {
+                grpc::Status status = reads_->result();
+                reads_.reset();
+                next(status);
+            }
+
+            AsyncService *service_;
+            grpc::ServerCompletionQueue *cq_;
+            KVStoreServiceImpl &impl_;
+            State state_ = State::kWaiting;
+
+            grpc::ServerContext ctx_;
+            // 请求和响应分配在调用自己的 arena 上，调用结束时随 arena 一次释放
+            google::protobuf::Arena arena_;
+            typename Method::Request *request_;
+            typename Method::Response *response_;
+            grpc::ServerAsyncResponseWriter<typename Method::Response> responder_;
+
+            std::unique_ptr<grpc::ClientContext> client_ctx_;
+            grpc::Status forward_status_;
+            std::unique_ptr<grpc::ClientAsyncResponseReader<typename Method::Response>> forward_reader_;
+
+            std::unique_ptr<grpc::Alarm> alarm_;
+            std::unique_ptr<ReplicaReads> reads_;
+        };
+    }
+
+    KVStoreHybridService::KVStoreHybridService(KVStoreServiceImpl &impl) : impl_(impl)
+    {
+    }
+
+    grpc::Status KVStoreHybridService::MultiGet(grpc::ServerContext *context, const MultiGetRequest *request, MultiGetResponse *response)
+    {
+        return impl_.MultiGet(context, request, response);
+    }
+
+    grpc::Status KVStoreHybridService::MultiPut(grpc::ServerContext *context, const MultiPutRequest *request, MultiPutResponse *response)
+    {
+        return impl_.MultiPut(context, request, response);
+    }
+
+    grpc::Status KVStoreHybridService::MultiDel(grpc::ServerContext *context, const MultiDeleteRequest *request, MultiDeleteResponse *response)
+    {
+        return impl_.MultiDel(context, request, response);
+    }
+
+    grpc::Status KVStoreHybridService::Scan(grpc::ServerContext *context, const ScanRequest *request, grpc::ServerWriter<ScanResponse> *writer)
+    {
+        return impl_.Scan(context, request, writer);
+    }
+
+    grpc::Status KVStoreHybridService::Subscribe(grpc::ServerContext *context, const SubscribeRequest *request, grpc::ServerWriter<Invalidation> *writer)
+    {
+        return impl_.Subscribe(context, request, writer);
+    }
+
+    grpc::Status KVStoreHybridService::Heartbeat(grpc::ServerContext *context, const HeartbeatRequest *request, HeartbeatResponse *response)
+    {
+        return impl_.Heartbeat(context, request, response);
+    }
+
+    grpc::Status KVStoreHybridService::Join(grpc::ServerContext *context, const JoinRequest *request, MembershipResponse *response)
+    {
+        return impl_.Join(context, request, response);
+    }
+
+    grpc::Status KVStoreHybridService::Leave(grpc::ServerContext *context, const LeaveRequest *request, MembershipResponse *response)
+    {
+        return impl_.Leave(context, request, response);
+    }
+
+    grpc::Status KVStoreHybridService::Migrate(grpc::ServerContext *context, grpc::ServerReader<MigrateEntry> *reader, MigrateResponse *response)
+    {
+        return impl_.Migrate(context, reader, response);
+    }
+
+    KVStoreAsyncServer::KVStoreAsyncServer(KVStoreServiceImpl &impl, int cq_count)
+        : impl_(impl), service_(impl), cq_count_(cq_count > 0 ? cq_count : std::max(1u, std::thread::hardware_concurrency()))
+    {
+    }
+
+    KVStoreAsyncServer::~KVStoreAsyncServer()
+    {
+        shutdown();
+    }
+
+    void KVStoreAsyncServer::register_with(grpc::ServerBuilder &builder)
+    {
+        builder.RegisterService(&service_);
+        for (int i = 0; i < cq_count_; i++)
+        {
+            cqs_.push_back(builder.AddCompletionQueue());
+        }
+    }
+
+    void KVStoreAsyncServer::start()
+    {
+        for (auto &cq : cqs_)
+        {
+            for (int i = 0; i < kCallsPerMethod; i++)
+            {
+                new UnaryCall<PutMethod>(&service_, cq.get(), impl_);
+                new UnaryCall<GetMethod>(&service_, cq.get(), impl_);
+                new UnaryCall<DelMethod>(&service_, cq.get(), impl_);
+                new UnaryCall<ReplicateMethod>(&service_, cq.get(), impl_);
+            }
+            threads_.emplace_back(&KVStoreAsyncServer::poll, this, cq.get());
+        }
+        SPDLOG_INFO("Async server started with {} completion queues", cq_count_);
+    }
+
+    void KVStoreAsyncServer::shutdown()
+    {
+        if (shutdown_)
+        {
+            return;
+        }
+        shutdown_ = true;
+        for (auto &cq : cqs_)
+        {
+            cq->Shutdown();
+        }
+        for (auto &t : threads_)
+        {
+            t.join();
+        }
+    }
+
+    void KVStoreAsyncServer::poll(grpc::ServerCompletionQueue *cq)
+    {
+        void *tag;
+        bool ok;
+        while (cq->Next(&tag, &ok))
+        {
+            static_cast<CallBase *>(tag)->proceed(ok);
+        }
+    }
+
+} // namespace kvstore
@@ -1,98 +1,1054 @@
 #include "client.h"
+#include "replicator.h"
+#include <grpcpp/alarm.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
+#include <random>
+#include <stdexcept>
 
 namespace kvstore
 {
 
-    KVClient::KVClient(std::shared_ptr<grpc::Channel> channel, size_t cache_capacity)
-        : stub_(kvstore::KVStoreRPC::NewStub(channel)), cache_(cache_capacity) {}
+    namespace
+    {
+        // 异步请求在 CQ 中的 tag，完成后由 reactor 线程调用 complete 并释放
+        class AsyncCallBase
+        {
+        public:
+            virtual ~AsyncCallBase() = default;
+            virtual void complete() = 0;
+        };
+
+        template <typename Response>
+        class AsyncCall final : public AsyncCallBase
+        {
+        public:
+            explicit AsyncCall(std::function<void(const grpc::Status &, Response &)> on_done) : on_done_(std::move(on_done)) {}
+
+            void start(std::unique_ptr<grpc::ClientAsyncResponseReader<Response>> reader)
+            {
+                reader_ = std::move(reader);
+                reader_->StartCall();
+                reader_->Finish(&response_, &status_, this);
+            }
+
+            grpc::ClientContext *context() { return &context_; }
+
+            void complete() override { on_done_(status_, response_); }
+
+        private:
+            grpc::ClientContext context_;
+            Response response_;
+            grpc::Status status_;
+            std::unique_ptr<grpc::ClientAsyncResponseReader<Response>> reader_;
+            std::function<void(const grpc::Status &, Response &)> on_done_;
+        };
+
+        // 到期时在 reactor 线程上执行回调的定时器，用于发送对冲请求和冲突重试；被取消时同样会交付，由回调根据状态决定是否执行
+        class ReactorTimer final : public AsyncCallBase
+        {
+        public:
+            explicit ReactorTimer(std::function<void()> on_fire) : on_fire_(std::move(on_fire)) {}
+
+            void set(grpc::CompletionQueue *cq, std::chrono::steady_clock::time_point deadline)
+            {
+                alarm_.Set(cq, std::chrono::system_clock::now() + (deadline - std::chrono::steady_clock::now()), this);
+            }
+
+            void cancel() { alarm_.Cancel(); }
+
+            void complete() override { on_fire_(); }
+
+        private:
+            grpc::Alarm alarm_;
+            std::function<void()> on_fire_;
+        };
+
+        // 订阅断开后重连的退避
+        const int kSubscribeRetryMinMs = 100;
+        const int kSubscribeRetryMaxMs = 5000;
+
+        std::string random_client_id()
+        {
+            std::random_device device;
+            std::mt19937_64 rng((static_cast<uint64_t>(device()) << 32) ^ device());
+            char buffer[33];
+            std::snprintf(buffer, sizeof(buffer), "%016llx%016llx", static_cast<unsigned long long>(rng()), static_cast<unsigned long long>(rng()));
+            return buffer;
+        }
+
+        int64_t elapsed_us(std::chrono::steady_clock::time_point start)
+        {
+            return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        // 依次尝试各节点，直到某个节点不再返回 UNAVAILABLE
+        template <typename Targets, typename Fn>
+        grpc::Status call_with_fallback(const Targets &targets, Fn &&fn)
+        {
+            grpc::Status status;
+            for (size_t attempt = 0; attempt < targets.count; attempt++)
+            {
+                status = fn(targets.at(attempt));
+                if (status.error_code() != grpc::StatusCode::UNAVAILABLE)
+                {
+                    break;
+                }
+            }
+            return status;
+        }
+
+        template <typename Request, typename Response>
+        using PrepareFn = std::unique_ptr<grpc::ClientAsyncResponseReader<Response>> (KVStoreRPC::Stub::*)(grpc::ClientContext *, const Request &, grpc::CompletionQueue *);
+
+        // call_with_fallback 的异步版本：第 attempt 个节点返回 UNAVAILABLE 时在 reactor 线程上改发下一个节点
+        template <typename Request, typename Response, typename Targets>
+        void issue_with_fallback(Targets targets, size_t attempt, Request request, PrepareFn<Request, Response> prepare,
+                                 grpc::CompletionQueue *cq, std::function<void(const grpc::Status &, Response &)> done)
+        {
+            KVStoreRPC::Stub *stub = targets.at(attempt);
+            auto *call = new AsyncCall<Response>(
+                [targets, attempt, request, prepare, cq, done](const grpc::Status &status, Response &response) mutable
+                {
+                    if (status.error_code() == grpc::StatusCode::UNAVAILABLE && attempt + 1 < targets.count)
+                    {
+                        issue_with_fallback(targets, attempt + 1, std::move(request), prepare, cq, std::move(done));
+                        return;
+                    }
+                    done(status, response);
+                });
+            call->start((stub->*prepare)(call->context(), request, cq));
+        }
+    }
+
+    KVClient::KVClient(std::shared_ptr<grpc::Channel> channel, size_t cache_bytes, int reactor_threads)
+        : stub_(kvstore::KVStoreRPC::NewStub(channel)), stubs_{stub_.get()}, cache_(cache_bytes), leases_enabled_(cache_bytes > 0),
+          client_id_(random_client_id()), reactor_count_(std::max(1, reactor_threads))
+    {
+        if (leases_enabled_)
+        {
+            subscriber_threads_.emplace_back(&KVClient::subscribe, this, stub_.get());
+        }
+    }
+
+    KVClient::KVClient(const std::vector<ClusterNode> &nodes, size_t cache_bytes, int reactor_threads)
+        : cache_(cache_bytes), leases_enabled_(cache_bytes > 0), client_id_(random_client_id()), reactor_count_(std::max(1, reactor_threads))
+    {
+        if (nodes.empty())
+        {
+            throw std::invalid_argument("KVClient requires at least one cluster node");
+        }
+        for (const auto &node : nodes)
+        {
+            auto channel = grpc::CreateChannel(node.address, grpc::InsecureChannelCredentials());
+            if (!stub_)
+            {
+                stub_ = kvstore::KVStoreRPC::NewStub(channel);
+            }
+            size_t before = hash_ring_.size();
+            hash_ring_.addNode(node.name);
+            if (hash_ring_.size() == before)
+            {
+                continue; // 重复的节点名
+            }
+            node_stubs_.push_back(kvstore::KVStoreRPC::NewStub(channel));
+            stubs_.push_back(node_stubs_.back().get());
+        }
+        // 每个节点都是一部分键的主副本，租约由主副本授予，因此向所有节点订阅
+        for (KVStoreRPC::Stub *stub : leases_enabled_ ? stubs_ : std::vector<KVStoreRPC::Stub *>())
+        {
+            subscriber_threads_.emplace_back(&KVClient::subscribe, this, stub);
+        }
+    }
+
+    KVClient::~KVClient()
+    {
+        {
+            std::lock_guard<std::mutex> lock(subscribe_mutex_);
+            stopping_ = true;
+            for (grpc::ClientContext *context : subscriptions_)
+            {
+                context->TryCancel();
+            }
+        }
+        subscribe_cv_.notify_all();
+        for (auto &t : subscriber_threads_)
+        {
+            t.join();
+        }
+        {
+            std::unique_lock<std::mutex> lock(in_flight_mutex_);
+            in_flight_cv_.wait(lock, [this]()
+                               { return in_flight_ == 0; });
+        }
+        // 此时 CQ 上只剩已经交付回调、尚未释放的调用，Shutdown 后 Next 会把它们取完再返回 false
+        cq_.Shutdown();
+        if (reactor_threads_.empty())
+        {
+            poll();
+        }
+        for (auto &t : reactor_threads_)
+        {
+            t.join();
+        }
+    }
 
     int64_t KVClient::getVersion()
     {
-        return current_version;
+        return versions_.max_version() + 1;
     }
 
-    grpc::Status KVClient::put(const std::string &key, const std::string &value)
+    VersionTable::VersionTable(size_t slots) : slots_(std::max<size_t>(slots, kStripes))
     {
-        kvstore::PutRequest request;
-        kvstore::PutResponse response;
-        grpc::ClientContext context;
+    }
 
-        request.set_key(key);
-        request.set_value(value);
+    int64_t VersionTable::next(const std::string &key)
+    {
+        size_t hash = std::hash<std::string>()(key);
+        size_t index = hash % slots_.size();
+        int64_t version;
+        {
+            std::lock_guard<std::mutex> lock(stripes_[index % kStripes]);
+            Slot &slot = slots_[index];
+            version = slot.version >= 0 && slot.hash == hash ? slot.version + 1 : max_version_.load(std::memory_order_relaxed) + 1;
+            slot.hash = hash;
+            slot.version = version;
+        }
+        int64_t seen = max_version_.load(std::memory_order_relaxed);
+        while (seen < version && !max_version_.compare_exchange_weak(seen, version, std::memory_order_relaxed))
+        {
+        }
+        return version;
+    }
+
+    void VersionTable::observe(const std::string &key, int64_t version)
+    {
+        size_t hash = std::hash<std::string>()(key);
+        size_t index = hash % slots_.size();
+        {
+            std::lock_guard<std::mutex> lock(stripes_[index % kStripes]);
+            Slot &slot = slots_[index];
+            if (slot.version < 0 || slot.hash != hash || slot.version < version)
+            {
+                slot.hash = hash;
+                slot.version = version;
+            }
+        }
+        int64_t seen = max_version_.load(std::memory_order_relaxed);
+        while (seen < version && !max_version_.compare_exchange_weak(seen, version, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    void KVClient::subscribe(KVStoreRPC::Stub *stub)
+    {
+        int backoff_ms = kSubscribeRetryMinMs;
+        while (true)
+        {
+            grpc::ClientContext context;
+            {
+                std::lock_guard<std::mutex> lock(subscribe_mutex_);
+                if (stopping_)
+                    return;
+                subscriptions_.push_back(&context);
+            }
+            SubscribeRequest request;
+            request.set_client_id(client_id_);
+            auto started = std::chrono::steady_clock::now();
+            std::unique_ptr<grpc::ClientReader<Invalidation>> reader = stub->Subscribe(&context, request);
+            Invalidation message;
+            while (reader->Read(&message))
+            {
+                on_invalidation(message);
+            }
+            reader->Finish();
+            // 断开期间收不到失效通知，已经拿到的租约都不再可信
+            drop_leases();
+
+            std::unique_lock<std::mutex> lock(subscribe_mutex_);
+            subscriptions_.erase(std::find(subscriptions_.begin(), subscriptions_.end(), &context));
+            backoff_ms = std::chrono::steady_clock::now() - started > std::chrono::milliseconds(kSubscribeRetryMaxMs) ? kSubscribeRetryMinMs : std::min(backoff_ms * 2, kSubscribeRetryMaxMs);
+            if (subscribe_cv_.wait_for(lock, std::chrono::milliseconds(backoff_ms), [this]()
+                                       { return stopping_; }))
+                return;
+        }
+    }
+
+    std::atomic<uint64_t> &KVClient::invalidation_counter(const std::string &key)
+    {
+        return invalidations_[std::hash<std::string>()(key) % invalidations_.size()];
+    }
+
+    void KVClient::on_invalidation(const Invalidation &message)
+    {
+        if (message.all())
+        {
+            drop_leases();
+            return;
+        }
+        // 先增加计数再清除缓存：与 finish_get 的写入-复查配合，通知到达后旧值不会留在缓存中
+        for (const auto &key : message.keys())
+        {
+            invalidation_counter(key).fetch_add(1);
+            cache_.clear(key);
+        }
+    }
+
+    void KVClient::drop_leases()
+    {
+        for (auto &counter : invalidations_)
+        {
+            counter.fetch_add(1);
+        }
+        cache_.clear_all();
+    }
+
+    KVClient::LeaseTicket KVClient::request_lease(const std::string &key, GetRequest &request)
+    {
+        LeaseTicket ticket;
+        if (leases_enabled_)
+        {
+            request.set_client_id(client_id_);
+            ticket.stamp = invalidation_counter(key).load();
+            ticket.sent = std::chrono::steady_clock::now();
+        }
+        return ticket;
+    }
+
+    void KVClient::set_consistency(const ConsistencyOptions &options)
+    {
+        consistency_ = options;
+    }
+
+    void KVClient::set_write_options(const WriteOptions &options)
+    {
+        write_options_ = options;
+    }
+
+    WriteStats KVClient::write_stats() const
+    {
+        WriteStats stats;
+        stats.conflicts = conflicts_.load(std::memory_order_relaxed);
+        stats.retries = conflict_retries_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    void KVClient::stamp_version(PutRequest &request)
+    {
+        if (write_options_.server_versions)
+        {
+            request.set_assign_version(true);
+            return;
+        }
+        request.set_version(versions_.next(request.key()));
+    }
+
+    bool KVClient::retry_conflict(const std::string &key, const grpc::Status &status, const PutResponse &response, int attempt)
+    {
+        if (!status.ok() || response.success())
+        {
+            return false;
+        }
+        // 冲突响应中的版本为服务端当前版本 + 1
+        conflicts_.fetch_add(1, std::memory_order_relaxed);
+        versions_.observe(key, response.version() - 1);
+        if (attempt >= write_options_.conflict_retries)
+        {
+            return false;
+        }
+        conflict_retries_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    std::chrono::microseconds KVClient::conflict_backoff(int attempt)
+    {
+        thread_local std::mt19937 rng(std::random_device{}());
+        std::uniform_real_distribution<double> jitter(0.5, 1.5);
+        int64_t base = write_options_.retry_backoff_us << std::min(attempt, 16);
+        return std::chrono::microseconds(static_cast<int64_t>(base * jitter(rng)));
+    }
+
+    KVClient::RouteTargets KVClient::targets_for(const std::string &key) const
+    {
+        int owner = stubs_.size() > 1 ? hash_ring_.getNode(key) : -1;
+        return {stubs_.data(), stubs_.size(), owner < 0 ? 0 : static_cast<size_t>(owner)};
+    }
+
+    KVClient::RouteTargets KVClient::read_targets_for(const std::string &key)
+    {
+        if (!consistency_.allow_stale || consistency_.replicas <= 1 || stubs_.size() <= 1)
+        {
+            return targets_for(key);
+        }
+        int ids[kMaxReplicas];
+        int count = hash_ring_.getNodes(key, std::min(consistency_.replicas, kMaxReplicas), ids);
+        int pick = ids[next_replica_.fetch_add(1, std::memory_order_relaxed) % count];
+        return {stubs_.data(), stubs_.size(), static_cast<size_t>(pick)};
+    }
+
+    struct KVClient::HedgedRead
+    {
+        std::mutex mutex;
+        GetRequest requests[2]; // 0 为首选请求，1 为对冲请求
+        KVStoreRPC::Stub *stubs[2] = {nullptr, nullptr};
+        AsyncCall<GetResponse> *calls[2] = {nullptr, nullptr}; // 尚未完成的尝试，完成后置空
+        ReactorTimer *timer = nullptr;
+        int outstanding = 0;
+        bool hedged = false;
+        bool finished = false;
+        std::chrono::steady_clock::time_point start;
+        std::function<void(const grpc::Status &, GetResponse &)> done;
+    };
+
+    void LatencyWindow::reset(double percentile)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        samples_.clear();
+        next_ = 0;
+        pending_ = 0;
+        percentile_ = std::max(0.0, std::min(percentile, 100.0));
+        cached_.store(-1, std::memory_order_relaxed);
+    }
+
+    void LatencyWindow::record(int64_t us)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (samples_.size() < kCapacity)
+        {
+            samples_.push_back(us);
+        }
+        else
+        {
+            samples_[next_] = us;
+            next_ = (next_ + 1) % kCapacity;
+        }
+        if (++pending_ < kRefreshEvery)
+        {
+            return;
+        }
+        pending_ = 0;
+        std::vector<int64_t> sorted(samples_);
+        size_t rank = std::min(sorted.size() - 1, static_cast<size_t>(percentile_ / 100.0 * sorted.size()));
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        cached_.store(sorted[rank], std::memory_order_relaxed);
+    }
+
+    void KVClient::set_hedging(const HedgeOptions &options)
+    {
+        hedging_ = options;
+        latency_.reset(options.percentile);
+    }
+
+    HedgeStats KVClient::hedge_stats() const
+    {
+        HedgeStats stats;
+        stats.reads = hedge_reads_.load(std::memory_order_relaxed);
+        stats.hedges_sent = hedges_sent_.load(std::memory_order_relaxed);
+        stats.hedge_wins = hedge_wins_.load(std::memory_order_relaxed);
+        stats.delay_us = hedge_delay_us();
+        return stats;
+    }
+
+    CacheStats KVClient::cache_stats() const
+    {
+        return cache_.stats();
+    }
+
+    int64_t KVClient::hedge_delay_us() const
+    {
+        int64_t delay = latency_.percentile();
+        if (delay < 0)
+        {
+            return hedging_.max_delay_us;
+        }
+        return std::max(hedging_.min_delay_us, std::min(delay, hedging_.max_delay_us));
+    }
+
+    void KVClient::hedged_get(const std::string &key, GetRequest request, std::function<void(const grpc::Status &, GetResponse &)> done)
+    {
+        RouteTargets targets = read_targets_for(key);
+        // 对冲目标：允许读旧值且多副本时取副本集合中的另一个副本，由它读本地副本；
+        // 否则取环上的下一个节点，由它转发给负责节点或按读 quorum 读取，对冲请求与首选请求的一致性相同
+        size_t hedge = (targets.first + 1) % targets.count;
+        if (consistency_.allow_stale && consistency_.replicas > 1)
+        {
+            int ids[kMaxReplicas];
+            int count = hash_ring_.getNodes(key, std::min(consistency_.replicas, kMaxReplicas), ids);
+            for (int i = 0; i < count; i++)
+            {
+                if (static_cast<size_t>(ids[i]) != targets.first)
+                {
+                    hedge = ids[i];
+                    break;
+                }
+            }
+        }
+
+        auto read = std::make_shared<HedgedRead>();
+        read->stubs[0] = targets.at(0);
+        read->stubs[1] = targets.stubs[hedge];
+        read->requests[1] = request;
+        read->requests[0] = std::move(request);
+        read->done = std::move(done);
+        read->start = std::chrono::steady_clock::now();
+        hedge_reads_.fetch_add(1, std::memory_order_relaxed);
+
+        read->timer = new ReactorTimer([this, read]()
+                                     {
+            {
+                std::lock_guard<std::mutex> lock(read->mutex);
+                read->timer = nullptr;
+            }
+            send_hedge(read); });
+        read->timer->set(reactor(), read->start + std::chrono::microseconds(hedge_delay_us()));
+        send_attempt(read, 0);
+    }
+
+    void KVClient::send_attempt(const std::shared_ptr<HedgedRead> &read, int slot)
+    {
+        auto *call = new AsyncCall<GetResponse>([this, read, slot](const grpc::Status &status, GetResponse &response)
+                                                { attempt_done(read, slot, status, response); });
         {
-            std::lock_guard<std::mutex> lock(version_mutex);
-            // std::cout << current_version << std::endl;
-            request.set_version(current_version++);
+            std::lock_guard<std::mutex> lock(read->mutex);
+            read->calls[slot] = call;
+            read->outstanding++;
         }
-        grpc::Status status = stub_->Put(&context, request, &response);
+        call->start(read->stubs[slot]->PrepareAsyncGet(call->context(), read->requests[slot], &cq_));
+    }
+
+    void KVClient::send_hedge(const std::shared_ptr<HedgedRead> &read)
+    {
+        {
+            std::lock_guard<std::mutex> lock(read->mutex);
+            if (read->finished || read->hedged)
+            {
+                return;
+            }
+            read->hedged = true;
+        }
+        hedges_sent_.fetch_add(1, std::memory_order_relaxed);
+        send_attempt(read, 1);
+    }
+
+    void KVClient::attempt_done(const std::shared_ptr<HedgedRead> &read, int slot, const grpc::Status &status, GetResponse &response)
+    {
+        // NOT_FOUND 也是有效的响应；其他错误时等待另一个尝试
+        bool answered = status.ok() || status.error_code() == grpc::StatusCode::NOT_FOUND;
+        bool deliver = false;
+        {
+            std::lock_guard<std::mutex> lock(read->mutex);
+            read->calls[slot] = nullptr;
+            read->outstanding--;
+            if (read->finished)
+            {
+                return; // 另一个尝试已经胜出，本次是被取消的一方
+            }
+            if (answered || (read->outstanding == 0 && read->hedged))
+            {
+                read->finished = true;
+                deliver = true;
+                if (read->calls[1 - slot] != nullptr)
+                {
+                    read->calls[1 - slot]->context()->TryCancel();
+                }
+                if (read->timer != nullptr)
+                {
+                    read->timer->cancel();
+                }
+            }
+        }
+        if (slot == 0 && answered)
+        {
+            latency_.record(elapsed_us(read->start));
+        }
+        if (!deliver)
+        {
+            send_hedge(read); // 首选节点出错时不再等待定时器，立即对冲
+            return;
+        }
+        if (slot == 1 && answered)
+        {
+            hedge_wins_.fetch_add(1, std::memory_order_relaxed);
+        }
+        read->done(status, response);
+    }
+
+    void KVClient::begin_async()
+    {
+        std::lock_guard<std::mutex> lock(in_flight_mutex_);
+        in_flight_++;
+    }
+
+    void KVClient::end_async()
+    {
+        std::lock_guard<std::mutex> lock(in_flight_mutex_);
+        if (--in_flight_ == 0)
+        {
+            in_flight_cv_.notify_all();
+        }
+    }
+
+    grpc::CompletionQueue *KVClient::reactor()
+    {
+        std::call_once(reactor_once_, [this]()
+                       {
+            for (int i = 0; i < reactor_count_; i++)
+            {
+                reactor_threads_.emplace_back(&KVClient::poll, this);
+            } });
+        return &cq_;
+    }
+
+    void KVClient::poll()
+    {
+        void *tag;
+        bool ok;
+        while (cq_.Next(&tag, &ok))
+        {
+            AsyncCallBase *call = static_cast<AsyncCallBase *>(tag);
+            call->complete();
+            delete call;
+        }
+    }
+
+    grpc::Status KVClient::finish_put(const std::string &key, const grpc::Status &status, const PutResponse &response)
+    {
         if (status.ok())
         {
             if (response.success())
             {
                 std::cout << "Put operation successful." << std::endl;
-                cache_.set(key, value, response.version());
+                versions_.observe(key, response.version());
+                // 写入撤销了本客户端在该键上的租约，新值在下一次 Get 时连同租约一起取回
+                cache_.clear(key);
             }
             else
             {
                 std::cerr << "Put failed: " << status.error_message() << std::endl;
-                std::lock_guard<std::mutex> lock(version_mutex);
-                current_version = response.version();
-                std::cout << "Version conflict, please retry with new version: " << current_version << std::endl;
+                std::cout << "Version conflict, please retry with new version: " << response.version() << std::endl;
             }
         }
         return status;
     }
 
+    grpc::Status KVClient::finish_get(const std::string &key, const grpc::Status &status, GetResponse &response, GetResult &result, const LeaseTicket &ticket)
+    {
+        if (status.ok() && response.found())
+        {
+            result.found = true;
+            result.value = std::move(*response.mutable_value());
+            result.version = response.version();
+            std::atomic<uint64_t> &counter = invalidation_counter(key);
+            if (response.lease_ms() > 0 && counter.load() == ticket.stamp)
+            {
+                cache_.set(key, result.value, result.version, ticket.sent + std::chrono::milliseconds(response.lease_ms()));
+                // 写入缓存与失效通知交错时，由这里或通知处理中的一方清除
+                if (counter.load() != ticket.stamp)
+                {
+                    cache_.clear(key);
+                }
+            }
+            versions_.observe(key, result.version);
+            return grpc::Status::OK;
+        }
+        else
+        {
+            std::cerr << "Get failed: " << status.error_message() << std::endl;
+            return grpc::Status(grpc::StatusCode::NOT_FOUND, "Key not found");
+        }
+    }
+
+    grpc::Status KVClient::finish_del(const std::string &key, const grpc::Status &status, const DeleteResponse &response)
+    {
+        if (status.ok() && response.success())
+        {
+            std::cout << "Del operation successful." << std::endl;
+            cache_.clear(key);
+            return grpc::Status::OK;
+        }
+        else
+        {
+            std::cerr << "Del failed: " << status.error_message() << std::endl;
+            return grpc::Status(grpc::StatusCode::NOT_FOUND, "Key not found");
+        }
+    }
+
+    grpc::Status KVClient::put(const std::string &key, const std::string &value)
+    {
+        return put(key, value, std::chrono::milliseconds(0));
+    }
+
+    grpc::Status KVClient::put(const std::string &key, const std::string &value, std::chrono::milliseconds ttl)
+    {
+        kvstore::PutRequest request;
+        kvstore::PutResponse response;
+
+        request.set_key(key);
+        request.set_value(value);
+        request.set_write_quorum(consistency_.write_quorum);
+        request.set_ttl_ms(ttl.count());
+        stamp_version(request);
+        grpc::Status status;
+        for (int attempt = 0;; attempt++)
+        {
+            status = call_with_fallback(targets_for(key), [&](KVStoreRPC::Stub *stub)
+                                        {
+                grpc::ClientContext context;
+                return stub->Put(&context, request, &response); });
+            if (!retry_conflict(key, status, response, attempt))
+            {
+                break;
+            }
+            std::this_thread::sleep_for(conflict_backoff(attempt));
+            stamp_version(request);
+        }
+        return finish_put(key, status, response);
+    }
+
     grpc::Status KVClient::get(const std::string &key, std::string &value, int64_t &version)
     {
-        if (cache_.get(key, value, version) && current_version - version < 2)
+        if (cache_.get(key, value, version))
         {
-            return grpc::Status::OK; // 如果缓存有数据直接返回
+            return grpc::Status::OK; // 租约期内的缓存直接返回
         }
 
         kvstore::GetRequest request;
         kvstore::GetResponse response;
-        grpc::ClientContext context;
 
         request.set_key(key);
+        request.set_read_quorum(consistency_.read_quorum);
+        request.set_allow_stale(consistency_.allow_stale);
+        LeaseTicket ticket = request_lease(key, request);
 
-        grpc::Status status = stub_->Get(&context, request, &response);
-        if (status.ok() && response.found())
+        grpc::Status status;
+        if (hedging_enabled())
         {
-            value = response.value();
-            version = response.version();
-            // std::cout << "v" << response.version() << std::endl;
-            current_version = version + 1;
-            return grpc::Status::OK;
+            auto finished = std::make_shared<std::promise<void>>();
+            std::future<void> ready = finished->get_future();
+            hedged_get(key, std::move(request), [&status, &response, finished](const grpc::Status &reply_status, GetResponse &reply)
+                       {
+                status = reply_status;
+                response.Swap(&reply);
+                finished->set_value(); });
+            ready.wait();
         }
         else
         {
-            std::cerr << "Get failed: " << status.error_message() << std::endl;
-            return grpc::Status(grpc::StatusCode::NOT_FOUND, "Key not found");
+            status = call_with_fallback(read_targets_for(key), [&](KVStoreRPC::Stub *stub)
+                                        {
+                grpc::ClientContext context;
+                return stub->Get(&context, request, &response); });
+        }
+        GetResult result;
+        status = finish_get(key, status, response, result, ticket);
+        if (status.ok())
+        {
+            value = std::move(result.value);
+            version = result.version;
         }
+        return status;
     }
 
     grpc::Status KVClient::del(const std::string &key)
     {
         kvstore::DeleteRequest request;
         kvstore::DeleteResponse response;
-        grpc::ClientContext context;
 
         request.set_key(key);
+        request.set_write_quorum(consistency_.write_quorum);
 
-        grpc::Status status = stub_->Del(&context, request, &response);
-        if (status.ok() && response.success())
+        grpc::Status status = call_with_fallback(targets_for(key), [&](KVStoreRPC::Stub *stub)
+                                                 {
+            grpc::ClientContext context;
+            return stub->Del(&context, request, &response); });
+        return finish_del(key, status, response);
+    }
+
+    void KVClient::async_put(const std::string &key, const std::string &value, StatusCallback done)
+    {
+        kvstore::PutRequest request;
+        request.set_key(key);
+        request.set_value(value);
+        request.set_write_quorum(consistency_.write_quorum);
+        stamp_version(request);
+        begin_async();
+        send_put(std::move(request), 0, std::move(done));
+    }
+
+    void KVClient::send_put(PutRequest request, int attempt, StatusCallback done)
+    {
+        RouteTargets targets = targets_for(request.key());
+        issue_with_fallback<PutRequest, PutResponse>(targets, 0, request, &KVStoreRPC::Stub::PrepareAsyncPut, reactor(),
+                                                     [this, request, attempt, done](const grpc::Status &status, PutResponse &response) mutable
+                                                     {
+                                                         if (retry_conflict(request.key(), status, response, attempt))
+                                                         {
+                                                             // 在 reactor 上等待退避，不占用线程
+                                                             auto *timer = new ReactorTimer([this, request, attempt, done]() mutable
+                                                                                            {
+                                                                 stamp_version(request);
+                                                                 send_put(std::move(request), attempt + 1, std::move(done)); });
+                                                             timer->set(reactor(), std::chrono::steady_clock::now() + conflict_backoff(attempt));
+                                                             return;
+                                                         }
+                                                         done(finish_put(request.key(), status, response));
+                                                         end_async();
+                                                     });
+    }
+
+    void KVClient::async_get(const std::string &key, GetCallback done)
+    {
+        GetResult cached;
+        if (cache_.get(key, cached.value, cached.version))
+        {
+            cached.found = true;
+            done(grpc::Status::OK, cached); // 缓存命中时在调用线程上直接完成
+            return;
+        }
+
+        kvstore::GetRequest request;
+        request.set_key(key);
+        request.set_read_quorum(consistency_.read_quorum);
+        request.set_allow_stale(consistency_.allow_stale);
+        LeaseTicket ticket = request_lease(key, request);
+        begin_async();
+        auto on_done = [this, key, done, ticket](const grpc::Status &status, GetResponse &response)
+        {
+            GetResult result;
+            grpc::Status final_status = finish_get(key, status, response, result, ticket);
+            done(final_status, result);
+            end_async();
+        };
+        if (hedging_enabled())
+        {
+            hedged_get(key, std::move(request), std::move(on_done));
+            return;
+        }
+        issue_with_fallback<GetRequest, GetResponse>(read_targets_for(key), 0, std::move(request), &KVStoreRPC::Stub::PrepareAsyncGet, reactor(), std::move(on_done));
+    }
+
+    void KVClient::async_del(const std::string &key, StatusCallback done)
+    {
+        kvstore::DeleteRequest request;
+        request.set_key(key);
+        request.set_write_quorum(consistency_.write_quorum);
+        begin_async();
+        issue_with_fallback<DeleteRequest, DeleteResponse>(targets_for(key), 0, std::move(request), &KVStoreRPC::Stub::PrepareAsyncDel, reactor(),
+                                                           [this, key, done](const grpc::Status &status, DeleteResponse &response)
+                                                           {
+                                                               done(finish_del(key, status, response));
+                                                               end_async();
+                                                           });
+    }
+
+    std::future<grpc::Status> KVClient::async_put(const std::string &key, const std::string &value)
+    {
+        auto promise = std::make_shared<std::promise<grpc::Status>>();
+        async_put(key, value, [promise](const grpc::Status &status)
+                  { promise->set_value(status); });
+        return promise->get_future();
+    }
+
+    std::future<grpc::Status> KVClient::async_get(const std::string &key, GetResult &result)
+    {
+        auto promise = std::make_shared<std::promise<grpc::Status>>();
+        std::future<grpc::Status> future = promise->get_future();
+        async_get(key, [promise, &result](const grpc::Status &status, const GetResult &got)
+                  {
+            result = got;
+            promise->set_value(status); });
+        return future;
+    }
+
+    std::future<grpc::Status> KVClient::async_del(const std::string &key)
+    {
+        auto promise = std::make_shared<std::promise<grpc::Status>>();
+        async_del(key, [promise](const grpc::Status &status)
+                  { promise->set_value(status); });
+        return promise->get_future();
+    }
+
+    grpc::Status KVClient::multi_get(const std::vector<std::string> &keys, std::vector<GetResult> &results)
+    {
+        results.assign(keys.size(), GetResult());
+
+        // 缓存命中的键不再发给服务端
+        kvstore::MultiGetRequest request;
+        std::vector<size_t> pending;
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            GetResult &result = results[i];
+            if (cache_.get(keys[i], result.value, result.version))
+            {
+                result.found = true;
+                continue;
+            }
+            request.add_keys(keys[i]);
+            pending.push_back(i);
+        }
+        if (pending.empty())
         {
-            std::cout << "Del operation successful." << std::endl;
-            cache_.clear(key);
             return grpc::Status::OK;
         }
-        else
+
+        kvstore::MultiGetResponse response;
+        grpc::ClientContext context;
+        grpc::Status status = stub_->MultiGet(&context, request, &response);
+        if (!status.ok() || response.results_size() != static_cast<int>(pending.size()))
         {
-            std::cerr << "Del failed: " << status.error_message() << std::endl;
-            return grpc::Status(grpc::StatusCode::NOT_FOUND, "Key not found");
+            std::cerr << "MultiGet failed: " << status.error_message() << std::endl;
+            return status.ok() ? grpc::Status(grpc::StatusCode::INTERNAL, "Malformed MultiGet response") : status;
+        }
+        for (size_t j = 0; j < pending.size(); j++)
+        {
+            GetResult &result = results[pending[j]];
+            kvstore::GetResponse *item = response.mutable_results(j);
+            if (item->found())
+            {
+                result.found = true;
+                result.value = std::move(*item->mutable_value());
+                result.version = item->version();
+                versions_.observe(keys[pending[j]], result.version);
+            }
+        }
+        return grpc::Status::OK;
+    }
+
+    grpc::Status KVClient::multi_put(const std::vector<std::pair<std::string, std::string>> &entries, std::vector<bool> &success)
+    {
+        success.assign(entries.size(), false);
+
+        // 每一轮只重发上一轮冲突的项
+        std::vector<size_t> pending(entries.size());
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            pending[i] = i;
+        }
+        for (int attempt = 0; !pending.empty(); attempt++)
+        {
+            kvstore::MultiPutRequest request;
+            for (size_t i : pending)
+            {
+                kvstore::PutRequest *item = request.add_entries();
+                item->set_key(entries[i].first);
+                item->set_value(entries[i].second);
+                stamp_version(*item);
+            }
+
+            kvstore::MultiPutResponse response;
+            grpc::ClientContext context;
+            grpc::Status status = stub_->MultiPut(&context, request, &response);
+            if (!status.ok() || response.results_size() != static_cast<int>(pending.size()))
+            {
+                std::cerr << "MultiPut failed: " << status.error_message() << std::endl;
+                return status.ok() ? grpc::Status(grpc::StatusCode::INTERNAL, "Malformed MultiPut response") : status;
+            }
+            std::vector<size_t> conflicted;
+            for (size_t j = 0; j < pending.size(); j++)
+            {
+                const std::string &key = entries[pending[j]].first;
+                const kvstore::PutResponse &item = response.results(j);
+                success[pending[j]] = item.success();
+                if (item.success())
+                {
+                    versions_.observe(key, item.version());
+                    cache_.clear(key);
+                }
+                else if (item.error_code() != grpc::StatusCode::OK)
+                {
+                    // 这一项在服务端出错（例如内存达到上限或负责节点不可达），不是版本冲突，不重试
+                    std::cerr << "MultiPut of " << key << " failed with status " << item.error_code() << std::endl;
+                }
+                else if (retry_conflict(key, status, item, attempt))
+                {
+                    conflicted.push_back(pending[j]);
+                }
+                else
+                {
+                    std::cout << "Version conflict, please retry with new version: " << item.version() << std::endl;
+                }
+            }
+            if (!conflicted.empty())
+            {
+                std::this_thread::sleep_for(conflict_backoff(attempt));
+            }
+            pending.swap(conflicted);
+        }
+        return grpc::Status::OK;
+    }
+
+    grpc::Status KVClient::multi_del(const std::vector<std::string> &keys, std::vector<bool> &deleted)
+    {
+        deleted.assign(keys.size(), false);
+
+        kvstore::MultiDeleteRequest request;
+        for (const auto &key : keys)
+        {
+            request.add_keys(key);
+        }
+
+        kvstore::MultiDeleteResponse response;
+        grpc::ClientContext context;
+        grpc::Status status = stub_->MultiDel(&context, request, &response);
+        if (!status.ok() || response.results_size() != static_cast<int>(keys.size()))
+        {
+            std::cerr << "MultiDel failed: " << status.error_message() << std::endl;
+            return status.ok() ? grpc::Status(grpc::StatusCode::INTERNAL, "Malformed MultiDel response") : status;
+        }
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            cache_.clear(keys[i]);
+            deleted[i] = response.results(i).success();
+        }
+        return grpc::Status::OK;
+    }
+
+    grpc::Status KVClient::scan(const std::string &start, const std::string &end, size_t limit, std::vector<ScanItem> &items, std::string &continuation)
+    {
+        kvstore::ScanRequest request;
+        request.set_start(start);
+        request.set_end(end);
+        request.set_limit(static_cast<uint32_t>(std::min<size_t>(limit, UINT32_MAX)));
+        request.set_continuation(continuation);
+        return run_scan(request, items, continuation);
+    }
+
+    grpc::Status KVClient::prefix_scan(const std::string &prefix, size_t limit, std::vector<ScanItem> &items, std::string &continuation)
+    {
+        kvstore::ScanRequest request;
+        request.set_prefix(prefix);
+        request.set_limit(static_cast<uint32_t>(std::min<size_t>(limit, UINT32_MAX)));
+        request.set_continuation(continuation);
+        return run_scan(request, items, continuation);
+    }
+
+    grpc::Status KVClient::run_scan(const ScanRequest &request, std::vector<ScanItem> &items, std::string &continuation)
+    {
+        items.clear();
+        grpc::ClientContext context;
+        auto reader = stub_->Scan(&context, request);
+        kvstore::ScanResponse chunk;
+        std::string next;
+        while (reader->Read(&chunk))
+        {
+            for (auto &entry : *chunk.mutable_entries())
+            {
+                versions_.observe(entry.key(), entry.version());
+                items.push_back({std::move(*entry.mutable_key()), std::move(*entry.mutable_value()), entry.version()});
+            }
+            next = chunk.continuation(); // 只有最后一块带令牌
+        }
+        grpc::Status status = reader->Finish();
+        if (!status.ok())
+        {
+            std::cerr << "Scan failed: " << status.error_message() << std::endl;
+            items.clear();
+            return status;
         }
+        continuation = std::move(next);
+        return grpc::Status::OK;
     }
 
 } // namespace kvstore
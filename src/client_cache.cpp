@@ -1,61 +1,375 @@
 #include "client_cache.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <new>
 
 namespace kvstore
 {
+    namespace
+    {
+        // 段数上限；每段至少 kMinSegmentBytes 字节，小容量的缓存只有一段，淘汰顺序接近全局 LRU
+        const size_t kMaxSegments = 16;
+        const size_t kMinSegmentBytes = 64 * 1024;
+        // 窗口区占每段容量的比例（百分比）
+        const size_t kWindowPercent = 1;
+        // 按平均条目大小估计每段的条目数，决定草图宽度
+        const size_t kAverageEntryBytes = 64;
+        const size_t kMinSketchWidth = 16;
+        const size_t kMaxSketchWidth = 1 << 20;
+        const uint8_t kMaxCount = 15;
+        // 索引节点（next 指针、string_view 键、条目指针、缓存的哈希值）、桶指针和环中槽位的开销
+        const size_t kIndexOverhead = 7 * sizeof(void *);
 
-    KVCacheLRU::KVCacheLRU(size_t capacity) : capacity_(capacity) {}
+        size_t round_up_pow2(size_t n)
+        {
+            size_t result = 1;
+            while (result < n)
+            {
+                result <<= 1;
+            }
+            return result;
+        }
+    }
 
-    bool KVCacheLRU::get(const std::string &key, std::string &value, int64_t &version)
+    void KVCache::FrequencySketch::reset(size_t width)
     {
-        std::lock_guard<std::mutex> lock(mutex_);
-        auto it = cache_map_.find(key);
-        if (it != cache_map_.end())
+        width_ = round_up_pow2(std::min(std::max(width, kMinSketchWidth), kMaxSketchWidth));
+        sample_size_ = width_ * 10;
+        table_.reset(new std::atomic<uint8_t>[width_ * kDepth]);
+        for (size_t i = 0; i < width_ * kDepth; i++)
         {
-            // 移动到前面，表示最近访问
-            cache_list_.splice(cache_list_.begin(), cache_list_, it->second.second);
-            value = it->second.first.first;    // 提取缓存的值
-            version = it->second.first.second; // 提取版本号
-            return true;
+            table_[i].store(0, std::memory_order_relaxed);
         }
-        return false;
+        additions_.store(0, std::memory_order_relaxed);
     }
 
-    void KVCacheLRU::set(const std::string &key, const std::string &value, int64_t version)
+    size_t KVCache::FrequencySketch::index(size_t hash, size_t row) const
     {
-        std::lock_guard<std::mutex> lock(mutex_);
-        auto it = cache_map_.find(key);
-        if (it != cache_map_.end())
+        static const uint64_t kSeeds[kDepth] = {0x97cb3127ULL, 0xb8e2a6d9ULL, 0x58e1b4f1ULL, 0x3b2d4c5eULL};
+        uint64_t h = (static_cast<uint64_t>(hash) + kSeeds[row]) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 32;
+        return row * width_ + (h & (width_ - 1));
+    }
+
+    void KVCache::FrequencySketch::increment(size_t hash)
+    {
+        for (size_t row = 0; row < kDepth; row++)
         {
-            // 更新缓存条目并移动到前面
-            it->second.first.first = value;
-            it->second.first.second = version;
-            cache_list_.splice(cache_list_.begin(), cache_list_, it->second.second);
+            std::atomic<uint8_t> &counter = table_[index(hash, row)];
+            uint8_t count = counter.load(std::memory_order_relaxed);
+            if (count < kMaxCount)
+            {
+                counter.store(count + 1, std::memory_order_relaxed);
+            }
         }
-        else
+        // 恰好达到样本数的线程负责衰减，其余线程继续累加
+        if (additions_.fetch_add(1, std::memory_order_relaxed) + 1 == sample_size_)
         {
-            // 如果缓存已满，移除最少使用的元素
-            if (cache_map_.size() >= capacity_)
+            for (size_t i = 0; i < width_ * kDepth; i++)
             {
-                const auto &oldest = cache_list_.back();
-                cache_map_.erase(oldest);
-                cache_list_.pop_back();
+                table_[i].store(table_[i].load(std::memory_order_relaxed) >> 1, std::memory_order_relaxed);
             }
+            additions_.fetch_sub(sample_size_ / 2, std::memory_order_relaxed);
+        }
+    }
+
+    uint32_t KVCache::FrequencySketch::frequency(size_t hash) const
+    {
+        uint32_t result = kMaxCount;
+        for (size_t row = 0; row < kDepth; row++)
+        {
+            result = std::min<uint32_t>(result, table_[index(hash, row)].load(std::memory_order_relaxed));
+        }
+        return result;
+    }
+
+    KVCache::KVCache(size_t capacity_bytes) : capacity_(capacity_bytes), segment_count_(1)
+    {
+        while (segment_count_ * 2 <= kMaxSegments && segment_count_ * 2 * kMinSegmentBytes <= capacity_)
+        {
+            segment_count_ *= 2;
+        }
+        segments_.reset(new Segment[segment_count_]);
+        for (size_t i = 0; i < segment_count_; i++)
+        {
+            Segment &segment = segments_[i];
+            size_t capacity = capacity_ / segment_count_ + (i < capacity_ % segment_count_ ? 1 : 0);
+            segment.window.capacity = capacity * kWindowPercent / 100;
+            segment.main.capacity = capacity - segment.window.capacity;
+            segment.sketch.reset(capacity / kAverageEntryBytes);
+        }
+    }
+
+    KVCache::~KVCache()
+    {
+        for (size_t i = 0; i < segment_count_; i++)
+        {
+            for (Entry *entry : segments_[i].window.slots)
+            {
+                free_entry(entry);
+            }
+            for (Entry *entry : segments_[i].main.slots)
+            {
+                free_entry(entry);
+            }
+        }
+    }
+
+    size_t KVCache::charge(size_t key_size, size_t value_size)
+    {
+        return sizeof(Entry) + key_size + value_size + kIndexOverhead;
+    }
+
+    KVCache::Entry *KVCache::make_entry(const std::string &key, const std::string &value, int64_t version, std::chrono::steady_clock::time_point expires, size_t hash)
+    {
+        void *memory = ::operator new(sizeof(Entry) + key.size() + value.size());
+        Entry *entry = new (memory) Entry();
+        entry->referenced.store(false, std::memory_order_relaxed);
+        entry->region = kWindow;
+        entry->version = version;
+        entry->expires = expires;
+        entry->key_size = static_cast<uint32_t>(key.size());
+        entry->value_size = static_cast<uint32_t>(value.size());
+        entry->slot = 0;
+        entry->hash = hash;
+        std::memcpy(const_cast<char *>(entry->key_data()), key.data(), key.size());
+        std::memcpy(entry->value_data(), value.data(), value.size());
+        return entry;
+    }
+
+    void KVCache::free_entry(Entry *entry)
+    {
+        entry->~Entry();
+        ::operator delete(entry);
+    }
+
+    size_t KVCache::hash_of(std::string_view key)
+    {
+        return std::hash<std::string_view>()(key);
+    }
+
+    KVCache::Segment &KVCache::segment_for(size_t hash) const
+    {
+        // 段内的 unordered_map 用哈希值的低位选桶，这里取高位选段，避免同一段内的键集中到少数桶
+        return segments_[(static_cast<uint64_t>(hash) >> 48) & (segment_count_ - 1)];
+    }
+
+    void KVCache::attach(Ring &ring, Entry *entry)
+    {
+        entry->slot = ring.slots.size();
+        ring.slots.push_back(entry);
+        ring.bytes += entry->charge();
+    }
+
+    void KVCache::detach(Ring &ring, Entry *entry)
+    {
+        // 用最后一个条目填补空位，保持环紧凑
+        Entry *last = ring.slots.back();
+        ring.slots[entry->slot] = last;
+        last->slot = entry->slot;
+        ring.slots.pop_back();
+        ring.bytes -= entry->charge();
+        if (ring.hand >= ring.slots.size())
+        {
+            ring.hand = 0;
+        }
+    }
 
-            // 添加新条目到前面
-            cache_list_.emplace_front(key);
-            cache_map_[key] = {{value, version}, cache_list_.begin()};
+    KVCache::Entry *KVCache::victim(Ring &ring)
+    {
+        if (ring.slots.empty())
+        {
+            return nullptr;
+        }
+        // 最多转两圈：第一圈清掉所有访问位，第二圈必然找到访问位为 0 的条目
+        while (true)
+        {
+            Entry *entry = ring.slots[ring.hand];
+            ring.hand = (ring.hand + 1) % ring.slots.size();
+            if (entry->referenced.load(std::memory_order_relaxed))
+            {
+                entry->referenced.store(false, std::memory_order_relaxed);
+                continue;
+            }
+            return entry;
+        }
+    }
+
+    void KVCache::remove(Segment &segment, Entry *entry)
+    {
+        segment.index.erase(entry->key());
+        detach(segment.ring(entry->region), entry);
+        free_entry(entry);
+    }
+
+    void KVCache::rebalance(Segment &segment)
+    {
+        while (segment.window.bytes > segment.window.capacity)
+        {
+            Entry *candidate = victim(segment.window);
+            detach(segment.window, candidate);
+            candidate->referenced.store(false, std::memory_order_relaxed);
+            candidate->region = kMain;
+
+            // 主区放不下时，候选条目与主区的淘汰候选逐个比较频率，输的一方被移除
+            uint32_t frequency = segment.sketch.frequency(candidate->hash);
+            bool admitted = true;
+            while (segment.main.bytes + candidate->charge() > segment.main.capacity)
+            {
+                Entry *main_victim = victim(segment.main);
+                if (main_victim == nullptr || frequency <= segment.sketch.frequency(main_victim->hash))
+                {
+                    admitted = false;
+                    break;
+                }
+                remove(segment, main_victim);
+                segment.evictions++;
+            }
+            if (admitted)
+            {
+                attach(segment.main, candidate);
+            }
+            else
+            {
+                segment.index.erase(candidate->key());
+                free_entry(candidate);
+                segment.rejections++;
+            }
+        }
+        // 主区的条目原地变大后可能超出容量
+        while (segment.main.bytes > segment.main.capacity)
+        {
+            remove(segment, victim(segment.main));
+            segment.evictions++;
+        }
+    }
+
+    bool KVCache::get(const std::string &key, std::string &value, int64_t &version)
+    {
+        size_t hash = hash_of(key);
+        Segment &segment = segment_for(hash);
+        segment.sketch.increment(hash); // 频率只在读取时累加，未命中同样计入；读取未命中后回填不再重复计数
+        std::shared_lock<std::shared_mutex> lock(segment.mutex);
+        auto it = segment.index.find(std::string_view(key));
+        if (it == segment.index.end())
+        {
+            segment.misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        Entry *entry = it->second;
+        if (entry->expires != std::chrono::steady_clock::time_point::max() && entry->expires <= std::chrono::steady_clock::now())
+        {
+            // 过期的条目留给淘汰或下一次 set 处理，共享锁内不修改索引
+            segment.misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        // 访问位已经为 1 时不再写，热点条目的缓存行不会在读者之间来回失效
+        if (!entry->referenced.load(std::memory_order_relaxed))
+        {
+            entry->referenced.store(true, std::memory_order_relaxed);
+        }
+        segment.hits.fetch_add(1, std::memory_order_relaxed);
+        value.assign(entry->value_data(), entry->value_size); // 提取缓存的值
+        version = entry->version;                               // 提取版本号
+        return true;
+    }
+
+    void KVCache::set(const std::string &key, const std::string &value, int64_t version, std::chrono::steady_clock::time_point expires)
+    {
+        size_t hash = hash_of(key);
+        Segment &segment = segment_for(hash);
+        bool cacheable = charge(key.size(), value.size()) <= segment.capacity();
+        std::unique_lock<std::shared_mutex> lock(segment.mutex);
+        auto it = segment.index.find(std::string_view(key));
+        if (it != segment.index.end())
+        {
+            Entry *old = it->second;
+            if (!cacheable)
+            {
+                remove(segment, old);
+                return;
+            }
+            if (old->value_size == value.size())
+            {
+                // 长度不变时原地更新，持有独占锁，没有读者
+                std::memcpy(old->value_data(), value.data(), value.size());
+                old->version = version;
+                old->expires = expires;
+                old->referenced.store(true, std::memory_order_relaxed);
+                return;
+            }
+            // 索引的键指向条目内部，替换条目时先删除旧条目，新条目留在原来的区域
+            Region region = old->region;
+            remove(segment, old);
+            Entry *entry = make_entry(key, value, version, expires, hash);
+            entry->referenced.store(true, std::memory_order_relaxed);
+            entry->region = region;
+            attach(segment.ring(region), entry);
+            segment.index.emplace(entry->key(), entry);
+            rebalance(segment);
+            return;
+        }
+        if (!cacheable)
+        {
+            return;
+        }
+
+        Entry *entry = make_entry(key, value, version, expires, hash);
+        attach(segment.window, entry);
+        segment.index.emplace(entry->key(), entry);
+        rebalance(segment);
+    }
+
+    void KVCache::clear(const std::string &key)
+    {
+        Segment &segment = segment_for(hash_of(key));
+        std::unique_lock<std::shared_mutex> lock(segment.mutex);
+        auto it = segment.index.find(std::string_view(key));
+        if (it != segment.index.end())
+        {
+            remove(segment, it->second);
+        }
+    }
+
+    void KVCache::clear_all()
+    {
+        for (size_t i = 0; i < segment_count_; i++)
+        {
+            Segment &segment = segments_[i];
+            std::unique_lock<std::shared_mutex> lock(segment.mutex);
+            segment.index.clear();
+            for (Ring *ring : {&segment.window, &segment.main})
+            {
+                for (Entry *entry : ring->slots)
+                {
+                    free_entry(entry);
+                }
+                ring->slots.clear();
+                ring->hand = 0;
+                ring->bytes = 0;
+            }
         }
     }
 
-    void KVCacheLRU::clear(const std::string &key)
+    CacheStats KVCache::stats() const
     {
-        std::lock_guard<std::mutex> lock(mutex_);
-        auto it = cache_map_.find(key);
-        if (it != cache_map_.end())
+        CacheStats result;
+        result.capacity_bytes = capacity_;
+        for (size_t i = 0; i < segment_count_; i++)
         {
-            cache_list_.erase(it->second.second);
-            cache_map_.erase(it);
+            Segment &segment = segments_[i];
+            std::shared_lock<std::shared_mutex> lock(segment.mutex);
+            result.hits += segment.hits.load(std::memory_order_relaxed);
+            result.misses += segment.misses.load(std::memory_order_relaxed);
+            result.evictions += segment.evictions;
+            result.rejections += segment.rejections;
+            result.entries += segment.index.size();
+            result.bytes += segment.window.bytes + segment.main.bytes;
+            result.sketch_bytes += segment.sketch.bytes();
         }
+        return result;
     }
 
 } // namespace kvstore
@@ -1,33 +1,192 @@
 #include "consistency_hash.h"
-#include <iostream>
-#include <functional>
+#include <algorithm>
+#include <cstring>
 
-ConsistencyHash::ConsistencyHash(int num_replicas) : num_replicas(num_replicas) {}
+namespace
+{
+    const uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+    const uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+    const uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+    const uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+    inline uint64_t rotl(uint64_t x, int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    inline uint64_t read64(const char *p)
+    {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint32_t read32(const char *p)
+    {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint64_t xxh_round(uint64_t acc, uint64_t input)
+    {
+        acc += input * kPrime2;
+        acc = rotl(acc, 31);
+        return acc * kPrime1;
+    }
+
+    inline uint64_t merge_round(uint64_t acc, uint64_t val)
+    {
+        acc ^= xxh_round(0, val);
+        return acc * kPrime1 + kPrime4;
+    }
+}
+
+ConsistencyHash::ConsistencyHash(int num_replicas) : num_replicas(std::max(1, num_replicas)) {}
+
+uint64_t ConsistencyHash::hash(const char *data, size_t size, uint64_t seed)
+{
+    const char *p = data;
+    const char *end = data + size;
+    uint64_t h;
+
+    if (size >= 32)
+    {
+        uint64_t v1 = seed + kPrime1 + kPrime2;
+        uint64_t v2 = seed + kPrime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - kPrime1;
+        const char *limit = end - 32;
+        do
+        {
+            v1 = xxh_round(v1, read64(p));
+            v2 = xxh_round(v2, read64(p + 8));
+            v3 = xxh_round(v3, read64(p + 16));
+            v4 = xxh_round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge_round(h, v1);
+        h = merge_round(h, v2);
+        h = merge_round(h, v3);
+        h = merge_round(h, v4);
+    }
+    else
+    {
+        h = seed + kPrime5;
+    }
 
-unsigned int ConsistencyHash::hash(const std::string &key)
+    h += static_cast<uint64_t>(size);
+    for (; p + 8 <= end; p += 8)
+    {
+        h ^= xxh_round(0, read64(p));
+        h = rotl(h, 27) * kPrime1 + kPrime4;
+    }
+    if (p + 4 <= end)
+    {
+        h ^= static_cast<uint64_t>(read32(p)) * kPrime1;
+        h = rotl(h, 23) * kPrime2 + kPrime3;
+        p += 4;
+    }
+    for (; p < end; p++)
+    {
+        h ^= static_cast<uint64_t>(static_cast<uint8_t>(*p)) * kPrime5;
+        h = rotl(h, 11) * kPrime1;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+void ConsistencyHash::addNode(const std::string &node, int weight)
 {
-    return std::hash<std::string>{}(key);
+    auto it = std::find(nodes.begin(), nodes.end(), node);
+    if (it != nodes.end())
+    {
+        weights[it - nodes.begin()] = std::max(1, weight);
+    }
+    else
+    {
+        nodes.push_back(node);
+        weights.push_back(std::max(1, weight));
+    }
+    rebuild();
 }
 
-void ConsistencyHash::addNode(const std::string &node)
+void ConsistencyHash::removeNode(const std::string &node)
 {
-    int hash_val = hash(node);
-    // std::cout << "hash_val: " << hash_val << std::endl;
-    ring[hash_val] = node;
-    nodes.push_back(node);
+    auto it = std::find(nodes.begin(), nodes.end(), node);
+    if (it == nodes.end())
+        return;
+    weights.erase(weights.begin() + (it - nodes.begin()));
+    nodes.erase(it);
+    rebuild();
 }
 
-std::string ConsistencyHash::getNode(const std::string &key)
+void ConsistencyHash::rebuild()
+{
+    ring.clear();
+    size_t total = 0;
+    for (int weight : weights)
+    {
+        total += static_cast<size_t>(num_replicas) * weight;
+    }
+    ring.reserve(total);
+    for (uint32_t i = 0; i < nodes.size(); i++)
+    {
+        // 虚拟节点 j 的位置为 hash("<节点名>#<j>")
+        std::string label = nodes[i] + "#";
+        size_t prefix = label.size();
+        int count = num_replicas * weights[i];
+        for (int j = 0; j < count; j++)
+        {
+            label.resize(prefix);
+            label += std::to_string(j);
+            ring.push_back({hash(label), i});
+        }
+    }
+    // 哈希值相同时按节点名排序，保证环与节点的添加顺序无关
+    std::sort(ring.begin(), ring.end(), [this](const Point &a, const Point &b)
+              { return a.hash != b.hash ? a.hash < b.hash : nodes[a.node] < nodes[b.node]; });
+}
+
+int ConsistencyHash::getNode(const std::string &key) const
 {
     if (ring.empty())
-        return "";
-    int hash_val = hash(key);
-    // std::cout << "hash_val for key: " << hash_val << std::endl;
-    auto it = ring.lower_bound(hash_val);
+        return -1;
+    uint64_t hash_val = hash(key);
+    auto it = std::lower_bound(ring.begin(), ring.end(), hash_val, [](const Point &point, uint64_t value)
+                               { return point.hash < value; });
     if (it == ring.end())
     {
         it = ring.begin();
     }
-    // std::cout << it->second << std::endl;
-    return it->second;
+    return static_cast<int>(it->node);
+}
+
+int ConsistencyHash::getNodes(const std::string &key, int count, int *out) const
+{
+    if (ring.empty() || count <= 0)
+        return 0;
+    int limit = std::min(count, static_cast<int>(nodes.size()));
+    uint64_t hash_val = hash(key);
+    auto start = std::lower_bound(ring.begin(), ring.end(), hash_val, [](const Point &point, uint64_t value)
+                                  { return point.hash < value; });
+    size_t first = start - ring.begin();
+    int found = 0;
+    // 从负责节点开始顺时针走，跳过已选中节点的其他虚拟节点
+    for (size_t step = 0; step < ring.size() && found < limit; step++)
+    {
+        int node = static_cast<int>(ring[(first + step) % ring.size()].node);
+        if (std::find(out, out + found, node) == out + found)
+        {
+            out[found++] = node;
+        }
+    }
+    return found;
 }
@@ -1,8 +1,93 @@
 #include "kv_store.h"
+#include "snapshot.h"
 #include <spdlog/spdlog.h>
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <filesystem>
+#include <random>
 
 namespace kvstore
 {
+    namespace
+    {
+        const char *kSnapshotTmpName = "snapshot.tmp";
+
+        // 后台过期每次持有分片写锁时至多处理的计时器数，以及每个刻度在一个分片上至多处理的批数，剩下的留到下一个刻度
+        const size_t kExpireBatch = 64;
+        const int kExpireBatchesPerTick = 16;
+
+        // 超过内存上限时每次写入至多淘汰的键数，以及后台线程每个刻度至多淘汰的键数
+        const size_t kEvictionsPerWrite = 8;
+        const size_t kEvictionsPerTick = 256;
+
+        // LFU 的访问信息：高 8 位为上次更新时的分钟数，低 8 位为对数计数器。
+        // 新键从 kLfuInitCounter 开始，计数器越大递增的概率越低，每经过一分钟减 1
+        const uint8_t kLfuInitCounter = 5;
+        const int kLfuLogFactor = 10;
+
+        // 分层存储：比位置信息大不了多少的值不移出内存；后台线程每次在一个分片上移出至多一批值，每个刻度至多移出的值数；
+        // 溢出的值在上次读取之后 kPromoteIdleS 秒内再次被读到时放回内存；整理时每批重新追加的值数
+        const size_t kMinSpillBytes = 64;
+        const size_t kDemoteBatch = 64;
+        const size_t kDemotionsPerTick = 1024;
+        const uint16_t kPromoteIdleS = 10;
+        const size_t kCompactBatch = 256;
+
+        uint32_t monotonic_seconds()
+        {
+            return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+
+        uint64_t random_u64()
+        {
+            thread_local std::mt19937_64 engine(std::random_device{}());
+            return engine();
+        }
+
+        uint8_t lfu_counter(uint16_t access, uint32_t now_s)
+        {
+            uint8_t counter = access & 0xff;
+            uint8_t minutes = static_cast<uint8_t>((now_s / 60) - (access >> 8));
+            return counter > minutes ? counter - minutes : 0;
+        }
+
+        uint16_t lfu_access(uint8_t counter, uint32_t now_s)
+        {
+            return static_cast<uint16_t>(((now_s / 60) & 0xff) << 8 | counter);
+        }
+
+        // 只有带过期时间的记录才读取时钟
+        bool expired_now(const Record *record)
+        {
+            return record->expiring && record->expired(wall_clock_ms());
+        }
+
+        std::string snapshot_path(const std::string &dir, uint64_t segment)
+        {
+            char name[32];
+            std::snprintf(name, sizeof(name), "snapshot-%06" PRIu64 ".snap", segment);
+            return (std::filesystem::path(dir) / name).string();
+        }
+
+        // 按段号升序列出目录中的快照文件
+        std::vector<std::pair<uint64_t, std::string>> list_snapshots(const std::string &dir)
+        {
+            std::vector<std::pair<uint64_t, std::string>> snapshots;
+            for (const auto &entry : std::filesystem::directory_iterator(dir))
+            {
+                uint64_t segment;
+                if (std::sscanf(entry.path().filename().c_str(), "snapshot-%" SCNu64 ".snap", &segment) == 1)
+                {
+                    snapshots.emplace_back(segment, entry.path().string());
+                }
+            }
+            std::sort(snapshots.begin(), snapshots.end());
+            return snapshots;
+        }
+    }
+
     NodeInfo::NodeInfo(const std::string &node_name, const std::string &node_address) : node_name_(node_name), node_address_(node_address)
     {
     }
@@ -10,78 +95,1208 @@ namespace kvstore
     {
     }
 
-    std::string NodeInfo::get_name()
+    const std::string &NodeInfo::get_name() const
     {
         return node_name_;
     }
 
-    std::string NodeInfo::get_address()
+    const std::string &NodeInfo::get_address() const
     {
         return node_address_;
     }
 
-    NodeInfo KVStore::get_nodeinfo()
+    const NodeInfo &KVStore::get_nodeinfo() const
     {
         return node_info_;
     }
 
-    KVStore::KVStore(const NodeInfo &node_info) : node_info_(node_info)
+    KVStore::KVStore(const NodeInfo &node_info, const KVStoreOptions &options)
+        : node_info_(node_info), shard_count_(options.shard_count > 0 ? options.shard_count : 1), shards_(new Shard[shard_count_]),
+          data_dir_(options.data_dir), snapshot_interval_s_(options.snapshot_interval_s), snapshot_wal_bytes_(options.snapshot_wal_bytes),
+          max_memory_bytes_(options.max_memory_bytes), eviction_policy_(options.eviction_policy), eviction_samples_(std::max(1, options.eviction_samples)),
+          max_hot_value_bytes_(options.max_hot_value_bytes),
+          track_access_(eviction_policy_ == EvictionPolicy::kAllKeysLru || eviction_policy_ == EvictionPolicy::kAllKeysLfu || max_hot_value_bytes_ > 0)
     {
+        clock_s_.store(monotonic_seconds(), std::memory_order_relaxed);
+        if (max_hot_value_bytes_ > 0)
+        {
+            if (options.value_log_dir.empty() && data_dir_.empty())
+            {
+                throw std::invalid_argument("Tiered storage needs value_log_dir or data_dir");
+            }
+            ValueLogOptions value_log_options;
+            value_log_options.dir = !options.value_log_dir.empty() ? options.value_log_dir : (std::filesystem::path(data_dir_) / "vlog").string();
+            value_log_options.segment_bytes = options.value_log_segment_bytes;
+            value_log_ = std::make_unique<ValueLog>(value_log_options);
+            for (size_t i = 0; i < shard_count_; i++)
+            {
+                shards_[i].value_log = value_log_.get();
+            }
+        }
+        if (!data_dir_.empty())
+        {
+            recover(options);
+            if (snapshot_interval_s_ > 0 || snapshot_wal_bytes_ > 0)
+            {
+                snapshot_thread_ = std::thread(&KVStore::snapshot_loop, this);
+            }
+        }
+        expiry_thread_ = std::thread(&KVStore::expiry_loop, this);
+        if (value_log_)
+        {
+            tiering_thread_ = std::thread(&KVStore::tiering_loop, this);
+        }
     }
 
     KVStore::~KVStore()
     {
+        {
+            std::lock_guard<std::mutex> lock(loop_mutex_);
+            stop_ = true;
+        }
+        loop_cv_.notify_all();
+        if (snapshot_thread_.joinable())
+        {
+            snapshot_thread_.join();
+        }
+        expiry_thread_.join();
+        if (tiering_thread_.joinable())
+        {
+            tiering_thread_.join();
+        }
+    }
+
+    // 先加载最新的快照，再重放快照之后的日志段
+    void KVStore::recover(const KVStoreOptions &options)
+    {
+        std::filesystem::create_directories(data_dir_);
+        std::filesystem::remove(std::filesystem::path(data_dir_) / kSnapshotTmpName); // 上次未写完的快照
+
+        uint64_t first_segment = 0;
+        auto snapshots = list_snapshots(data_dir_);
+        if (!snapshots.empty())
+        {
+            unsigned threads = options.recovery_threads > 0 ? options.recovery_threads : std::max(1u, std::thread::hardware_concurrency());
+            auto begin = std::chrono::steady_clock::now();
+            SnapshotInfo info = load_snapshot(
+                snapshots.back().second, threads,
+                [this](uint64_t entries)
+                {
+                    for (size_t i = 0; i < shard_count_; i++)
+                        shards_[i].index.reserve(entries / shard_count_ + 1);
+                },
+                [this](std::string &&key, std::string &&value, int64_t version, int64_t expire_at_ms)
+                { load_entry(std::move(key), std::move(value), version, expire_at_ms); });
+            first_segment = info.wal_segment;
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin);
+            SPDLOG_INFO("Node {} loaded {} keys from {} in {} ms", node_info_.get_name(), info.entries, snapshots.back().second, elapsed.count());
+        }
+
+        WalOptions wal_options;
+        wal_options.dir = data_dir_;
+        wal_options.sync_mode = options.sync_mode;
+        wal_options.sync_interval_ms = options.sync_interval_ms;
+        wal_ = std::make_unique<WriteAheadLog>(wal_options);
+        size_t count = wal_->replay(first_segment, [this](const WalRecord &record)
+                                    { apply_record(record); });
+        SPDLOG_INFO("Node {} replayed {} WAL records from {}", node_info_.get_name(), count, data_dir_);
     }
 
-    bool KVStore::put(const std::string &key, const std::string &value, int64_t version)
+    bool KVStore::snapshot()
+    {
+        if (!wal_)
+        {
+            return false;
+        }
+        std::lock_guard<std::mutex> guard(snapshot_mutex_);
+        try
+        {
+            auto begin = std::chrono::steady_clock::now();
+            // 切换日志段之前的修改都已经应用到内存，快照必然包含它们；之后的修改在新段中，恢复时重放
+            uint64_t segment = wal_->rotate();
+            std::string tmp_path = (std::filesystem::path(data_dir_) / kSnapshotTmpName).string();
+            size_t count = 0;
+            {
+                SnapshotWriter writer(tmp_path);
+                // 复制分片只增加记录的引用计数，不复制键和值
+                std::vector<ValueRef> entries;
+                int64_t now_ms = wall_clock_ms();
+                for (size_t i = 0; i < shard_count_; i++)
+                {
+                    // 只在复制单个分片时持有它的共享锁，编码和写文件都在锁外进行
+                    {
+                        Shard &shard = shards_[i];
+                        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+                        entries.reserve(shard.index.size());
+                        shard.index.for_each([&](Record *record)
+                                             {
+                            if (!record->expired(now_ms))
+                                entries.emplace_back(record, &shard.allocator); });
+                    }
+                    for (auto &entry : entries)
+                    {
+                        // 溢出的值在锁外读出；读取前被整理移走的值按键重新查找，期间被删除的键不再写入
+                        if (entry.needs_load() && !load_value(entry))
+                            continue;
+                        writer.add(entry.key(), entry.view(), entry.version(), entry.expire_at_ms());
+                        count++;
+                    }
+                    entries.clear();
+                }
+                writer.finish(segment);
+            }
+            std::string path = snapshot_path(data_dir_, segment);
+            std::filesystem::rename(tmp_path, path);
+            sync_directory(data_dir_);
+
+            for (const auto &old : list_snapshots(data_dir_))
+            {
+                if (old.first < segment)
+                    std::filesystem::remove(old.second);
+            }
+            wal_->remove_segments_before(segment);
+
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin);
+            MemoryStats memory = memory_stats();
+            SPDLOG_INFO("Node {} wrote snapshot {} with {} keys in {} ms, {:.1f} bytes per key in memory", node_info_.get_name(), path, count,
+                        elapsed.count(), memory.bytes_per_key());
+            return true;
+        }
+        catch (const std::exception &e)
+        {
+            SPDLOG_ERROR("Node {} snapshot failed: {}", node_info_.get_name(), e.what());
+            return false;
+        }
+    }
+
+    void KVStore::snapshot_loop()
+    {
+        auto interval = std::chrono::seconds(snapshot_interval_s_);
+        auto last_snapshot = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(loop_mutex_);
+        while (!stop_)
+        {
+            loop_cv_.wait_for(lock, std::chrono::seconds(1), [this]
+                              { return stop_; });
+            if (stop_)
+                break;
+            auto now = std::chrono::steady_clock::now();
+            bool due = (snapshot_interval_s_ > 0 && now - last_snapshot >= interval) ||
+                       (snapshot_wal_bytes_ > 0 && wal_->segment_bytes() >= snapshot_wal_bytes_);
+            if (due)
+            {
+                lock.unlock();
+                snapshot();
+                last_snapshot = std::chrono::steady_clock::now();
+                lock.lock();
+            }
+        }
+    }
+
+    void KVStore::expiry_loop()
+    {
+        std::unique_lock<std::mutex> lock(loop_mutex_);
+        while (!stop_)
+        {
+            loop_cv_.wait_for(lock, std::chrono::milliseconds(TimerWheel::kTickMs), [this]
+                              { return stop_; });
+            if (stop_)
+                break;
+            lock.unlock();
+            clock_s_.store(monotonic_seconds(), std::memory_order_relaxed);
+            int64_t now_ms = wall_clock_ms();
+            for (size_t i = 0; i < shard_count_; i++)
+            {
+                if (shards_[i].timer_count.load(std::memory_order_relaxed) > 0)
+                {
+                    expire_shard(shards_[i], now_ms);
+                }
+            }
+            // 写入只淘汰少量的键，剩下的超出部分由后台线程逐步淘汰
+            if (max_memory_bytes_ > 0 && eviction_policy_ != EvictionPolicy::kNoEviction)
+            {
+                evict(kEvictionsPerTick);
+            }
+            lock.lock();
+        }
+    }
+
+    size_t KVStore::expire_shard(Shard &shard, int64_t now_ms)
+    {
+        std::vector<TimerWheel::Timer> due;
+        std::vector<Record *> expired;
+        size_t count = 0;
+        for (int batch = 0; batch < kExpireBatchesPerTick; batch++)
+        {
+            bool more;
+            {
+                std::unique_lock<std::shared_mutex> lock(shard.mutex);
+                more = shard.timers.advance(now_ms, kExpireBatch, due);
+                shard.update_charge();
+                for (const auto &timer : due)
+                {
+                    // 键被覆盖或删除后旧的计时器仍留在时间轮中，只删除当前记录确实已经过期的键
+                    size_t pos = shard.index.find(timer.key, RecordIndex::hash(timer.key));
+                    if (pos != RecordIndex::npos && shard.index.at(pos)->expired(now_ms))
+                    {
+                        expired.push_back(shard.remove(pos));
+                    }
+                }
+            }
+            for (Record *record : expired)
+            {
+                Record::release(record, shard.allocator);
+            }
+            count += expired.size();
+            expired.clear();
+            due.clear();
+            if (!more)
+                break;
+        }
+        return count;
+    }
+
+    size_t KVStore::evict(size_t max_evictions)
+    {
+        size_t evicted = 0;
+        // 按分片轮流淘汰，连续一轮所有分片都没有可淘汰的键时停止
+        size_t misses = 0;
+        while (evicted < max_evictions && misses < shard_count_ && used_memory() > max_memory_bytes_)
+        {
+            Shard &shard = shards_[evict_cursor_.fetch_add(1, std::memory_order_relaxed) % shard_count_];
+            size_t freed = evict_from(shard);
+            if (freed == 0)
+            {
+                misses++;
+                continue;
+            }
+            misses = 0;
+            evicted++;
+            evicted_keys_.fetch_add(1, std::memory_order_relaxed);
+            evicted_bytes_.fetch_add(freed, std::memory_order_relaxed);
+        }
+        return evicted;
+    }
+
+    void KVStore::make_room()
+    {
+        if (max_memory_bytes_ == 0 || used_memory() <= max_memory_bytes_)
+        {
+            return;
+        }
+        if (eviction_policy_ != EvictionPolicy::kNoEviction && evict(kEvictionsPerWrite) > 0)
+        {
+            return;
+        }
+        rejected_writes_.fetch_add(1, std::memory_order_relaxed);
+        throw MemoryLimitExceeded("Memory limit of " + std::to_string(max_memory_bytes_) + " bytes exceeded");
+    }
+
+    // 在分片中随机采样若干条记录，按策略选出淘汰的一条（已经过期的记录优先）；volatile-ttl 从时间轮中取最早到期的键。
+    // 淘汰与删除一样写日志，但不等待刷盘：淘汰的键在崩溃后重新出现也不影响正确性
+    size_t KVStore::evict_from(Shard &shard)
+    {
+        Record *victim = nullptr;
+        size_t freed = 0;
+        {
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            size_t pos = RecordIndex::npos;
+            if (eviction_policy_ == EvictionPolicy::kVolatileTtl)
+            {
+                // 键被覆盖或删除后旧的计时器仍在时间轮中，过期时间与当前记录一致的才是有效的计时器
+                TimerWheel::Timer timer;
+                for (int probe = 0; probe < 16 && pos == RecordIndex::npos && shard.timers.pop_earliest(timer, eviction_samples_); probe++)
+                {
+                    size_t found = shard.index.find(timer.key, RecordIndex::hash(timer.key));
+                    if (found != RecordIndex::npos && shard.index.at(found)->expire_at_ms() == timer.expire_at_ms)
+                    {
+                        pos = found;
+                    }
+                }
+                shard.update_charge();
+            }
+            else
+            {
+                int64_t now_ms = wall_clock_ms();
+                uint32_t now_s = clock_s_.load(std::memory_order_relaxed);
+                int best_score = -1;
+                for (int i = 0; i < eviction_samples_; i++)
+                {
+                    size_t sample = shard.index.sample(random_u64());
+                    if (sample == RecordIndex::npos)
+                    {
+                        break;
+                    }
+                    const Record *record = shard.index.at(sample);
+                    // 分数越高越先淘汰
+                    int score = 0;
+                    if (record->expired(now_ms))
+                        score = INT32_MAX;
+                    else if (eviction_policy_ != EvictionPolicy::kAllKeysRandom)
+                        score = coldness(record, now_s);
+                    if (score > best_score)
+                    {
+                        best_score = score;
+                        pos = sample;
+                    }
+                    if (eviction_policy_ == EvictionPolicy::kAllKeysRandom || score == INT32_MAX)
+                    {
+                        break;
+                    }
+                }
+            }
+            if (pos == RecordIndex::npos)
+            {
+                return 0;
+            }
+            freed = Shard::charge(shard.index.at(pos));
+            victim = shard.remove(pos);
+            if (wal_)
+            {
+                wal_->append(WalOp::kDel, victim->key(), std::string_view(), 0);
+            }
+        }
+        Record::release(victim, shard.allocator);
+        return freed;
+    }
+
+    size_t KVStore::used_memory() const
+    {
+        size_t used = 0;
+        for (size_t i = 0; i < shard_count_; i++)
+        {
+            used += shards_[i].charged_bytes.load(std::memory_order_relaxed);
+        }
+        return used;
+    }
+
+    void KVStore::init_access(Record *record, const Record *previous) const
+    {
+        uint32_t now_s = clock_s_.load(std::memory_order_relaxed);
+        uint16_t access = static_cast<uint16_t>(now_s);
+        if (eviction_policy_ == EvictionPolicy::kAllKeysLfu)
+        {
+            uint8_t counter = previous != nullptr ? std::max(lfu_counter(previous->access.load(std::memory_order_relaxed), now_s), kLfuInitCounter) : kLfuInitCounter;
+            access = lfu_access(counter, now_s);
+        }
+        record->access.store(access, std::memory_order_relaxed);
+    }
+
+    void KVStore::init_spilled_access(Record *record, const Record *previous) const
+    {
+        if (eviction_policy_ == EvictionPolicy::kAllKeysLfu)
+        {
+            init_access(record, previous);
+            return;
+        }
+        record->access.store(static_cast<uint16_t>(clock_s_.load(std::memory_order_relaxed) - kPromoteIdleS - 1), std::memory_order_relaxed);
+    }
+
+    // 多个读者可能同时更新同一条记录，丢失个别更新只影响近似的程度；值不变时不写，热点键的缓存行不会在核心间来回失效
+    void KVStore::touch(Record *record) const
+    {
+        if (!track_access_)
+        {
+            return;
+        }
+        uint32_t now_s = clock_s_.load(std::memory_order_relaxed);
+        uint16_t access = record->access.load(std::memory_order_relaxed);
+        uint16_t updated = static_cast<uint16_t>(now_s);
+        if (eviction_policy_ == EvictionPolicy::kAllKeysLfu)
+        {
+            uint8_t counter = lfu_counter(access, now_s);
+            int base = std::max(0, counter - kLfuInitCounter);
+            if (counter < 255 && random_u64() % (base * kLfuLogFactor + 1) == 0)
+            {
+                counter++;
+            }
+            updated = lfu_access(counter, now_s);
+        }
+        if (updated != access)
+        {
+            record->access.store(updated, std::memory_order_relaxed);
+        }
+    }
+
+    // LFU 为衰减后的计数器取反，其余为空闲的秒数
+    int KVStore::coldness(const Record *record, uint32_t now_s) const
     {
-        std::lock_guard<std::mutex> lock(store_mutex);
-        auto it = store_.find(key);
-        if (it == store_.end() || version > it->second.second)
+        uint16_t access = record->access.load(std::memory_order_relaxed);
+        if (eviction_policy_ == EvictionPolicy::kAllKeysLfu)
         {
-            store_[key] = {value, version};
+            return 255 - lfu_counter(access, now_s);
+        }
+        return static_cast<uint16_t>(now_s - access);
+    }
+
+    bool KVStore::load_value(ValueRef &ref)
+    {
+        while (ref.needs_load())
+        {
+            const Record *record = ref.record();
+            auto value = std::make_shared<std::string>();
+            if (value_log_->read(record->locator(), record->key_size, record->value_size, *value))
+            {
+                ref.set_loaded(std::move(value));
+                return true;
+            }
+            // 读取之前段已被整理删除，当前记录要么已经指向新的位置，要么已被覆盖或删除
+            std::string key(record->key());
+            size_t hash = RecordIndex::hash(key);
+            Shard &shard = shard_for(hash);
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            size_t pos = shard.index.find(key, hash);
+            if (pos == RecordIndex::npos || expired_now(shard.index.at(pos)))
+            {
+                ref = ValueRef();
+                return false;
+            }
+            ref = ValueRef(shard.index.at(pos), &shard.allocator);
         }
         return true;
     }
 
+    void KVStore::promote(Shard &shard, size_t hash, const ValueRef &ref)
+    {
+        Record *record = Record::create(shard.allocator, ref.key(), std::string(ref.view()), ref.version(), ref.expire_at_ms());
+        {
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            size_t pos = shard.index.find(ref.key(), hash);
+            // 读取期间记录可能已被覆盖、删除或整理移走，这时放弃
+            if (pos != RecordIndex::npos && shard.index.at(pos) == ref.record())
+            {
+                record->access.store(ref.record()->access.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                record = shard.replace(pos, record);
+            }
+        }
+        Record::release(record, shard.allocator);
+    }
+
+    // 在共享锁内采样选出冷值并持有它们的引用，写值日志在锁外进行，最后在写锁内替换仍未变化的记录
+    size_t KVStore::demote(Shard &shard, size_t max_values)
+    {
+        std::vector<ValueRef> picked;
+        {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            int64_t now_ms = wall_clock_ms();
+            uint32_t now_s = clock_s_.load(std::memory_order_relaxed);
+            for (size_t n = 0; n < max_values; n++)
+            {
+                Record *coldest = nullptr;
+                int coldest_score = -1;
+                for (int i = 0; i < eviction_samples_; i++)
+                {
+                    size_t sample = shard.index.sample(random_u64());
+                    if (sample == RecordIndex::npos)
+                        break;
+                    Record *record = shard.index.at(sample);
+                    if (record->spilled || record->value_size < kMinSpillBytes || record->expired(now_ms))
+                        continue;
+                    int score = coldness(record, now_s);
+                    if (score > coldest_score)
+                    {
+                        coldest = record;
+                        coldest_score = score;
+                    }
+                }
+                if (coldest == nullptr)
+                    continue;
+                bool duplicate = std::any_of(picked.begin(), picked.end(), [coldest](const ValueRef &ref)
+                                             { return ref.record() == coldest; });
+                if (!duplicate)
+                    picked.emplace_back(coldest, &shard.allocator);
+            }
+        }
+        if (picked.empty())
+        {
+            return 0;
+        }
+
+        std::vector<std::pair<std::string_view, std::string_view>> entries;
+        for (const auto &ref : picked)
+        {
+            entries.emplace_back(ref.key(), ref.view());
+        }
+        std::vector<ValueLocator> locators;
+        value_log_->append(entries, locators);
+        std::vector<Record *> spilled;
+        for (size_t i = 0; i < picked.size(); i++)
+        {
+            const ValueRef &ref = picked[i];
+            spilled.push_back(Record::create_spilled(shard.allocator, ref.key(), locators[i], static_cast<uint32_t>(ref.size()), ref.version(), ref.expire_at_ms()));
+        }
+
+        size_t demoted = 0;
+        {
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            for (size_t i = 0; i < picked.size(); i++)
+            {
+                size_t pos = shard.index.find(picked[i].key(), RecordIndex::hash(picked[i].key()));
+                if (pos != RecordIndex::npos && shard.index.at(pos) == picked[i].record())
+                {
+                    init_spilled_access(spilled[i], picked[i].record());
+                    spilled[i] = shard.replace(pos, spilled[i]);
+                    demoted++;
+                }
+                else
+                {
+                    // 写值日志期间被覆盖或删除
+                    value_log_->discard(locators[i], picked[i].key().size(), picked[i].size());
+                }
+            }
+        }
+        for (Record *record : spilled)
+        {
+            Record::release(record, shard.allocator);
+        }
+        return demoted;
+    }
+
+    void KVStore::compact(uint32_t segment)
+    {
+        // 仍被索引引用的条目：持有当前记录和值的副本，攒够一批后一起追加
+        std::vector<std::pair<ValueRef, std::string>> batch;
+        size_t moved = 0;
+        auto flush = [&]
+        {
+            std::vector<std::pair<std::string_view, std::string_view>> entries;
+            for (const auto &entry : batch)
+            {
+                entries.emplace_back(entry.first.key(), entry.second);
+            }
+            std::vector<ValueLocator> locators;
+            value_log_->append(entries, locators);
+            for (size_t i = 0; i < batch.size(); i++)
+            {
+                const ValueRef &ref = batch[i].first;
+                size_t hash = RecordIndex::hash(ref.key());
+                Shard &shard = shard_for(hash);
+                Record *record = Record::create_spilled(shard.allocator, ref.key(), locators[i], static_cast<uint32_t>(ref.size()), ref.version(), ref.expire_at_ms());
+                {
+                    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+                    size_t pos = shard.index.find(ref.key(), hash);
+                    if (pos != RecordIndex::npos && shard.index.at(pos) == ref.record())
+                    {
+                        record->access.store(ref.record()->access.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                        record = shard.replace(pos, record);
+                        moved++;
+                    }
+                    else
+                    {
+                        value_log_->discard(locators[i], ref.key().size(), ref.size());
+                    }
+                }
+                Record::release(record, shard.allocator);
+            }
+            batch.clear();
+        };
+        value_log_->for_each(segment, [&](std::string_view key, std::string_view value, const ValueLocator &locator)
+                             {
+            size_t hash = RecordIndex::hash(key);
+            Shard &shard = shard_for(hash);
+            {
+                std::shared_lock<std::shared_mutex> lock(shard.mutex);
+                size_t pos = shard.index.find(key, hash);
+                if (pos == RecordIndex::npos)
+                    return;
+                Record *record = shard.index.at(pos);
+                if (!record->spilled || record->locator().segment != locator.segment || record->locator().offset != locator.offset)
+                    return;
+                batch.emplace_back(ValueRef(record, &shard.allocator), std::string(value));
+            }
+            if (batch.size() >= kCompactBatch)
+                flush(); });
+        flush();
+        value_log_->remove(segment);
+        SPDLOG_INFO("Node {} compacted value log segment {}, moved {} live values", node_info_.get_name(), segment, moved);
+    }
+
+    size_t KVStore::hot_value_bytes() const
+    {
+        size_t hot = 0;
+        for (size_t i = 0; i < shard_count_; i++)
+        {
+            hot += shards_[i].hot_value_bytes.load(std::memory_order_relaxed);
+        }
+        return hot;
+    }
+
+    void KVStore::tiering_loop()
+    {
+        std::unique_lock<std::mutex> lock(loop_mutex_);
+        while (!stop_)
+        {
+            loop_cv_.wait_for(lock, std::chrono::milliseconds(TimerWheel::kTickMs), [this]
+                              { return stop_; });
+            if (stop_)
+                break;
+            lock.unlock();
+            try
+            {
+                // 按分片轮流移出冷值，连续一轮所有分片都没有可移出的值时停止
+                size_t demoted = 0;
+                size_t misses = 0;
+                while (demoted < kDemotionsPerTick && misses < shard_count_ && hot_value_bytes() > max_hot_value_bytes_)
+                {
+                    Shard &shard = shards_[demote_cursor_.fetch_add(1, std::memory_order_relaxed) % shard_count_];
+                    size_t count = demote(shard, kDemoteBatch);
+                    misses = count == 0 ? misses + 1 : 0;
+                    demoted += count;
+                }
+                if (uint32_t segment = value_log_->pick_compaction())
+                {
+                    compact(segment);
+                }
+            }
+            catch (const std::exception &e)
+            {
+                SPDLOG_ERROR("Node {} tiering failed: {}", node_info_.get_name(), e.what());
+            }
+            lock.lock();
+        }
+    }
+
+    void KVStore::expire_key(Shard &shard, const std::string &key, size_t hash)
+    {
+        Record *old = nullptr;
+        {
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            size_t pos = shard.index.find(key, hash);
+            if (pos != RecordIndex::npos && expired_now(shard.index.at(pos)))
+            {
+                old = shard.remove(pos);
+            }
+        }
+        if (old != nullptr)
+        {
+            Record::release(old, shard.allocator);
+        }
+    }
+
+    size_t KVStore::shard_count() const
+    {
+        return shard_count_;
+    }
+
+    KVStore::Shard::~Shard()
+    {
+        index.for_each([this](Record *record)
+                       { Record::release(record, allocator); });
+    }
+
+    // slab 块按大小级别取整后的大小，加上单独存放的值、有序键集合中的键和偏移
+    size_t KVStore::Shard::charge(const Record *record)
+    {
+        return SlabAllocator::chunk_size(record->size_class, record->block_size()) + record->external_bytes() + record->key_size + sizeof(uint32_t);
+    }
+
+    void KVStore::Shard::update_charge()
+    {
+        timer_count.store(timers.size(), std::memory_order_relaxed);
+        charged_bytes.store(record_charge + index.bytes() + timers.size() * sizeof(TimerWheel::Timer), std::memory_order_relaxed);
+    }
+
+    void KVStore::Shard::account(const Record *record, bool added)
+    {
+        size_t data = record->key_size + record->value_size;
+        size_t external = record->external_bytes();
+        size_t charged = charge(record);
+        size_t hot = record->spilled ? 0 : record->value_size;
+        size_t spilled = record->spilled ? record->value_size : 0;
+        if (added)
+        {
+            data_bytes += data;
+            external_bytes += external;
+            record_charge += charged;
+            hot_value_bytes.store(hot_value_bytes.load(std::memory_order_relaxed) + hot, std::memory_order_relaxed);
+            spilled_keys += record->spilled;
+            spilled_bytes += spilled;
+            return;
+        }
+        data_bytes -= data;
+        external_bytes -= external;
+        record_charge -= charged;
+        hot_value_bytes.store(hot_value_bytes.load(std::memory_order_relaxed) - hot, std::memory_order_relaxed);
+        spilled_keys -= record->spilled;
+        spilled_bytes -= spilled;
+        // 离开索引的溢出记录不会再被找到，即使仍有读者持有它，整理时也不再保留它的值
+        if (record->spilled && value_log != nullptr)
+        {
+            value_log->discard(record->locator(), record->key_size, record->value_size);
+        }
+    }
+
+    Record *KVStore::Shard::publish(size_t pos, Record *record, size_t hash)
+    {
+        account(record, true);
+        if (record->expiring)
+        {
+            timers.schedule(record->key(), record->expire_at_ms(), wall_clock_ms());
+        }
+        Record *old = nullptr;
+        if (pos == RecordIndex::npos)
+        {
+            index.insert(record, hash);
+            keys.insert(record->key());
+        }
+        else
+        {
+            old = index.replace(pos, record);
+            account(old, false);
+        }
+        update_charge();
+        return old;
+    }
+
+    Record *KVStore::Shard::remove(size_t pos)
+    {
+        Record *old = index.erase(pos);
+        keys.erase(old->key());
+        account(old, false);
+        update_charge();
+        return old;
+    }
+
+    Record *KVStore::Shard::replace(size_t pos, Record *record)
+    {
+        account(record, true);
+        Record *old = index.replace(pos, record);
+        account(old, false);
+        update_charge();
+        return old;
+    }
+
+    KVStore::Shard &KVStore::shard_for(size_t hash)
+    {
+        return shards_[hash % shard_count_];
+    }
+
+    void KVStore::apply_record(const WalRecord &record)
+    {
+        if (record.op == WalOp::kDel)
+        {
+            size_t hash = RecordIndex::hash(record.key);
+            Shard &shard = shard_for(hash);
+            Record *old = nullptr;
+            {
+                std::unique_lock<std::shared_mutex> lock(shard.mutex);
+                size_t pos = shard.index.find(record.key, hash);
+                if (pos != RecordIndex::npos)
+                    old = shard.remove(pos);
+            }
+            if (old != nullptr)
+                Record::release(old, shard.allocator);
+            return;
+        }
+        load_entry(std::string(record.key), std::string(record.value), record.version, record.expire_at_ms);
+    }
+
+    void KVStore::load_entry(std::string &&key, std::string &&value, int64_t version, int64_t expire_at_ms)
+    {
+        size_t hash = RecordIndex::hash(key);
+        Shard &shard = shard_for(hash);
+        // 已经过期的条目不再装入，但仍要覆盖更早的版本
+        bool expired = expire_at_ms != 0 && expire_at_ms <= wall_clock_ms();
+        // 分层存储时内存中的值已经达到上限，恢复的值直接写入值日志，不先装入内存再移出
+        bool spill = !expired && value_log_ && value.size() >= kMinSpillBytes && hot_value_bytes() > max_hot_value_bytes_;
+        Record *record = nullptr;
+        if (spill)
+        {
+            std::vector<ValueLocator> locators;
+            value_log_->append({{key, value}}, locators);
+            record = Record::create_spilled(shard.allocator, key, locators[0], static_cast<uint32_t>(value.size()), version, expire_at_ms);
+        }
+        else if (!expired)
+        {
+            record = Record::create(shard.allocator, key, std::move(value), version, expire_at_ms);
+        }
+        Record *old = nullptr;
+        {
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            size_t pos = shard.index.find(key, hash);
+            if (pos == RecordIndex::npos || version > shard.index.at(pos)->version)
+            {
+                if (record != nullptr)
+                {
+                    if (spill)
+                        init_spilled_access(record, nullptr);
+                    else
+                        init_access(record, nullptr);
+                    old = shard.publish(pos, record, hash);
+                }
+                else if (pos != RecordIndex::npos)
+                    old = shard.remove(pos);
+                record = nullptr;
+            }
+        }
+        if (record != nullptr && record->spilled)
+        {
+            value_log_->discard(record->locator(), record->key_size, record->value_size);
+        }
+        if (record != nullptr || old != nullptr)
+        {
+            Record::release(record != nullptr ? record : old, shard.allocator);
+        }
+    }
+
+    void KVStore::sync_wal(uint64_t lsn)
+    {
+        if (wal_ && !wal_->wait(lsn))
+        {
+            throw std::runtime_error("Failed to persist write to WAL");
+        }
+    }
+
+    bool KVStore::put(const std::string &key, const std::string &value, int64_t version)
+    {
+        put_if_newer(key, value, version);
+        return true;
+    }
+
+    // 记录在取锁之前创建，分片锁内只做查找和替换索引中的指针，被替换的旧记录在锁外释放
+    PutResult KVStore::put_if_newer(const std::string &key, std::string value, int64_t version, ValueRef *written, int64_t expire_at_ms)
+    {
+        size_t hash = RecordIndex::hash(key);
+        Shard &shard = shard_for(hash);
+        if (max_memory_bytes_ != 0 && used_memory() > max_memory_bytes_)
+        {
+            // 超过上限时先在读锁下检查版本，不会生效的写入直接返回版本冲突，不为它淘汰其他键，也不拒绝它。
+            // 放锁后腾出空间，取写锁时再检查一次版本
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            size_t pos = shard.index.find(key, hash);
+            if (pos != RecordIndex::npos && !expired_now(shard.index.at(pos)) && version <= shard.index.at(pos)->version)
+            {
+                return {false, shard.index.at(pos)->version};
+            }
+        }
+        make_room();
+        Record *record = Record::create(shard.allocator, key, std::move(value), version, expire_at_ms);
+        Record *old = nullptr;
+        uint64_t lsn = 0;
+        {
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            size_t pos = shard.index.find(key, hash);
+            // 已过期但尚未回收的记录与 get 一样视为不存在，新写入直接覆盖它
+            bool live = pos != RecordIndex::npos && !expired_now(shard.index.at(pos));
+            if (live && version <= shard.index.at(pos)->version)
+            {
+                int64_t current = shard.index.at(pos)->version;
+                lock.unlock();
+                Record::release(record, shard.allocator);
+                return {false, current};
+            }
+            // 在分片锁内追加日志，保证同一个键的日志顺序与内存中的修改顺序一致
+            if (wal_)
+            {
+                lsn = wal_->append(WalOp::kPut, key, record->value(), version, expire_at_ms);
+            }
+            if (written != nullptr)
+            {
+                *written = ValueRef(record, &shard.allocator);
+            }
+            init_access(record, live ? shard.index.at(pos) : nullptr);
+            old = shard.publish(pos, record, hash);
+        }
+        if (old != nullptr)
+        {
+            Record::release(old, shard.allocator);
+        }
+        // 释放分片锁后再等待刷盘，其他写入者可以并入同一次 fdatasync
+        sync_wal(lsn);
+        return {true, version};
+    }
+
+    PutResult KVStore::put_next_version(const std::string &key, std::string value, ValueRef *written, int64_t expire_at_ms)
+    {
+        make_room();
+        size_t hash = RecordIndex::hash(key);
+        Shard &shard = shard_for(hash);
+        // 版本在锁内确定，记录发布到索引之前没有其他线程能看到它
+        Record *record = Record::create(shard.allocator, key, std::move(value), 0, expire_at_ms);
+        Record *old = nullptr;
+        uint64_t lsn = 0;
+        int64_t version;
+        {
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            size_t pos = shard.index.find(key, hash);
+            // 过期的键与不存在的键一样从版本 1 开始，不延续已失效的版本
+            bool live = pos != RecordIndex::npos && !expired_now(shard.index.at(pos));
+            version = record->version = live ? shard.index.at(pos)->version + 1 : 1;
+            if (wal_)
+            {
+                lsn = wal_->append(WalOp::kPut, key, record->value(), record->version, expire_at_ms);
+            }
+            if (written != nullptr)
+            {
+                *written = ValueRef(record, &shard.allocator);
+            }
+            init_access(record, live ? shard.index.at(pos) : nullptr);
+            old = shard.publish(pos, record, hash);
+        }
+        if (old != nullptr)
+        {
+            Record::release(old, shard.allocator);
+        }
+        sync_wal(lsn);
+        return {true, version};
+    }
+
     bool KVStore::get(const std::string &key, std::string &value, int64_t &version)
     {
-        std::lock_guard<std::mutex> lock(store_mutex);
-        auto it = store_.find(key);
-        if (it != store_.end())
+        size_t hash = RecordIndex::hash(key);
+        Shard &shard = shard_for(hash);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        size_t pos = shard.index.find(key, hash);
+        if (pos == RecordIndex::npos)
+        {
+            return false;
+        }
+        Record *record = shard.index.at(pos);
+        if (expired_now(record))
+        {
+            lock.unlock();
+            expire_key(shard, key, hash);
+            return false;
+        }
+        if (record->spilled)
         {
-            value = it->second.first;
-            version = it->second.second;
+            lock.unlock();
+            ValueRef ref;
+            if (!get(key, ref, version))
+                return false;
+            value.assign(ref.view());
             return true;
         }
-        return false;
+        touch(record);
+        value.assign(record->value());
+        version = record->version;
+        return true;
     }
 
-    bool KVStore::del(const std::string &key)
+    bool KVStore::get(const std::string &key, ValueRef &value, int64_t &version)
     {
-        std::lock_guard<std::mutex> lock(store_mutex);
-        auto it = store_.find(key);
-        if (it != store_.end())
+        size_t hash = RecordIndex::hash(key);
+        Shard &shard = shard_for(hash);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        size_t pos = shard.index.find(key, hash);
+        if (pos == RecordIndex::npos)
+        {
+            return false;
+        }
+        Record *record = shard.index.at(pos);
+        if (expired_now(record))
+        {
+            lock.unlock();
+            expire_key(shard, key, hash);
+            return false;
+        }
+        // 溢出的值在不久前也被读过时放回内存：LRU 时钟下为上次读取后 kPromoteIdleS 秒内，LFU 下为计数器已经高于初始值
+        bool reread = false;
+        if (record->spilled)
+        {
+            int cold = coldness(record, clock_s_.load(std::memory_order_relaxed));
+            reread = eviction_policy_ == EvictionPolicy::kAllKeysLfu ? cold < 255 - kLfuInitCounter : cold <= kPromoteIdleS;
+        }
+        touch(record);
+        value = ValueRef(record, &shard.allocator);
+        version = record->version;
+        if (!value.needs_load())
         {
-            store_.erase(it);
-            // SPDLOG_INFO("TRUE");
             return true;
         }
-        // else
-        //     SPDLOG_INFO("FALSE");
-        return false;
+        // 值在值日志中，在锁外读取
+        lock.unlock();
+        if (!load_value(value))
+        {
+            return false;
+        }
+        version = value.version();
+        if (reread)
+        {
+            promote(shard, hash, value);
+        }
+        return true;
+    }
+
+    bool KVStore::peek(const std::string &key, ValueRef &value)
+    {
+        size_t hash = RecordIndex::hash(key);
+        Shard &shard = shard_for(hash);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        size_t pos = shard.index.find(key, hash);
+        if (pos == RecordIndex::npos || expired_now(shard.index.at(pos)))
+        {
+            return false;
+        }
+        value = ValueRef(shard.index.at(pos), &shard.allocator);
+        lock.unlock();
+        return !value.needs_load() || load_value(value);
+    }
+
+    bool KVStore::del_where(const std::string &key, const std::function<bool(int64_t)> &keep, int64_t *deleted_version)
+    {
+        size_t hash = RecordIndex::hash(key);
+        Shard &shard = shard_for(hash);
+        Record *old;
+        uint64_t lsn = 0;
+        {
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            size_t pos = shard.index.find(key, hash);
+            // 已过期的键视为不存在，留给后台回收
+            if (pos == RecordIndex::npos || expired_now(shard.index.at(pos)) || keep(shard.index.at(pos)->version))
+            {
+                return false;
+            }
+            old = shard.remove(pos);
+            if (wal_)
+            {
+                lsn = wal_->append(WalOp::kDel, key, std::string_view(), 0);
+            }
+        }
+        if (deleted_version != nullptr)
+        {
+            *deleted_version = old->version;
+        }
+        Record::release(old, shard.allocator);
+        sync_wal(lsn);
+        return true;
+    }
+
+    bool KVStore::del(const std::string &key, int64_t *deleted_version)
+    {
+        return del_where(key, [](int64_t)
+                         { return false; }, deleted_version);
+    }
+
+    bool KVStore::del_if_version(const std::string &key, int64_t version)
+    {
+        return del_where(key, [version](int64_t current)
+                         { return current != version; }, nullptr);
+    }
+
+    bool KVStore::del_if_not_newer(const std::string &key, int64_t version)
+    {
+        return del_where(key, [version](int64_t current)
+                         { return current > version; }, nullptr);
+    }
+
+    void KVStore::for_each_key_in_shard(size_t shard, const std::function<void(std::string_view, int64_t)> &fn)
+    {
+        int64_t now_ms = wall_clock_ms();
+        std::shared_lock<std::shared_mutex> lock(shards_[shard].mutex);
+        shards_[shard].index.for_each([&](Record *record)
+                                      {
+            if (!record->expired(now_ms))
+                fn(record->key(), record->version); });
+    }
+
+    void KVStore::scan(const std::string &start, const std::string &end, size_t limit, std::vector<ValueRef> &out)
+    {
+        if (limit == 0)
+        {
+            return;
+        }
+        size_t first = out.size();
+        int64_t now_ms = wall_clock_ms();
+        for (size_t i = 0; i < shard_count_; i++)
+        {
+            Shard &shard = shards_[i];
+            size_t taken = 0;
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            shard.keys.scan(start, end, [&](std::string_view key)
+                            {
+                Record *record = shard.index.at(shard.index.find(key, RecordIndex::hash(key)));
+                if (record->expired(now_ms))
+                    return true;
+                out.emplace_back(record, &shard.allocator);
+                return ++taken < limit; });
+        }
+        // 各分片内已经有序，合并后只保留最小的 limit 项
+        auto begin = out.begin() + first;
+        auto by_key = [](const ValueRef &a, const ValueRef &b)
+        { return a.key() < b.key(); };
+        if (out.size() - first > limit)
+        {
+            std::nth_element(begin, begin + limit, out.end(), by_key);
+            out.resize(first + limit);
+        }
+        std::sort(out.begin() + first, out.end(), by_key);
+        // 溢出的值在锁外读出，读取前被删除的键从结果中去掉
+        size_t kept = first;
+        for (size_t i = first; i < out.size(); i++)
+        {
+            if (out[i].needs_load() && !load_value(out[i]))
+                continue;
+            if (kept != i)
+                out[kept] = std::move(out[i]);
+            kept++;
+        }
+        out.resize(kept);
+    }
+
+    MemoryStats KVStore::memory_stats() const
+    {
+        MemoryStats stats;
+        for (size_t i = 0; i < shard_count_; i++)
+        {
+            const Shard &shard = shards_[i];
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            stats.keys += shard.index.size();
+            stats.data_bytes += shard.data_bytes;
+            stats.external_bytes += shard.external_bytes;
+            stats.index_bytes += shard.index.bytes();
+            stats.ordered_bytes += shard.keys.bytes();
+            stats.timer_bytes += shard.timers.bytes();
+            stats.timers += shard.timers.size();
+            stats.record_bytes += shard.allocator.used_bytes();
+            stats.slab_bytes += shard.allocator.reserved_bytes();
+            stats.used_bytes += shard.charged_bytes.load(std::memory_order_relaxed);
+            stats.hot_value_bytes += shard.hot_value_bytes.load(std::memory_order_relaxed);
+            stats.spilled_keys += shard.spilled_keys;
+            stats.spilled_bytes += shard.spilled_bytes;
+        }
+        stats.value_log_bytes = value_log_ ? value_log_->bytes() : 0;
+        stats.max_bytes = max_memory_bytes_;
+        stats.evicted_keys = evicted_keys_.load(std::memory_order_relaxed);
+        stats.evicted_bytes = evicted_bytes_.load(std::memory_order_relaxed);
+        stats.rejected_writes = rejected_writes_.load(std::memory_order_relaxed);
+        return stats;
     }
 
     int64_t KVStore::getVersion(const std::string &key)
     {
-        auto it = store_.find(key);
-        if (it != store_.end())
+        size_t hash = RecordIndex::hash(key);
+        Shard &shard = shard_for(hash);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        size_t pos = shard.index.find(key, hash);
+        if (pos != RecordIndex::npos && !expired_now(shard.index.at(pos)))
         {
-            return it->second.second;
+            return shard.index.at(pos)->version;
         }
         return -1; // 返回一个无效的版本号
     }
 
+    // 名称与 Redis 的 maxmemory-policy 一致，按表逐个比较
+    bool parse_eviction_policy(const std::string &name, EvictionPolicy &policy)
+    {
+        static const std::pair<const char *, EvictionPolicy> kPolicies[] = {
+            {"noeviction", EvictionPolicy::kNoEviction},
+            {"allkeys-lru", EvictionPolicy::kAllKeysLru},
+            {"allkeys-lfu", EvictionPolicy::kAllKeysLfu},
+            {"allkeys-random", EvictionPolicy::kAllKeysRandom},
+            {"volatile-ttl", EvictionPolicy::kVolatileTtl},
+        };
+        for (const auto &entry : kPolicies)
+        {
+            if (name == entry.first)
+            {
+                policy = entry.second;
+                return true;
+            }
+        }
+        return false;
+    }
+
     // Function to parse host and port from a string in "host:port" format
     std::pair<std::string, int> parse_host_port(const std::string &input)
     {
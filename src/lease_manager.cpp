@@ -0,0 +1,278 @@
+#include "lease_manager.h"
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+
+namespace kvstore
+{
+    namespace
+    {
+        const size_t kShardCount = 16;
+        // 订阅流空闲时检查客户端是否已断开的间隔
+        const int kPollIntervalMs = 100;
+    }
+
+    // 一个订阅流待发送的通知。queued 为已排队的通知批次序号，sent 为已写入流的序号，
+    // waiters 中的写操作在 sent 追上自己排队时的序号或流关闭时得到确认
+    struct LeaseManager::Subscriber
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::vector<std::string> pending;
+        bool all = false;
+        uint64_t queued = 0;
+        uint64_t sent = 0;
+        std::vector<std::pair<uint64_t, std::shared_ptr<AckCounter>>> waiters;
+        std::atomic<bool> closed{false};
+
+        // 在 mutex 内调用：确认已发出的通知，流关闭时确认全部
+        void flush()
+        {
+            bool all_done = closed.load();
+            auto done = std::partition(waiters.begin(), waiters.end(), [&](const std::pair<uint64_t, std::shared_ptr<AckCounter>> &waiter)
+                                       { return !all_done && waiter.first > sent; });
+            for (auto it = done; it != waiters.end(); ++it)
+            {
+                it->second->complete(true);
+            }
+            waiters.erase(done, waiters.end());
+        }
+
+        // 在 mutex 内调用
+        void close()
+        {
+            closed.store(true);
+            flush();
+            cv.notify_all();
+        }
+    };
+
+    LeaseManager::LeaseManager(const LeaseOptions &options) : options_(options), shards_(new Shard[kShardCount])
+    {
+    }
+
+    LeaseManager::~LeaseManager()
+    {
+        shutdown();
+    }
+
+    LeaseManager::Shard &LeaseManager::shard_for(const std::string &key)
+    {
+        return shards_[std::hash<std::string>()(key) % kShardCount];
+    }
+
+    void LeaseManager::sweep(Shard &shard, Clock::time_point now)
+    {
+        for (auto it = shard.leases.begin(); it != shard.leases.end();)
+        {
+            auto &holders = it->second;
+            holders.erase(std::remove_if(holders.begin(), holders.end(), [now](const Holder &holder)
+                                         { return holder.expires <= now || holder.subscriber->closed.load(); }),
+                          holders.end());
+            it = holders.empty() ? shard.leases.erase(it) : std::next(it);
+        }
+        shard.next_sweep = now + std::chrono::milliseconds(options_.lease_ms);
+    }
+
+    int64_t LeaseManager::grant(const std::string &client_id, const std::string &key)
+    {
+        if (options_.lease_ms <= 0 || client_id.empty())
+        {
+            return 0;
+        }
+        std::shared_ptr<Subscriber> subscriber;
+        {
+            std::shared_lock<std::shared_mutex> lock(subscribers_mutex_);
+            auto it = subscribers_.find(client_id);
+            if (it == subscribers_.end())
+            {
+                return 0;
+            }
+            subscriber = it->second;
+        }
+
+        Clock::time_point now = Clock::now();
+        Clock::time_point expires = now + std::chrono::milliseconds(options_.lease_ms);
+        Shard &shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (now >= shard.next_sweep)
+        {
+            sweep(shard, now);
+        }
+        auto &holders = shard.leases[key];
+        for (auto &holder : holders)
+        {
+            if (holder.subscriber == subscriber)
+            {
+                holder.expires = expires;
+                return options_.lease_ms;
+            }
+        }
+        holders.push_back({std::move(subscriber), expires});
+        return options_.lease_ms;
+    }
+
+    std::shared_ptr<AckCounter> LeaseManager::invalidate(const std::string &key)
+    {
+        if (options_.lease_ms <= 0)
+        {
+            return nullptr;
+        }
+        std::vector<Holder> holders;
+        {
+            Shard &shard = shard_for(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.leases.find(key);
+            if (it == shard.leases.end())
+            {
+                return nullptr;
+            }
+            holders.swap(it->second);
+            shard.leases.erase(it);
+        }
+
+        // 只等待仍然有效的租约，最多等到其中最晚的一个到期
+        Clock::time_point now = Clock::now();
+        auto live = std::remove_if(holders.begin(), holders.end(), [now](const Holder &holder)
+                                   { return holder.expires <= now || holder.subscriber->closed.load(); });
+        holders.erase(live, holders.end());
+        if (holders.empty())
+        {
+            return nullptr;
+        }
+        Clock::time_point deadline = now;
+        for (auto &holder : holders)
+        {
+            deadline = std::max(deadline, holder.expires);
+        }
+        int count = static_cast<int>(holders.size());
+        auto acks = std::make_shared<AckCounter>(count, count, deadline);
+        // 通知排进所有持有者的队列后立即返回，多个持有者的发送互相重叠
+        for (auto &holder : holders)
+        {
+            Subscriber &subscriber = *holder.subscriber;
+            std::lock_guard<std::mutex> lock(subscriber.mutex);
+            if (subscriber.closed.load())
+            {
+                acks->complete(true);
+                continue;
+            }
+            subscriber.pending.push_back(key);
+            subscriber.waiters.emplace_back(++subscriber.queued, acks);
+            subscriber.cv.notify_all();
+        }
+        return acks;
+    }
+
+    void LeaseManager::revoke_all()
+    {
+        if (options_.lease_ms <= 0)
+        {
+            return;
+        }
+        for (size_t i = 0; i < kShardCount; i++)
+        {
+            std::lock_guard<std::mutex> lock(shards_[i].mutex);
+            shards_[i].leases.clear();
+        }
+        std::shared_lock<std::shared_mutex> lock(subscribers_mutex_);
+        for (auto &entry : subscribers_)
+        {
+            Subscriber &subscriber = *entry.second;
+            std::lock_guard<std::mutex> subscriber_lock(subscriber.mutex);
+            subscriber.pending.clear();
+            subscriber.all = true;
+            subscriber.queued++;
+            subscriber.cv.notify_all();
+        }
+    }
+
+    grpc::Status LeaseManager::serve(const std::string &client_id, grpc::ServerContext *context, grpc::ServerWriter<Invalidation> *writer)
+    {
+        if (options_.lease_ms <= 0)
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Leases are disabled");
+        }
+        if (client_id.empty())
+        {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Missing client id");
+        }
+        auto subscriber = std::make_shared<Subscriber>();
+        {
+            std::unique_lock<std::shared_mutex> lock(subscribers_mutex_);
+            if (shutdown_)
+            {
+                return grpc::Status(grpc::StatusCode::UNAVAILABLE, "Server is shutting down");
+            }
+            auto &slot = subscribers_[client_id];
+            if (slot)
+            {
+                // 客户端重新订阅，旧的流上登记的租约随之作废
+                std::lock_guard<std::mutex> subscriber_lock(slot->mutex);
+                slot->close();
+            }
+            slot = subscriber;
+        }
+
+        while (true)
+        {
+            Invalidation message;
+            uint64_t batch;
+            {
+                std::unique_lock<std::mutex> lock(subscriber->mutex);
+                subscriber->cv.wait_for(lock, std::chrono::milliseconds(kPollIntervalMs), [&]()
+                                        { return !subscriber->pending.empty() || subscriber->all || subscriber->closed.load(); });
+                if (subscriber->closed.load())
+                {
+                    break;
+                }
+                if (subscriber->pending.empty() && !subscriber->all)
+                {
+                    if (context->IsCancelled())
+                        break;
+                    continue;
+                }
+                // 积压的通知合并成一条消息发送
+                message.set_all(subscriber->all);
+                for (auto &key : subscriber->pending)
+                {
+                    message.add_keys(std::move(key));
+                }
+                subscriber->pending.clear();
+                subscriber->all = false;
+                batch = subscriber->queued;
+            }
+            if (!writer->Write(message))
+            {
+                break;
+            }
+            std::lock_guard<std::mutex> lock(subscriber->mutex);
+            subscriber->sent = batch;
+            subscriber->flush();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(subscriber->mutex);
+            subscriber->close();
+        }
+        std::unique_lock<std::shared_mutex> lock(subscribers_mutex_);
+        auto it = subscribers_.find(client_id);
+        if (it != subscribers_.end() && it->second == subscriber)
+        {
+            subscribers_.erase(it);
+        }
+        return grpc::Status::OK;
+    }
+
+    void LeaseManager::shutdown()
+    {
+        std::unique_lock<std::shared_mutex> lock(subscribers_mutex_);
+        shutdown_ = true;
+        for (auto &entry : subscribers_)
+        {
+            std::lock_guard<std::mutex> subscriber_lock(entry.second->mutex);
+            entry.second->close();
+        }
+    }
+
+} // namespace kvstore
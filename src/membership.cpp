@@ -0,0 +1,458 @@
+#include "membership.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+
+namespace kvstore
+{
+    namespace
+    {
+        bool newer(const ClusterView &a, const ClusterView &b)
+        {
+            return a.epoch() != b.epoch() ? a.epoch() > b.epoch() : a.origin() > b.origin();
+        }
+
+        bool contains(const ClusterView &view, const std::string &name)
+        {
+            return std::any_of(view.members().begin(), view.members().end(), [&](const Member &m)
+                               { return m.name() == name; });
+        }
+
+        std::string describe(const ClusterView &view)
+        {
+            std::string names;
+            for (const auto &member : view.members())
+            {
+                names += names.empty() ? member.name() : "," + member.name();
+            }
+            return names;
+        }
+
+        std::chrono::system_clock::time_point deadline_after(int ms)
+        {
+            return std::chrono::system_clock::now() + std::chrono::milliseconds(ms);
+        }
+    }
+
+    const Route *RoutingTable::owner(const std::string &key) const
+    {
+        int id = ring.getNode(key);
+        return id < 0 ? nullptr : &routes[id];
+    }
+
+    const Route *RoutingTable::previous_owner(const std::string &key) const
+    {
+        int id = previous_ring.getNode(key);
+        return id < 0 ? nullptr : &previous_routes[id];
+    }
+
+    Membership::Membership(const NodeInfo &self, const std::vector<NodeInfo> &nodes, PeerChannelPool &peers,
+                           const MembershipOptions &options, std::function<void()> on_change)
+        : self_(self), peers_(peers), options_(options), on_change_(std::move(on_change)), joined_(options.seed.empty())
+    {
+        // 静态配置的集群各节点从同一个 epoch 1 视图开始；通过 seed 加入的节点先只认识自己，epoch 为 0，任何集群视图都比它新
+        ClusterView view;
+        if (options_.seed.empty())
+        {
+            view.set_epoch(1);
+            for (const auto &node : nodes)
+            {
+                Member *member = view.add_members();
+                member->set_name(node.get_name());
+                member->set_address(node.get_address());
+            }
+        }
+        else
+        {
+            Member *member = view.add_members();
+            member->set_name(self_.get_name());
+            member->set_address(self_.get_address());
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        install(view);
+        changed_ = false;
+    }
+
+    Membership::~Membership()
+    {
+        stop();
+    }
+
+    void Membership::start()
+    {
+        thread_ = std::thread(&Membership::heartbeat_loop, this);
+    }
+
+    void Membership::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(loop_mutex_);
+            stop_ = true;
+        }
+        loop_cv_.notify_one();
+        if (thread_.joinable())
+        {
+            thread_.join();
+        }
+    }
+
+    void Membership::install(const ClusterView &view)
+    {
+        // 上一任成员中仍在集群里的节点使用它现在的地址，节点换了地址后两张路由表不会来回切换连接
+        auto address_of = [&view](const google::protobuf::RepeatedPtrField<Member> &members, const std::string &name)
+        {
+            for (const auto *source : {&view.members(), &members})
+            {
+                for (const auto &member : *source)
+                {
+                    if (member.name() == name)
+                        return member.address();
+                }
+            }
+            return std::string();
+        };
+        auto build = [this, &address_of](const google::protobuf::RepeatedPtrField<Member> &members, ConsistencyHash &ring, std::vector<Route> &routes)
+        {
+            for (const auto &member : members)
+            {
+                ring.addNode(member.name());
+            }
+            routes.resize(ring.size());
+            for (size_t id = 0; id < routes.size(); id++)
+            {
+                Route &route = routes[id];
+                route.name = ring.getNodeName(id);
+                route.address = address_of(members, route.name);
+                route.is_self = route.name == self_.get_name();
+                route.peer = route.is_self ? nullptr : peers_.add(route.name, route.address);
+            }
+        };
+        auto table = std::make_shared<RoutingTable>();
+        table->view = view;
+        build(view.members(), table->ring, table->routes);
+        // 上一个环取自视图记录的上一任成员，而不是本节点之前的视图：通过 seed 加入的节点之前只有只含自己的 epoch 0 视图，
+        // 用它会让每个键的上一任负责节点都是自己，回读被跳过
+        build(view.previous_members(), table->previous_ring, table->previous_routes);
+
+        // 新成员从加入时刻开始计算超时，已移除的成员不再跟踪
+        auto now = Clock::now();
+        std::unordered_map<std::string, Clock::time_point> last_seen;
+        for (const auto &route : table->routes)
+        {
+            auto it = last_seen_.find(route.name);
+            last_seen[route.name] = it == last_seen_.end() ? now : it->second;
+        }
+        last_seen_.swap(last_seen);
+
+        std::atomic_store(&table_, std::shared_ptr<const RoutingTable>(std::move(table)));
+        changed_ = true;
+        SPDLOG_INFO("Node {} installed view epoch {} from '{}': [{}]", self_.get_name(), view.epoch(), view.origin(), describe(view));
+    }
+
+    bool Membership::adopt(const ClusterView &view)
+    {
+        if (!newer(view, table_->view))
+        {
+            return false;
+        }
+        install(view);
+        bool member = contains(view, self_.get_name());
+        if (!member && joined_ && !leaving_)
+        {
+            SPDLOG_WARN("Node {} was removed from the cluster by {}, rejoining", self_.get_name(), view.origin());
+        }
+        joined_ = member;
+        return true;
+    }
+
+    void Membership::publish(std::vector<Member> members)
+    {
+        std::sort(members.begin(), members.end(), [](const Member &a, const Member &b)
+                  { return a.name() < b.name(); });
+        ClusterView view;
+        view.set_epoch(table_->view.epoch() + 1);
+        view.set_origin(self_.get_name());
+        *view.mutable_previous_members() = table_->view.members();
+        for (auto &member : members)
+        {
+            *view.add_members() = std::move(member);
+        }
+        install(view);
+    }
+
+    void Membership::notify_change()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!changed_)
+                return;
+            changed_ = false;
+        }
+        if (on_change_)
+        {
+            on_change_();
+        }
+        {
+            std::lock_guard<std::mutex> lock(loop_mutex_);
+            wake_ = true;
+        }
+        loop_cv_.notify_one();
+    }
+
+    void Membership::on_heartbeat(const HeartbeatRequest &request, HeartbeatResponse *response)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = last_seen_.find(request.from());
+            if (it != last_seen_.end())
+            {
+                it->second = Clock::now();
+            }
+            adopt(request.view());
+            *response->mutable_view() = table_->view;
+        }
+        notify_change();
+    }
+
+    grpc::Status Membership::join(const Member &node, ClusterView *view)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!joined_)
+            {
+                return grpc::Status(grpc::StatusCode::UNAVAILABLE, "Node is not a cluster member");
+            }
+            std::vector<Member> members(table_->view.members().begin(), table_->view.members().end());
+            auto it = std::find_if(members.begin(), members.end(), [&](const Member &m)
+                                   { return m.name() == node.name(); });
+            if (it == members.end() || it->address() != node.address())
+            {
+                if (it == members.end())
+                    members.push_back(node);
+                else
+                    *it = node;
+                SPDLOG_INFO("Node {} accepted join of {} ({})", self_.get_name(), node.name(), node.address());
+                publish(std::move(members));
+            }
+            *view = table_->view;
+        }
+        notify_change();
+        return grpc::Status::OK;
+    }
+
+    grpc::Status Membership::leave(const std::string &name, ClusterView *view)
+    {
+        if (name != self_.get_name())
+        {
+            // 离开的节点需要知道自己是主动离开，不再重新加入，因此把请求转给它本身；联系不上时直接移除
+            auto table = this->table();
+            const Route *target = nullptr;
+            for (const auto &route : table->routes)
+            {
+                if (route.name == name)
+                    target = &route;
+            }
+            if (target == nullptr)
+            {
+                return grpc::Status(grpc::StatusCode::NOT_FOUND, "Node not in cluster");
+            }
+            KVStoreRPC::Stub *stub = PeerChannelPool::next_stub(target->peer);
+            LeaveRequest request;
+            request.set_name(name);
+            MembershipResponse response;
+            grpc::ClientContext context;
+            context.set_deadline(deadline_after(std::max(options_.heartbeat_interval_ms, 1000)));
+            grpc::Status status = stub == nullptr ? grpc::Status(grpc::StatusCode::UNAVAILABLE, "No channel")
+                                                  : stub->Leave(&context, request, &response);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (status.ok())
+                {
+                    adopt(response.view());
+                }
+                else if (contains(table_->view, name))
+                {
+                    SPDLOG_WARN("Node {} unreachable on leave ({}), removing it", name, status.error_message());
+                    std::vector<Member> members;
+                    for (const auto &member : table_->view.members())
+                    {
+                        if (member.name() != name)
+                            members.push_back(member);
+                    }
+                    publish(std::move(members));
+                }
+                *view = table_->view;
+            }
+            notify_change();
+            return grpc::Status::OK;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            leaving_ = true;
+            std::vector<Member> members;
+            for (const auto &member : table_->view.members())
+            {
+                if (member.name() != name)
+                    members.push_back(member);
+            }
+            if (members.size() != static_cast<size_t>(table_->view.members_size()))
+            {
+                SPDLOG_INFO("Node {} leaving the cluster", name);
+                publish(std::move(members));
+            }
+            joined_ = false;
+            *view = table_->view;
+        }
+        notify_change();
+        return grpc::Status::OK;
+    }
+
+    bool Membership::join_via(KVStoreRPC::Stub *stub)
+    {
+        JoinRequest request;
+        request.mutable_node()->set_name(self_.get_name());
+        request.mutable_node()->set_address(self_.get_address());
+        MembershipResponse response;
+        grpc::ClientContext context;
+        context.set_deadline(deadline_after(std::max(options_.heartbeat_interval_ms, 1000)));
+        grpc::Status status = stub->Join(&context, request, &response);
+        if (!status.ok())
+        {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            adopt(response.view());
+        }
+        notify_change();
+        return true;
+    }
+
+    void Membership::heartbeat_loop()
+    {
+        std::unique_ptr<KVStoreRPC::Stub> seed_stub;
+        while (true)
+        {
+            bool need_join;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                need_join = !joined_ && !leaving_;
+            }
+            if (need_join)
+            {
+                // 优先向视图中的其他成员申请加入，都不可用时再找 seed
+                bool joined = false;
+                auto table = this->table();
+                for (const auto &route : table->routes)
+                {
+                    KVStoreRPC::Stub *stub = PeerChannelPool::next_stub(route.peer);
+                    if (stub != nullptr && join_via(stub))
+                    {
+                        joined = true;
+                        break;
+                    }
+                }
+                if (!joined && !options_.seed.empty())
+                {
+                    if (!seed_stub)
+                    {
+                        seed_stub = KVStoreRPC::NewStub(grpc::CreateChannel(options_.seed, grpc::InsecureChannelCredentials()));
+                    }
+                    join_via(seed_stub.get());
+                }
+            }
+
+            heartbeat_round();
+
+            std::unique_lock<std::mutex> lock(loop_mutex_);
+            loop_cv_.wait_for(lock, std::chrono::milliseconds(options_.heartbeat_interval_ms), [this]()
+                              { return stop_ || wake_; });
+            if (stop_)
+            {
+                return;
+            }
+            wake_ = false;
+        }
+    }
+
+    void Membership::heartbeat_round()
+    {
+        struct Pending
+        {
+            std::string name;
+            grpc::ClientContext context;
+            HeartbeatResponse response;
+            grpc::Status status;
+            std::unique_ptr<grpc::ClientAsyncResponseReader<HeartbeatResponse>> reader;
+        };
+
+        auto table = this->table();
+        HeartbeatRequest request;
+        request.set_from(self_.get_name());
+        *request.mutable_view() = table->view;
+
+        // 所有心跳同时发出，一轮的耗时不随节点数增长
+        grpc::CompletionQueue cq;
+        std::vector<std::unique_ptr<Pending>> pending;
+        for (const auto &route : table->routes)
+        {
+            KVStoreRPC::Stub *stub = PeerChannelPool::next_stub(route.peer);
+            if (stub == nullptr)
+                continue;
+            auto call = std::make_unique<Pending>();
+            call->name = route.name;
+            call->context.set_deadline(deadline_after(std::max(options_.heartbeat_interval_ms, 200)));
+            call->reader = stub->AsyncHeartbeat(&call->context, request, &cq);
+            call->reader->Finish(&call->response, &call->status, call.get());
+            pending.push_back(std::move(call));
+        }
+        void *tag;
+        bool ok;
+        for (size_t n = 0; n < pending.size(); n++)
+        {
+            cq.Next(&tag, &ok);
+        }
+        cq.Shutdown();
+        while (cq.Next(&tag, &ok))
+        {
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto now = Clock::now();
+            for (const auto &call : pending)
+            {
+                if (!call->status.ok())
+                    continue;
+                auto it = last_seen_.find(call->name);
+                if (it != last_seen_.end())
+                {
+                    it->second = now;
+                }
+                adopt(call->response.view());
+            }
+
+            if (joined_ && options_.failure_timeout_ms > 0)
+            {
+                auto timeout = std::chrono::milliseconds(options_.failure_timeout_ms);
+                std::vector<Member> alive;
+                for (const auto &member : table_->view.members())
+                {
+                    auto it = last_seen_.find(member.name());
+                    if (member.name() != self_.get_name() && it != last_seen_.end() && now - it->second > timeout)
+                    {
+                        SPDLOG_WARN("Node {} detected failure of {}, removing it", self_.get_name(), member.name());
+                        continue;
+                    }
+                    alive.push_back(member);
+                }
+                if (alive.size() != static_cast<size_t>(table_->view.members_size()))
+                {
+                    publish(std::move(alive));
+                }
+            }
+        }
+        notify_change();
+    }
+
+} // namespace kvstore
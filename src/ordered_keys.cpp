@@ -0,0 +1,103 @@
+#include "ordered_keys.h"
+
+namespace kvstore
+{
+    OrderedKeys::OrderedKeys()
+    {
+        leaves_.emplace(std::string(), Leaf());
+    }
+
+    size_t OrderedKeys::Leaf::lower_bound(std::string_view key) const
+    {
+        size_t low = 0, high = size();
+        while (low < high)
+        {
+            size_t mid = (low + high) / 2;
+            if (this->key(mid) < key)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        return low;
+    }
+
+    void OrderedKeys::insert(std::string_view key)
+    {
+        auto it = leaf_for(key);
+        Leaf &leaf = it->second;
+        size_t i = leaf.lower_bound(key);
+        leaf.data.insert(leaf.offsets[i], key.data(), key.size());
+        leaf.offsets.insert(leaf.offsets.begin() + i + 1, leaf.offsets[i] + static_cast<uint32_t>(key.size()));
+        for (size_t j = i + 2; j < leaf.offsets.size(); j++)
+        {
+            leaf.offsets[j] += static_cast<uint32_t>(key.size());
+        }
+
+        if (leaf.size() <= kMaxKeys && (leaf.data.size() <= kMaxBytes || leaf.size() < 2))
+        {
+            return;
+        }
+        // 从中间分裂，后一半的第一个键成为新叶子的下界
+        size_t mid = leaf.size() / 2;
+        uint32_t cut = leaf.offsets[mid];
+        Leaf upper;
+        upper.data.assign(leaf.data, cut, std::string::npos);
+        upper.offsets.clear();
+        for (size_t j = mid; j < leaf.offsets.size(); j++)
+        {
+            upper.offsets.push_back(leaf.offsets[j] - cut);
+        }
+        leaf.data.resize(cut);
+        leaf.offsets.resize(mid + 1);
+        std::string fence(upper.key(0));
+        leaves_.emplace_hint(std::next(it), std::move(fence), std::move(upper));
+    }
+
+    void OrderedKeys::erase(std::string_view key)
+    {
+        auto it = leaf_for(key);
+        Leaf &leaf = it->second;
+        size_t i = leaf.lower_bound(key);
+        if (i == leaf.size() || leaf.key(i) != key)
+        {
+            return;
+        }
+        uint32_t length = leaf.offsets[i + 1] - leaf.offsets[i];
+        leaf.data.erase(leaf.offsets[i], length);
+        leaf.offsets.erase(leaf.offsets.begin() + i + 1);
+        for (size_t j = i + 1; j < leaf.offsets.size(); j++)
+        {
+            leaf.offsets[j] -= length;
+        }
+
+        // 空叶子并入前一个叶子的区间；与后一个叶子合计不到半满时把后者并进来
+        if (leaf.size() == 0 && it != leaves_.begin())
+        {
+            leaves_.erase(it);
+            return;
+        }
+        auto next = std::next(it);
+        if (next != leaves_.end() && leaf.size() + next->second.size() <= kMaxKeys / 2 &&
+            leaf.data.size() + next->second.data.size() <= kMaxBytes / 2)
+        {
+            uint32_t base = static_cast<uint32_t>(leaf.data.size());
+            leaf.data += next->second.data;
+            for (size_t j = 1; j < next->second.offsets.size(); j++)
+            {
+                leaf.offsets.push_back(base + next->second.offsets[j]);
+            }
+            leaves_.erase(next);
+        }
+    }
+
+    size_t OrderedKeys::bytes() const
+    {
+        // std::map 的节点另有约 48 字节的树指针和颜色
+        size_t total = 0;
+        for (const auto &entry : leaves_)
+        {
+            total += 48 + sizeof(entry) + entry.first.capacity() + entry.second.data.capacity() + entry.second.offsets.capacity() * sizeof(uint32_t);
+        }
+        return total;
+    }
+}
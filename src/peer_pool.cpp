@@ -0,0 +1,88 @@
+#include "peer_pool.h"
+
+namespace kvstore
+{
+
+    PeerChannelPool::PeerChannelPool(const std::vector<NodeInfo> &nodes, const std::string &self_name, const ChannelOptions &options) : options_(options)
+    {
+        for (const auto &node : nodes)
+        {
+            if (node.get_name() == self_name)
+            {
+                continue; // 本节点的请求直接访问本地存储，不需要通道
+            }
+            peers_[node.get_name()] = connect(node.get_address());
+        }
+    }
+
+    std::unique_ptr<PeerChannelPool::Peer> PeerChannelPool::connect(const std::string &address) const
+    {
+        int channel_count = options_.channels_per_peer > 0 ? options_.channels_per_peer : 1;
+        auto peer = std::make_unique<Peer>();
+        peer->address = address;
+        for (int i = 0; i < channel_count; i++)
+        {
+            grpc::ChannelArguments args;
+            args.SetInt(GRPC_ARG_KEEPALIVE_TIME_MS, options_.keepalive_time_ms);
+            args.SetInt(GRPC_ARG_KEEPALIVE_TIMEOUT_MS, options_.keepalive_timeout_ms);
+            args.SetInt(GRPC_ARG_KEEPALIVE_PERMIT_WITHOUT_CALLS, 1);
+            args.SetInt(GRPC_ARG_HTTP2_MAX_PINGS_WITHOUT_DATA, 0);
+            args.SetInt(GRPC_ARG_INITIAL_RECONNECT_BACKOFF_MS, options_.initial_reconnect_backoff_ms);
+            args.SetInt(GRPC_ARG_MIN_RECONNECT_BACKOFF_MS, options_.initial_reconnect_backoff_ms);
+            args.SetInt(GRPC_ARG_MAX_RECONNECT_BACKOFF_MS, options_.max_reconnect_backoff_ms);
+            // 每个 channel 使用独立的 subchannel 池，保证是真正独立的 TCP 连接
+            args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+
+            auto channel = grpc::CreateCustomChannel(address, grpc::InsecureChannelCredentials(), args);
+            channel->GetState(true); // 提前发起连接，避免首个转发请求承担握手开销
+            peer->stubs.push_back(KVStoreRPC::NewStub(channel));
+            peer->channels.push_back(std::move(channel));
+        }
+        return peer;
+    }
+
+    PeerChannelPool::Peer *PeerChannelPool::add(const std::string &node_name, const std::string &address)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &peer = peers_[node_name];
+        if (peer && peer->address != address)
+        {
+            retired_.push_back(std::move(peer));
+        }
+        if (!peer)
+        {
+            peer = connect(address);
+        }
+        return peer.get();
+    }
+
+    KVStoreRPC::Stub *PeerChannelPool::get_stub(const std::string &node_name)
+    {
+        return next_stub(find(node_name));
+    }
+
+    PeerChannelPool::Peer *PeerChannelPool::find(const std::string &node_name)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = peers_.find(node_name);
+        return it == peers_.end() ? nullptr : it->second.get();
+    }
+
+    KVStoreRPC::Stub *PeerChannelPool::next_stub(Peer *peer)
+    {
+        if (peer == nullptr)
+        {
+            return nullptr;
+        }
+        size_t index = peer->next.fetch_add(1, std::memory_order_relaxed) % peer->stubs.size();
+        return peer->stubs[index].get();
+    }
+
+    void PeerChannelPool::apply_server_keepalive(grpc::ServerBuilder &builder, const ChannelOptions &options)
+    {
+        builder.AddChannelArgument(GRPC_ARG_KEEPALIVE_PERMIT_WITHOUT_CALLS, 1);
+        builder.AddChannelArgument(GRPC_ARG_HTTP2_MIN_RECV_PING_INTERVAL_WITHOUT_DATA_MS, options.keepalive_time_ms / 2);
+        builder.AddChannelArgument(GRPC_ARG_HTTP2_MAX_PING_STRIKES, 0);
+    }
+
+} // namespace kvstore
@@ -0,0 +1,218 @@
+#include "rebalancer.h"
+#include "replicator.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <map>
+
+namespace kvstore
+{
+    namespace
+    {
+        // 失败后重试的间隔
+        const std::chrono::milliseconds kRetryDelay(1000);
+    }
+
+    Rebalancer::Rebalancer(KVStore &store, Membership &membership, uint64_t bytes_per_sec, int replicas)
+        : store_(store), membership_(membership), bytes_per_sec_(bytes_per_sec), replicas_(std::max(1, std::min(replicas, kMaxReplicas)))
+    {
+    }
+
+    Rebalancer::~Rebalancer()
+    {
+        stop();
+    }
+
+    void Rebalancer::start()
+    {
+        thread_ = std::thread(&Rebalancer::loop, this);
+    }
+
+    void Rebalancer::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        if (thread_.joinable())
+        {
+            thread_.join();
+        }
+    }
+
+    void Rebalancer::notify()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_ = true;
+        }
+        cv_.notify_all();
+    }
+
+    bool Rebalancer::stopping()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stop_;
+    }
+
+    void Rebalancer::loop()
+    {
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this]()
+                         { return stop_ || pending_; });
+                if (stop_)
+                    return;
+                pending_ = false;
+            }
+            if (!run_pass())
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                // 视图又变了就立即重做，否则稍后重试
+                if (!pending_ && !cv_.wait_for(lock, kRetryDelay, [this]()
+                                               { return stop_ || pending_; }))
+                {
+                    pending_ = true;
+                }
+            }
+        }
+    }
+
+    bool Rebalancer::run_pass()
+    {
+        auto table = membership_.table();
+        if (table->routes.empty())
+        {
+            return true;
+        }
+        pass_start_ = std::chrono::steady_clock::now();
+        pass_bytes_ = 0;
+        uint64_t moved = 0;
+        bool complete = true;
+
+        for (size_t shard = 0; shard < store_.shard_count(); shard++)
+        {
+            if (stopping() || membership_.table() != table)
+            {
+                return false;
+            }
+            // 在分片锁内只收集需要处理的键和版本，值在锁外逐个读出并发送：
+            // 本节点是主副本时把键补发给新加入副本集合的节点；不再持有副本时发给整个副本集合，全部确认后删除本地副本
+            std::vector<std::pair<std::string, int64_t>> keys;
+            std::map<int, std::vector<size_t>> outgoing; // 目标节点 -> keys 中的下标
+            std::vector<size_t> dropped;
+            store_.for_each_key_in_shard(shard, [&](std::string_view key_view, int64_t version)
+                                         {
+                std::string key(key_view);
+                int ids[kMaxReplicas];
+                int count = table->ring.getNodes(key, replicas_, ids);
+                int self = -1;
+                for (int i = 0; i < count; i++)
+                {
+                    if (table->routes[ids[i]].is_self)
+                        self = i;
+                }
+                if (self > 0)
+                    return; // 备份副本由主副本负责补齐
+                int previous[kMaxReplicas];
+                int previous_count = self == 0 ? table->previous_ring.getNodes(key, replicas_, previous) : 0;
+                bool collected = false;
+                for (int i = 0; i < count; i++)
+                {
+                    const std::string &name = table->routes[ids[i]].name;
+                    if (i == self || std::any_of(previous, previous + previous_count, [&](int id)
+                                                 { return table->previous_routes[id].name == name; }))
+                        continue;
+                    if (!collected)
+                    {
+                        keys.emplace_back(std::move(key), version);
+                        collected = true;
+                    }
+                    outgoing[ids[i]].push_back(keys.size() - 1);
+                }
+                if (self < 0 && collected)
+                    dropped.push_back(keys.size() - 1); });
+
+            bool shard_complete = true;
+            for (auto &target : outgoing)
+            {
+                const Route &route = table->routes[target.first];
+                KVStoreRPC::Stub *stub = PeerChannelPool::next_stub(route.peer);
+                if (stub == nullptr || !stream(stub, keys, target.second))
+                {
+                    SPDLOG_WARN("Migrating {} keys to {} failed, will retry", target.second.size(), route.name);
+                    shard_complete = false;
+                    continue;
+                }
+                moved += target.second.size();
+            }
+            if (!shard_complete)
+            {
+                complete = false;
+                continue; // 本地副本保留到下一轮全部发送成功
+            }
+            for (size_t index : dropped)
+            {
+                store_.del_if_version(keys[index].first, keys[index].second);
+            }
+        }
+        if (moved > 0)
+        {
+            migrated_keys_.fetch_add(moved, std::memory_order_relaxed);
+            SPDLOG_INFO("Migrated {} keys for view epoch {}", moved, table->view.epoch());
+        }
+        return complete;
+    }
+
+    bool Rebalancer::stream(KVStoreRPC::Stub *stub, const std::vector<std::pair<std::string, int64_t>> &keys, const std::vector<size_t> &indexes)
+    {
+        grpc::ClientContext context;
+        MigrateResponse response;
+        auto writer = stub->Migrate(&context, &response);
+        uint64_t sent = 0;
+        for (size_t index : indexes)
+        {
+            // 发送时才读出值，同一时刻只持有一个条目；收集之后已被删除或过期的键跳过，被覆盖的键发送新值
+            ValueRef value;
+            if (!store_.peek(keys[index].first, value))
+                continue;
+            MigrateEntry entry;
+            entry.set_key(keys[index].first);
+            entry.set_value(value.data(), value.size());
+            entry.set_version(value.version());
+            entry.set_expire_at_ms(value.expire_at_ms());
+            if (!throttle(entry.key().size() + entry.value().size()))
+            {
+                context.TryCancel();
+                writer->Finish();
+                return false;
+            }
+            if (!writer->Write(entry))
+            {
+                break; // 流已断开，Finish 会给出原因
+            }
+            sent++;
+        }
+        writer->WritesDone();
+        grpc::Status status = writer->Finish();
+        return status.ok() && response.received() == sent;
+    }
+
+    bool Rebalancer::throttle(size_t bytes)
+    {
+        pass_bytes_ += bytes;
+        if (bytes_per_sec_ == 0)
+        {
+            return !stopping();
+        }
+        // 令发送进度不超过 bytes_per_sec_：已发送的字节对应的最早时刻未到就等待
+        auto due = pass_start_ + std::chrono::microseconds(pass_bytes_ * 1000000 / bytes_per_sec_);
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait_until(lock, due, [this]()
+                       { return stop_; });
+        return !stop_;
+    }
+
+} // namespace kvstore
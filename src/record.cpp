@@ -0,0 +1,358 @@
+#include "record.h"
+#include <algorithm>
+#include <new>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace kvstore
+{
+    Record *Record::create(SlabAllocator &allocator, std::string_view key, std::string &&value, int64_t version, int64_t expire_at_ms)
+    {
+        bool external = value.size() > kInlineValueLimit;
+        bool expiring = expire_at_ms != 0;
+        size_t size = sizeof(Record) + (expiring ? sizeof(int64_t) : 0) + key.size() + (external ? sizeof(std::string *) : value.size());
+        uint8_t size_class;
+        void *block = allocator.allocate(size, size_class);
+        Record *record = new (block) Record;
+        record->refs.store(1, std::memory_order_relaxed);
+        record->key_size = static_cast<uint32_t>(key.size());
+        record->value_size = static_cast<uint32_t>(value.size());
+        record->size_class = size_class;
+        record->external = external;
+        record->expiring = expiring;
+        record->spilled = false;
+        record->access.store(0, std::memory_order_relaxed);
+        record->version = version;
+        char *data = reinterpret_cast<char *>(record + 1);
+        if (expiring)
+        {
+            std::memcpy(data, &expire_at_ms, sizeof(expire_at_ms));
+            data += sizeof(expire_at_ms);
+        }
+        std::memcpy(data, key.data(), key.size());
+        if (external)
+        {
+            std::string *owned = new std::string(std::move(value));
+            std::memcpy(data + key.size(), &owned, sizeof(owned));
+        }
+        else
+        {
+            std::memcpy(data + key.size(), value.data(), value.size());
+        }
+        return record;
+    }
+
+    Record *Record::create_spilled(SlabAllocator &allocator, std::string_view key, const ValueLocator &locator, uint32_t value_size, int64_t version,
+                                   int64_t expire_at_ms)
+    {
+        bool expiring = expire_at_ms != 0;
+        size_t size = sizeof(Record) + (expiring ? sizeof(int64_t) : 0) + key.size() + sizeof(ValueLocator);
+        uint8_t size_class;
+        void *block = allocator.allocate(size, size_class);
+        Record *record = new (block) Record;
+        record->refs.store(1, std::memory_order_relaxed);
+        record->key_size = static_cast<uint32_t>(key.size());
+        record->value_size = value_size;
+        record->size_class = size_class;
+        record->external = false;
+        record->expiring = expiring;
+        record->spilled = true;
+        record->access.store(0, std::memory_order_relaxed);
+        record->version = version;
+        char *data = reinterpret_cast<char *>(record + 1);
+        if (expiring)
+        {
+            std::memcpy(data, &expire_at_ms, sizeof(expire_at_ms));
+            data += sizeof(expire_at_ms);
+        }
+        std::memcpy(data, key.data(), key.size());
+        std::memcpy(data + key.size(), &locator, sizeof(locator));
+        return record;
+    }
+
+    void Record::release(Record *record, SlabAllocator &allocator)
+    {
+        if (record->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        {
+            return;
+        }
+        if (record->external)
+        {
+            delete record->external_value();
+        }
+        size_t size = record->block_size();
+        uint8_t size_class = record->size_class;
+        record->~Record();
+        allocator.free(record, size_class, size);
+    }
+
+    namespace
+    {
+        constexpr int8_t kEmpty = -128;
+        constexpr int8_t kDeleted = -2;
+
+        // 一组控制字节上的匹配，结果为每个槽位一位的掩码
+#if defined(__AVX2__)
+        struct Group
+        {
+            static constexpr size_t kWidth = 32;
+            __m256i ctrl;
+
+            explicit Group(const int8_t *pos) : ctrl(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(pos))) {}
+            uint32_t match(int8_t h2) const { return _mm256_movemask_epi8(_mm256_cmpeq_epi8(ctrl, _mm256_set1_epi8(h2))); }
+            uint32_t match_empty() const { return match(kEmpty); }
+            uint32_t match_free() const { return _mm256_movemask_epi8(ctrl); } // 空或已删除的控制字节最高位为 1
+        };
+        const char *kProbeKind = "avx2";
+#elif defined(__SSE2__)
+        struct Group
+        {
+            static constexpr size_t kWidth = 16;
+            __m128i ctrl;
+
+            explicit Group(const int8_t *pos) : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pos))) {}
+            uint32_t match(int8_t h2) const { return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2))); }
+            uint32_t match_empty() const { return match(kEmpty); }
+            uint32_t match_free() const { return _mm_movemask_epi8(ctrl); }
+        };
+        const char *kProbeKind = "sse2";
+#else
+        struct Group
+        {
+            static constexpr size_t kWidth = 8;
+            const int8_t *ctrl;
+
+            explicit Group(const int8_t *pos) : ctrl(pos) {}
+            uint32_t match(int8_t h2) const
+            {
+                uint32_t mask = 0;
+                for (size_t i = 0; i < kWidth; i++)
+                    mask |= static_cast<uint32_t>(ctrl[i] == h2) << i;
+                return mask;
+            }
+            uint32_t match_empty() const { return match(kEmpty); }
+            uint32_t match_free() const
+            {
+                uint32_t mask = 0;
+                for (size_t i = 0; i < kWidth; i++)
+                    mask |= static_cast<uint32_t>(ctrl[i] < 0) << i;
+                return mask;
+            }
+        };
+        const char *kProbeKind = "portable";
+#endif
+
+        int8_t h2_of(uint32_t hash) { return static_cast<int8_t>(hash & 0x7f); }
+
+        // 按组做三角数探测：组数为 2 的幂时依次访问到每一组
+        struct ProbeSeq
+        {
+            size_t mask;
+            size_t group;
+            size_t step = 0;
+
+            ProbeSeq(uint32_t hash, size_t capacity) : mask(capacity / Group::kWidth - 1), group((hash >> 7) & mask) {}
+            size_t offset() const { return group * Group::kWidth; }
+            void next() { group = (group + ++step) & mask; }
+        };
+    }
+
+    const char *RecordIndex::probe_kind()
+    {
+        return kProbeKind;
+    }
+
+    RecordIndex::Table::Table(size_t slot_count) : capacity(slot_count)
+    {
+        if (capacity == 0)
+            return;
+        ctrl.reset(new int8_t[capacity]);
+        slots.reset(new Slot[capacity]);
+        std::memset(ctrl.get(), kEmpty, capacity);
+    }
+
+    size_t RecordIndex::Table::find(std::string_view key, uint32_t hash) const
+    {
+        if (used == 0)
+        {
+            return npos;
+        }
+        for (ProbeSeq seq(hash, capacity);; seq.next())
+        {
+            // 控制字节和槽位在不同的数组中，先发出槽位的预取，两次缓存未命中互相重叠
+            const char *group_slots = reinterpret_cast<const char *>(slots.get() + seq.offset());
+            for (size_t line = 0; line < Group::kWidth * sizeof(Slot); line += 64)
+                __builtin_prefetch(group_slots + line);
+            Group group(ctrl.get() + seq.offset());
+            for (uint32_t mask = group.match(h2_of(hash)); mask != 0; mask &= mask - 1)
+            {
+                size_t slot = seq.offset() + __builtin_ctz(mask);
+                if (slots[slot].hash == hash && slots[slot].record->key() == key)
+                    return slot;
+            }
+            // 探测链在第一个含空槽位的组结束
+            if (group.match_empty() != 0)
+                return npos;
+        }
+    }
+
+    size_t RecordIndex::Table::find_free(uint32_t hash) const
+    {
+        for (ProbeSeq seq(hash, capacity);; seq.next())
+        {
+            uint32_t mask = Group(ctrl.get() + seq.offset()).match_free();
+            if (mask != 0)
+                return seq.offset() + __builtin_ctz(mask);
+        }
+    }
+
+    void RecordIndex::Table::set(size_t slot, Record *record, uint32_t hash)
+    {
+        if (ctrl[slot] == kDeleted)
+            deleted--;
+        ctrl[slot] = h2_of(hash);
+        slots[slot].record = record;
+        slots[slot].hash = hash;
+        used++;
+    }
+
+    void RecordIndex::Table::clear(size_t slot)
+    {
+        // 所在组还有空槽位时，没有探测链会越过这一组，可以直接置空；否则留下墓碑
+        size_t group = slot - slot % Group::kWidth;
+        if (Group(ctrl.get() + group).match_empty() != 0)
+        {
+            ctrl[slot] = kEmpty;
+        }
+        else
+        {
+            ctrl[slot] = kDeleted;
+            deleted++;
+        }
+        used--;
+    }
+
+    size_t RecordIndex::find(std::string_view key, size_t hash) const
+    {
+        uint32_t mixed = mix(hash);
+        size_t pos = current_.find(key, mixed);
+        if (pos == npos && old_.capacity > 0)
+        {
+            pos = old_.find(key, mixed);
+            if (pos != npos)
+                pos |= kOldTable;
+        }
+        return pos;
+    }
+
+    Record *RecordIndex::replace(size_t pos, Record *record)
+    {
+        Slot &slot = table_of(pos).slots[pos & ~kOldTable];
+        Record *old = slot.record;
+        slot.record = record;
+        return old;
+    }
+
+    void RecordIndex::insert(Record *record, size_t hash)
+    {
+        if (current_.capacity == 0 || current_.full())
+        {
+            // 墓碑超过一半时按原大小重建，否则容量翻倍
+            size_t capacity = current_.capacity;
+            grow(capacity == 0 ? Group::kWidth : current_.used * 2 < capacity ? capacity : capacity * 2);
+        }
+        uint32_t mixed = mix(hash);
+        current_.set(current_.find_free(mixed), record, mixed);
+        size_++;
+        migrate(kMigrateGroups);
+    }
+
+    Record *RecordIndex::erase(size_t pos)
+    {
+        Table &table = table_of(pos);
+        Record *record = table.slots[pos & ~kOldTable].record;
+        table.clear(pos & ~kOldTable);
+        size_--;
+        migrate(kMigrateGroups);
+        return record;
+    }
+
+    size_t RecordIndex::sample(uint64_t random) const
+    {
+        if (size_ == 0)
+        {
+            return npos;
+        }
+        // 增量扩容期间按两张表中的记录数选表
+        bool old = old_.used > 0 && random % size_ < old_.used;
+        const Table &table = old ? old_ : current_;
+        size_t mask = table.capacity - 1; // 组宽和组数都是 2 的幂
+        size_t start = 0;
+        for (int probe = 0; probe < 8; probe++)
+        {
+            start = (random >> 16) & mask;
+            if (table.ctrl[start] >= 0)
+                return old ? start | kOldTable : start;
+            random = random * 6364136223846793005ull + 1442695040888963407ull; // 线性同余，得到下一个随机槽位
+        }
+        for (size_t i = 1; i < table.capacity; i++)
+        {
+            size_t slot = (start + i) & mask;
+            if (table.ctrl[slot] >= 0)
+                return old ? slot | kOldTable : slot;
+        }
+        return npos;
+    }
+
+    void RecordIndex::reserve(size_t count)
+    {
+        size_t capacity = Group::kWidth;
+        while (capacity - capacity / 8 <= count)
+        {
+            capacity *= 2;
+        }
+        if (capacity > current_.capacity)
+        {
+            grow(capacity);
+            migrate(SIZE_MAX);
+        }
+    }
+
+    void RecordIndex::grow(size_t capacity)
+    {
+        // 新表的容量足以在旧表迁移完之前容纳所有插入，上一次扩容未完成只会发生在连续重建时
+        migrate(SIZE_MAX);
+        old_ = std::move(current_);
+        current_ = Table(capacity);
+        migrated_groups_ = 0;
+    }
+
+    void RecordIndex::migrate(size_t groups)
+    {
+        if (old_.capacity == 0)
+        {
+            return;
+        }
+        size_t total = old_.capacity / Group::kWidth;
+        size_t end = groups >= total - migrated_groups_ ? total : migrated_groups_ + groups;
+        for (; migrated_groups_ < end; migrated_groups_++)
+        {
+            for (size_t slot = migrated_groups_ * Group::kWidth; slot < (migrated_groups_ + 1) * Group::kWidth; slot++)
+            {
+                if (old_.ctrl[slot] < 0)
+                    continue;
+                const Slot &entry = old_.slots[slot];
+                current_.set(current_.find_free(entry.hash), entry.record, entry.hash);
+                // 已迁移的槽位留下墓碑，经过这一组去查找旧表中后续组的探测链不会中断
+                old_.ctrl[slot] = kDeleted;
+                old_.used--;
+                old_.deleted++;
+            }
+        }
+        if (migrated_groups_ == total)
+        {
+            old_ = Table();
+        }
+    }
+}
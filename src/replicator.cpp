@@ -0,0 +1,126 @@
+#include "replicator.h"
+#include <spdlog/spdlog.h>
+
+namespace kvstore
+{
+    namespace
+    {
+        // 一次发往备份副本的写入，完成后由轮询线程销毁
+        struct ReplicaCall
+        {
+            grpc::ClientContext context;
+            ReplicateResponse response;
+            grpc::Status status;
+            std::unique_ptr<grpc::ClientAsyncResponseReader<ReplicateResponse>> reader;
+            std::shared_ptr<AckCounter> acks;
+        };
+    }
+
+    void ReplicaReads::merge(const grpc::Status &status, GetResponse &reply)
+    {
+        if (!status.ok() && status.error_code() != grpc::StatusCode::NOT_FOUND)
+            return;
+        responded_++;
+        if (status.ok() && reply.found() && (!found_ || reply.version() > response_->version()))
+        {
+            response_->Swap(&reply);
+            found_ = true;
+        }
+    }
+
+    void ReplicaReads::start(const std::function<void *(Read *)> &tag)
+    {
+        if (responded_ >= quorum_)
+            return;
+        // 所有副本同时读取，凑够 quorum 个响应即可返回
+        for (auto &read : reads_)
+        {
+            read->reader->StartCall();
+            read->reader->Finish(&read->response, &read->status, tag(read.get()));
+            pending_++;
+        }
+    }
+
+    bool ReplicaReads::complete(Read *read)
+    {
+        pending_--;
+        bool reached = responded_ >= quorum_;
+        merge(read->status, read->response);
+        if (!reached && responded_ >= quorum_ && pending_ > 0)
+        {
+            // 其余读取取消后很快完成，调用方仍要等到它们的事件全部到达
+            for (auto &other : reads_)
+            {
+                other->context.TryCancel();
+            }
+        }
+        return pending_ == 0;
+    }
+
+    grpc::Status ReplicaReads::result()
+    {
+        if (quorum_ == 0 || responded_ < quorum_)
+        {
+            response_->set_found(false);
+            return grpc::Status(grpc::StatusCode::UNAVAILABLE, "Read quorum not reached");
+        }
+        if (!found_)
+        {
+            response_->set_found(false);
+            return grpc::Status(grpc::StatusCode::NOT_FOUND, "Key not found");
+        }
+        return grpc::Status::OK;
+    }
+
+    Replicator::Replicator(int timeout_ms) : timeout_ms_(timeout_ms)
+    {
+    }
+
+    Replicator::~Replicator()
+    {
+        stop();
+    }
+
+    void Replicator::start()
+    {
+        thread_ = std::thread(&Replicator::poll, this);
+    }
+
+    void Replicator::stop()
+    {
+        if (thread_.joinable())
+        {
+            cq_.Shutdown();
+            thread_.join();
+        }
+    }
+
+    void Replicator::send(KVStoreRPC::Stub *stub, const ReplicateRequest &request, const std::shared_ptr<AckCounter> &acks)
+    {
+        auto *call = new ReplicaCall();
+        call->acks = acks;
+        call->context.set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(timeout_ms_));
+        call->reader = stub->PrepareAsyncReplicate(&call->context, request, &cq_);
+        call->reader->StartCall();
+        call->reader->Finish(&call->response, &call->status, call);
+    }
+
+    void Replicator::poll()
+    {
+        void *tag;
+        bool ok;
+        while (cq_.Next(&tag, &ok))
+        {
+            auto *call = static_cast<ReplicaCall *>(tag);
+            // 副本已有更新的版本同样算作确认：更新的写入会由它自己的主副本保证复制
+            if (!call->status.ok())
+            {
+                failures_.fetch_add(1, std::memory_order_relaxed);
+                SPDLOG_DEBUG("Replicate failed: {}", call->status.error_message());
+            }
+            call->acks->complete(call->status.ok());
+            delete call;
+        }
+    }
+
+} // namespace kvstore
@@ -1,73 +1,718 @@
 #include "server.h"
 #include <spdlog/spdlog.h>
+#include <map>
 
 namespace kvstore
 {
-
-    KVStoreServiceImpl::KVStoreServiceImpl(const NodeInfo &node_info, const std::vector<NodeInfo> &nodes_map) : store_(node_info), nodes_map_(nodes_map)
+    namespace
     {
-        for (auto i = nodes_map_.begin(); i != nodes_map_.end(); i++)
+        // 迁移期间向上一任负责节点回读/删除的超时
+        const int kPreviousOwnerTimeoutMs = 500;
+
+        // 转发失败时返回给调用方的状态。UNAVAILABLE（负责节点不可达）原样返回，客户端据此改试其他节点；
+        // DEADLINE_EXCEEDED（写 quorum 不足或转发超时，写入可能已经生效）也原样返回，客户端不能改试其他节点重发
+        grpc::Status forward_failure(const grpc::Status &status)
+        {
+            if (status.error_code() == grpc::StatusCode::UNAVAILABLE || status.error_code() == grpc::StatusCode::DEADLINE_EXCEEDED)
+                return status;
+            return grpc::Status(grpc::StatusCode::INTERNAL, "Forwarding request failed");
+        }
+
+        const uint32_t kDefaultScanLimit = 1000;
+        const uint32_t kMaxScanLimit = 100000;
+        // 扫描结果按块流式发送，每块至多这么多条目或字节，服务端同时持有的数据不超过一块
+        const size_t kScanChunkEntries = 256;
+        const size_t kScanChunkBytes = 1 << 20;
+
+        // 紧跟在 key 之后的最小键，作为下一页的起点
+        std::string key_after(const std::string &key)
+        {
+            std::string next = key;
+            next.push_back('\0');
+            return next;
+        }
+
+        // 带 prefix 前缀的键的上界（不含）：去掉末尾的 0xff 后把最后一个字节加一，前缀全为 0xff 时没有上界
+        std::string prefix_end(std::string prefix)
+        {
+            while (!prefix.empty() && static_cast<unsigned char>(prefix.back()) == 0xff)
+            {
+                prefix.pop_back();
+            }
+            if (!prefix.empty())
+            {
+                prefix.back() = static_cast<char>(static_cast<unsigned char>(prefix.back()) + 1);
+            }
+            return prefix;
+        }
+
+        // 归并扫描的一路输入，按键的顺序逐项取出
+        class ScanSource
+        {
+        public:
+            virtual ~ScanSource() = default;
+            // 当前项，没有更多项时返回 nullptr
+            virtual ScanEntry *peek() = 0;
+            void pop() { index_++; }
+            // 本页之后这一路是否还有数据
+            virtual bool has_more() = 0;
+            virtual grpc::Status status() const { return grpc::Status::OK; }
+
+        protected:
+            ScanResponse chunk_;
+            int index_ = 0;
+        };
+
+        // 本节点的存储，每次取一块
+        class LocalScan final : public ScanSource
+        {
+        public:
+            LocalScan(KVStore &store, std::string start, std::string end, size_t batch)
+                : store_(store), start_(std::move(start)), end_(std::move(end)), batch_(batch) {}
+
+            ScanEntry *peek() override
+            {
+                if (index_ == chunk_.entries_size() && !exhausted_)
+                {
+                    refill();
+                }
+                return index_ < chunk_.entries_size() ? chunk_.mutable_entries(index_) : nullptr;
+            }
+
+            bool has_more() override { return peek() != nullptr; }
+
+        private:
+            void refill()
+            {
+                std::vector<ValueRef> refs;
+                store_.scan(start_, end_, batch_, refs);
+                chunk_.Clear();
+                index_ = 0;
+                for (const ValueRef &ref : refs)
+                {
+                    ScanEntry *entry = chunk_.add_entries();
+                    entry->set_key(ref.key().data(), ref.key().size());
+                    entry->set_value(ref.data(), ref.size());
+                    entry->set_version(ref.version());
+                }
+                exhausted_ = refs.size() < batch_;
+                if (!refs.empty())
+                {
+                    start_ = key_after(chunk_.entries(chunk_.entries_size() - 1).key());
+                }
+            }
+
+            KVStore &store_;
+            std::string start_;
+            std::string end_;
+            size_t batch_;
+            bool exhausted_ = false;
+        };
+
+        // 另一个节点上的本地扫描，请求发出后对端立即开始扫描并推送，各节点并行
+        class RemoteScan final : public ScanSource
         {
-            hash_ring_.addNode(i->get_name());
+        public:
+            RemoteScan(KVStoreRPC::Stub *stub, const grpc::ServerContext &server_context, const ScanRequest &request, const std::string &node)
+                : context_(grpc::ClientContext::FromServerContext(server_context)), reader_(stub->Scan(context_.get(), request)), node_(node) {}
+
+            ~RemoteScan() override
+            {
+                if (!finished_)
+                {
+                    context_->TryCancel();
+                    reader_->Finish();
+                }
+            }
+
+            ScanEntry *peek() override
+            {
+                while (index_ == chunk_.entries_size() && !finished_)
+                {
+                    chunk_.clear_entries();
+                    index_ = 0;
+                    if (!reader_->Read(&chunk_))
+                    {
+                        finished_ = true;
+                        status_ = reader_->Finish();
+                        if (!status_.ok())
+                        {
+                            SPDLOG_WARN("Scan on node {} failed: {}", node_, status_.error_message());
+                            status_ = grpc::Status(grpc::StatusCode::UNAVAILABLE, "Scan on node " + node_ + " failed");
+                        }
+                    }
+                    else if (!chunk_.continuation().empty())
+                    {
+                        truncated_ = true;
+                    }
+                }
+                return index_ < chunk_.entries_size() ? chunk_.mutable_entries(index_) : nullptr;
+            }
+
+            bool has_more() override { return peek() != nullptr || truncated_; }
+            grpc::Status status() const override { return status_; }
+
+        private:
+            std::unique_ptr<grpc::ClientContext> context_;
+            std::unique_ptr<grpc::ClientReader<ScanResponse>> reader_;
+            std::string node_;
+            bool finished_ = false;
+            bool truncated_ = false; // 对端的一页已满，之后还有数据
+            grpc::Status status_;
+        };
+
+        ReplicationOptions normalized(ReplicationOptions options)
+        {
+            options.replicas = std::max(1, std::min(options.replicas, kMaxReplicas));
+            options.write_quorum = std::max(1, std::min(options.write_quorum, options.replicas));
+            options.read_quorum = std::max(1, std::min(options.read_quorum, options.replicas));
+            return options;
+        }
+
+        // 发往一个远端节点的子批量请求
+        template <typename Request, typename Response>
+        struct SubBatch
+        {
+            std::vector<int> indexes; // 子请求中第 j 项在原请求中的位置
+            Request request;
+            Response response;
+            grpc::ClientContext context;
+            grpc::Status status;
+            std::unique_ptr<grpc::ClientAsyncResponseReader<Response>> reader;
+        };
+
+        // 按负责节点拆分批量请求：本节点负责的项调用 local(i) 直接处理，
+        // 其余项用 add 按节点组成子请求，通过 call 并行发出后把子响应的第 j 项结果换回原位置 i。
+        // 每项的结果互不影响：处理失败的项（本地出错、负责节点未知或子请求失败）在自己的结果中记下错误码，其余各项照常完成。
+        // 子请求在 deadline 之前没有响应时按失败处理，不会因为一个节点无响应而一直等待
+        template <typename Request, typename Response, typename Local, typename Add, typename Call>
+        void fan_out(const std::vector<Route> &routes, const std::vector<int> &owners, Response *response,
+                     std::chrono::system_clock::time_point deadline, Local local, Add add, Call call)
+        {
+            auto fail = [response](int i, const grpc::Status &status)
+            { response->mutable_results(i)->set_error_code(status.error_code()); };
+            std::map<int, SubBatch<Request, Response>> batches;
+            for (size_t i = 0; i < owners.size(); i++)
+            {
+                if (owners[i] >= 0 && routes[owners[i]].is_self)
+                {
+                    grpc::Status status = local(i);
+                    if (!status.ok())
+                        fail(i, status);
+                    continue;
+                }
+                auto &batch = batches[owners[i]];
+                batch.indexes.push_back(i);
+                add(batch.request, i);
+            }
+
+            // 所有子请求同时发出，总耗时取决于最慢的节点而不是节点数之和
+            grpc::CompletionQueue cq;
+            size_t sent = 0;
+            for (auto &entry : batches)
+            {
+                SubBatch<Request, Response> &batch = entry.second;
+                KVStoreRPC::Stub *stub = entry.first < 0 ? nullptr : PeerChannelPool::next_stub(routes[entry.first].peer);
+                if (stub == nullptr)
+                {
+                    batch.status = grpc::Status(grpc::StatusCode::UNAVAILABLE, "Target node not found");
+                    continue;
+                }
+                batch.context.set_deadline(deadline);
+                batch.reader = call(stub, &batch.context, batch.request, &cq);
+                batch.reader->Finish(&batch.response, &batch.status, &batch);
+                sent++;
+            }
+            void *tag;
+            bool ok;
+            for (size_t n = 0; n < sent; n++)
+            {
+                cq.Next(&tag, &ok);
+            }
+            cq.Shutdown();
+            while (cq.Next(&tag, &ok))
+            {
+            }
+
+            for (auto &entry : batches)
+            {
+                SubBatch<Request, Response> &batch = entry.second;
+                bool complete = batch.status.ok() && batch.response.results_size() == static_cast<int>(batch.indexes.size());
+                for (size_t j = 0; j < batch.indexes.size(); j++)
+                {
+                    if (complete)
+                        response->mutable_results(batch.indexes[j])->Swap(batch.response.mutable_results(j));
+                    else
+                        fail(batch.indexes[j], batch.status.ok() ? grpc::Status(grpc::StatusCode::INTERNAL, "Malformed batch response") : batch.status);
+                }
+            }
         }
     }
 
+    KVStoreServiceImpl::KVStoreServiceImpl(const NodeInfo &node_info, const std::vector<NodeInfo> &nodes_map, const ChannelOptions &channel_options, const KVStoreOptions &store_options, const MembershipOptions &membership_options, const ReplicationOptions &replication_options, const LeaseOptions &lease_options)
+        : store_(node_info, store_options), nodes_map_(nodes_map), peers_(nodes_map, node_info.get_name(), channel_options),
+          membership_(node_info, nodes_map, peers_, membership_options, [this]()
+                      {
+                          rebalancer_.notify();
+                          leases_.revoke_all();
+                      }),
+          rebalancer_(store_, membership_, membership_options.migration_bytes_per_sec, normalized(replication_options).replicas),
+          replication_(normalized(replication_options)), replicator_(replication_.replica_timeout_ms), leases_(lease_options),
+          forward_timeout_ms_(channel_options.forward_timeout_ms)
+    {
+        replicator_.start();
+        membership_.start();
+        rebalancer_.start();
+    }
+
     KVStoreServiceImpl::~KVStoreServiceImpl()
     {
+        membership_.stop();
+        rebalancer_.stop();
+        replicator_.stop();
+        leases_.shutdown();
     }
 
-    grpc::Status KVStoreServiceImpl::Put(grpc::ServerContext *context, const kvstore::PutRequest *request, kvstore::PutResponse *response)
+    void KVStoreServiceImpl::shutdown()
     {
-        // std::lock_guard<std::mutex> lock(store_mutex);
-        std::string node = hash_ring_.getNode(request->key());
-        // 如果当前节点负责存储
-        if (node == store_.get_nodeinfo().get_name())
+        leases_.shutdown();
+    }
+
+    KVStoreRPC::Stub *KVStoreServiceImpl::route(const std::string &key, bool &local)
+    {
+        auto table = membership_.table();
+        const Route *target = table->owner(key);
+        if (target == nullptr)
+        {
+            local = false;
+            return nullptr;
+        }
+        local = target->is_self;
+        return local ? nullptr : PeerChannelPool::next_stub(target->peer);
+    }
+
+    std::chrono::system_clock::time_point KVStoreServiceImpl::forward_deadline(const grpc::ServerContext &context) const
+    {
+        // 没有截止时间的调用 deadline() 为 time_point::max()
+        if (context.deadline() != std::chrono::system_clock::time_point::max())
+        {
+            return context.deadline();
+        }
+        return std::chrono::system_clock::now() + std::chrono::milliseconds(forward_timeout_ms_);
+    }
+
+    grpc::Status KVStoreServiceImpl::put_local(const PutRequest &request, std::string value, PutResponse *response, ValueRef *written, std::shared_ptr<AckCounter> *flush)
+    {
+        if (request.ttl_ms() < 0)
+        {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "ttl_ms must not be negative");
+        }
+        PutResult result;
+        // 相对的 TTL 在主副本上换算成绝对过期时间，副本和迁移都沿用这个时间
+        int64_t expire_at_ms = request.ttl_ms() > 0 ? wall_clock_ms() + request.ttl_ms() : 0;
+        try
         {
-            int64_t current_version = store_.getVersion(request->key());
-            if (request->version() > current_version)
+            result = request.assign_version() ? store_.put_next_version(request.key(), std::move(value), written, expire_at_ms)
+                                              : store_.put_if_newer(request.key(), std::move(value), request.version(), written, expire_at_ms);
+        }
+        catch (const MemoryLimitExceeded &e)
+        {
+            // 内存达到上限且没有可淘汰的键，客户端可以在删除一些键后重试
+            return grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED, e.what());
+        }
+        catch (const std::exception &e)
+        {
+            SPDLOG_ERROR("Put {} failed: {}", request.key(), e.what());
+            return grpc::Status(grpc::StatusCode::INTERNAL, e.what());
+        }
+        if (result.applied)
+        {
+            invalidate(request.key(), flush);
+            response->set_version(result.current_version);
+            response->set_success(true);
+        }
+        else
+        {
+            response->set_version(result.current_version + 1);
+            // SPDLOG_INFO("Version: {}", response->version());
+            response->set_success(false);
+        }
+        return grpc::Status::OK;
+    }
+
+    grpc::Status KVStoreServiceImpl::get_local(const GetRequest &request, GetResponse *response)
+    {
+        ValueRef value;
+        int64_t version;
+
+        if (store_.get(request.key(), value, version))
+        {
+            // 在分片锁外从记录复制到响应，这是值在读路径上唯一的一次复制
+            response->set_value(value.data(), value.size());
+            response->set_version(version);
+            // SPDLOG_INFO("Version: {}", version);
+            response->set_found(true);
+            if (value.expire_at_ms() != 0)
             {
-                store_.put(request->key(), request->value(), request->version());
-                response->set_version(request->version());
-                response->set_success(true);
+                response->set_ttl_ms(std::max<int64_t>(1, value.expire_at_ms() - wall_clock_ms()));
             }
-            else
+            return grpc::Status::OK;
+        }
+        response->set_found(false);
+        return grpc::Status(grpc::StatusCode::NOT_FOUND, "Key not found");
+    }
+
+    grpc::Status KVStoreServiceImpl::del_local(const DeleteRequest &request, DeleteResponse *response, int64_t *deleted_version, std::shared_ptr<AckCounter> *flush)
+    {
+        bool deleted;
+        try
+        {
+            deleted = store_.del(request.key(), deleted_version);
+        }
+        catch (const std::exception &e)
+        {
+            SPDLOG_ERROR("Del {} failed: {}", request.key(), e.what());
+            return grpc::Status(grpc::StatusCode::INTERNAL, e.what());
+        }
+        response->set_success(deleted);
+        if (!deleted)
+        {
+            return grpc::Status(grpc::StatusCode::NOT_FOUND, "Key not found");
+        }
+        invalidate(request.key(), flush);
+        return grpc::Status::OK;
+    }
+
+    void KVStoreServiceImpl::invalidate(const std::string &key, std::shared_ptr<AckCounter> *flush)
+    {
+        std::shared_ptr<AckCounter> notified = leases_.invalidate(key);
+        if (flush != nullptr)
+        {
+            *flush = std::move(notified);
+        }
+        else if (notified)
+        {
+            notified->wait();
+        }
+    }
+
+    grpc::Status KVStoreServiceImpl::get_owned(const GetRequest &request, GetResponse *response)
+    {
+        KVStoreRPC::Stub *previous = nullptr;
+        grpc::Status status = start_get_owned(request, response, &previous);
+        if (previous == nullptr)
+        {
+            return status;
+        }
+        grpc::ClientContext context;
+        context.set_deadline(previous_owner_deadline());
+        grpc::Status previous_status = previous->Get(&context, previous_request(request), response);
+        return finish_get_owned(status, previous_status, response);
+    }
+
+    grpc::Status KVStoreServiceImpl::del_owned(const DeleteRequest &request, DeleteResponse *response, int64_t *deleted_version)
+    {
+        KVStoreRPC::Stub *previous = nullptr;
+        grpc::Status status = start_del_owned(request, response, deleted_version, &previous);
+        if (previous == nullptr)
+        {
+            return status;
+        }
+        DeleteResponse previous_response;
+        grpc::ClientContext context;
+        context.set_deadline(previous_owner_deadline());
+        grpc::Status previous_status = previous->Del(&context, previous_request(request), &previous_response);
+        return finish_del_owned(status, previous_status, previous_response, response, deleted_version);
+    }
+
+    grpc::Status KVStoreServiceImpl::start_get_owned(const GetRequest &request, GetResponse *response, KVStoreRPC::Stub **previous)
+    {
+        int64_t lease_ms = leases_.grant(request.client_id(), request.key());
+        grpc::Status status = get_local(request, response);
+        if (status.error_code() != grpc::StatusCode::NOT_FOUND)
+        {
+            if (status.ok())
             {
-                response->set_version(store_.getVersion(request->key()) + 1);
-                // SPDLOG_INFO("Version: {}", response->version());
-                response->set_success(false);
+                // 租约不超过键的剩余存活时间，客户端缓存不会返回已经过期的值
+                response->set_lease_ms(response->ttl_ms() > 0 ? std::min(lease_ms, response->ttl_ms()) : lease_ms);
             }
+            return status;
+        }
+        // 键可能还没从上一任负责节点迁移过来
+        *previous = previous_owner(request.key());
+        return status;
+    }
+
+    grpc::Status KVStoreServiceImpl::finish_get_owned(const grpc::Status &status, const grpc::Status &previous_status, GetResponse *response)
+    {
+        if (previous_status.ok() && response->found())
+        {
             return grpc::Status::OK;
         }
-        // 如果当前节点不负责存储，则转发请求给其他节点
-        std::string target_address; // 使用 node_map 查询目标节点的地址
-        for (auto i = nodes_map_.begin(); i != nodes_map_.end(); i++)
+        response->set_found(false);
+        return status;
+    }
+
+    grpc::Status KVStoreServiceImpl::start_del_owned(const DeleteRequest &request, DeleteResponse *response, int64_t *deleted_version, KVStoreRPC::Stub **previous,
+                                                     std::shared_ptr<AckCounter> *flush)
+    {
+        grpc::Status status = del_local(request, response, deleted_version, flush);
+        if (!status.ok() && status.error_code() != grpc::StatusCode::NOT_FOUND)
+        {
+            return status;
+        }
+        // 上一任负责节点上尚未迁移的副本也要删掉，否则迁移过来后键会重新出现
+        *previous = previous_owner(request.key());
+        return status;
+    }
+
+    grpc::Status KVStoreServiceImpl::finish_del_owned(const grpc::Status &status, const grpc::Status &previous_status, const DeleteResponse &previous_response,
+                                                      DeleteResponse *response, int64_t *deleted_version)
+    {
+        if (previous_status.ok() && previous_response.success())
         {
-            if (i->get_name() == node)
+            response->set_success(true);
+            if (deleted_version != nullptr)
             {
-                target_address = i->get_address();
+                *deleted_version = INT64_MAX; // 版本未知，副本上的旧值一并删除
             }
+            return grpc::Status::OK;
         }
-        if (target_address.empty())
+        return status;
+    }
+
+    KVStoreRPC::Stub *KVStoreServiceImpl::previous_owner(const std::string &key)
+    {
+        auto table = membership_.table();
+        const Route *previous = table->previous_owner(key);
+        return previous == nullptr || previous->is_self ? nullptr : PeerChannelPool::next_stub(previous->peer);
+    }
+
+    std::chrono::system_clock::time_point KVStoreServiceImpl::previous_owner_deadline()
+    {
+        return std::chrono::system_clock::now() + std::chrono::milliseconds(kPreviousOwnerTimeoutMs);
+    }
+
+    std::shared_ptr<AckCounter> KVStoreServiceImpl::replicate(const ReplicateRequest &request, int write_quorum)
+    {
+        int quorum = write_quorum > 0 ? std::min(write_quorum, replication_.replicas) : replication_.write_quorum;
+        auto deadline = AckCounter::Clock::now() + std::chrono::milliseconds(replication_.replica_timeout_ms);
+        if (replication_.replicas <= 1)
         {
-            // 如果没有找到目标节点的地址，返回错误
-            return grpc::Status(grpc::StatusCode::NOT_FOUND, "Target node not found");
+            return std::make_shared<AckCounter>(quorum - 1, 0, deadline);
         }
+        auto table = membership_.table();
+        int ids[kMaxReplicas];
+        int count = table->ring.getNodes(request.key(), replication_.replicas, ids);
+        // 集群节点数少于副本数时，quorum 以实际副本数为上限
+        quorum = std::min(quorum, count);
+        std::vector<KVStoreRPC::Stub *> stubs;
+        for (int i = 0; i < count; i++)
+        {
+            const Route &route = table->routes[ids[i]];
+            KVStoreRPC::Stub *stub = route.is_self ? nullptr : PeerChannelPool::next_stub(route.peer);
+            if (stub != nullptr)
+            {
+                stubs.push_back(stub);
+            }
+        }
+        auto acks = std::make_shared<AckCounter>(quorum - 1, static_cast<int>(stubs.size()), deadline);
+        for (auto *stub : stubs)
+        {
+            replicator_.send(stub, request, acks);
+        }
+        return acks;
+    }
 
-        // 创建 gRPC 客户端来转发请求
-        auto channel = grpc::CreateChannel(target_address, grpc::InsecureChannelCredentials());
-        kvstore::KVStoreRPC::Stub stub(channel);
+    grpc::Status KVStoreServiceImpl::quorum_status(bool acked)
+    {
+        if (!acked)
+        {
+            // 主副本上的写入已经生效，未确认的副本会在恢复后由再平衡补齐。
+            // 不能返回 UNAVAILABLE：客户端会改发其他节点，重发的写入会再次分配版本或得到版本冲突
+            return grpc::Status(grpc::StatusCode::DEADLINE_EXCEEDED, "Write applied but write quorum not reached");
+        }
+        return grpc::Status::OK;
+    }
 
-        // 构建转发请求
-        kvstore::PutRequest forward_request;
-        forward_request.set_key(request->key());
-        forward_request.set_value(request->value());
-        forward_request.set_version(request->version());
+    grpc::Status KVStoreServiceImpl::wait_quorum(AckCounter &acks)
+    {
+        return quorum_status(acks.wait());
+    }
+
+    grpc::Status KVStoreServiceImpl::start_put_primary(const PutRequest &request, std::string value, PutResponse *response, std::shared_ptr<AckCounter> *acks,
+                                                       std::shared_ptr<AckCounter> *flush)
+    {
+        ValueRef written;
+        grpc::Status status = put_local(request, std::move(value), response, &written, flush);
+        // 没有备份副本时不构造复制请求，省去一次值的复制
+        if (!status.ok() || !response->success() || replication_.replicas <= 1)
+        {
+            return status;
+        }
+        ReplicateRequest replica_request;
+        replica_request.set_key(request.key());
+        replica_request.set_value(written.data(), written.size());
+        // 由主副本分配版本时请求中的版本无意义，副本使用实际写入的版本
+        replica_request.set_version(response->version());
+        replica_request.set_expire_at_ms(written.expire_at_ms());
+        *acks = replicate(replica_request, request.write_quorum());
+        return status;
+    }
+
+    std::shared_ptr<AckCounter> KVStoreServiceImpl::replicate_delete(const DeleteRequest &request, int64_t deleted_version)
+    {
+        ReplicateRequest replica_request;
+        replica_request.set_key(request.key());
+        replica_request.set_version(deleted_version);
+        replica_request.set_deleted(true);
+        return replicate(replica_request, request.write_quorum());
+    }
+
+    grpc::Status KVStoreServiceImpl::put_primary(const PutRequest &request, std::string value, PutResponse *response)
+    {
+        std::shared_ptr<AckCounter> acks;
+        std::shared_ptr<AckCounter> flush;
+        grpc::Status status = start_put_primary(request, std::move(value), response, &acks, &flush);
+        if (flush)
+        {
+            flush->wait();
+        }
+        return acks ? wait_quorum(*acks) : status;
+    }
+
+    grpc::Status KVStoreServiceImpl::del_primary(const DeleteRequest &request, DeleteResponse *response)
+    {
+        int64_t deleted_version = 0;
+        grpc::Status status = del_owned(request, response, &deleted_version);
+        if (!status.ok())
+        {
+            return status;
+        }
+        return wait_quorum(*replicate_delete(request, deleted_version));
+    }
+
+    bool KVStoreServiceImpl::read_here(const GetRequest &request, GetResponse *response, grpc::Status *status)
+    {
+        int quorum = read_quorum(request);
+        if (quorum > 1)
+        {
+            *status = read_replicas(request, quorum, false, response);
+            return true;
+        }
+        return read_stale(request, response, status);
+    }
+
+    int KVStoreServiceImpl::read_quorum(const GetRequest &request) const
+    {
+        return request.read_quorum() > 0 ? std::min(request.read_quorum(), replication_.replicas) : replication_.read_quorum;
+    }
+
+    bool KVStoreServiceImpl::read_stale(const GetRequest &request, GetResponse *response, grpc::Status *status)
+    {
+        if (replication_.replicas <= 1 || !(request.allow_stale() || replication_.stale_reads))
+        {
+            return false;
+        }
+        // 本节点是备份副本时直接读本地；本地没有（复制尚未到达或迁移未完成）时仍交给主副本
+        auto table = membership_.table();
+        int ids[kMaxReplicas];
+        int count = table->ring.getNodes(request.key(), replication_.replicas, ids);
+        for (int i = 1; i < count; i++)
+        {
+            if (table->routes[ids[i]].is_self)
+            {
+                *status = get_local(request, response);
+                return status->ok();
+            }
+        }
+        return false;
+    }
+
+    void KVStoreServiceImpl::prepare_reads(const GetRequest &request, int quorum, bool skip_primary, grpc::CompletionQueue *cq, ReplicaReads &reads)
+    {
+        auto table = membership_.table();
+        int ids[kMaxReplicas];
+        int count = table->ring.getNodes(request.key(), replication_.replicas, ids);
+        GetRequest replica_request;
+        replica_request.set_key(request.key());
+        replica_request.set_local_only(true);
+        int replicas = 0;
+        for (int i = skip_primary ? 1 : 0; i < count; i++)
+        {
+            replicas++;
+            const Route &route = table->routes[ids[i]];
+            if (route.is_self)
+            {
+                GetResponse reply;
+                reads.merge(get_local(replica_request, &reply), reply);
+                continue;
+            }
+            KVStoreRPC::Stub *stub = PeerChannelPool::next_stub(route.peer);
+            if (stub == nullptr)
+                continue;
+            auto read = std::make_unique<ReplicaReads::Read>();
+            read->context.set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(replication_.replica_timeout_ms));
+            read->reader = stub->PrepareAsyncGet(&read->context, replica_request, cq);
+            reads.add(std::move(read));
+        }
+        reads.set_quorum(quorum, replicas);
+    }
+
+    grpc::Status KVStoreServiceImpl::read_replicas(const GetRequest &request, int quorum, bool skip_primary, GetResponse *response)
+    {
+        grpc::CompletionQueue cq;
+        ReplicaReads reads(response);
+        prepare_reads(request, quorum, skip_primary, &cq, reads);
+        reads.start([](ReplicaReads::Read *read)
+                    { return read; });
+        void *tag;
+        bool ok;
+        while (!reads.finished() && cq.Next(&tag, &ok))
+        {
+            reads.complete(static_cast<ReplicaReads::Read *>(tag));
+        }
+        cq.Shutdown();
+        while (cq.Next(&tag, &ok))
+        {
+        }
+        return reads.result();
+    }
+
+    bool KVStoreServiceImpl::read_backup(const GetRequest &request, GetResponse *response, grpc::Status *status)
+    {
+        if (replication_.replicas <= 1)
+        {
+            return false;
+        }
+        *status = read_replicas(request, 1, true, response);
+        return status->ok() || status->error_code() == grpc::StatusCode::NOT_FOUND;
+    }
+
+    grpc::Status KVStoreServiceImpl::Put(grpc::ServerContext *context, const kvstore::PutRequest *request, kvstore::PutResponse *response)
+    {
+        // std::lock_guard<std::mutex> lock(store_mutex);
+        bool local;
+        KVStoreRPC::Stub *stub = route(request->key(), local);
+        // 如果当前节点负责存储
+        if (local)
+        {
+            // 同步接口的请求不可修改，只把值复制一次交给存储；异步服务端直接移出调用自己持有的请求中的值，不复制
+            return put_primary(*request, request->value(), response);
+        }
+        // 如果当前节点不负责存储，则通过连接池转发请求给其他节点
+        if (stub == nullptr)
+        {
+            // 如果没有找到目标节点，返回错误
+            return grpc::Status(grpc::StatusCode::NOT_FOUND, "Target node not found");
+        }
 
         kvstore::PutResponse forward_response;
         grpc::ClientContext client_context;
+        client_context.set_deadline(forward_deadline(*context));
 
-        // 转发请求给目标节点
-        grpc::Status status = stub.Put(&client_context, forward_request, &forward_response);
+        // 原样转发收到的请求，不复制值
+        grpc::Status status = stub->Put(&client_context, *request, &forward_response);
 
         if (status.ok())
         {
@@ -85,7 +730,7 @@ namespace kvstore
         else
         {
             // 转发失败，返回错误
-            return grpc::Status(grpc::StatusCode::INTERNAL, "Forwarding request failed");
+            return forward_failure(status);
         }
         return grpc::Status::OK;
     }
@@ -93,61 +738,44 @@ namespace kvstore
     grpc::Status KVStoreServiceImpl::Get(grpc::ServerContext *context, const kvstore::GetRequest *request, kvstore::GetResponse *response)
     {
         // std::lock_guard<std::mutex> lock(store_mutex);
-        std::string node = hash_ring_.getNode(request->key());
-        if (node == store_.get_nodeinfo().get_name())
+        if (request->local_only())
         {
-            std::string value;
-            int64_t version;
-
-            if (store_.get(request->key(), value, version))
-            {
-                response->set_value(value);
-                response->set_version(version);
-                // SPDLOG_INFO("Version: {}", version);
-                response->set_found(true);
-            }
-            else
-            {
-                response->set_found(false);
-                return grpc::Status(grpc::StatusCode::NOT_FOUND, "Key not found");
-            }
-            return grpc::Status::OK;
+            return get_local(*request, response);
         }
-        // 如果当前节点不负责存储，则转发请求给其他节点
-        std::string target_address; // 使用 node_map 查询目标节点的地址
-        for (auto i = nodes_map_.begin(); i != nodes_map_.end(); i++)
+        grpc::Status replica_status;
+        if (read_here(*request, response, &replica_status))
         {
-            if (i->get_name() == node)
-            {
-                target_address = i->get_address();
-            }
+            return replica_status;
+        }
+        bool local;
+        KVStoreRPC::Stub *stub = route(request->key(), local);
+        if (local)
+        {
+            return get_owned(*request, response);
         }
-        if (target_address.empty())
+        // 如果当前节点不负责存储，则通过连接池转发请求给其他节点
+        if (stub == nullptr)
         {
-            // 如果没有找到目标节点的地址，返回错误
+            // 如果没有找到目标节点，返回错误
             return grpc::Status(grpc::StatusCode::NOT_FOUND, "Target node not found");
         }
 
-        // 创建 gRPC 客户端来转发请求
-        auto channel = grpc::CreateChannel(target_address, grpc::InsecureChannelCredentials());
-        kvstore::KVStoreRPC::Stub stub(channel);
-
         // 构建转发请求
         kvstore::GetRequest forward_request;
         forward_request.set_key(request->key());
+        forward_request.set_client_id(request->client_id());
 
         kvstore::GetResponse forward_response;
         grpc::ClientContext client_context;
+        client_context.set_deadline(forward_deadline(*context));
 
         // 转发请求给目标节点
-        grpc::Status status = stub.Get(&client_context, forward_request, &forward_response);
+        grpc::Status status = stub->Get(&client_context, forward_request, &forward_response);
 
         if (status.ok() && forward_response.found())
         {
-            response->set_value(forward_response.value());
-            // SPDLOG_INFO("Forward Version {}", forward_response.version());
-            response->set_version(forward_response.version());
-            response->set_found(true);
+            // 交换两个消息的内容，值不复制
+            response->Swap(&forward_response);
             return grpc::Status::OK;
         }
         else
@@ -156,55 +784,44 @@ namespace kvstore
             response->set_found(false);
             if (status.error_code() == grpc::StatusCode::NOT_FOUND)
                 return grpc::Status(grpc::StatusCode::NOT_FOUND, "Key not found");
-            return grpc::Status(grpc::StatusCode::INTERNAL, "Forwarding request failed");
+            grpc::Status replica_status;
+            if (read_backup(*request, response, &replica_status))
+                return replica_status;
+            return forward_failure(status);
         }
     }
 
     grpc::Status KVStoreServiceImpl::Del(grpc::ServerContext *context, const kvstore::DeleteRequest *request, kvstore::DeleteResponse *response)
     {
         // std::lock_guard<std::mutex> lock(store_mutex);
-        std::string node = hash_ring_.getNode(request->key());
-        if (node == store_.get_nodeinfo().get_name())
+        if (request->local_only())
         {
-            if (store_.del(request->key()))
-            {
-                response->set_success(true);
-            }
-            else
-            {
-                response->set_success(false);
-                return grpc::Status(grpc::StatusCode::NOT_FOUND, "Key not found");
-            }
-            return grpc::Status::OK;
+            return del_local(*request, response);
         }
-        // 如果当前节点不负责存储，则转发请求给其他节点
-        std::string target_address; // 使用 node_map 查询目标节点的地址
-        for (auto i = nodes_map_.begin(); i != nodes_map_.end(); i++)
+        bool local;
+        KVStoreRPC::Stub *stub = route(request->key(), local);
+        if (local)
         {
-            if (i->get_name() == node)
-            {
-                target_address = i->get_address();
-            }
+            return del_primary(*request, response);
         }
-        if (target_address.empty())
+        // 如果当前节点不负责存储，则通过连接池转发请求给其他节点
+        if (stub == nullptr)
         {
-            // 如果没有找到目标节点的地址，返回错误
+            // 如果没有找到目标节点，返回错误
             return grpc::Status(grpc::StatusCode::NOT_FOUND, "Target node not found");
         }
 
-        // 创建 gRPC 客户端来转发请求
-        auto channel = grpc::CreateChannel(target_address, grpc::InsecureChannelCredentials());
-        kvstore::KVStoreRPC::Stub stub(channel);
-
         // 构建转发请求
         kvstore::DeleteRequest forward_request;
         forward_request.set_key(request->key());
+        forward_request.set_write_quorum(request->write_quorum());
 
         kvstore::DeleteResponse forward_response;
         grpc::ClientContext client_context;
+        client_context.set_deadline(forward_deadline(*context));
 
         // 转发请求给目标节点
-        grpc::Status status = stub.Del(&client_context, forward_request, &forward_response);
+        grpc::Status status = stub->Del(&client_context, forward_request, &forward_response);
 
         // SPDLOG_INFO("Success?");
         if (status.ok() && forward_response.success())
@@ -220,7 +837,302 @@ namespace kvstore
             response->set_success(false);
             if (status.error_code() == grpc::StatusCode::NOT_FOUND)
                 return grpc::Status(grpc::StatusCode::NOT_FOUND, "Key not found");
-            return grpc::Status(grpc::StatusCode::INTERNAL, "Forwarding request failed");
+            return forward_failure(status);
+        }
+    }
+
+    grpc::Status KVStoreServiceImpl::MultiGet(grpc::ServerContext *context, const kvstore::MultiGetRequest *request, kvstore::MultiGetResponse *response)
+    {
+        auto table = membership_.table();
+        std::vector<int> owners;
+        owners.reserve(request->keys_size());
+        for (const auto &key : request->keys())
+        {
+            owners.push_back(table->ring.getNode(key));
+            response->add_results();
+        }
+        fan_out<MultiGetRequest>(
+            table->routes, owners, response, forward_deadline(*context),
+            [&](int i)
+            {
+                GetRequest get_request;
+                get_request.set_key(request->keys(i));
+                grpc::Status status = get_owned(get_request, response->mutable_results(i));
+                return status.error_code() == grpc::StatusCode::NOT_FOUND ? grpc::Status::OK : status;
+            },
+            [&](MultiGetRequest &sub_request, int i)
+            { sub_request.add_keys(request->keys(i)); },
+            [](KVStoreRPC::Stub *stub, grpc::ClientContext *ctx, const MultiGetRequest &sub_request, grpc::CompletionQueue *cq)
+            { return stub->AsyncMultiGet(ctx, sub_request, cq); });
+        return grpc::Status::OK;
+    }
+
+    grpc::Status KVStoreServiceImpl::MultiPut(grpc::ServerContext *context, const kvstore::MultiPutRequest *request, kvstore::MultiPutResponse *response)
+    {
+        auto table = membership_.table();
+        std::vector<int> owners;
+        owners.reserve(request->entries_size());
+        for (const auto &entry : request->entries())
+        {
+            owners.push_back(table->ring.getNode(entry.key()));
+            response->add_results();
+        }
+        // 本节点负责的各项先全部发出复制请求，最后统一等待确认，复制往返互相重叠
+        std::vector<std::shared_ptr<AckCounter>> pending;
+        fan_out<MultiPutRequest>(
+            table->routes, owners, response, forward_deadline(*context),
+            [&](int i)
+            {
+                // 同步接口的请求不可修改，本地写入的项只复制值，转发的项整体放入子请求
+                const PutRequest &entry = request->entries(i);
+                ValueRef written;
+                grpc::Status status = put_local(entry, entry.value(), response->mutable_results(i), &written);
+                if (status.ok() && response->results(i).success() && replication_.replicas > 1)
+                {
+                    ReplicateRequest replica_request;
+                    replica_request.set_key(entry.key());
+                    replica_request.set_value(written.data(), written.size());
+                    replica_request.set_version(response->results(i).version());
+                    replica_request.set_expire_at_ms(written.expire_at_ms());
+                    pending.push_back(replicate(replica_request, entry.write_quorum()));
+                }
+                return status;
+            },
+            [&](MultiPutRequest &sub_request, int i)
+            { *sub_request.add_entries() = request->entries(i); },
+            [](KVStoreRPC::Stub *stub, grpc::ClientContext *ctx, const MultiPutRequest &sub_request, grpc::CompletionQueue *cq)
+            { return stub->AsyncMultiPut(ctx, sub_request, cq); });
+        grpc::Status result = grpc::Status::OK;
+        for (auto &acks : pending)
+        {
+            grpc::Status replica_status = wait_quorum(*acks);
+            if (result.ok() && !replica_status.ok())
+                result = replica_status;
+        }
+        return result;
+    }
+
+    grpc::Status KVStoreServiceImpl::MultiDel(grpc::ServerContext *context, const kvstore::MultiDeleteRequest *request, kvstore::MultiDeleteResponse *response)
+    {
+        auto table = membership_.table();
+        std::vector<int> owners;
+        owners.reserve(request->keys_size());
+        for (const auto &key : request->keys())
+        {
+            owners.push_back(table->ring.getNode(key));
+            response->add_results();
+        }
+        std::vector<std::shared_ptr<AckCounter>> pending;
+        fan_out<MultiDeleteRequest>(
+            table->routes, owners, response, forward_deadline(*context),
+            [&](int i)
+            {
+                DeleteRequest del_request;
+                del_request.set_key(request->keys(i));
+                int64_t deleted_version = 0;
+                grpc::Status status = del_owned(del_request, response->mutable_results(i), &deleted_version);
+                if (status.ok())
+                {
+                    pending.push_back(replicate_delete(del_request, deleted_version));
+                }
+                return status.error_code() == grpc::StatusCode::NOT_FOUND ? grpc::Status::OK : status;
+            },
+            [&](MultiDeleteRequest &sub_request, int i)
+            { sub_request.add_keys(request->keys(i)); },
+            [](KVStoreRPC::Stub *stub, grpc::ClientContext *ctx, const MultiDeleteRequest &sub_request, grpc::CompletionQueue *cq)
+            { return stub->AsyncMultiDel(ctx, sub_request, cq); });
+        grpc::Status result = grpc::Status::OK;
+        for (auto &acks : pending)
+        {
+            grpc::Status replica_status = wait_quorum(*acks);
+            if (result.ok() && !replica_status.ok())
+                result = replica_status;
+        }
+        return result;
+    }
+
+    grpc::Status KVStoreServiceImpl::Scan(grpc::ServerContext *context, const kvstore::ScanRequest *request, grpc::ServerWriter<kvstore::ScanResponse> *writer)
+    {
+        std::string start = request->start();
+        std::string end = request->end();
+        if (!request->prefix().empty())
+        {
+            start = request->prefix();
+            end = prefix_end(request->prefix());
+        }
+        if (!request->continuation().empty())
+        {
+            // 令牌是下一页的起始键
+            if (request->continuation() < start)
+            {
+                return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Continuation token is outside the scanned range");
+            }
+            start = request->continuation();
+        }
+        uint32_t limit = request->limit() == 0 ? kDefaultScanLimit : std::min(request->limit(), kMaxScanLimit);
+
+        std::vector<std::unique_ptr<ScanSource>> sources;
+        sources.push_back(std::make_unique<LocalScan>(store_, start, end, std::min<size_t>(limit, kScanChunkEntries)));
+        if (!request->local_only())
+        {
+            // 各节点按同样的区间各扫描一页，本节点归并后取前 limit 项
+            ScanRequest sub_request;
+            sub_request.set_start(start);
+            sub_request.set_end(end);
+            sub_request.set_limit(limit);
+            sub_request.set_local_only(true);
+            auto table = membership_.table();
+            for (const Route &route : table->routes)
+            {
+                if (route.is_self)
+                    continue;
+                KVStoreRPC::Stub *stub = PeerChannelPool::next_stub(route.peer);
+                if (stub == nullptr)
+                {
+                    return grpc::Status(grpc::StatusCode::UNAVAILABLE, "Node " + route.name + " is unknown");
+                }
+                sources.push_back(std::make_unique<RemoteScan>(stub, *context, sub_request, route.name));
+            }
         }
+
+        ScanResponse chunk;
+        size_t chunk_bytes = 0;
+        uint32_t count = 0;
+        std::string last_key;
+        while (count < limit)
+        {
+            const ScanEntry *first = nullptr;
+            for (auto &source : sources)
+            {
+                const ScanEntry *entry = source->peek();
+                if (!source->status().ok())
+                    return source->status();
+                if (entry != nullptr && (first == nullptr || entry->key() < first->key()))
+                    first = entry;
+            }
+            if (first == nullptr)
+                break;
+            // 多个副本上的同一个键只保留版本最新的一份
+            last_key = first->key();
+            ScanEntry merged;
+            merged.set_version(-1);
+            for (auto &source : sources)
+            {
+                ScanEntry *entry = source->peek();
+                if (entry != nullptr && entry->key() == last_key)
+                {
+                    if (entry->version() > merged.version())
+                        merged.Swap(entry);
+                    source->pop();
+                }
+            }
+            chunk_bytes += merged.key().size() + merged.value().size();
+            chunk.add_entries()->Swap(&merged);
+            count++;
+            if (chunk.entries_size() >= static_cast<int>(kScanChunkEntries) || chunk_bytes >= kScanChunkBytes)
+            {
+                if (!writer->Write(chunk))
+                    return grpc::Status(grpc::StatusCode::CANCELLED, "Scan stream closed");
+                chunk.Clear();
+                chunk_bytes = 0;
+            }
+        }
+
+        bool more = false;
+        if (count == limit)
+        {
+            for (auto &source : sources)
+            {
+                more = more || source->has_more();
+                if (!source->status().ok())
+                    return source->status();
+            }
+        }
+        if (more)
+        {
+            chunk.set_continuation(key_after(last_key));
+        }
+        writer->Write(chunk);
+        return grpc::Status::OK;
+    }
+
+    grpc::Status KVStoreServiceImpl::Subscribe(grpc::ServerContext *context, const kvstore::SubscribeRequest *request, grpc::ServerWriter<kvstore::Invalidation> *writer)
+    {
+        return leases_.serve(request->client_id(), context, writer);
+    }
+
+    grpc::Status KVStoreServiceImpl::Heartbeat(grpc::ServerContext *context, const kvstore::HeartbeatRequest *request, kvstore::HeartbeatResponse *response)
+    {
+        membership_.on_heartbeat(*request, response);
+        return grpc::Status::OK;
+    }
+
+    grpc::Status KVStoreServiceImpl::Join(grpc::ServerContext *context, const kvstore::JoinRequest *request, kvstore::MembershipResponse *response)
+    {
+        return membership_.join(request->node(), response->mutable_view());
+    }
+
+    grpc::Status KVStoreServiceImpl::Leave(grpc::ServerContext *context, const kvstore::LeaveRequest *request, kvstore::MembershipResponse *response)
+    {
+        return membership_.leave(request->name(), response->mutable_view());
+    }
+
+    grpc::Status KVStoreServiceImpl::Migrate(grpc::ServerContext *context, grpc::ServerReader<kvstore::MigrateEntry> *reader, kvstore::MigrateResponse *response)
+    {
+        // 迁移来的条目按版本合并，本节点已有更新版本时忽略
+        MigrateEntry entry;
+        uint64_t received = 0;
+        try
+        {
+            while (reader->Read(&entry))
+            {
+                store_.put_if_newer(entry.key(), std::move(*entry.mutable_value()), entry.version(), nullptr, entry.expire_at_ms());
+                received++;
+            }
+        }
+        catch (const MemoryLimitExceeded &e)
+        {
+            SPDLOG_WARN("Migrate stopped after {} entries: {}", received, e.what());
+            return grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED, e.what());
+        }
+        catch (const std::exception &e)
+        {
+            SPDLOG_ERROR("Migrate failed after {} entries: {}", received, e.what());
+            return grpc::Status(grpc::StatusCode::INTERNAL, e.what());
+        }
+        response->set_received(received);
+        return grpc::Status::OK;
+    }
+
+    grpc::Status KVStoreServiceImpl::Replicate(grpc::ServerContext *context, const kvstore::ReplicateRequest *request, kvstore::ReplicateResponse *response)
+    {
+        // 同步接口的请求不可修改，只复制值；异步服务端直接移出调用自己持有的请求中的值
+        return apply_replica(*request, request->value(), response);
+    }
+
+    grpc::Status KVStoreServiceImpl::apply_replica(const ReplicateRequest &request, std::string value, ReplicateResponse *response)
+    {
+        // 复制请求可能乱序到达，按版本合并：写入只覆盖旧版本，删除不影响更新的版本
+        try
+        {
+            if (request.deleted())
+            {
+                response->set_applied(store_.del_if_not_newer(request.key(), request.version()));
+            }
+            else
+            {
+                response->set_applied(store_.put_if_newer(request.key(), std::move(value), request.version(), nullptr, request.expire_at_ms()).applied);
+            }
+        }
+        catch (const MemoryLimitExceeded &e)
+        {
+            return grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED, e.what());
+        }
+        catch (const std::exception &e)
+        {
+            SPDLOG_ERROR("Replicate {} failed: {}", request.key(), e.what());
+            return grpc::Status(grpc::StatusCode::INTERNAL, e.what());
+        }
+        return grpc::Status::OK;
     }
 }
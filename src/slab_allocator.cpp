@@ -0,0 +1,123 @@
+#include "slab_allocator.h"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+namespace kvstore
+{
+    namespace
+    {
+        size_t round_up(size_t size, size_t alignment)
+        {
+            return (size + alignment - 1) / alignment * alignment;
+        }
+    }
+
+    const std::vector<size_t> &SlabAllocator::class_sizes()
+    {
+        static const std::vector<size_t> sizes = []()
+        {
+            std::vector<size_t> result;
+            for (size_t size = 16; size <= 256; size += 8)
+            {
+                result.push_back(size);
+            }
+            while (result.back() < kMaxChunk)
+            {
+                result.push_back(std::min(kMaxChunk, round_up(result.back() * 5 / 4, 16)));
+            }
+            return result;
+        }();
+        return sizes;
+    }
+
+    uint8_t SlabAllocator::class_for(size_t size)
+    {
+        const std::vector<size_t> &sizes = class_sizes();
+        if (size <= 256)
+        {
+            return size <= 16 ? 0 : static_cast<uint8_t>((size - 16 + 7) / 8);
+        }
+        return static_cast<uint8_t>(std::lower_bound(sizes.begin(), sizes.end(), size) - sizes.begin());
+    }
+
+    size_t SlabAllocator::chunk_size(uint8_t size_class, size_t size)
+    {
+        return size_class == kOversize ? size : class_sizes()[size_class];
+    }
+
+    SlabAllocator::SlabAllocator() : classes_(class_sizes().size())
+    {
+    }
+
+    SlabAllocator::~SlabAllocator() = default;
+
+    void *SlabAllocator::allocate(size_t size, uint8_t &size_class)
+    {
+        if (size > kMaxChunk)
+        {
+            void *chunk = std::malloc(size);
+            if (chunk == nullptr)
+            {
+                throw std::bad_alloc();
+            }
+            size_class = kOversize;
+            std::lock_guard<std::mutex> lock(mutex_);
+            oversize_bytes_ += size;
+            used_bytes_ += size;
+            return chunk;
+        }
+
+        size_class = class_for(size);
+        size_t chunk = class_sizes()[size_class];
+        std::lock_guard<std::mutex> lock(mutex_);
+        SizeClass &cls = classes_[size_class];
+        used_bytes_ += chunk;
+        if (cls.free != nullptr)
+        {
+            FreeChunk *head = cls.free;
+            cls.free = head->next;
+            return head;
+        }
+        if (cls.cursor == cls.end)
+        {
+            // slab 末尾不足一块的部分不再使用
+            slabs_.emplace_back(new char[kSlabBytes]);
+            cls.cursor = slabs_.back().get();
+            cls.end = cls.cursor + kSlabBytes / chunk * chunk;
+        }
+        void *result = cls.cursor;
+        cls.cursor += chunk;
+        return result;
+    }
+
+    void SlabAllocator::free(void *chunk, uint8_t size_class, size_t size)
+    {
+        if (size_class == kOversize)
+        {
+            std::free(chunk);
+            std::lock_guard<std::mutex> lock(mutex_);
+            oversize_bytes_ -= size;
+            used_bytes_ -= size;
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        SizeClass &cls = classes_[size_class];
+        FreeChunk *head = static_cast<FreeChunk *>(chunk);
+        head->next = cls.free;
+        cls.free = head;
+        used_bytes_ -= class_sizes()[size_class];
+    }
+
+    size_t SlabAllocator::reserved_bytes() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return slabs_.size() * kSlabBytes + oversize_bytes_;
+    }
+
+    size_t SlabAllocator::used_bytes() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return used_bytes_;
+    }
+}
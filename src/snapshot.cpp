@@ -0,0 +1,313 @@
+#include "snapshot.h"
+#include "codec.h"
+#include <atomic>
+#include <mutex>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace kvstore
+{
+    namespace
+    {
+        const char kMagic[8] = {'D', 'K', 'V', 'S', 'N', 'A', 'P', '\0'};
+        const uint32_t kFormatVersion = 2;
+        const uint32_t kFormatWithoutExpiry = 1;
+        const size_t kHeaderSize = 16;
+        const size_t kTailSize = 4 + 8 + 8 + 4 + 8; // 块数 + 总条目数 + 段号 + crc + magic
+        const size_t kBlockSize = 64 * 1024;
+
+        std::runtime_error corrupt(const std::string &path, const std::string &reason)
+        {
+            return std::runtime_error("Corrupt snapshot " + path + ": " + reason);
+        }
+
+        // 只读映射整个文件，析构时解除映射
+        class MappedFile
+        {
+        public:
+            explicit MappedFile(const std::string &path)
+            {
+                int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0)
+                {
+                    throw std::runtime_error("Failed to open snapshot " + path + ": " + std::strerror(errno));
+                }
+                struct stat st;
+                ::fstat(fd, &st);
+                size_ = st.st_size;
+                if (size_ > 0)
+                {
+                    void *addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (addr == MAP_FAILED)
+                    {
+                        ::close(fd);
+                        throw std::runtime_error("Failed to mmap snapshot " + path + ": " + std::strerror(errno));
+                    }
+                    data_ = static_cast<const char *>(addr);
+                    ::madvise(addr, size_, MADV_WILLNEED);
+                }
+                ::close(fd);
+            }
+            ~MappedFile()
+            {
+                if (data_ != nullptr)
+                    ::munmap(const_cast<char *>(data_), size_);
+            }
+            const char *data() const { return data_; }
+            size_t size() const { return size_; }
+
+        private:
+            const char *data_ = nullptr;
+            size_t size_ = 0;
+        };
+
+        struct Footer
+        {
+            uint32_t format;
+            SnapshotInfo info;
+            std::vector<uint64_t> block_offsets;
+        };
+
+        Footer parse_footer(const std::string &path, const MappedFile &file)
+        {
+            const char *data = file.data();
+            size_t size = file.size();
+            if (size < kHeaderSize + kTailSize || std::memcmp(data, kMagic, sizeof(kMagic)) != 0 ||
+                std::memcmp(data + size - sizeof(kMagic), kMagic, sizeof(kMagic)) != 0)
+            {
+                throw corrupt(path, "bad magic");
+            }
+            uint32_t format = codec::decode_fixed32(data + 8);
+            if (format != kFormatVersion && format != kFormatWithoutExpiry)
+            {
+                throw corrupt(path, "unsupported format version");
+            }
+
+            const char *tail = data + size - kTailSize;
+            uint32_t block_count = codec::decode_fixed32(tail);
+            Footer footer;
+            footer.format = format;
+            footer.info.entries = codec::decode_fixed64(tail + 4);
+            footer.info.wal_segment = codec::decode_fixed64(tail + 12);
+            uint32_t crc = codec::decode_fixed32(tail + 20);
+
+            size_t index_size = static_cast<size_t>(block_count) * 8;
+            if (size - kHeaderSize - kTailSize < index_size)
+            {
+                throw corrupt(path, "bad block index");
+            }
+            const char *index = tail - index_size;
+            if (codec::crc32(index, index_size + 20) != crc)
+            {
+                throw corrupt(path, "footer checksum mismatch");
+            }
+            footer.block_offsets.reserve(block_count);
+            for (uint32_t i = 0; i < block_count; i++)
+            {
+                uint64_t offset = codec::decode_fixed64(index + i * 8);
+                if (offset < kHeaderSize || offset > static_cast<uint64_t>(index - data))
+                {
+                    throw corrupt(path, "block offset out of range");
+                }
+                footer.block_offsets.push_back(offset);
+            }
+            return footer;
+        }
+
+        void decode_block(const std::string &path, uint32_t format, const char *p, const char *end,
+                          const std::function<void(std::string &&, std::string &&, int64_t, int64_t)> &apply)
+        {
+            uint32_t crc, size, count;
+            if (!codec::get_fixed32(p, end, crc) || !codec::get_fixed32(p, end, size) || end - p < static_cast<ptrdiff_t>(size))
+            {
+                throw corrupt(path, "truncated block");
+            }
+            if (codec::crc32(p, size) != crc)
+            {
+                throw corrupt(path, "block checksum mismatch");
+            }
+            end = p + size;
+            if (!codec::get_fixed32(p, end, count))
+            {
+                throw corrupt(path, "truncated block");
+            }
+            std::string key, value;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                uint64_t version, expire_at_ms = 0;
+                if (!codec::get_bytes(p, end, key) || !codec::get_bytes(p, end, value) || !codec::get_fixed64(p, end, version) ||
+                    (format != kFormatWithoutExpiry && !codec::get_fixed64(p, end, expire_at_ms)))
+                {
+                    throw corrupt(path, "truncated entry");
+                }
+                apply(std::move(key), std::move(value), static_cast<int64_t>(version), static_cast<int64_t>(expire_at_ms));
+            }
+        }
+    }
+
+    SnapshotWriter::SnapshotWriter(const std::string &path) : path_(path)
+    {
+        fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd_ < 0)
+        {
+            throw std::runtime_error("Failed to create snapshot " + path_ + ": " + std::strerror(errno));
+        }
+        std::string header(kMagic, sizeof(kMagic));
+        codec::put_fixed32(header, kFormatVersion);
+        codec::put_fixed32(header, 0);
+        write(header);
+        block_.reserve(kBlockSize + 1024);
+    }
+
+    SnapshotWriter::~SnapshotWriter()
+    {
+        if (fd_ >= 0)
+        {
+            ::close(fd_);
+        }
+    }
+
+    void SnapshotWriter::add(std::string_view key, std::string_view value, int64_t version, int64_t expire_at_ms)
+    {
+        codec::put_bytes(block_, key);
+        codec::put_bytes(block_, value);
+        codec::put_fixed64(block_, static_cast<uint64_t>(version));
+        codec::put_fixed64(block_, static_cast<uint64_t>(expire_at_ms));
+        block_entries_++;
+        total_entries_++;
+        if (block_.size() >= kBlockSize)
+        {
+            flush_block();
+        }
+    }
+
+    void SnapshotWriter::flush_block()
+    {
+        if (block_entries_ == 0)
+            return;
+        std::string payload;
+        payload.reserve(4 + block_.size());
+        codec::put_fixed32(payload, block_entries_);
+        payload.append(block_);
+
+        std::string header;
+        codec::put_fixed32(header, codec::crc32(payload.data(), payload.size()));
+        codec::put_fixed32(header, static_cast<uint32_t>(payload.size()));
+        block_offsets_.push_back(offset_);
+        write(header);
+        write(payload);
+        block_.clear();
+        block_entries_ = 0;
+    }
+
+    void SnapshotWriter::write(const std::string &data)
+    {
+        const char *p = data.data();
+        size_t size = data.size();
+        while (size > 0)
+        {
+            ssize_t n = ::write(fd_, p, size);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw std::runtime_error("Failed to write snapshot " + path_ + ": " + std::strerror(errno));
+            }
+            p += n;
+            size -= n;
+        }
+        offset_ += data.size();
+    }
+
+    void SnapshotWriter::finish(uint64_t wal_segment)
+    {
+        flush_block();
+        std::string footer;
+        for (uint64_t offset : block_offsets_)
+        {
+            codec::put_fixed64(footer, offset);
+        }
+        codec::put_fixed32(footer, static_cast<uint32_t>(block_offsets_.size()));
+        codec::put_fixed64(footer, total_entries_);
+        codec::put_fixed64(footer, wal_segment);
+        codec::put_fixed32(footer, codec::crc32(footer.data(), footer.size()));
+        footer.append(kMagic, sizeof(kMagic));
+        write(footer);
+        if (::fsync(fd_) != 0)
+        {
+            throw std::runtime_error("Failed to sync snapshot " + path_ + ": " + std::strerror(errno));
+        }
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+    SnapshotInfo read_snapshot_info(const std::string &path)
+    {
+        MappedFile file(path);
+        return parse_footer(path, file).info;
+    }
+
+    SnapshotInfo load_snapshot(const std::string &path, unsigned threads,
+                               const std::function<void(uint64_t)> &reserve,
+                               const std::function<void(std::string &&, std::string &&, int64_t, int64_t)> &apply)
+    {
+        MappedFile file(path);
+        Footer footer = parse_footer(path, file);
+        reserve(footer.info.entries);
+
+        const char *index = file.data() + file.size() - kTailSize - footer.block_offsets.size() * 8;
+        auto block_end = [&](size_t i)
+        {
+            return i + 1 < footer.block_offsets.size() ? file.data() + footer.block_offsets[i + 1] : index;
+        };
+
+        // 各线程从共享计数器领取数据块，块之间互不依赖
+        std::atomic<size_t> next_block(0);
+        std::atomic<bool> failed(false);
+        std::string error;
+        std::mutex error_mutex;
+        auto worker = [&]()
+        {
+            size_t i;
+            while (!failed.load(std::memory_order_relaxed) &&
+                   (i = next_block.fetch_add(1, std::memory_order_relaxed)) < footer.block_offsets.size())
+            {
+                try
+                {
+                    decode_block(path, footer.format, file.data() + footer.block_offsets[i], block_end(i), apply);
+                }
+                catch (const std::exception &e)
+                {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    error = e.what();
+                    failed = true;
+                }
+            }
+        };
+
+        if (threads == 0)
+            threads = 1;
+        std::vector<std::thread> pool;
+        for (unsigned t = 1; t < threads; t++)
+        {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (auto &t : pool)
+        {
+            t.join();
+        }
+        if (failed)
+        {
+            throw std::runtime_error(error);
+        }
+        return footer.info;
+    }
+
+} // namespace kvstore
@@ -0,0 +1,152 @@
+#include "timer_wheel.h"
+#include <algorithm>
+#include <iterator>
+
+namespace kvstore
+{
+    void TimerWheel::schedule(std::string_view key, int64_t expire_at_ms, int64_t now_ms)
+    {
+        if (size_ == 0)
+        {
+            // 空的时间轮直接跳到当前刻度，空闲期间不需要逐个刻度前进
+            tick_ = now_ms / kTickMs;
+        }
+        Timer timer{std::string(key), expire_at_ms};
+        key_bytes_ += heap_bytes(timer.key);
+        size_++;
+        place(std::move(timer));
+    }
+
+    void TimerWheel::place(Timer &&timer)
+    {
+        int64_t tick = tick_of(timer.expire_at_ms);
+        if (tick <= tick_)
+        {
+            due_.push_back(std::move(timer));
+            return;
+        }
+        // 与当前刻度的距离小于 64^(level+1) 时放在第 level 层，槽位由到期刻度在该层的 6 位决定
+        uint64_t delta = static_cast<uint64_t>(tick - tick_);
+        int level = 0;
+        while (level < kLevels - 1 && delta >= (uint64_t(1) << (kSlotBits * (level + 1))))
+        {
+            level++;
+        }
+        if (level == kLevels - 1 && delta >= (uint64_t(1) << (kSlotBits * kLevels)))
+        {
+            tick = tick_ + (int64_t(1) << (kSlotBits * kLevels)) - 1;
+        }
+        slots_[level][(tick >> (kSlotBits * level)) & (kSlots - 1)].push_back(std::move(timer));
+    }
+
+    bool TimerWheel::advance(int64_t now_ms, size_t budget, std::vector<Timer> &out)
+    {
+        int64_t now_tick = now_ms / kTickMs;
+        if (size_ == 0)
+        {
+            tick_ = std::max(tick_, now_tick);
+            return false;
+        }
+        size_t work = 0;
+        while (work < budget)
+        {
+            // 前进到下一个刻度之前，先把下移中的计时器放回低层、把已到期的交给调用方
+            if (!cascading_.empty())
+            {
+                Timer timer = std::move(cascading_.back());
+                cascading_.pop_back();
+                place(std::move(timer));
+                work++;
+                continue;
+            }
+            if (!due_.empty())
+            {
+                key_bytes_ -= heap_bytes(due_.back().key);
+                out.push_back(std::move(due_.back()));
+                due_.pop_back();
+                size_--;
+                work++;
+                continue;
+            }
+            if (tick_ >= now_tick)
+            {
+                return false;
+            }
+            tick_++;
+            // 刻度到达第 level 层槽位的起点时取出该槽位，其中的计时器都在 64^level 个刻度之内到期
+            for (int level = 1; level < kLevels; level++)
+            {
+                if ((tick_ & ((int64_t(1) << (kSlotBits * level)) - 1)) != 0)
+                {
+                    break;
+                }
+                std::vector<Timer> &slot = slots_[level][(tick_ >> (kSlotBits * level)) & (kSlots - 1)];
+                if (cascading_.empty())
+                {
+                    cascading_.swap(slot);
+                }
+                else
+                {
+                    std::move(slot.begin(), slot.end(), std::back_inserter(cascading_));
+                    slot.clear();
+                }
+            }
+            due_.swap(slots_[0][tick_ & (kSlots - 1)]);
+            work++;
+        }
+        return !cascading_.empty() || !due_.empty() || tick_ < now_tick;
+    }
+
+    bool TimerWheel::pop_earliest(Timer &timer, size_t samples)
+    {
+        std::vector<Timer> *slot = !due_.empty() ? &due_ : !cascading_.empty() ? &cascading_ : nullptr;
+        // 每层从当前刻度之后的槽位开始，绕一圈回到当前槽位（其中是下一轮的计时器）
+        for (int level = 0; slot == nullptr && level < kLevels; level++)
+        {
+            size_t current = static_cast<size_t>(tick_ >> (kSlotBits * level));
+            for (size_t i = 1; i <= kSlots; i++)
+            {
+                std::vector<Timer> &candidate = slots_[level][(current + i) & (kSlots - 1)];
+                if (!candidate.empty())
+                {
+                    slot = &candidate;
+                    break;
+                }
+            }
+        }
+        if (slot == nullptr)
+        {
+            return false;
+        }
+        size_t earliest = 0;
+        for (size_t i = 1; i < std::min(samples, slot->size()); i++)
+        {
+            if ((*slot)[i].expire_at_ms < (*slot)[earliest].expire_at_ms)
+            {
+                earliest = i;
+            }
+        }
+        timer = std::move((*slot)[earliest]);
+        if (earliest + 1 != slot->size())
+        {
+            (*slot)[earliest] = std::move(slot->back());
+        }
+        slot->pop_back();
+        key_bytes_ -= heap_bytes(timer.key);
+        size_--;
+        return true;
+    }
+
+    size_t TimerWheel::bytes() const
+    {
+        size_t total = key_bytes_;
+        for (const auto &level : slots_)
+        {
+            for (const auto &slot : level)
+            {
+                total += slot.capacity() * sizeof(Timer);
+            }
+        }
+        return total + (due_.capacity() + cascading_.capacity()) * sizeof(Timer);
+    }
+}
@@ -0,0 +1,271 @@
+#include "value_log.h"
+#include "codec.h"
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace kvstore
+{
+    namespace
+    {
+        bool pwrite_all(int fd, const char *data, size_t size, uint64_t offset)
+        {
+            while (size > 0)
+            {
+                ssize_t n = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+                if (n < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    return false;
+                }
+                data += n;
+                size -= n;
+                offset += n;
+            }
+            return true;
+        }
+
+        bool pread_all(int fd, char *data, size_t size, uint64_t offset)
+        {
+            while (size > 0)
+            {
+                ssize_t n = ::pread(fd, data, size, static_cast<off_t>(offset));
+                if (n <= 0)
+                {
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    return false;
+                }
+                data += n;
+                size -= n;
+                offset += n;
+            }
+            return true;
+        }
+    }
+
+    ValueLog::Segment::~Segment()
+    {
+        ::close(fd);
+    }
+
+    ValueLog::ValueLog(const ValueLogOptions &options) : options_(options)
+    {
+        std::filesystem::create_directories(options_.dir);
+        // 上次运行留下的段中的值都能从快照和 WAL 恢复，不再使用
+        for (const auto &entry : std::filesystem::directory_iterator(options_.dir))
+        {
+            uint32_t segment;
+            if (std::sscanf(entry.path().filename().c_str(), "vlog-%" SCNu32 ".log", &segment) == 1)
+            {
+                std::filesystem::remove(entry.path());
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        open_segment(1);
+    }
+
+    ValueLog::~ValueLog()
+    {
+        for (const auto &entry : segments_)
+        {
+            std::filesystem::remove(entry.second->path);
+        }
+    }
+
+    std::string ValueLog::segment_path(uint32_t segment) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "vlog-%06" PRIu32 ".log", segment);
+        return (std::filesystem::path(options_.dir) / name).string();
+    }
+
+    void ValueLog::open_segment(uint32_t segment)
+    {
+        std::string path = segment_path(segment);
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Failed to open value log " + path + ": " + std::strerror(errno));
+        }
+        active_ = std::make_shared<Segment>(segment, fd, std::move(path));
+        segments_.emplace(segment, active_);
+    }
+
+    void ValueLog::append(const std::vector<std::pair<std::string_view, std::string_view>> &entries, std::vector<ValueLocator> &locators)
+    {
+        std::string buffer;
+        size_t total = 0;
+        for (const auto &entry : entries)
+        {
+            total += entry_size(entry.first.size(), entry.second.size());
+        }
+        buffer.reserve(total);
+        locators.clear();
+        for (const auto &entry : entries)
+        {
+            uint32_t crc = codec::crc32(entry.second.data(), entry.second.size());
+            locators.push_back(ValueLocator{buffer.size(), 0, crc});
+            codec::put_fixed32(buffer, static_cast<uint32_t>(entry.first.size()));
+            codec::put_fixed32(buffer, static_cast<uint32_t>(entry.second.size()));
+            codec::put_fixed32(buffer, crc);
+            buffer.append(entry.first);
+            buffer.append(entry.second);
+        }
+
+        // 锁内只分配位置，写文件在锁外进行，不阻塞同时进行的读取
+        std::shared_ptr<Segment> segment;
+        uint64_t offset;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (active_->size >= options_.segment_bytes)
+            {
+                open_segment(active_->id + 1);
+            }
+            segment = active_;
+            offset = segment->size;
+            segment->size += buffer.size();
+            segment->live += buffer.size();
+        }
+        if (!pwrite_all(segment->fd, buffer.data(), buffer.size(), offset))
+        {
+            std::string error = std::strerror(errno);
+            discard(ValueLocator{offset, segment->id, 0}, 0, buffer.size() - kHeaderSize);
+            throw std::runtime_error("Failed to write value log " + segment->path + ": " + error);
+        }
+        for (auto &locator : locators)
+        {
+            locator.offset += offset;
+            locator.segment = segment->id;
+        }
+    }
+
+    bool ValueLog::read(const ValueLocator &locator, size_t key_size, size_t value_size, std::string &value) const
+    {
+        std::shared_ptr<Segment> segment;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = segments_.find(locator.segment);
+            if (it == segments_.end())
+            {
+                return false;
+            }
+            segment = it->second;
+        }
+        value.resize(value_size);
+        if (!pread_all(segment->fd, value.data(), value_size, locator.offset + kHeaderSize + key_size))
+        {
+            throw std::runtime_error("Failed to read value log " + segment->path + ": " + std::strerror(errno));
+        }
+        if (codec::crc32(value.data(), value.size()) != locator.crc)
+        {
+            throw std::runtime_error("Corrupted value at offset " + std::to_string(locator.offset) + " of " + segment->path);
+        }
+        return true;
+    }
+
+    void ValueLog::discard(const ValueLocator &locator, size_t key_size, size_t value_size)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = segments_.find(locator.segment);
+        if (it != segments_.end())
+        {
+            it->second->live -= entry_size(key_size, value_size);
+        }
+    }
+
+    uint32_t ValueLog::pick_compaction() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint32_t picked = 0;
+        double picked_ratio = options_.compact_garbage_ratio;
+        for (const auto &entry : segments_)
+        {
+            const Segment &segment = *entry.second;
+            if (entry.second == active_ || segment.size == 0)
+                continue;
+            double ratio = 1.0 - static_cast<double>(segment.live) / static_cast<double>(segment.size);
+            if (ratio >= picked_ratio)
+            {
+                picked = segment.id;
+                picked_ratio = ratio;
+            }
+        }
+        return picked;
+    }
+
+    void ValueLog::for_each(uint32_t id, const std::function<void(std::string_view, std::string_view, const ValueLocator &)> &fn) const
+    {
+        std::shared_ptr<Segment> segment;
+        uint64_t size;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = segments_.find(id);
+            if (it == segments_.end())
+            {
+                return;
+            }
+            segment = it->second;
+            size = segment->size;
+        }
+        std::string data(size, '\0');
+        if (!pread_all(segment->fd, data.data(), size, 0))
+        {
+            throw std::runtime_error("Failed to read value log " + segment->path + ": " + std::strerror(errno));
+        }
+        size_t offset = 0;
+        while (data.size() - offset >= kHeaderSize)
+        {
+            uint32_t key_size = codec::decode_fixed32(data.data() + offset);
+            uint32_t value_size = codec::decode_fixed32(data.data() + offset + 4);
+            uint32_t crc = codec::decode_fixed32(data.data() + offset + 8);
+            if (data.size() - offset - kHeaderSize < static_cast<uint64_t>(key_size) + value_size)
+            {
+                break;
+            }
+            const char *key = data.data() + offset + kHeaderSize;
+            fn(std::string_view(key, key_size), std::string_view(key + key_size, value_size), ValueLocator{offset, id, crc});
+            offset += entry_size(key_size, value_size);
+        }
+    }
+
+    void ValueLog::remove(uint32_t segment)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = segments_.find(segment);
+        if (it == segments_.end() || it->second == active_)
+        {
+            return;
+        }
+        std::filesystem::remove(it->second->path);
+        segments_.erase(it);
+    }
+
+    uint64_t ValueLog::bytes() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t total = 0;
+        for (const auto &entry : segments_)
+        {
+            total += entry.second->size;
+        }
+        return total;
+    }
+
+    uint64_t ValueLog::live_bytes() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t total = 0;
+        for (const auto &entry : segments_)
+        {
+            total += entry.second->live;
+        }
+        return total;
+    }
+}
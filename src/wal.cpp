@@ -0,0 +1,345 @@
+#include "wal.h"
+#include "codec.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace kvstore
+{
+    namespace
+    {
+        const size_t kHeaderSize = 8; // crc32 + payload 长度
+        const uint8_t kPutExpiring = 3; // 带过期时间的 kPut
+
+        bool write_all(int fd, const char *data, size_t size)
+        {
+            while (size > 0)
+            {
+                ssize_t n = ::write(fd, data, size);
+                if (n < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    return false;
+                }
+                data += n;
+                size -= n;
+            }
+            return true;
+        }
+
+        bool decode_record(const char *p, const char *end, WalRecord &record)
+        {
+            if (end - p < 1)
+                return false;
+            uint8_t op = static_cast<uint8_t>(*p++);
+            uint64_t version, expire_at_ms = 0;
+            if (!codec::get_fixed64(p, end, version) ||
+                (op == kPutExpiring && !codec::get_fixed64(p, end, expire_at_ms)) ||
+                !codec::get_bytes(p, end, record.key) ||
+                !codec::get_bytes(p, end, record.value))
+                return false;
+            record.op = op == kPutExpiring ? WalOp::kPut : static_cast<WalOp>(op);
+            record.version = static_cast<int64_t>(version);
+            record.expire_at_ms = static_cast<int64_t>(expire_at_ms);
+            return p == end && (record.op == WalOp::kPut || record.op == WalOp::kDel);
+        }
+
+        std::string read_file(const std::string &path)
+        {
+            std::string data;
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+            {
+                throw std::runtime_error("Failed to open WAL " + path + ": " + std::strerror(errno));
+            }
+            char buf[1 << 16];
+            ssize_t n;
+            while ((n = ::read(fd, buf, sizeof(buf))) > 0)
+            {
+                data.append(buf, n);
+            }
+            ::close(fd);
+            return data;
+        }
+    }
+
+    bool sync_directory(const std::string &dir)
+    {
+        int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        bool ok = ::fsync(fd) == 0;
+        ::close(fd);
+        return ok;
+    }
+
+    WriteAheadLog::WriteAheadLog(const WalOptions &options) : options_(options)
+    {
+        std::filesystem::create_directories(options_.dir);
+        std::vector<uint64_t> segments = list_segments();
+        open_segment(segments.empty() ? 1 : segments.back());
+        flusher_ = std::thread(&WriteAheadLog::flush_loop, this);
+    }
+
+    WriteAheadLog::~WriteAheadLog()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        work_cv_.notify_one();
+        flusher_.join();
+        ::close(fd_);
+    }
+
+    std::string WriteAheadLog::segment_path(uint64_t segment) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "wal-%06" PRIu64 ".log", segment);
+        return (std::filesystem::path(options_.dir) / name).string();
+    }
+
+    std::vector<uint64_t> WriteAheadLog::list_segments() const
+    {
+        std::vector<uint64_t> segments;
+        for (const auto &entry : std::filesystem::directory_iterator(options_.dir))
+        {
+            uint64_t segment;
+            if (std::sscanf(entry.path().filename().c_str(), "wal-%" SCNu64 ".log", &segment) == 1)
+            {
+                segments.push_back(segment);
+            }
+        }
+        std::sort(segments.begin(), segments.end());
+        return segments;
+    }
+
+    void WriteAheadLog::open_segment(uint64_t segment)
+    {
+        std::string path = segment_path(segment);
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Failed to open WAL " + path + ": " + std::strerror(errno));
+        }
+        struct stat st;
+        ::fstat(fd, &st);
+        sync_directory(options_.dir);
+        if (fd_ >= 0)
+        {
+            ::close(fd_);
+        }
+        fd_ = fd;
+        segment_ = segment;
+        segment_bytes_ = st.st_size;
+    }
+
+    size_t WriteAheadLog::replay(uint64_t first_segment, const std::function<void(const WalRecord &)> &apply)
+    {
+        size_t count = 0;
+        WalRecord record;
+        for (uint64_t segment : list_segments())
+        {
+            if (segment < first_segment)
+                continue;
+            std::string path = segment_path(segment);
+            std::string data = read_file(path);
+            size_t offset = 0;
+            while (data.size() - offset >= kHeaderSize)
+            {
+                uint32_t crc = codec::decode_fixed32(data.data() + offset);
+                uint32_t size = codec::decode_fixed32(data.data() + offset + 4);
+                if (data.size() - offset - kHeaderSize < size)
+                    break;
+                const char *payload = data.data() + offset + kHeaderSize;
+                if (codec::crc32(payload, size) != crc || !decode_record(payload, payload + size, record))
+                    break;
+                apply(record);
+                offset += kHeaderSize + size;
+                count++;
+            }
+
+            if (offset != data.size())
+            {
+                SPDLOG_WARN("WAL {}: dropping {} trailing bytes", path, data.size() - offset);
+                if (segment == segment_)
+                {
+                    // 崩溃时可能留下半条记录，截掉后续内容以免新记录追加在损坏数据之后
+                    if (::ftruncate(fd_, offset) != 0)
+                    {
+                        throw std::runtime_error("Failed to truncate WAL " + path + ": " + std::strerror(errno));
+                    }
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    segment_bytes_ = offset;
+                }
+            }
+        }
+        return count;
+    }
+
+    uint64_t WriteAheadLog::append(WalOp op, std::string_view key, std::string_view value, int64_t version, int64_t expire_at_ms)
+    {
+        bool expiring = op == WalOp::kPut && expire_at_ms != 0;
+        std::string payload;
+        payload.reserve(1 + 8 + 8 + 4 + key.size() + 4 + value.size());
+        payload.push_back(static_cast<char>(expiring ? kPutExpiring : static_cast<uint8_t>(op)));
+        codec::put_fixed64(payload, static_cast<uint64_t>(version));
+        if (expiring)
+        {
+            codec::put_fixed64(payload, static_cast<uint64_t>(expire_at_ms));
+        }
+        codec::put_bytes(payload, key);
+        codec::put_bytes(payload, value);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        codec::put_fixed32(buffer_, codec::crc32(payload.data(), payload.size()));
+        codec::put_fixed32(buffer_, static_cast<uint32_t>(payload.size()));
+        buffer_.append(payload);
+        uint64_t lsn = ++next_lsn_;
+        work_cv_.notify_one();
+        return lsn;
+    }
+
+    bool WriteAheadLog::wait(uint64_t lsn)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (options_.sync_mode == WalSyncMode::kAlways)
+        {
+            done_cv_.wait(lock, [&]
+                          { return synced_lsn_ >= lsn || failed_; });
+            return synced_lsn_ >= lsn;
+        }
+        done_cv_.wait(lock, [&]
+                      { return written_lsn_ >= lsn || failed_; });
+        return written_lsn_ >= lsn;
+    }
+
+    uint64_t WriteAheadLog::rotate()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        uint64_t target = segment_ + 1;
+        rotate_requested_ = true;
+        work_cv_.notify_one();
+        done_cv_.wait(lock, [&]
+                      { return segment_ >= target || failed_; });
+        if (segment_ < target)
+        {
+            throw std::runtime_error("Failed to rotate WAL in " + options_.dir);
+        }
+        return segment_;
+    }
+
+    void WriteAheadLog::remove_segments_before(uint64_t segment)
+    {
+        for (uint64_t old_segment : list_segments())
+        {
+            if (old_segment < segment)
+            {
+                std::filesystem::remove(segment_path(old_segment));
+            }
+        }
+        sync_directory(options_.dir);
+    }
+
+    uint64_t WriteAheadLog::segment_bytes()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return segment_bytes_;
+    }
+
+    void WriteAheadLog::flush_loop()
+    {
+        auto interval = std::chrono::milliseconds(options_.sync_interval_ms > 0 ? options_.sync_interval_ms : 1);
+        auto last_sync = std::chrono::steady_clock::now();
+        std::string batch;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+            auto ready = [&]
+            { return stop_ || rotate_requested_ || !buffer_.empty(); };
+            if (options_.sync_mode == WalSyncMode::kInterval)
+            {
+                work_cv_.wait_for(lock, interval, ready);
+            }
+            else
+            {
+                work_cv_.wait(lock, ready);
+            }
+            bool stopping = stop_;
+            // 与取出缓冲区在同一次加锁内决定是否切换日志段，之后追加的记录都会写入新段
+            bool failed = failed_;
+            bool rotating = rotate_requested_ && !failed;
+            uint64_t next_segment = segment_ + 1;
+
+            // 刷盘期间到达的写入会积累在 buffer_ 中，下一轮一并写入并只做一次 fdatasync
+            batch.clear();
+            batch.swap(buffer_);
+            uint64_t batch_lsn = next_lsn_;
+            lock.unlock();
+
+            // 写盘失败后文件末尾可能是半条记录，之后追加的记录在重放时会随它一起被丢弃，
+            // 所以不再写入，之后的写入全部报告失败
+            bool ok = !failed && (batch.empty() || write_all(fd_, batch.data(), batch.size()));
+            bool synced = false;
+            auto now = std::chrono::steady_clock::now();
+            bool need_sync = options_.sync_mode == WalSyncMode::kAlways || rotating ||
+                             (options_.sync_mode == WalSyncMode::kInterval && (now - last_sync >= interval || stopping));
+            if (ok && need_sync)
+            {
+                ok = ::fdatasync(fd_) == 0;
+                synced = ok;
+                last_sync = now;
+            }
+            if (!ok && !failed)
+            {
+                SPDLOG_ERROR("WAL {}: write failed: {}", segment_path(segment_), std::strerror(errno));
+            }
+            if (ok && rotating)
+            {
+                try
+                {
+                    lock.lock();
+                    open_segment(next_segment);
+                    lock.unlock();
+                }
+                catch (const std::exception &e)
+                {
+                    lock.unlock();
+                    SPDLOG_ERROR("{}", e.what());
+                    ok = false;
+                }
+            }
+
+            lock.lock();
+            if (ok)
+            {
+                written_lsn_ = batch_lsn;
+                if (synced)
+                    synced_lsn_ = batch_lsn;
+                if (!rotating)
+                    segment_bytes_ += batch.size();
+            }
+            else
+            {
+                failed_ = true;
+            }
+            if (rotating)
+                rotate_requested_ = false;
+            done_cv_.notify_all();
+            if (stopping && buffer_.empty())
+                break;
+        }
+    }
+
+} // namespace kvstore
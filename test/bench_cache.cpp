@@ -0,0 +1,175 @@
+#include "client_cache.h"
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// 比较客户端缓存与原来单锁的 list + unordered_map LRU 实现：
+// 1~64 个线程下的命中吞吐量，以及热点读取混杂一次性扫描时的命中率
+// 用法: ./bench_cache [key_count] [ops_per_thread]
+
+// 原实现：一把互斥锁保护 std::list 与 std::unordered_map，每次命中都要 splice，键存两份
+class LegacyLRU
+{
+public:
+    explicit LegacyLRU(size_t capacity) : capacity_(capacity) {}
+
+    bool get(const std::string &key, std::string &value, int64_t &version)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = cache_map_.find(key);
+        if (it != cache_map_.end())
+        {
+            cache_list_.splice(cache_list_.begin(), cache_list_, it->second.second);
+            value = it->second.first.first;
+            version = it->second.first.second;
+            return true;
+        }
+        return false;
+    }
+
+    void set(const std::string &key, const std::string &value, int64_t version)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = cache_map_.find(key);
+        if (it != cache_map_.end())
+        {
+            it->second.first.first = value;
+            it->second.first.second = version;
+            cache_list_.splice(cache_list_.begin(), cache_list_, it->second.second);
+        }
+        else
+        {
+            if (cache_map_.size() >= capacity_)
+            {
+                const auto &oldest = cache_list_.back();
+                cache_map_.erase(oldest);
+                cache_list_.pop_back();
+            }
+            cache_list_.emplace_front(key);
+            cache_map_[key] = {{value, version}, cache_list_.begin()};
+        }
+    }
+
+private:
+    size_t capacity_;
+    std::list<std::string> cache_list_;
+    std::unordered_map<std::string, std::pair<std::pair<std::string, int64_t>, std::list<std::string>::iterator>> cache_map_;
+    std::mutex mutex_;
+};
+
+template <typename Cache>
+double run(Cache &cache, const std::vector<std::string> &keys, int thread_count, int ops_per_thread)
+{
+    std::atomic<bool> start(false);
+    std::atomic<uint64_t> misses(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; ++t)
+    {
+        threads.emplace_back([&, t]()
+                             {
+            std::mt19937 rng(t);
+            std::uniform_int_distribution<size_t> key_dist(0, keys.size() - 1);
+            std::string value;
+            int64_t version;
+            uint64_t local_misses = 0;
+            while (!start.load(std::memory_order_acquire))
+            {
+                std::this_thread::yield();
+            }
+            for (int i = 0; i < ops_per_thread; ++i)
+            {
+                if (!cache.get(keys[key_dist(rng)], value, version))
+                    local_misses++;
+            }
+            misses.fetch_add(local_misses); });
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    start.store(true, std::memory_order_release);
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    if (misses.load() != 0)
+    {
+        std::cerr << "  misses: " << misses.load() << std::endl;
+    }
+    return thread_count * static_cast<double>(ops_per_thread) / elapsed.count();
+}
+
+template <typename Cache>
+void bench(const char *name, size_t capacity, const std::vector<std::string> &keys, int ops_per_thread)
+{
+    Cache cache(capacity);
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        cache.set(keys[i], "value" + std::to_string(i), static_cast<int64_t>(i));
+    }
+    std::cout << name << std::endl;
+    for (int threads = 1; threads <= 64; threads *= 2)
+    {
+        double ops = run(cache, keys, threads, ops_per_thread);
+        std::cout << "  threads: " << std::setw(2) << threads
+                  << "  throughput: " << std::fixed << std::setprecision(0) << ops << " ops/s" << std::endl;
+    }
+}
+
+// 20% 的读取落在 hot_count 个热点键上，其余读取依次扫描只出现一次的键，未命中时写入缓存
+template <typename Cache>
+void bench_scan(const char *name, size_t capacity, size_t hot_count, int ops)
+{
+    Cache cache(capacity);
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<size_t> hot_dist(0, hot_count - 1);
+    std::uniform_int_distribution<int> percent(0, 99);
+    std::string value;
+    int64_t version;
+    uint64_t hot_reads = 0, hot_hits = 0;
+    size_t next_scan = 0;
+    for (int i = 0; i < ops; ++i)
+    {
+        bool hot = percent(rng) < 20;
+        std::string key = hot ? "hot" + std::to_string(hot_dist(rng)) : "scan" + std::to_string(next_scan++);
+        bool hit = cache.get(key, value, version);
+        if (!hit)
+            cache.set(key, "value_" + key, 1);
+        if (hot)
+        {
+            hot_reads++;
+            hot_hits += hit;
+        }
+    }
+    std::cout << "  " << name << "  hot key hit ratio: " << std::setprecision(3) << static_cast<double>(hot_hits) / hot_reads << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    size_t key_count = argc > 1 ? std::stoul(argv[1]) : 10000;
+    int ops_per_thread = argc > 2 ? std::stoi(argv[2]) : 200000;
+
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < key_count; ++i)
+    {
+        keys.push_back("key" + std::to_string(i));
+    }
+    // 分段缓存按段平分容量，键在各段间并不绝对均匀，容量取键数的两倍保证所有读取都命中，只测量命中路径
+    size_t entry_bytes = kvstore::KVCache::charge(keys.back().size(), ("value" + std::to_string(key_count)).size());
+    bench<LegacyLRU>("legacy list + map, single mutex", key_count * 2, keys, ops_per_thread);
+    bench<kvstore::KVCache>("segmented W-TinyLFU", key_count * 2 * entry_bytes, keys, ops_per_thread);
+
+    // 两种缓存都能容纳 2000 个条目，热点键 1000 个
+    std::cout << "hot set + scan" << std::endl;
+    size_t scan_entry_bytes = kvstore::KVCache::charge(10, 16);
+    bench_scan<LegacyLRU>("legacy LRU", 2000, 1000, 1000000);
+    bench_scan<kvstore::KVCache>("W-TinyLFU ", 2000 * scan_entry_bytes, 1000, 1000000);
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include "consistency_hash.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// 测量一致性哈希环在 3~1000 个节点下的负载均衡程度和查找耗时
+// 负载不均衡度 = 最重节点的键数 / 平均键数，1.00 表示完全均匀
+// 用法: ./bench_consistency_hash [key_count] [num_replicas]
+
+struct Result
+{
+    double max_over_mean;
+    double stddev_pct;
+    double ns_per_op;
+};
+
+Result run(int node_count, int num_replicas, const std::vector<std::string> &keys)
+{
+    ConsistencyHash ring(num_replicas);
+    for (int i = 1; i <= node_count; ++i)
+    {
+        ring.addNode("node" + std::to_string(i));
+    }
+
+    size_t sink = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (const auto &key : keys)
+    {
+        sink += ring.getNode(key) + 1;
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - begin;
+    if (sink == 0)
+    {
+        std::cerr << "empty ring" << std::endl;
+    }
+
+    std::vector<size_t> load(node_count);
+    for (const auto &key : keys)
+    {
+        load[ring.getNode(key)]++;
+    }
+
+    double mean = static_cast<double>(keys.size()) / node_count;
+    size_t max_load = 0;
+    double variance = 0;
+    for (size_t n : load)
+    {
+        max_load = std::max(max_load, n);
+        variance += (n - mean) * (n - mean);
+    }
+    variance /= node_count;
+    return {max_load / mean, std::sqrt(variance) / mean * 100, elapsed.count() / keys.size()};
+}
+
+int main(int argc, char **argv)
+{
+    int key_count = argc > 1 ? std::stoi(argv[1]) : 1000000;
+    int num_replicas = argc > 2 ? std::stoi(argv[2]) : 160;
+
+    std::vector<std::string> keys;
+    keys.reserve(key_count);
+    for (int i = 0; i < key_count; ++i)
+    {
+        keys.push_back("key" + std::to_string(i));
+    }
+
+    for (int replicas : {1, num_replicas})
+    {
+        std::cout << "virtual nodes per node: " << replicas << std::endl;
+        for (int nodes : {3, 10, 100, 1000})
+        {
+            Result r = run(nodes, replicas, keys);
+            std::cout << "  nodes: " << std::setw(4) << nodes
+                      << "  max/mean: " << std::fixed << std::setprecision(2) << r.max_over_mean
+                      << "  stddev: " << std::setprecision(1) << r.stddev_pct << "%"
+                      << "  lookup: " << std::setprecision(0) << r.ns_per_op << " ns/op" << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,214 @@
+#include "record.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 比较 KVStore 分片索引的几种实现在不同负载因子下的查找和插入耗时，以及从空表增长时单次插入的最长耗时。
+//   map:    改造前的 std::unordered_map，每个条目一个节点，键是独立的 std::string
+//   linear: 上一版的线性探测索引，槽位为带哈希标签的指针，扩容时一次性重新散列
+//   swiss:  RecordIndex，控制字节分组匹配，保存 32 位哈希，增量扩容
+// 用法: ./bench_index [capacity_log2] [grow_keys]
+
+namespace
+{
+    using kvstore::Record;
+    using kvstore::RecordIndex;
+
+    // 上一版 RecordIndex，仅保留基准测试需要的操作
+    class LinearIndex
+    {
+    public:
+        size_t find(std::string_view key, size_t hash) const
+        {
+            if (size_ == 0)
+                return SIZE_MAX;
+            uint64_t tag = hash >> 48;
+            for (size_t pos = home(hash);; pos = (pos + 1) & mask_)
+            {
+                uint64_t slot = slots_[pos];
+                if (slot == 0)
+                    return SIZE_MAX;
+                if ((slot >> 48) == tag && record_of(slot)->key() == key)
+                    return pos;
+            }
+        }
+
+        void insert(Record *record, size_t hash)
+        {
+            if (size_ + 1 > static_cast<size_t>(slots_.size() * 0.8))
+                rehash(std::max<size_t>(16, slots_.size() * 2));
+            size_t pos = home(hash);
+            while (slots_[pos] != 0)
+                pos = (pos + 1) & mask_;
+            slots_[pos] = (static_cast<uint64_t>(hash) >> 48 << 48) | reinterpret_cast<uint64_t>(record);
+            size_++;
+        }
+
+        void reserve(size_t count)
+        {
+            size_t capacity = 16;
+            while (capacity * 0.8 < count)
+                capacity *= 2;
+            if (capacity > slots_.size())
+                rehash(capacity);
+        }
+
+        double load_factor() const { return slots_.empty() ? 0 : static_cast<double>(size_) / slots_.size(); }
+
+    private:
+        static Record *record_of(uint64_t slot) { return reinterpret_cast<Record *>(slot & ((1ull << 48) - 1)); }
+        size_t home(size_t hash) const { return (static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ull) >> shift_; }
+
+        void rehash(size_t capacity)
+        {
+            std::vector<uint64_t> old;
+            old.swap(slots_);
+            slots_.assign(capacity, 0);
+            mask_ = capacity - 1;
+            shift_ = 64 - __builtin_ctzll(capacity);
+            for (uint64_t slot : old)
+            {
+                if (slot == 0)
+                    continue;
+                size_t pos = home(RecordIndex::hash(record_of(slot)->key()));
+                while (slots_[pos] != 0)
+                    pos = (pos + 1) & mask_;
+                slots_[pos] = slot;
+            }
+        }
+
+        std::vector<uint64_t> slots_;
+        size_t mask_ = 0;
+        int shift_ = 64;
+        size_t size_ = 0;
+    };
+
+    class MapIndex
+    {
+    public:
+        bool find(std::string_view key, size_t) const { return map_.find(std::string(key)) != map_.end(); }
+        void insert(Record *record, size_t) { map_.emplace(std::string(record->key()), record); }
+        void reserve(size_t count) { map_.reserve(count); }
+        double load_factor() const { return map_.load_factor(); }
+
+    private:
+        std::unordered_map<std::string, Record *> map_;
+    };
+
+    struct Keys
+    {
+        kvstore::SlabAllocator allocator;
+        std::vector<Record *> records;
+        std::vector<size_t> hashes;
+        std::vector<std::string> misses;
+        std::vector<size_t> order; // 查找顺序随机打乱，避免顺序访问掩盖缓存未命中
+
+        explicit Keys(size_t count)
+        {
+            std::mt19937_64 rng(42);
+            for (size_t i = 0; i < count; i++)
+            {
+                std::string key = "key" + std::to_string(rng());
+                records.push_back(Record::create(allocator, key, std::string(), 0));
+                hashes.push_back(RecordIndex::hash(key));
+                misses.push_back("miss" + std::to_string(rng()));
+                order.push_back(i);
+            }
+            std::shuffle(order.begin(), order.end(), rng);
+        }
+
+        ~Keys()
+        {
+            for (Record *record : records)
+                Record::release(record, allocator);
+        }
+    };
+
+    double elapsed_ns(std::chrono::steady_clock::time_point begin, size_t ops)
+    {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / ops;
+    }
+
+    template <typename Index>
+    bool found(const Index &index, std::string_view key, size_t hash)
+    {
+        if constexpr (std::is_same_v<Index, MapIndex>)
+            return index.find(key, hash);
+        else
+            return index.find(key, hash) != SIZE_MAX;
+    }
+
+    // 预留 capacity 个槽位后插入 count 个键，再分别做命中和未命中的查找
+    template <typename Index>
+    void run_load(const char *label, const Keys &keys, size_t capacity, size_t count)
+    {
+        Index index;
+        index.reserve(capacity * 4 / 5);
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; i++)
+            index.insert(keys.records[i], keys.hashes[i]);
+        double put = elapsed_ns(begin, count);
+
+        size_t hits = 0;
+        begin = std::chrono::steady_clock::now();
+        for (size_t i : keys.order)
+        {
+            if (i < count)
+                hits += found(index, keys.records[i]->key(), RecordIndex::hash(keys.records[i]->key()));
+        }
+        double get = elapsed_ns(begin, count);
+
+        size_t false_hits = 0;
+        begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; i++)
+            false_hits += found(index, keys.misses[i], RecordIndex::hash(keys.misses[i]));
+        double miss = elapsed_ns(begin, count);
+
+        std::printf("%-7s  load %.3f  put %6.1f ns  get hit %6.1f ns  get miss %6.1f ns%s\n", label, index.load_factor(), put, get, miss,
+                    hits == count && false_hits == 0 ? "" : "  VERIFY FAILED");
+    }
+
+    // 从空表插入全部键，记录单次插入的最长耗时，扩容时一次性重新散列的实现会在这里停顿
+    template <typename Index>
+    void run_grow(const char *label, const Keys &keys)
+    {
+        Index index;
+        double worst = 0;
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < keys.records.size(); i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            index.insert(keys.records[i], keys.hashes[i]);
+            worst = std::max(worst, std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        }
+        double total = elapsed_ns(begin, keys.records.size());
+        std::printf("%-7s  %zu inserts  %6.1f ns/insert  worst single insert %10.1f us\n", label, keys.records.size(), total, worst);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t capacity = size_t(1) << (argc > 1 ? std::stoul(argv[1]) : 20);
+    size_t grow_keys = argc > 2 ? std::stoul(argv[2]) : 8000000;
+
+    Keys keys(std::max(capacity, grow_keys));
+    std::printf("swiss probing: %s, table capacity %zu\n", RecordIndex::probe_kind(), capacity);
+    for (double load : {0.25, 0.5, 0.75, 0.85})
+    {
+        size_t count = static_cast<size_t>(capacity * load);
+        std::printf("-- target load %.2f (%zu keys)\n", load, count);
+        run_load<MapIndex>("map", keys, capacity, count);
+        run_load<LinearIndex>("linear", keys, capacity, count);
+        run_load<RecordIndex>("swiss", keys, capacity, count);
+    }
+
+    std::printf("-- growth from empty\n");
+    run_grow<MapIndex>("map", keys);
+    run_grow<LinearIndex>("linear", keys);
+    run_grow<RecordIndex>("swiss", keys);
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include "kv_store.h"
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 测量 KVStore 在 1~64 个线程下的吞吐量，读写比例为 9:1
+// 用法: ./bench_kv_store [shard_count] [ops_per_thread]
+
+static const int kKeyCount = 100000;
+
+double run(kvstore::KVStore &store, int thread_count, int ops_per_thread)
+{
+    std::atomic<bool> start(false);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; ++t)
+    {
+        threads.emplace_back([&, t]()
+                             {
+            std::mt19937 rng(t);
+            std::uniform_int_distribution<int> key_dist(0, kKeyCount - 1);
+            std::string value;
+            int64_t version;
+            while (!start.load(std::memory_order_acquire))
+            {
+                std::this_thread::yield();
+            }
+            for (int i = 0; i < ops_per_thread; ++i)
+            {
+                std::string key = "key" + std::to_string(key_dist(rng));
+                if (i % 10 == 0)
+                {
+                    store.put(key, "value" + std::to_string(i), i);
+                }
+                else
+                {
+                    store.get(key, value, version);
+                }
+            } });
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    start.store(true, std::memory_order_release);
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    return thread_count * static_cast<double>(ops_per_thread) / elapsed.count();
+}
+
+int main(int argc, char **argv)
+{
+    size_t shard_count = argc > 1 ? std::stoul(argv[1]) : kvstore::KVStoreOptions().shard_count;
+    int ops_per_thread = argc > 2 ? std::stoi(argv[2]) : 200000;
+
+    for (size_t shards : {static_cast<size_t>(1), shard_count})
+    {
+        kvstore::KVStoreOptions options;
+        options.shard_count = shards;
+        kvstore::KVStore store(kvstore::NodeInfo("bench", "localhost:0"), options);
+        for (int i = 0; i < kKeyCount; ++i)
+        {
+            store.put("key" + std::to_string(i), "value" + std::to_string(i), 0);
+        }
+
+        std::cout << "shards: " << shards << std::endl;
+        for (int threads = 1; threads <= 64; threads *= 2)
+        {
+            double ops = run(store, threads, ops_per_thread);
+            std::cout << "  threads: " << std::setw(2) << threads
+                      << "  throughput: " << std::fixed << std::setprecision(0) << ops << " ops/s" << std::endl;
+        }
+    }
+    return 0;
+}
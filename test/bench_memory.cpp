@@ -0,0 +1,150 @@
+#include "kv_store.h"
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// 比较装载大量小键时 KVStore（slab 记录 + 开放寻址索引）与改造前按分片的 std::unordered_map 存储的内存占用和耗时。
+// 每种存储在单独的子进程中装载，RSS 为装载前后 /proc/self/statm 的差值
+// 用法: ./bench_memory [key_count] [value_size] [slab|map|both]
+
+namespace
+{
+    // 改造前 KVStore 的存储结构：每个分片一把读写锁和一个 unordered_map，值为引用计数缓冲区
+    class LegacyStore
+    {
+    public:
+        explicit LegacyStore(size_t shard_count) : shard_count_(shard_count), shards_(new Shard[shard_count]) {}
+
+        void put(const std::string &key, std::string value, int64_t version)
+        {
+            Shard &shard = shards_[std::hash<std::string>{}(key) % shard_count_];
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            auto &entry = shard.store[key];
+            entry.first = std::make_shared<const std::string>(std::move(value));
+            entry.second = version;
+        }
+
+        bool get(const std::string &key, std::string &value)
+        {
+            Shard &shard = shards_[std::hash<std::string>{}(key) % shard_count_];
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            auto it = shard.store.find(key);
+            if (it == shard.store.end())
+                return false;
+            value = *it->second.first;
+            return true;
+        }
+
+    private:
+        struct alignas(64) Shard
+        {
+            std::shared_mutex mutex;
+            std::unordered_map<std::string, std::pair<std::shared_ptr<const std::string>, int64_t>> store;
+        };
+
+        size_t shard_count_;
+        std::unique_ptr<Shard[]> shards_;
+    };
+
+    size_t rss_bytes()
+    {
+        long pages = 0, resident = 0;
+        FILE *file = std::fopen("/proc/self/statm", "r");
+        if (file != nullptr)
+        {
+            if (std::fscanf(file, "%ld %ld", &pages, &resident) != 2)
+                resident = 0;
+            std::fclose(file);
+        }
+        return static_cast<size_t>(resident) * sysconf(_SC_PAGESIZE);
+    }
+
+    // 装载 key_count 个键，再随机读一遍，打印一行结果
+    template <typename Put, typename Get>
+    void run(const char *label, size_t key_count, size_t value_size, Put &&put, Get &&get, const std::function<void()> &report)
+    {
+        size_t rss_before = rss_bytes();
+        std::string value(value_size, 'v');
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < key_count; ++i)
+        {
+            put("key" + std::to_string(i), value);
+        }
+        std::chrono::duration<double> load = std::chrono::steady_clock::now() - begin;
+        size_t rss = rss_bytes() - rss_before;
+
+        std::string got;
+        size_t found = 0;
+        begin = std::chrono::steady_clock::now();
+        for (size_t i = 0, k = 0; i < key_count; ++i, k = (k + 7919) % key_count)
+        {
+            found += get("key" + std::to_string(k), got);
+        }
+        std::chrono::duration<double> read = std::chrono::steady_clock::now() - begin;
+
+        std::printf("%-6s load %6.2f s (%5.0f ns/key)  get %6.2f s (%5.0f ns/key)  rss %7.1f MiB  %6.1f B/key  %s\n", label, load.count(),
+                    load.count() * 1e9 / key_count, read.count(), read.count() * 1e9 / key_count, rss / 1048576.0,
+                    static_cast<double>(rss) / key_count, found == key_count ? "" : "VERIFY FAILED");
+        report();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t key_count = argc > 1 ? std::stoul(argv[1]) : 10000000;
+    size_t value_size = argc > 2 ? std::stoul(argv[2]) : 16;
+    std::string mode = argc > 3 ? argv[3] : "both";
+
+    std::cout << key_count << " keys, " << value_size << " byte values" << std::endl;
+    for (const std::string &store : {"map", "slab"})
+    {
+        if (mode != "both" && mode != store)
+            continue;
+        std::cout.flush();
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            if (store == "map")
+            {
+                LegacyStore legacy(16);
+                run(
+                    "map", key_count, value_size, [&](const std::string &key, const std::string &value)
+                    { legacy.put(key, value, 0); },
+                    [&](const std::string &key, std::string &value)
+                    { return legacy.get(key, value); },
+                    [] {});
+            }
+            else
+            {
+                kvstore::KVStore kv(kvstore::NodeInfo("bench", "localhost:0"));
+                int64_t version;
+                run(
+                    "slab", key_count, value_size, [&](const std::string &key, const std::string &value)
+                    { kv.put_if_newer(key, value, 0); },
+                    [&](const std::string &key, std::string &value)
+                    { return kv.get(key, value, version); },
+                    [&]
+                    {
+                        kvstore::MemoryStats stats = kv.memory_stats();
+                        std::printf("       memory_stats: %zu keys, data %.1f MiB, records %.1f MiB, slabs %.1f MiB, index %.1f MiB, "
+                                    "external %.1f MiB, %.1f B/key\n",
+                                    stats.keys, stats.data_bytes / 1048576.0, stats.record_bytes / 1048576.0, stats.slab_bytes / 1048576.0,
+                                    stats.index_bytes / 1048576.0, stats.external_bytes / 1048576.0, stats.bytes_per_key());
+                    });
+            }
+            std::fflush(stdout);
+            _exit(0);
+        }
+        int status;
+        waitpid(pid, &status, 0);
+    }
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include "consistency_hash.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+// 比较两种路由方式的单次耗时和堆分配次数：
+//   legacy: 环返回节点名副本，与本节点名（NodeInfo 副本）比较，再线性扫描节点列表查地址
+//   table:  环返回节点编号，直接索引预先建好的路由表
+// 用法: ./bench_routing [key_count] [node_count]
+
+static std::atomic<size_t> g_allocations(0);
+
+void *operator new(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+// 与服务端 NodeInfo 一样按值返回成员的旧式节点信息
+class LegacyNodeInfo
+{
+public:
+    LegacyNodeInfo(const std::string &name, const std::string &address) : name_(name), address_(address) {}
+    std::string get_name() const { return name_; }
+    std::string get_address() const { return address_; }
+
+private:
+    std::string name_;
+    std::string address_;
+};
+
+struct Route
+{
+    std::string name;
+    std::string address;
+    void *stub;
+    bool is_self;
+};
+
+template <typename Fn>
+void measure(const char *label, const std::vector<std::string> &keys, Fn &&fn)
+{
+    size_t sink = 0;
+    size_t allocations_before = g_allocations.load();
+    auto begin = std::chrono::steady_clock::now();
+    for (const auto &key : keys)
+    {
+        sink += fn(key);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - begin;
+    size_t allocations = g_allocations.load() - allocations_before;
+    std::cout << "  " << std::setw(6) << label
+              << "  " << std::fixed << std::setprecision(1) << elapsed.count() / keys.size() << " ns/op"
+              << "  " << std::setprecision(2) << static_cast<double>(allocations) / keys.size() << " allocs/op"
+              << (sink == 0 ? " (no remote keys)" : "") << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    int key_count = argc > 1 ? std::stoi(argv[1]) : 1000000;
+    int max_nodes = argc > 2 ? std::stoi(argv[2]) : 100;
+
+    std::vector<std::string> keys;
+    keys.reserve(key_count);
+    for (int i = 0; i < key_count; ++i)
+    {
+        keys.push_back("key" + std::to_string(i));
+    }
+
+    for (int node_count : {3, 10, max_nodes})
+    {
+        // 节点名和地址足够长，避开短字符串优化，与真实部署中的主机名相当
+        std::vector<LegacyNodeInfo> nodes;
+        ConsistencyHash ring;
+        for (int i = 1; i <= node_count; ++i)
+        {
+            std::string name = "kvstore-node-" + std::to_string(i);
+            nodes.emplace_back(name, name + ".cluster.local:50051");
+            ring.addNode(name);
+        }
+        LegacyNodeInfo self = nodes[0];
+
+        std::vector<Route> routes(ring.size());
+        for (size_t id = 0; id < routes.size(); ++id)
+        {
+            routes[id].name = ring.getNodeName(id);
+            for (const auto &node : nodes)
+            {
+                if (node.get_name() == routes[id].name)
+                    routes[id].address = node.get_address();
+            }
+            routes[id].stub = &routes[id];
+            routes[id].is_self = routes[id].name == self.get_name();
+        }
+
+        std::cout << "nodes: " << node_count << std::endl;
+        measure("legacy", keys, [&](const std::string &key) -> size_t
+                {
+            std::string node = ring.getNodeName(ring.getNode(key));
+            LegacyNodeInfo copy = self;
+            if (node == copy.get_name())
+                return 0;
+            for (const auto &info : nodes)
+            {
+                if (info.get_name() == node)
+                    return info.get_address().size();
+            }
+            return 0; });
+        measure("table", keys, [&](const std::string &key) -> size_t
+                {
+            const Route &route = routes[ring.getNode(key)];
+            return route.is_self ? 0 : route.address.size(); });
+    }
+    return 0;
+}
@@ -0,0 +1,174 @@
+#include <grpcpp/grpcpp.h>
+#include "kvstore.grpc.pb.h"
+#include "async_server.h"
+#include "consistency_hash.h"
+#include "server.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 统计处理一次 Put / Get 时值被复制的次数。两个节点与客户端在同一进程内，
+// 值的每一次 std::string 复制都会分配一块不小于值大小的内存，按这类分配的次数计为复制次数，
+// 包括服务端反序列化请求、客户端反序列化响应时从网络缓冲区复制的各一次。
+// gRPC 的网络缓冲区由 gpr_malloc 分配，不计入统计。
+//   local:   请求直接发给负责节点
+//   forward: 请求发给另一个节点，由它转发给负责节点
+// 用法: ./bench_value_copy [sync|async] [requests]
+
+static std::atomic<size_t> g_threshold(SIZE_MAX);
+static std::atomic<size_t> g_copies(0);
+
+void *operator new(size_t size)
+{
+    if (size >= g_threshold.load(std::memory_order_relaxed))
+        g_copies.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+    struct BenchNode
+    {
+        std::unique_ptr<kvstore::KVStoreServiceImpl> service;
+        std::unique_ptr<kvstore::KVStoreAsyncServer> async_server;
+        std::unique_ptr<grpc::Server> server;
+
+        BenchNode(const kvstore::NodeInfo &node, const std::vector<kvstore::NodeInfo> &nodes, bool async_mode)
+        {
+            kvstore::LeaseOptions leases;
+            leases.lease_ms = 0;
+            service = std::make_unique<kvstore::KVStoreServiceImpl>(node, nodes, kvstore::ChannelOptions(), kvstore::KVStoreOptions(),
+                                                                    kvstore::MembershipOptions(), kvstore::ReplicationOptions(), leases);
+            grpc::ServerBuilder builder;
+            builder.AddListeningPort(node.get_address(), grpc::InsecureServerCredentials());
+            builder.SetMaxReceiveMessageSize(-1);
+            if (async_mode)
+            {
+                async_server = std::make_unique<kvstore::KVStoreAsyncServer>(*service, 1);
+                async_server->register_with(builder);
+            }
+            else
+            {
+                builder.RegisterService(service.get());
+            }
+            server = builder.BuildAndStart();
+            if (async_server)
+            {
+                async_server->start();
+            }
+        }
+
+        ~BenchNode()
+        {
+            service->shutdown();
+            server->Shutdown();
+            if (async_server)
+            {
+                async_server->shutdown();
+            }
+        }
+    };
+
+    // 找一个由 owner 号节点负责的键
+    std::string key_owned_by(int owner, const std::vector<kvstore::NodeInfo> &nodes)
+    {
+        ConsistencyHash ring;
+        for (const auto &node : nodes)
+        {
+            ring.addNode(node.get_name());
+        }
+        for (int i = 0;; i++)
+        {
+            std::string key = "copy_key" + std::to_string(i);
+            if (ring.getNode(key) == owner)
+                return key;
+        }
+    }
+
+    template <typename Fn>
+    void measure(const char *label, size_t value_size, int requests, Fn &&fn)
+    {
+        fn(); // 预热连接
+        g_threshold.store(value_size);
+        g_copies.store(0);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < requests; i++)
+        {
+            fn();
+        }
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / requests;
+        double copies = static_cast<double>(g_copies.load()) / requests;
+        g_threshold.store(SIZE_MAX);
+        std::cout << std::left << std::setw(16) << label << std::right << std::setw(8) << value_size
+                  << std::setw(14) << std::fixed << std::setprecision(2) << copies
+                  << std::setw(14) << static_cast<size_t>(copies * value_size) << std::setw(12) << std::setprecision(1) << us << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool async_mode = argc > 1 && std::string(argv[1]) == "async";
+    int requests = argc > 2 ? std::atoi(argv[2]) : 2000;
+
+    std::vector<kvstore::NodeInfo> nodes = {kvstore::NodeInfo("node1", "localhost:50131"), kvstore::NodeInfo("node2", "localhost:50132")};
+    std::vector<std::unique_ptr<BenchNode>> servers;
+    for (const auto &node : nodes)
+    {
+        servers.push_back(std::make_unique<BenchNode>(node, nodes, async_mode));
+    }
+
+    grpc::ChannelArguments args;
+    args.SetMaxReceiveMessageSize(-1);
+    auto stub = kvstore::KVStoreRPC::NewStub(grpc::CreateCustomChannel(nodes[0].get_address(), grpc::InsecureChannelCredentials(), args));
+    std::string local_key = key_owned_by(0, nodes);
+    std::string remote_key = key_owned_by(1, nodes);
+
+    std::cout << (async_mode ? "async" : "sync") << " server, " << requests << " requests per row" << std::endl;
+    std::cout << std::left << std::setw(16) << "op" << std::right << std::setw(8) << "bytes" << std::setw(14) << "copies/req"
+              << std::setw(14) << "copied B/req" << std::setw(12) << "us/req" << std::endl;
+    for (size_t value_size : {4096, 65536})
+    {
+        for (const std::string &key : {local_key, remote_key})
+        {
+            std::string path = key == local_key ? "local" : "forward";
+            kvstore::PutRequest put;
+            put.set_key(key);
+            put.set_value(std::string(value_size, 'v'));
+            put.set_assign_version(true);
+            kvstore::PutResponse put_response;
+            measure(("put " + path).c_str(), value_size, requests, [&]()
+                    {
+                grpc::ClientContext context;
+                stub->Put(&context, put, &put_response); });
+
+            kvstore::GetRequest get;
+            get.set_key(key);
+            kvstore::GetResponse get_response;
+            measure(("get " + path).c_str(), value_size, requests, [&]()
+                    {
+                grpc::ClientContext context;
+                stub->Get(&context, get, &get_response); });
+        }
+    }
+    servers.clear();
+    return 0;
+}
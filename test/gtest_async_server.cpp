@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+#include "test_cluster.h"
+#include <map>
+
+// 在同一进程内以异步模式（KVStoreAsyncServer）启动节点，验证本地处理、转发、复制和 quorum 读在 CQ 状态机上的行为
+namespace
+{
+    using namespace kvstore_test;
+
+    NodeOptions AsyncOptions()
+    {
+        NodeOptions options;
+        options.async = true;
+        options.membership.heartbeat_interval_ms = 100;
+        options.membership.failure_timeout_ms = 0; // 不自动移除节点
+        return options;
+    }
+
+    grpc::Status Put(TestNode &node, const std::string &key, const std::string &value, int64_t version, kvstore::PutResponse *response, int write_quorum = 0)
+    {
+        kvstore::PutRequest request;
+        request.set_key(key);
+        request.set_value(value);
+        request.set_version(version);
+        request.set_write_quorum(write_quorum);
+        grpc::ClientContext context;
+        return node.stub->Put(&context, request, response);
+    }
+
+    grpc::Status Del(TestNode &node, const std::string &key)
+    {
+        kvstore::DeleteRequest request;
+        request.set_key(key);
+        kvstore::DeleteResponse response;
+        grpc::ClientContext context;
+        return node.stub->Del(&context, request, &response);
+    }
+
+    // 对端连接可能还在重连退避中，失败则重试
+    std::map<std::string, std::string> PutKeys(TestNode &node, const std::string &prefix, int count)
+    {
+        std::map<std::string, std::string> data;
+        for (int i = 0; i < count; i++)
+        {
+            std::string key = prefix + std::to_string(i);
+            std::string value = prefix + "_value" + std::to_string(i);
+            EXPECT_TRUE(WaitFor([&]()
+                                {
+                kvstore::PutResponse response;
+                return Put(node, key, value, 1, &response).ok() && response.success(); }))
+                << "PUT failed for key: " << key;
+            data[key] = value;
+        }
+        return data;
+    }
+
+    const kvstore::Route *Owner(TestNode &node, const std::string &key)
+    {
+        return node.service->membership().table()->owner(key);
+    }
+}
+
+// 经同一个节点写入的键一部分在本地处理，一部分转发给负责节点；读取和删除从另一个节点发起同样经过转发
+TEST(AsyncServerTest, TestLocalAndForwarded)
+{
+    std::vector<kvstore::NodeInfo> nodes = {
+        kvstore::NodeInfo("node1", "localhost:50121"),
+        kvstore::NodeInfo("node2", "localhost:50122")};
+    auto cluster = StartCluster(nodes, AsyncOptions());
+
+    auto data = PutKeys(*cluster[0], "async_key", 40);
+    int local = 0;
+    for (const auto &entry : data)
+    {
+        const kvstore::Route *owner = Owner(*cluster[0], entry.first);
+        local += owner->is_self ? 1 : 0;
+        // 值只存在于负责节点上
+        TestNode &holder = owner->is_self ? *cluster[0] : *cluster[1];
+        std::string value;
+        ASSERT_TRUE(Get(holder, entry.first, value, true)) << entry.first;
+        ASSERT_EQ(value, entry.second);
+        ASSERT_TRUE(Get(*cluster[1], entry.first, value)) << "GET failed for key: " << entry.first;
+        ASSERT_EQ(value, entry.second);
+
+        // 旧版本的写入无论本地还是转发都返回冲突和可用的下一个版本
+        kvstore::PutResponse response;
+        ASSERT_TRUE(Put(*cluster[1], entry.first, "stale", 1, &response).ok());
+        ASSERT_FALSE(response.success());
+        ASSERT_EQ(response.version(), 2);
+    }
+    ASSERT_GT(local, 0);
+    ASSERT_LT(local, static_cast<int>(data.size()));
+
+    for (const auto &entry : data)
+    {
+        ASSERT_TRUE(Del(*cluster[1], entry.first).ok()) << "DEL failed for key: " << entry.first;
+        std::string value;
+        ASSERT_FALSE(Get(*cluster[0], entry.first, value));
+        ASSERT_EQ(Del(*cluster[0], entry.first).error_code(), grpc::StatusCode::NOT_FOUND);
+    }
+}
+
+// 副本写入由异步服务端应用；quorum 读并行读取各副本；写 quorum 不足时写入在主副本生效并返回 DEADLINE_EXCEEDED
+TEST(AsyncServerTest, TestReplicatedWrites)
+{
+    std::vector<kvstore::NodeInfo> nodes = {
+        kvstore::NodeInfo("node1", "localhost:50123"),
+        kvstore::NodeInfo("node2", "localhost:50124"),
+        kvstore::NodeInfo("node3", "localhost:50125")};
+    NodeOptions options = AsyncOptions();
+    options.replication.replicas = 3;
+    options.replication.write_quorum = 3;
+    options.replication.replica_timeout_ms = 500;
+    auto cluster = StartCluster(nodes, options);
+    WarmUp(*cluster[0], cluster);
+
+    auto data = PutKeys(*cluster[0], "async_replica", 20);
+    for (const auto &entry : data)
+    {
+        for (auto &node : cluster)
+        {
+            std::string value;
+            ASSERT_TRUE(Get(*node, entry.first, value, true)) << entry.first;
+            ASSERT_EQ(value, entry.second);
+        }
+        kvstore::GetRequest request;
+        request.set_key(entry.first);
+        request.set_read_quorum(3);
+        kvstore::GetResponse response;
+        grpc::ClientContext context;
+        ASSERT_TRUE(cluster[1]->stub->Get(&context, request, &response).ok()) << entry.first;
+        ASSERT_EQ(response.value(), entry.second);
+    }
+
+    cluster[2]->stop();
+    for (const auto &entry : data)
+    {
+        if (Owner(*cluster[0], entry.first)->name == "node3")
+            continue;
+        kvstore::PutResponse response;
+        ASSERT_EQ(Put(*cluster[0], entry.first, "updated", 2, &response).error_code(), grpc::StatusCode::DEADLINE_EXCEEDED) << entry.first;
+        std::string value;
+        ASSERT_TRUE(Get(*cluster[0], entry.first, value));
+        ASSERT_EQ(value, "updated");
+        ASSERT_TRUE(Put(*cluster[0], entry.first, "updated", 3, &response, 2).ok()) << entry.first;
+        ASSERT_TRUE(response.success());
+    }
+}
+
+// 新节点加入后迁移尚未完成（限速），新负责节点在 CQ 上回读和删除上一任负责节点上的键
+TEST(AsyncServerTest, TestPreviousOwner)
+{
+    std::vector<kvstore::NodeInfo> nodes = {
+        kvstore::NodeInfo("node1", "localhost:50126"),
+        kvstore::NodeInfo("node2", "localhost:50127")};
+    NodeOptions options = AsyncOptions();
+    options.membership.migration_bytes_per_sec = 1;
+    auto cluster = StartCluster(nodes, options);
+    auto data = PutKeys(*cluster[0], "async_previous", 40);
+
+    kvstore::NodeInfo node3("node3", "localhost:50128");
+    options.membership.seed = "localhost:50126";
+    cluster.push_back(StartNode(node3, {node3}, options));
+    ASSERT_TRUE(WaitFor([&]()
+                        {
+        for (auto &node : cluster)
+        {
+            if (node->service->membership().table()->view.members_size() != 3)
+                return false;
+        }
+        return true; }))
+        << "node3 did not join";
+
+    int pending = 0;
+    for (const auto &entry : data)
+    {
+        std::string value;
+        if (!Owner(*cluster[2], entry.first)->is_self || Get(*cluster[2], entry.first, value, true))
+            continue;
+        pending++;
+        ASSERT_TRUE(Get(*cluster[2], entry.first, value)) << entry.first;
+        ASSERT_EQ(value, entry.second);
+        ASSERT_TRUE(Del(*cluster[0], entry.first).ok()) << entry.first;
+        ASSERT_FALSE(Get(*cluster[2], entry.first, value)) << entry.first;
+        ASSERT_FALSE(Get(*cluster[0], entry.first, value, true)) << entry.first;
+        ASSERT_FALSE(Get(*cluster[1], entry.first, value, true)) << entry.first;
+    }
+    ASSERT_GT(pending, 0);
+}
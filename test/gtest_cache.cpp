@@ -1,12 +1,13 @@
 #include <gtest/gtest.h>
 #include <grpcpp/grpcpp.h>
 #include "client.h"
+#include "client_cache.h"
 
 // 模拟 PUT 请求
 TEST(KVStoreTest, TestCacheAndPutLRU)
 {
     std::string server_address("localhost:50051");
-    kvstore::KVClient client(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 2);
+    kvstore::KVClient client(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 2 * kvstore::KVCache::charge(4, 6)); // 容纳两个条目
 
     std::string key = "key1";
     std::string value1 = "value1";
@@ -34,7 +35,7 @@ TEST(KVStoreTest, TestCacheAndPutLRU)
 TEST(KVStoreTest, TestCacheInvalidationLRU)
 {
     std::string server_address("localhost:50051");
-    kvstore::KVClient client(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1);
+    kvstore::KVClient client(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), kvstore::KVCache::charge(4, 6)); // 只容纳一个条目
 
     std::string key1 = "key1";
     std::string value1 = "value1";
@@ -67,6 +68,66 @@ TEST(KVStoreTest, TestCacheInvalidationLRU)
     ASSERT_TRUE(status.ok()) << "DEL failed for key: " << key2;
 }
 
+// 缓存占用不超过字节预算，超过容量的值不缓存
+TEST(KVCacheTest, TestByteBudget)
+{
+    size_t capacity = 100 * kvstore::KVCache::charge(8, 100);
+    kvstore::KVCache cache(capacity);
+    for (int i = 0; i < 1000; i++)
+    {
+        cache.set("key" + std::to_string(i), std::string(100, 'v'), i);
+        ASSERT_LE(cache.stats().bytes, capacity);
+    }
+    kvstore::CacheStats stats = cache.stats();
+    ASSERT_GT(stats.entries, 0u);
+    ASSERT_LE(stats.entries, capacity / kvstore::KVCache::charge(4, 100)); // 最短的键为 4 字节
+    ASSERT_EQ(stats.capacity_bytes, capacity);
+
+    std::string value;
+    int64_t version;
+    cache.set("large", std::string(capacity, 'v'), 1);
+    ASSERT_FALSE(cache.get("large", value, version));
+}
+
+// 只访问一次的扫描键不会挤掉反复读取的热点键
+TEST(KVCacheTest, TestScanResistance)
+{
+    kvstore::KVCache cache(1000 * kvstore::KVCache::charge(8, 16));
+    std::string value;
+    int64_t version;
+    auto read = [&](const std::string &key)
+    {
+        if (cache.get(key, value, version))
+            return true;
+        cache.set(key, "value_" + key, 1);
+        return false;
+    };
+
+    for (int round = 0; round < 10; round++)
+    {
+        for (int i = 0; i < 500; i++)
+        {
+            read("hot" + std::to_string(i));
+        }
+    }
+    for (int i = 0; i < 5000; i++)
+    {
+        read("scan" + std::to_string(i));
+    }
+
+    int hits = 0;
+    for (int i = 0; i < 500; i++)
+    {
+        hits += cache.get("hot" + std::to_string(i), value, version);
+    }
+    ASSERT_GE(hits, 450) << "scan evicted the hot working set";
+
+    kvstore::CacheStats stats = cache.stats();
+    ASSERT_GT(stats.rejections, 0u);
+    ASSERT_GT(stats.hit_ratio(), 0.0);
+    ASSERT_LE(stats.bytes, stats.capacity_bytes);
+}
+
 int main(int argc, char **argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
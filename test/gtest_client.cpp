@@ -2,13 +2,17 @@
 #include <grpcpp/grpcpp.h>
 #include "kvstore.grpc.pb.h"
 #include "client.h"
+#include <atomic>
+#include <cstdio>
+#include <future>
+#include <memory>
 #include <thread>
 
 // 模拟 PUT 请求，支持多个键值对
 TEST(KVStoreTest, TestPut)
 {
     std::string server_address("localhost:50051");
-    kvstore::KVClient client(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 10);
+    kvstore::KVClient client(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
 
     std::vector<std::pair<std::string, std::string>> key_value_pairs = {
         {"key1", "value1"},
@@ -27,7 +31,7 @@ TEST(KVStoreTest, TestPut)
 TEST(KVStoreTest, TestGet)
 {
     std::string server_address("localhost:50051");
-    kvstore::KVClient client(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 10);
+    kvstore::KVClient client(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
 
     std::vector<std::pair<std::string, std::string>> key_value_pairs = {
         {"key1", "value1"},
@@ -49,7 +53,7 @@ TEST(KVStoreTest, TestGet)
 TEST(KVStoreTest, TestDel)
 {
     std::string server_address("localhost:50051");
-    kvstore::KVClient client(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 10);
+    kvstore::KVClient client(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
 
     std::vector<std::string> keys_to_delete = {"key1", "key2", "key3"};
 
@@ -64,8 +68,8 @@ TEST(KVStoreTest, TestDel)
 TEST(KVStoreTest, TestConcurrentPut)
 {
     std::string server_address("localhost:50051");
-    kvstore::KVClient client1(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 10);
-    kvstore::KVClient client2(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 10);
+    kvstore::KVClient client1(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
+    kvstore::KVClient client2(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
 
     std::string key = "key1";
     std::string value1 = "value1";
@@ -103,8 +107,8 @@ TEST(KVStoreTest, TestConcurrentPut)
 TEST(KVStoreTest, TestConcurrentGet)
 {
     std::string server_address("localhost:50051");
-    kvstore::KVClient client1(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 10);
-    kvstore::KVClient client2(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 10);
+    kvstore::KVClient client1(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
+    kvstore::KVClient client2(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
 
     std::string key = "key1";
     std::string expected_value = "value2";
@@ -135,8 +139,8 @@ TEST(KVStoreTest, TestConcurrentGet)
 TEST(KVStoreTest, TestConcurrentDel)
 {
     std::string server_address("localhost:50051");
-    kvstore::KVClient client1(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 10);
-    kvstore::KVClient client2(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 10);
+    kvstore::KVClient client1(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
+    kvstore::KVClient client2(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
 
     std::string key = "key1";
     std::string value1 = "value1";
@@ -162,8 +166,333 @@ TEST(KVStoreTest, TestConcurrentDel)
     t2.join();
 }
 
+// 测试批量 PUT/GET/DEL，键分布在多个节点上
+TEST(KVStoreTest, TestMultiPutGetDel)
+{
+    std::string server_address("localhost:50051");
+    kvstore::KVClient client(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
+
+    std::vector<std::pair<std::string, std::string>> entries;
+    std::vector<std::string> keys;
+    for (int i = 0; i < 20; ++i) {
+        entries.emplace_back("multi_key" + std::to_string(i), "multi_value" + std::to_string(i));
+        keys.push_back("multi_key" + std::to_string(i));
+    }
+
+    std::vector<bool> success;
+    grpc::Status status = client.multi_put(entries, success);
+    ASSERT_TRUE(status.ok()) << "MULTI PUT failed: " << status.error_message();
+    for (size_t i = 0; i < entries.size(); ++i) {
+        ASSERT_TRUE(success[i]) << "PUT failed for key: " << entries[i].first;
+    }
+
+    std::vector<std::string> get_keys = keys;
+    get_keys.push_back("multi_missing");
+    std::vector<kvstore::GetResult> results;
+    status = client.multi_get(get_keys, results);
+    ASSERT_TRUE(status.ok()) << "MULTI GET failed: " << status.error_message();
+    ASSERT_EQ(results.size(), get_keys.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        ASSERT_TRUE(results[i].found) << "GET failed for key: " << keys[i];
+        ASSERT_EQ(results[i].value, entries[i].second);
+    }
+    ASSERT_FALSE(results.back().found);
+
+    std::vector<bool> deleted;
+    status = client.multi_del(keys, deleted);
+    ASSERT_TRUE(status.ok()) << "MULTI DEL failed: " << status.error_message();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        ASSERT_TRUE(deleted[i]) << "DEL failed for key: " << keys[i];
+    }
+
+    kvstore::KVClient fresh_client(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
+    status = fresh_client.multi_get(keys, results);
+    ASSERT_TRUE(status.ok());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        ASSERT_FALSE(results[i].found) << "Key still present: " << keys[i];
+    }
+}
+
+// 测试异步接口：单个客户端线程同时挂起多个请求
+TEST(KVStoreTest, TestAsyncPutGetDel)
+{
+    std::string server_address("localhost:50051");
+    kvstore::KVClient client(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20, 2);
+
+    const int count = 200;
+    std::vector<std::future<grpc::Status>> puts;
+    for (int i = 0; i < count; ++i) {
+        puts.push_back(client.async_put("async_key" + std::to_string(i), "async_value" + std::to_string(i)));
+    }
+    for (int i = 0; i < count; ++i) {
+        grpc::Status status = puts[i].get();
+        ASSERT_TRUE(status.ok()) << "ASYNC PUT failed for key: async_key" << i;
+    }
+
+    std::vector<kvstore::GetResult> results(count);
+    std::vector<std::future<grpc::Status>> gets;
+    for (int i = 0; i < count; ++i) {
+        gets.push_back(client.async_get("async_key" + std::to_string(i), results[i]));
+    }
+    for (int i = 0; i < count; ++i) {
+        grpc::Status status = gets[i].get();
+        ASSERT_TRUE(status.ok()) << "ASYNC GET failed for key: async_key" << i;
+        ASSERT_EQ(results[i].value, "async_value" + std::to_string(i));
+    }
+
+    // 回调形式
+    std::atomic<int> deleted(0);
+    std::promise<void> all_done;
+    std::atomic<int> remaining(count);
+    for (int i = 0; i < count; ++i) {
+        client.async_del("async_key" + std::to_string(i), [&](const grpc::Status &status) {
+            if (status.ok()) {
+                deleted++;
+            }
+            if (--remaining == 0) {
+                all_done.set_value();
+            }
+        });
+    }
+    all_done.get_future().wait();
+    ASSERT_EQ(deleted.load(), count);
+
+    kvstore::GetResult missing;
+    grpc::Status status = client.async_get("async_key0", missing).get();
+    ASSERT_EQ(status.error_code(), grpc::StatusCode::NOT_FOUND);
+    ASSERT_FALSE(missing.found);
+}
+
+// 测试客户端路由：键直接发给负责节点；node4 不存在，发给它的请求应回退到其他节点并由服务端转发
+TEST(KVStoreTest, TestClientRouting)
+{
+    std::vector<kvstore::ClusterNode> nodes = {
+        {"node1", "localhost:50051"},
+        {"node2", "localhost:50052"},
+        {"node3", "localhost:50053"},
+        {"node4", "localhost:50059"}
+    };
+    kvstore::KVClient client(nodes, 1 << 20);
+    kvstore::KVClient entry_client(grpc::CreateChannel("localhost:50051", grpc::InsecureChannelCredentials()), 1 << 20);
+
+    for (int i = 0; i < 30; ++i) {
+        std::string key = "routed_key" + std::to_string(i);
+        grpc::Status status = client.put(key, "routed_value" + std::to_string(i));
+        ASSERT_TRUE(status.ok()) << "PUT failed for key: " << key << " " << status.error_message();
+    }
+    for (int i = 0; i < 30; ++i) {
+        std::string key = "routed_key" + std::to_string(i);
+        std::string value;
+        int64_t version;
+        grpc::Status status = entry_client.get(key, value, version);
+        ASSERT_TRUE(status.ok()) << "GET failed for key: " << key;
+        ASSERT_EQ(value, "routed_value" + std::to_string(i));
+
+        kvstore::GetResult result;
+        status = client.async_get(key, result).get();
+        ASSERT_TRUE(status.ok()) << "ASYNC GET failed for key: " << key;
+        ASSERT_EQ(result.value, "routed_value" + std::to_string(i));
+    }
+    for (int i = 0; i < 30; ++i) {
+        std::string key = "routed_key" + std::to_string(i);
+        ASSERT_TRUE(client.del(key).ok()) << "DEL failed for key: " << key;
+    }
+}
+
+// 读到其他键的旧版本不影响之后写入的版本：版本按键记录，不会产生冲突
+TEST(KVStoreTest, TestPerKeyVersions)
+{
+    std::string server_address("localhost:50051");
+    kvstore::KVClient writer(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
+    kvstore::KVClient cold_writer(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
+    kvstore::KVClient client(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
+
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_TRUE(writer.put("versioned_hot", "hot" + std::to_string(i)).ok());
+    }
+    ASSERT_TRUE(cold_writer.put("versioned_cold", "cold").ok());
+
+    std::string value;
+    int64_t hot_version, cold_version;
+    ASSERT_TRUE(client.get("versioned_hot", value, hot_version).ok());
+    ASSERT_TRUE(client.get("versioned_cold", value, cold_version).ok());
+    ASSERT_GT(hot_version, cold_version);
+
+    ASSERT_TRUE(client.put("versioned_hot", "hot_new").ok());
+    ASSERT_TRUE(client.put("versioned_cold", "cold_new").ok());
+    ASSERT_EQ(client.write_stats().conflicts, 0u);
+    ASSERT_TRUE(writer.get("versioned_hot", value, hot_version).ok());
+    ASSERT_EQ(value, "hot_new");
+    ASSERT_TRUE(writer.get("versioned_cold", value, cold_version).ok());
+    ASSERT_EQ(value, "cold_new");
+
+    ASSERT_TRUE(writer.del("versioned_hot").ok());
+    ASSERT_TRUE(writer.del("versioned_cold").ok());
+}
+
+// 不知道键当前版本的写入冲突后，按服务端返回的版本自动重试
+TEST(KVStoreTest, TestConflictRetry)
+{
+    std::string server_address("localhost:50051");
+    kvstore::KVClient writer(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
+    kvstore::KVClient client(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
+    kvstore::WriteOptions options;
+    options.conflict_retries = 3;
+    client.set_write_options(options);
+
+    for (int i = 0; i < 5; ++i) {
+        ASSERT_TRUE(writer.put("retried_key", "old" + std::to_string(i)).ok());
+    }
+    ASSERT_TRUE(client.put("retried_key", "new").ok());
+    kvstore::WriteStats stats = client.write_stats();
+    ASSERT_EQ(stats.conflicts, 1u);
+    ASSERT_EQ(stats.retries, 1u);
+
+    std::string value;
+    int64_t version;
+    ASSERT_TRUE(writer.get("retried_key", value, version).ok());
+    ASSERT_EQ(value, "new");
+
+    // 批量写入同样重试冲突的项
+    std::vector<bool> success;
+    ASSERT_TRUE(writer.multi_put({{"retried_key", "old"}, {"retried_key2", "old"}}, success).ok());
+    kvstore::KVClient batch_client(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
+    batch_client.set_write_options(options);
+    ASSERT_TRUE(batch_client.multi_put({{"retried_key", "batch"}, {"retried_key2", "batch"}}, success).ok());
+    ASSERT_TRUE(success[0] && success[1]);
+    ASSERT_TRUE(writer.get("retried_key2", value, version).ok());
+    ASSERT_EQ(value, "batch");
+
+    std::vector<bool> deleted;
+    ASSERT_TRUE(writer.multi_del({"retried_key", "retried_key2"}, deleted).ok());
+}
+
+// 由主副本分配版本时并发写同一个键互不冲突，每次写入的版本加一
+TEST(KVStoreTest, TestServerAssignedVersions)
+{
+    std::string server_address("localhost:50051");
+    kvstore::WriteOptions options;
+    options.server_versions = true;
+    std::vector<std::unique_ptr<kvstore::KVClient>> clients;
+    for (int i = 0; i < 4; ++i) {
+        clients.push_back(std::make_unique<kvstore::KVClient>(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20));
+        clients.back()->set_write_options(options);
+    }
+
+    const int kWrites = 25;
+    std::vector<std::thread> threads;
+    for (auto &client : clients) {
+        threads.emplace_back([&client]() {
+            for (int i = 0; i < kWrites; ++i) {
+                ASSERT_TRUE(client->put("assigned_key", "value" + std::to_string(i)).ok());
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    std::string value;
+    int64_t version;
+    ASSERT_TRUE(clients[0]->get("assigned_key", value, version).ok());
+    ASSERT_EQ(version, static_cast<int64_t>(clients.size()) * kWrites);
+    for (auto &client : clients) {
+        ASSERT_EQ(client->write_stats().conflicts, 0u);
+    }
+    ASSERT_TRUE(clients[0]->del("assigned_key").ok());
+}
+
 int main(int argc, char **argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
 }
+
+// 前缀扫描覆盖所有节点上的键：逐页取出，结果按键排序、不重复，且不包含前缀之外的键
+TEST(KVStoreTest, TestPrefixScan)
+{
+    kvstore::KVClient client(grpc::CreateChannel("localhost:50051", grpc::InsecureChannelCredentials()), 1 << 20);
+    std::vector<std::pair<std::string, std::string>> entries;
+    std::vector<std::string> expected;
+    for (int i = 0; i < 300; ++i) {
+        char key[32];
+        std::snprintf(key, sizeof(key), "scan_user:%03d", i);
+        entries.emplace_back(key, "scan_value" + std::to_string(i));
+        expected.push_back(key);
+    }
+    std::vector<bool> success;
+    ASSERT_TRUE(client.multi_put(entries, success).ok());
+    ASSERT_TRUE(client.put("scan_user;", "outside").ok());
+    ASSERT_TRUE(client.put("scan_use", "outside").ok());
+
+    std::vector<std::string> scanned;
+    std::string continuation;
+    int pages = 0;
+    do {
+        std::vector<kvstore::ScanItem> items;
+        grpc::Status status = client.prefix_scan("scan_user:", 64, items, continuation);
+        ASSERT_TRUE(status.ok()) << status.error_message();
+        ASSERT_LE(items.size(), 64u);
+        for (const auto &item : items) {
+            ASSERT_EQ(item.value, "scan_value" + std::to_string(std::stoi(item.key.substr(10))));
+            scanned.push_back(item.key);
+        }
+        pages++;
+    } while (!continuation.empty());
+    ASSERT_EQ(scanned, expected);
+    ASSERT_EQ(pages, 5);
+
+    std::vector<std::string> keys(expected);
+    keys.push_back("scan_user;");
+    keys.push_back("scan_use");
+    std::vector<bool> deleted;
+    ASSERT_TRUE(client.multi_del(keys, deleted).ok());
+}
+
+// 区间扫描 [start, end)，end 不包含在结果中
+TEST(KVStoreTest, TestRangeScan)
+{
+    kvstore::KVClient client(grpc::CreateChannel("localhost:50052", grpc::InsecureChannelCredentials()), 1 << 20);
+    for (int i = 0; i < 50; ++i) {
+        char key[32];
+        std::snprintf(key, sizeof(key), "range_key%02d", i);
+        ASSERT_TRUE(client.put(key, "v").ok());
+    }
+    std::vector<kvstore::ScanItem> items;
+    std::string continuation;
+    ASSERT_TRUE(client.scan("range_key10", "range_key20", 0, items, continuation).ok());
+    ASSERT_TRUE(continuation.empty());
+    ASSERT_EQ(items.size(), 10u);
+    ASSERT_EQ(items.front().key, "range_key10");
+    ASSERT_EQ(items.back().key, "range_key19");
+
+    for (int i = 0; i < 50; ++i) {
+        char key[32];
+        std::snprintf(key, sizeof(key), "range_key%02d", i);
+        ASSERT_TRUE(client.del(key).ok());
+    }
+}
+
+// 带 ttl 写入的键到期后读不到，缓存的租约也不会超过剩余的存活时间；不带 ttl 重新写入后不再过期
+TEST(KVStoreTest, TestPutWithTtl)
+{
+    kvstore::KVClient client(grpc::CreateChannel("localhost:50051", grpc::InsecureChannelCredentials()), 1 << 20);
+    std::string value;
+    int64_t version;
+    ASSERT_TRUE(client.put("ttl_session", "token", std::chrono::milliseconds(300)).ok());
+    ASSERT_TRUE(client.put("ttl_counter", "1", std::chrono::milliseconds(300)).ok());
+    ASSERT_TRUE(client.get("ttl_session", value, version).ok());
+    ASSERT_EQ(value, "token");
+    ASSERT_TRUE(client.put("ttl_counter", "2").ok());
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    ASSERT_FALSE(client.get("ttl_session", value, version).ok());
+    ASSERT_TRUE(client.get("ttl_counter", value, version).ok());
+    ASSERT_EQ(value, "2");
+    std::vector<kvstore::ScanItem> items;
+    std::string continuation;
+    ASSERT_TRUE(client.prefix_scan("ttl_", 0, items, continuation).ok());
+    ASSERT_EQ(items.size(), 1u);
+    ASSERT_EQ(items[0].key, "ttl_counter");
+    ASSERT_TRUE(client.del("ttl_counter").ok());
+}
@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+#include "consistency_hash.h"
+#include <string>
+#include <vector>
+
+// 验证一致性哈希：XXH64 与参考实现一致，环只取决于节点集合
+namespace
+{
+    std::vector<std::string> Owners(const ConsistencyHash &ring, const std::string &key, int count)
+    {
+        int ids[8];
+        int found = ring.getNodes(key, count, ids);
+        std::vector<std::string> names;
+        for (int i = 0; i < found; i++)
+        {
+            names.push_back(ring.getNodeName(ids[i]));
+        }
+        return names;
+    }
+}
+
+// xxHash 参考实现给出的 XXH64 结果，覆盖空输入、不足 4/8/32 字节的尾部和 32 字节分组
+TEST(ConsistencyHashTest, TestXxh64ReferenceVectors)
+{
+    EXPECT_EQ(ConsistencyHash::hash(""), 0xEF46DB3751D8E999ULL);
+    EXPECT_EQ(ConsistencyHash::hash("a"), 0xD24EC4F1A98C6E5BULL);
+    EXPECT_EQ(ConsistencyHash::hash("abc"), 0x44BC2CF5AD770999ULL);
+    EXPECT_EQ(ConsistencyHash::hash("xxhash"), 0x32DD38952C4BC720ULL);
+    EXPECT_EQ(ConsistencyHash::hash("Nobody inspects the spammish repetition"), 0xFBCEA83C8A378BF1ULL);
+    std::string xxhash = "xxhash";
+    EXPECT_EQ(ConsistencyHash::hash(xxhash.data(), xxhash.size(), 20141025), 0xB559B98D844E0635ULL);
+}
+
+// 以不同顺序添加同样的节点（含权重与先删后加），每个键的负责节点和副本节点都相同
+TEST(ConsistencyHashTest, TestRingIndependentOfInsertionOrder)
+{
+    ConsistencyHash forward;
+    forward.addNode("node1");
+    forward.addNode("node2", 2);
+    forward.addNode("node3");
+    forward.addNode("node4");
+
+    ConsistencyHash backward;
+    backward.addNode("node4");
+    backward.addNode("node5");
+    backward.addNode("node3");
+    backward.addNode("node2", 2);
+    backward.addNode("node1");
+    backward.removeNode("node5");
+
+    ASSERT_EQ(forward.size(), backward.size());
+    for (int i = 0; i < 10000; i++)
+    {
+        std::string key = "key" + std::to_string(i);
+        ASSERT_EQ(forward.getNodeName(forward.getNode(key)), backward.getNodeName(backward.getNode(key))) << key;
+        ASSERT_EQ(Owners(forward, key, 3), Owners(backward, key, 3)) << key;
+    }
+}
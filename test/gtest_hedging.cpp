@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+#include <grpcpp/grpcpp.h>
+#include "kvstore.grpc.pb.h"
+#include "client.h"
+#include "consistency_hash.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+// 用两个只实现 Get 的假节点验证对冲读：慢节点上的读请求由另一个节点的对冲请求完成
+namespace
+{
+    class FakeNode final : public kvstore::KVStoreRPC::Service
+    {
+    public:
+        FakeNode(const std::string &name, int delay_ms) : name_(name), delay_ms_(delay_ms) {}
+
+        grpc::Status Get(grpc::ServerContext *context, const kvstore::GetRequest *request, kvstore::GetResponse *response) override
+        {
+            if (request->allow_stale())
+            {
+                stale_reads++;
+            }
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(delay_ms_);
+            while (std::chrono::steady_clock::now() < deadline && !context->IsCancelled())
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            response->set_value(name_ + ":" + request->key());
+            response->set_version(1);
+            response->set_found(true);
+            return grpc::Status::OK;
+        }
+
+        std::atomic<int> stale_reads{0};
+
+    private:
+        std::string name_;
+        int delay_ms_;
+    };
+
+    struct FakeCluster
+    {
+        FakeNode slow{"slow", 300};
+        FakeNode fast{"fast", 0};
+        std::unique_ptr<grpc::Server> slow_server;
+        std::unique_ptr<grpc::Server> fast_server;
+        std::vector<kvstore::ClusterNode> nodes = {{"slow", "localhost:50101"}, {"fast", "localhost:50102"}};
+
+        FakeCluster()
+        {
+            slow_server = Start(slow, nodes[0].address);
+            fast_server = Start(fast, nodes[1].address);
+        }
+
+        ~FakeCluster()
+        {
+            slow_server->Shutdown();
+            fast_server->Shutdown();
+        }
+
+        static std::unique_ptr<grpc::Server> Start(FakeNode &node, const std::string &address)
+        {
+            grpc::ServerBuilder builder;
+            builder.AddListeningPort(address, grpc::InsecureServerCredentials());
+            builder.RegisterService(&node);
+            return builder.BuildAndStart();
+        }
+    };
+
+    // 哈希环上由 owner 负责的键，环的构建方式与客户端相同
+    std::vector<std::string> KeysOwnedBy(const std::vector<kvstore::ClusterNode> &nodes, const std::string &owner, int count)
+    {
+        ConsistencyHash ring;
+        for (const auto &node : nodes)
+        {
+            ring.addNode(node.name);
+        }
+        std::vector<std::string> keys;
+        for (int i = 0; (int)keys.size() < count; i++)
+        {
+            std::string key = "hedge_key" + std::to_string(i);
+            if (ring.getNodeName(ring.getNode(key)) == owner)
+                keys.push_back(key);
+        }
+        return keys;
+    }
+}
+
+// 负责节点很慢时，对冲请求在延迟上限后发给另一个节点并胜出
+TEST(HedgingTest, TestHedgeBeatsSlowNode)
+{
+    FakeCluster cluster;
+    kvstore::KVClient client(cluster.nodes, 1 << 20);
+    kvstore::HedgeOptions options;
+    options.enabled = true;
+    options.max_delay_us = 20000;
+    client.set_hedging(options);
+
+    auto keys = KeysOwnedBy(cluster.nodes, "slow", 10);
+    for (const auto &key : keys)
+    {
+        std::string value;
+        int64_t version;
+        auto start = std::chrono::steady_clock::now();
+        ASSERT_TRUE(client.get(key, value, version).ok()) << "GET failed for key: " << key;
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        ASSERT_EQ(value, "fast:" + key);
+        ASSERT_LT(elapsed, std::chrono::milliseconds(200)) << "hedged read waited for the slow node";
+    }
+
+    // 异步接口同样对冲
+    kvstore::GetResult result;
+    ASSERT_TRUE(client.async_get(keys[0], result).get().ok());
+    ASSERT_EQ(result.value, "fast:" + keys[0]);
+
+    kvstore::HedgeStats stats = client.hedge_stats();
+    ASSERT_EQ(stats.reads, keys.size() + 1);
+    ASSERT_EQ(stats.hedges_sent, keys.size() + 1);
+    ASSERT_EQ(stats.hedge_wins, keys.size() + 1);
+}
+
+// 负责节点正常响应时直接使用它的结果，对冲请求不会胜出
+TEST(HedgingTest, TestNoHedgeWinOnFastNode)
+{
+    FakeCluster cluster;
+    kvstore::KVClient client(cluster.nodes, 1 << 20);
+    kvstore::HedgeOptions options;
+    options.enabled = true;
+    options.min_delay_us = 50000; // 远大于本机往返时间
+    options.max_delay_us = 50000;
+    client.set_hedging(options);
+
+    for (const auto &key : KeysOwnedBy(cluster.nodes, "fast", 100))
+    {
+        std::string value;
+        int64_t version;
+        ASSERT_TRUE(client.get(key, value, version).ok()) << "GET failed for key: " << key;
+        ASSERT_EQ(value, "fast:" + key);
+    }
+    kvstore::HedgeStats stats = client.hedge_stats();
+    ASSERT_EQ(stats.reads, 100u);
+    ASSERT_EQ(stats.hedge_wins, 0u);
+    ASSERT_EQ(stats.delay_us, 50000);
+}
+
+// 多副本时只有允许读旧值的客户端才向备份副本发出读旧值的对冲请求，否则对冲请求同样经由负责节点读取
+TEST(HedgingTest, TestHedgeKeepsConsistency)
+{
+    FakeCluster cluster;
+    kvstore::KVClient client(cluster.nodes, 1 << 20);
+    kvstore::HedgeOptions options;
+    options.enabled = true;
+    options.max_delay_us = 20000;
+    client.set_hedging(options);
+    kvstore::ConsistencyOptions consistency;
+    consistency.replicas = 2;
+    client.set_consistency(consistency);
+
+    auto keys = KeysOwnedBy(cluster.nodes, "slow", 10);
+    for (const auto &key : keys)
+    {
+        std::string value;
+        int64_t version;
+        ASSERT_TRUE(client.get(key, value, version).ok()) << "GET failed for key: " << key;
+        ASSERT_EQ(value, "fast:" + key);
+    }
+    ASSERT_EQ(client.hedge_stats().hedge_wins, keys.size());
+    ASSERT_EQ(cluster.fast.stale_reads, 0);
+    ASSERT_EQ(cluster.slow.stale_reads, 0);
+
+    consistency.allow_stale = true;
+    client.set_consistency(consistency);
+    for (const auto &key : keys)
+    {
+        std::string value;
+        int64_t version;
+        ASSERT_TRUE(client.get(key, value, version).ok()) << "GET failed for key: " << key;
+    }
+    ASSERT_GT(cluster.fast.stale_reads, 0);
+}
@@ -0,0 +1,959 @@
+#include <gtest/gtest.h>
+#include "kv_store.h"
+#include "snapshot.h"
+#include <sys/resource.h>
+#include <unistd.h>
+#include <csignal>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+
+// 直接验证 KVStore 的存储层：slab 记录、开放寻址索引和内存统计
+namespace
+{
+    kvstore::KVStoreOptions SingleShard()
+    {
+        kvstore::KVStoreOptions options;
+        options.shard_count = 1; // 所有键落在同一个索引中，覆盖扩容和删除时的前移
+        return options;
+    }
+
+    // 在不限内存的存储中执行 fill 后的记账内存。以它为上限的存储执行同样的写入恰好达到上限而不淘汰
+    size_t UsedAfter(kvstore::KVStoreOptions options, const std::function<void(kvstore::KVStore &)> &fill)
+    {
+        options.max_memory_bytes = 0;
+        kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+        fill(store);
+        return store.memory_stats().used_bytes;
+    }
+
+    void PutKeys(kvstore::KVStore &store, const std::string &prefix, int count, int64_t expire_at_ms = 0)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            ASSERT_TRUE(store.put_if_newer(prefix + std::to_string(i), std::string(100, 'v'), 1, nullptr, expire_at_ms).applied);
+        }
+    }
+
+    int CountKeys(kvstore::KVStore &store, const std::string &prefix, int count)
+    {
+        int found = 0;
+        std::string value;
+        int64_t version;
+        for (int i = 0; i < count; i++)
+        {
+            found += store.get(prefix + std::to_string(i), value, version);
+        }
+        return found;
+    }
+
+    // 本进程独占的空数据目录
+    std::string TempDir(const std::string &name)
+    {
+        std::string dir = (std::filesystem::temp_directory_path() / ("gtest_" + name + "_" + std::to_string(::getpid()))).string();
+        std::filesystem::remove_all(dir);
+        return dir;
+    }
+
+    // 目录中以 prefix 开头的文件，按文件名排序
+    std::vector<std::string> ListFiles(const std::string &dir, const std::string &prefix)
+    {
+        std::vector<std::string> files;
+        for (const auto &entry : std::filesystem::directory_iterator(dir))
+        {
+            if (entry.path().filename().string().rfind(prefix, 0) == 0)
+                files.push_back(entry.path().string());
+        }
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
+    // 把文件中 offset 处的一个字节取反
+    void FlipByte(const std::string &path, uint64_t offset)
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekg(static_cast<std::streamoff>(offset));
+        char byte = static_cast<char>(file.get());
+        file.seekp(static_cast<std::streamoff>(offset));
+        file.put(static_cast<char>(~byte));
+    }
+}
+
+// 大量键插入、覆盖、删除一半后，剩下的键都能读到最新的值
+TEST(KVStoreStorageTest, TestInsertOverwriteErase)
+{
+    kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), SingleShard());
+    const int count = 20000;
+    for (int i = 0; i < count; i++)
+    {
+        ASSERT_TRUE(store.put_if_newer("key" + std::to_string(i), "value" + std::to_string(i), 1).applied);
+    }
+    for (int i = 0; i < count; i += 3)
+    {
+        ASSERT_TRUE(store.put_if_newer("key" + std::to_string(i), "new" + std::to_string(i), 2).applied);
+    }
+    ASSERT_FALSE(store.put_if_newer("key0", "stale", 1).applied);
+    for (int i = 0; i < count; i += 2)
+    {
+        ASSERT_TRUE(store.del("key" + std::to_string(i)));
+    }
+
+    std::string value;
+    int64_t version;
+    for (int i = 0; i < count; i++)
+    {
+        std::string key = "key" + std::to_string(i);
+        if (i % 2 == 0)
+        {
+            ASSERT_FALSE(store.get(key, value, version)) << key;
+            continue;
+        }
+        ASSERT_TRUE(store.get(key, value, version)) << key;
+        ASSERT_EQ(value, (i % 3 == 0 ? "new" : "value") + std::to_string(i));
+        ASSERT_EQ(version, i % 3 == 0 ? 2 : 1);
+    }
+    ASSERT_EQ(store.memory_stats().keys, static_cast<size_t>(count / 2));
+}
+
+// put_if_newer 只接受更新的版本：成功时 current_version 为写入的版本，冲突时为键已有的版本且值不变
+TEST(KVStoreStorageTest, TestPutIfNewer)
+{
+    kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"));
+    kvstore::PutResult result = store.put_if_newer("key", "v3", 3);
+    ASSERT_TRUE(result.applied);
+    ASSERT_EQ(result.current_version, 3);
+
+    for (int64_t stale : {int64_t(3), int64_t(2), int64_t(0)})
+    {
+        result = store.put_if_newer("key", "stale", stale);
+        ASSERT_FALSE(result.applied) << stale;
+        ASSERT_EQ(result.current_version, 3) << stale;
+    }
+    std::string value;
+    int64_t version;
+    ASSERT_TRUE(store.get("key", value, version));
+    ASSERT_EQ(value, "v3");
+    ASSERT_EQ(version, 3);
+
+    result = store.put_if_newer("key", "v7", 7);
+    ASSERT_TRUE(result.applied);
+    ASSERT_EQ(result.current_version, 7);
+    ASSERT_EQ(store.put_next_version("key", "v8").current_version, 8);
+    ASSERT_EQ(store.put_next_version("fresh", "v1").current_version, 1);
+    ASSERT_TRUE(store.get("key", value, version));
+    ASSERT_EQ(value, "v8");
+
+    // 并发写同一个键：每次写入要么生效，要么看到不旧于自己的版本，最终留下最大的版本
+    const int threads = 8;
+    const int per_thread = 500;
+    std::vector<std::thread> writers;
+    for (int t = 0; t < threads; t++)
+    {
+        writers.emplace_back([&store, t]()
+                             {
+            for (int i = 0; i < per_thread; i++)
+            {
+                int64_t v = 100 + i * threads + t;
+                kvstore::PutResult r = store.put_if_newer("race", "v" + std::to_string(v), v);
+                EXPECT_TRUE(r.applied ? r.current_version == v : r.current_version >= v) << v;
+            } });
+    }
+    for (auto &writer : writers)
+    {
+        writer.join();
+    }
+    int64_t last = 100 + threads * per_thread - 1;
+    ASSERT_TRUE(store.get("race", value, version));
+    ASSERT_EQ(version, last);
+    ASSERT_EQ(value, "v" + std::to_string(last));
+}
+
+// 写入、覆盖、删除和由存储分配版本的写入重启后按日志顺序重放，恢复出重启前的状态
+TEST(KVStoreStorageTest, TestWalReplay)
+{
+    std::string dir = TempDir("wal_replay");
+    kvstore::KVStoreOptions options;
+    options.data_dir = dir;
+    options.snapshot_wal_bytes = 0;
+    const int count = 200;
+    {
+        kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+        for (int i = 0; i < count; i++)
+        {
+            ASSERT_TRUE(store.put_if_newer("key" + std::to_string(i), "v1-" + std::to_string(i), 1).applied);
+        }
+        for (int i = 0; i < count; i += 3)
+        {
+            ASSERT_TRUE(store.put_if_newer("key" + std::to_string(i), "v2-" + std::to_string(i), 2).applied);
+        }
+        for (int i = 0; i < count; i += 4)
+        {
+            ASSERT_TRUE(store.del("key" + std::to_string(i)));
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            store.put_next_version("counter", "c" + std::to_string(i));
+        }
+    }
+    // 第二次重启重放的是第一次重启后继续追加的同一个日志
+    for (int restart = 0; restart < 2; restart++)
+    {
+        kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+        std::string value;
+        int64_t version;
+        for (int i = 0; i < count; i++)
+        {
+            std::string key = "key" + std::to_string(i);
+            if (i % 4 == 0)
+            {
+                ASSERT_FALSE(store.get(key, value, version)) << key;
+                continue;
+            }
+            ASSERT_TRUE(store.get(key, value, version)) << key;
+            ASSERT_EQ(value, (i % 3 == 0 ? "v2-" : "v1-") + std::to_string(i));
+            ASSERT_EQ(version, i % 3 == 0 ? 2 : 1);
+        }
+        ASSERT_TRUE(store.get("counter", value, version));
+        ASSERT_EQ(value, "c2");
+        ASSERT_EQ(version, 3);
+        ASSERT_EQ(store.memory_stats().keys, static_cast<size_t>(count - count / 4 + 1));
+    }
+    std::filesystem::remove_all(dir);
+}
+
+// 切换日志段后各段按段号顺序重放，删除已被覆盖的段后只重放之后的段
+TEST(KVStoreStorageTest, TestWalRotation)
+{
+    std::string dir = TempDir("wal_rotation");
+    std::filesystem::create_directories(dir);
+    kvstore::WalOptions options;
+    options.dir = dir;
+    uint64_t second;
+    {
+        kvstore::WriteAheadLog wal(options);
+        ASSERT_TRUE(wal.wait(wal.append(kvstore::WalOp::kPut, "a", "1", 1)));
+        second = wal.rotate();
+        wal.append(kvstore::WalOp::kPut, "a", "2", 2);
+        wal.append(kvstore::WalOp::kDel, "a", "", 2);
+        ASSERT_TRUE(wal.wait(wal.append(kvstore::WalOp::kPut, "b", "1", 1, 12345)));
+    }
+    ASSERT_EQ(ListFiles(dir, "wal-").size(), 2u);
+
+    kvstore::WriteAheadLog wal(options);
+    std::vector<kvstore::WalRecord> records;
+    auto collect = [&](const kvstore::WalRecord &record)
+    { records.push_back(record); };
+    ASSERT_EQ(wal.replay(0, collect), 4u);
+    ASSERT_EQ(records[0].value, "1");
+    ASSERT_EQ(records[1].value, "2");
+    ASSERT_EQ(records[2].op, kvstore::WalOp::kDel);
+    ASSERT_EQ(records[3].key, "b");
+    ASSERT_EQ(records[3].expire_at_ms, 12345);
+
+    wal.remove_segments_before(second);
+    ASSERT_EQ(ListFiles(dir, "wal-").size(), 1u);
+    records.clear();
+    ASSERT_EQ(wal.replay(0, collect), 3u);
+    ASSERT_EQ(records[0].version, 2);
+    std::filesystem::remove_all(dir);
+}
+
+// 崩溃留下的半条记录和校验失败的尾部记录在恢复时丢弃，截掉之后新的写入接在有效记录之后
+TEST(KVStoreStorageTest, TestWalTornTail)
+{
+    std::string dir = TempDir("wal_tail");
+    kvstore::KVStoreOptions options;
+    options.data_dir = dir;
+    options.snapshot_wal_bytes = 0;
+    {
+        kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+        PutKeys(store, "key", 10);
+    }
+    std::string wal = ListFiles(dir, "wal-").back();
+    uint64_t size = std::filesystem::file_size(wal);
+    uint64_t record_size = size / 10; // 十条记录的键和值长度都相同
+    std::filesystem::resize_file(wal, size - 1);
+    {
+        kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+        ASSERT_EQ(CountKeys(store, "key", 10), 9);
+        ASSERT_EQ(CountKeys(store, "key", 9), 9);
+        ASSERT_EQ(std::filesystem::file_size(wal), record_size * 9);
+        PutKeys(store, "after", 1);
+    }
+    {
+        kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+        ASSERT_EQ(CountKeys(store, "key", 9), 9);
+        ASSERT_EQ(CountKeys(store, "after", 1), 1);
+    }
+
+    // 最后一条记录的值被改坏，校验失败后连同它一起丢弃
+    wal = ListFiles(dir, "wal-").back();
+    FlipByte(wal, std::filesystem::file_size(wal) - 1);
+    {
+        kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+        ASSERT_EQ(CountKeys(store, "key", 9), 9);
+        ASSERT_EQ(CountKeys(store, "after", 1), 0);
+    }
+    std::filesystem::remove_all(dir);
+}
+
+// 写盘失败（文件大小超过 RLIMIT_FSIZE，记录只写入一半）后的写入同样报告失败，不会追加在半条记录之后被重放丢弃
+TEST(KVStoreStorageTest, TestWalWriteFailure)
+{
+    std::string dir = TempDir("wal_failure");
+    kvstore::KVStoreOptions options;
+    options.data_dir = dir;
+    options.snapshot_wal_bytes = 0;
+    {
+        kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+        PutKeys(store, "key", 5);
+        std::string wal = ListFiles(dir, "wal-").back();
+
+        struct rlimit saved;
+        ASSERT_EQ(::getrlimit(RLIMIT_FSIZE, &saved), 0);
+        struct rlimit limit = saved;
+        limit.rlim_cur = std::filesystem::file_size(wal) + 16;
+        auto old_handler = std::signal(SIGXFSZ, SIG_IGN);
+        ASSERT_EQ(::setrlimit(RLIMIT_FSIZE, &limit), 0);
+        EXPECT_THROW(store.put_if_newer("torn", std::string(1000, 'v'), 1), std::runtime_error);
+        ASSERT_EQ(::setrlimit(RLIMIT_FSIZE, &saved), 0);
+        std::signal(SIGXFSZ, old_handler);
+        uint64_t torn_size = std::filesystem::file_size(wal);
+        ASSERT_GT(torn_size, limit.rlim_cur - 16);
+
+        // 限制解除后文件可以继续写入，但新的记录在重放时位于半条记录之后，不能报告为已持久化，也不再写入
+        for (int i = 0; i < 3; i++)
+        {
+            EXPECT_THROW(store.put_if_newer("after" + std::to_string(i), std::string(100, 'v'), 1), std::runtime_error);
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        ASSERT_EQ(std::filesystem::file_size(wal), torn_size);
+    }
+    {
+        kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+        ASSERT_EQ(CountKeys(store, "key", 5), 5);
+        std::string value;
+        int64_t version;
+        ASSERT_FALSE(store.get("torn", value, version));
+        ASSERT_EQ(CountKeys(store, "after", 3), 0);
+    }
+    std::filesystem::remove_all(dir);
+}
+
+// 快照加上之后的日志恢复出完整状态；快照完成后被它覆盖的日志段和旧快照都被删除
+TEST(KVStoreStorageTest, TestSnapshotWithWalTail)
+{
+    std::string dir = TempDir("snapshot_tail");
+    kvstore::KVStoreOptions options;
+    options.data_dir = dir;
+    options.snapshot_wal_bytes = 0;
+    options.recovery_threads = 4;
+    const int count = 5000; // 快照分成多个数据块，恢复时并行解码
+    auto check = [&](kvstore::KVStore &store)
+    {
+        std::string value;
+        int64_t version;
+        for (int i = 0; i < count; i++)
+        {
+            std::string key = "key" + std::to_string(i);
+            if (i % 5 == 0)
+            {
+                ASSERT_FALSE(store.get(key, value, version)) << key;
+                continue;
+            }
+            ASSERT_TRUE(store.get(key, value, version)) << key;
+            ASSERT_EQ(version, i % 7 == 0 ? 2 : 1) << key;
+            ASSERT_EQ(value, std::string(100, i % 7 == 0 ? 'w' : 'v'));
+        }
+        ASSERT_EQ(CountKeys(store, "tail", 100), 100);
+    };
+    {
+        kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+        PutKeys(store, "key", count);
+        ASSERT_TRUE(store.snapshot());
+        ASSERT_EQ(ListFiles(dir, "snapshot-").size(), 1u);
+        ASSERT_EQ(ListFiles(dir, "wal-").size(), 1u);
+        // 快照之后的修改只在日志中
+        for (int i = 0; i < count; i++)
+        {
+            if (i % 5 == 0)
+                ASSERT_TRUE(store.del("key" + std::to_string(i)));
+            else if (i % 7 == 0)
+                ASSERT_TRUE(store.put_if_newer("key" + std::to_string(i), std::string(100, 'w'), 2).applied);
+        }
+        PutKeys(store, "tail", 100);
+    }
+    {
+        kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+        check(store);
+        ASSERT_TRUE(store.snapshot());
+    }
+    ASSERT_EQ(ListFiles(dir, "snapshot-").size(), 1u);
+    kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+    check(store);
+    std::filesystem::remove_all(dir);
+}
+
+// 数据块校验失败、文件尾损坏或文件被截断的快照不会被部分加载，恢复直接报错
+TEST(KVStoreStorageTest, TestCorruptSnapshot)
+{
+    std::string dir = TempDir("snapshot_corrupt");
+    kvstore::KVStoreOptions options;
+    options.data_dir = dir;
+    options.snapshot_wal_bytes = 0;
+    {
+        kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+        PutKeys(store, "key", 2000);
+        ASSERT_TRUE(store.snapshot());
+    }
+    std::string path = ListFiles(dir, "snapshot-").back();
+    std::string good = dir + "/pristine"; // 不以 snapshot- 开头，恢复时不会当作快照
+    std::filesystem::copy_file(path, good);
+    auto load = [&]()
+    {
+        kvstore::load_snapshot(path, 2, [](uint64_t) {}, [](std::string &&, std::string &&, int64_t, int64_t) {});
+    };
+    load();
+
+    const uint64_t header = 16;
+    for (uint64_t offset : {header + 12, std::filesystem::file_size(path) / 2, std::filesystem::file_size(path) - 1})
+    {
+        std::filesystem::copy_file(good, path, std::filesystem::copy_options::overwrite_existing);
+        FlipByte(path, offset);
+        ASSERT_THROW(load(), std::runtime_error) << offset;
+        ASSERT_THROW(kvstore::KVStore(kvstore::NodeInfo("node1", "localhost:0"), options), std::runtime_error) << offset;
+    }
+    std::filesystem::copy_file(good, path, std::filesystem::copy_options::overwrite_existing);
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 100);
+    ASSERT_THROW(load(), std::runtime_error);
+
+    std::filesystem::copy_file(good, path, std::filesystem::copy_options::overwrite_existing);
+    std::filesystem::remove(good);
+    kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+    ASSERT_EQ(CountKeys(store, "key", 2000), 2000);
+    std::filesystem::remove_all(dir);
+}
+
+// 读者持有的值在被覆盖和删除之后仍然有效，大值不内联在记录中
+TEST(KVStoreStorageTest, TestValueRefOutlivesOverwrite)
+{
+    kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), SingleShard());
+    std::string large(64 << 10, 'x');
+    for (const std::string &first : {std::string("small"), large})
+    {
+        ASSERT_TRUE(store.put_if_newer("ref_key", first, 1).applied);
+        kvstore::ValueRef ref;
+        int64_t version;
+        ASSERT_TRUE(store.get("ref_key", ref, version));
+        ASSERT_TRUE(store.put_if_newer("ref_key", "second", 2).applied);
+        ASSERT_TRUE(store.del("ref_key"));
+        ASSERT_EQ(ref.view(), first);
+        ASSERT_EQ(ref.size(), first.size());
+    }
+}
+
+TEST(KVStoreStorageTest, TestMemoryStats)
+{
+    kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), SingleShard());
+    ASSERT_EQ(store.memory_stats().keys, 0u);
+    ASSERT_TRUE(store.put_if_newer("a", std::string(10, 'v'), 1).applied);
+    ASSERT_TRUE(store.put_if_newer("b", std::string(4096, 'v'), 1).applied);
+
+    kvstore::MemoryStats stats = store.memory_stats();
+    ASSERT_EQ(stats.keys, 2u);
+    ASSERT_EQ(stats.data_bytes, 2u + 10 + 4096);
+    ASSERT_GT(stats.external_bytes, 4096u);
+    ASSERT_GT(stats.record_bytes, 0u);
+    ASSERT_GE(stats.slab_bytes, stats.record_bytes);
+    ASSERT_GT(stats.index_bytes, 0u);
+
+    ASSERT_TRUE(store.del("b"));
+    stats = store.memory_stats();
+    ASSERT_EQ(stats.keys, 1u);
+    ASSERT_EQ(stats.data_bytes, 11u);
+    ASSERT_EQ(stats.external_bytes, 0u);
+}
+
+// 插入与删除交替进行，扩容迁移旧表期间和墓碑触发重建之后，每个键仍然只在一张表中且都能找到
+TEST(KVStoreStorageTest, TestChurnDuringResize)
+{
+    kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), SingleShard());
+    const int count = 50000;
+    std::string value;
+    int64_t version;
+    for (int i = 0; i < count; i++)
+    {
+        ASSERT_TRUE(store.put_if_newer("churn" + std::to_string(i), std::to_string(i), 1).applied);
+        if (i % 2 == 1)
+        {
+            ASSERT_TRUE(store.del("churn" + std::to_string(i / 2)));
+            ASSERT_FALSE(store.get("churn" + std::to_string(i / 2), value, version));
+        }
+        // 最早的一个尚未删除的键
+        ASSERT_TRUE(store.get("churn" + std::to_string((i + 1) / 2), value, version)) << i;
+    }
+    size_t live = 0;
+    for (int i = 0; i < count; i++)
+    {
+        bool deleted = i < count / 2;
+        ASSERT_EQ(store.get("churn" + std::to_string(i), value, version), !deleted) << i;
+        live += !deleted;
+    }
+    ASSERT_EQ(store.memory_stats().keys, live);
+}
+
+// 范围扫描跨分片按键的字节序归并，删除和覆盖写之后结果仍与键集合一致
+TEST(KVStoreStorageTest, TestScan)
+{
+    kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"));
+    const int count = 5000;
+    std::set<std::string> expected;
+    for (int i = 0; i < count; i++)
+    {
+        std::string key = "scan" + std::to_string(i);
+        ASSERT_TRUE(store.put_if_newer(key, "v1", 1).applied);
+        expected.insert(key);
+    }
+    for (int i = 0; i < count; i += 3)
+    {
+        ASSERT_TRUE(store.put_if_newer("scan" + std::to_string(i), "v2", 2).applied);
+    }
+    for (int i = 0; i < count; i += 2)
+    {
+        ASSERT_TRUE(store.del("scan" + std::to_string(i)));
+        expected.erase("scan" + std::to_string(i));
+    }
+    ASSERT_TRUE(store.put_if_newer("other", "v", 1).applied);
+
+    // 逐页扫描 [scan, scan~)，每页从上一页最后一个键之后开始
+    std::vector<std::string> scanned;
+    std::string start = "scan";
+    while (true)
+    {
+        std::vector<kvstore::ValueRef> page;
+        store.scan(start, "scan~", 97, page);
+        for (const auto &ref : page)
+        {
+            scanned.emplace_back(ref.key());
+            int i = std::stoi(std::string(ref.key().substr(4)));
+            ASSERT_EQ(ref.view(), i % 3 == 0 ? "v2" : "v1");
+            ASSERT_EQ(ref.version(), i % 3 == 0 ? 2 : 1);
+        }
+        if (page.size() < 97)
+            break;
+        start = scanned.back() + '\0';
+    }
+    ASSERT_EQ(scanned, std::vector<std::string>(expected.begin(), expected.end()));
+
+    std::vector<kvstore::ValueRef> all;
+    store.scan("", "", SIZE_MAX, all);
+    ASSERT_EQ(all.size(), expected.size() + 1);
+    ASSERT_EQ(all.front().key(), "other");
+}
+
+// 计时器在到期后的第一次推进中取出，不会提前，也不会推迟到下一次推进；跨越多层的计时器经过下移后同样准时
+TEST(KVStoreStorageTest, TestTimerWheel)
+{
+    kvstore::TimerWheel wheel;
+    std::mt19937_64 rng(7);
+    const int64_t start = 1000000;
+    const int count = 20000;
+    for (int i = 0; i < count; i++)
+    {
+        // 到期时间分布在 1 毫秒到约 3 小时之间，覆盖前三层
+        int64_t delay = static_cast<int64_t>(1 + rng() % (1ull << (4 + i % 20)));
+        wheel.schedule("timer" + std::to_string(i), start + delay, start);
+    }
+    ASSERT_EQ(wheel.size(), static_cast<size_t>(count));
+
+    std::set<std::string> fired;
+    int64_t previous = start;
+    for (int64_t now = start; wheel.size() > 0;)
+    {
+        now += static_cast<int64_t>(rng() % 500000);
+        std::vector<kvstore::TimerWheel::Timer> due;
+        while (wheel.advance(now, 97, due))
+        {
+        }
+        for (const auto &timer : due)
+        {
+            ASSERT_LE(timer.expire_at_ms, now) << timer.key;
+            ASSERT_GT(timer.expire_at_ms, previous - kvstore::TimerWheel::kTickMs) << timer.key;
+            ASSERT_TRUE(fired.insert(timer.key).second) << timer.key;
+        }
+        previous = now;
+    }
+    ASSERT_EQ(fired.size(), static_cast<size_t>(count));
+}
+
+// 过期的键读不到，也不出现在扫描中；后台回收不依赖读取，覆盖写去掉或延长过期时间
+TEST(KVStoreStorageTest, TestExpiry)
+{
+    kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"));
+    int64_t now = kvstore::wall_clock_ms();
+    for (int i = 0; i < 1000; i++)
+    {
+        ASSERT_TRUE(store.put_if_newer("ttl" + std::to_string(i), "v", 1, nullptr, now + 100).applied);
+    }
+    ASSERT_TRUE(store.put_if_newer("persistent", "v", 1).applied);
+    ASSERT_TRUE(store.put_if_newer("ttl0", "v", 2).applied);                         // 不再过期
+    ASSERT_TRUE(store.put_if_newer("ttl1", "v", 2, nullptr, now + 60000).applied); // 延长
+
+    std::string value;
+    int64_t version;
+    ASSERT_TRUE(store.get("ttl2", value, version));
+    kvstore::ValueRef ref;
+    ASSERT_TRUE(store.get("ttl1", ref, version));
+    ASSERT_EQ(ref.expire_at_ms(), now + 60000);
+    ASSERT_EQ(store.memory_stats().timers, 1001u);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    ASSERT_FALSE(store.get("ttl3", value, version));
+    ASSERT_FALSE(store.del("ttl4"));
+    std::vector<kvstore::ValueRef> scanned;
+    store.scan("ttl", "ttm", SIZE_MAX, scanned);
+    ASSERT_EQ(scanned.size(), 2u);
+
+    // 其余过期的键由后台线程删除
+    for (int i = 0; i < 100 && store.memory_stats().keys > 3; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    kvstore::MemoryStats stats = store.memory_stats();
+    ASSERT_EQ(stats.keys, 3u);
+    ASSERT_EQ(stats.timers, 1u);
+    ASSERT_TRUE(store.get("ttl0", value, version));
+    ASSERT_TRUE(store.get("ttl1", value, version));
+    ASSERT_TRUE(store.get("persistent", value, version));
+}
+
+// 已过期但还未回收的键对写入也视为不存在：更低的版本可以写入，分配版本从 1 重新开始
+TEST(KVStoreStorageTest, TestWriteOverExpired)
+{
+    kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"));
+    int64_t now = kvstore::wall_clock_ms();
+    for (int i = 0; i < 200; i++)
+    {
+        ASSERT_TRUE(store.put_if_newer("old" + std::to_string(i), "v", 5, nullptr, now + 50).applied);
+        ASSERT_TRUE(store.put_if_newer("counter" + std::to_string(i), "v", 7, nullptr, now + 50).applied);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    std::string value;
+    int64_t version;
+    for (int i = 0; i < 200; i++)
+    {
+        kvstore::PutResult result = store.put_if_newer("old" + std::to_string(i), "new", 1);
+        ASSERT_TRUE(result.applied) << i;
+        ASSERT_EQ(result.current_version, 1);
+        ASSERT_TRUE(store.get("old" + std::to_string(i), value, version));
+        ASSERT_EQ(value, "new");
+        ASSERT_EQ(version, 1);
+        ASSERT_EQ(store.put_next_version("counter" + std::to_string(i), "c").current_version, 1) << i;
+    }
+}
+
+// 过期时间随日志和快照持久化，重启时已过期的条目不再装入
+TEST(KVStoreStorageTest, TestExpiryRecovery)
+{
+    std::string dir = (std::filesystem::temp_directory_path() / ("gtest_expiry_" + std::to_string(::getpid()))).string();
+    std::filesystem::remove_all(dir);
+    kvstore::KVStoreOptions options;
+    options.data_dir = dir;
+    options.snapshot_wal_bytes = 0;
+    int64_t now = kvstore::wall_clock_ms();
+    {
+        kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+        ASSERT_TRUE(store.put_if_newer("snap_short", "v", 1, nullptr, now + 100).applied);
+        ASSERT_TRUE(store.put_if_newer("snap_long", "v", 1, nullptr, now + 600000).applied);
+        ASSERT_TRUE(store.snapshot());
+        ASSERT_TRUE(store.put_if_newer("wal_short", "v", 1, nullptr, now + 100).applied);
+        ASSERT_TRUE(store.put_if_newer("wal_long", "v", 1, nullptr, now + 600000).applied);
+        ASSERT_TRUE(store.put_if_newer("snap_long", "v", 2, nullptr, now + 100).applied); // 新版本先于旧版本过期
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+    kvstore::ValueRef ref;
+    int64_t version;
+    ASSERT_FALSE(store.get("snap_short", ref, version));
+    ASSERT_FALSE(store.get("wal_short", ref, version));
+    ASSERT_FALSE(store.get("snap_long", ref, version));
+    ASSERT_TRUE(store.get("wal_long", ref, version));
+    ASSERT_EQ(ref.expire_at_ms(), now + 600000);
+    ASSERT_EQ(store.memory_stats().keys, 1u);
+    ref = kvstore::ValueRef();
+    std::filesystem::remove_all(dir);
+}
+
+// 不淘汰时超过上限的写入被拒绝，读取和删除不受影响，删除腾出空间后可以再写入
+TEST(KVStoreStorageTest, TestMaxMemoryNoEviction)
+{
+    kvstore::KVStoreOptions options = SingleShard();
+    auto fill = [](kvstore::KVStore &store)
+    { PutKeys(store, "key", 100); };
+    options.max_memory_bytes = UsedAfter(options, fill);
+    kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+    fill(store);
+    ASSERT_EQ(store.memory_stats().used_bytes, options.max_memory_bytes);
+
+    ASSERT_TRUE(store.put_if_newer("over", "v", 1).applied); // 写入前未超过上限
+    ASSERT_THROW(store.put_if_newer("rejected", "v", 1), kvstore::MemoryLimitExceeded);
+    ASSERT_THROW(store.put_next_version("key0", "v"), kvstore::MemoryLimitExceeded);
+    ASSERT_EQ(CountKeys(store, "key", 100), 100);
+    for (int i = 0; i < 10; i++)
+    {
+        ASSERT_TRUE(store.del("key" + std::to_string(i)));
+    }
+    ASSERT_TRUE(store.put_if_newer("accepted", "v", 1).applied);
+
+    kvstore::MemoryStats stats = store.memory_stats();
+    ASSERT_EQ(stats.rejected_writes, 2u);
+    ASSERT_EQ(stats.evicted_keys, 0u);
+    ASSERT_EQ(stats.keys, 92u);
+}
+
+// 超过上限时版本冲突的写入照常返回冲突，既不淘汰其他键也不计入被拒绝的写入
+TEST(KVStoreStorageTest, TestMaxMemoryVersionConflict)
+{
+    for (auto policy : {kvstore::EvictionPolicy::kNoEviction, kvstore::EvictionPolicy::kAllKeysLru})
+    {
+        kvstore::KVStoreOptions options = SingleShard();
+        options.eviction_policy = policy;
+        auto fill = [](kvstore::KVStore &store)
+        { PutKeys(store, "key", 100); };
+        options.max_memory_bytes = UsedAfter(options, fill);
+        kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+        fill(store);
+        ASSERT_TRUE(store.put_if_newer("over", "v", 1).applied); // 写入前未超过上限
+
+        kvstore::PutResult stale = store.put_if_newer("key0", "stale", 0);
+        ASSERT_FALSE(stale.applied);
+        ASSERT_EQ(stale.current_version, 1);
+        kvstore::PutResult conflict = store.put_if_newer("key1", "conflict", 1);
+        ASSERT_FALSE(conflict.applied);
+        ASSERT_EQ(conflict.current_version, 1);
+
+        kvstore::MemoryStats stats = store.memory_stats();
+        ASSERT_EQ(stats.rejected_writes, 0u);
+        ASSERT_EQ(stats.evicted_keys, 0u);
+        ASSERT_EQ(CountKeys(store, "key", 100), 100);
+    }
+}
+
+// 近似 LRU 淘汰空闲最久的键，近似 LFU 淘汰访问最少的键，最近或经常读取的键都保留下来
+TEST(KVStoreStorageTest, TestEvictionLruLfu)
+{
+    for (auto policy : {kvstore::EvictionPolicy::kAllKeysLru, kvstore::EvictionPolicy::kAllKeysLfu})
+    {
+        kvstore::KVStoreOptions options;
+        options.eviction_policy = policy;
+        options.eviction_samples = 10;
+        auto fill = [](kvstore::KVStore &store)
+        { PutKeys(store, "old", 1000); };
+        options.max_memory_bytes = UsedAfter(options, fill);
+        kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+        fill(store);
+        if (policy == kvstore::EvictionPolicy::kAllKeysLru)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1100)); // 访问时间精确到秒
+        }
+        for (int round = 0; round < 20; round++)
+        {
+            ASSERT_EQ(CountKeys(store, "old", 100), 100); // old0 到 old99 是热点
+        }
+        PutKeys(store, "new", 300);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        kvstore::MemoryStats stats = store.memory_stats();
+        ASSERT_GE(stats.evicted_keys, 250u);
+        ASSERT_LE(stats.used_bytes, options.max_memory_bytes);
+        ASSERT_EQ(CountKeys(store, "old", 100), 100);
+        ASSERT_LT(CountKeys(store, "old", 1000), 1000);
+    }
+}
+
+// volatile-ttl 只淘汰带过期时间的键，分片内先淘汰最早过期的；随机淘汰把记账内存维持在上限以内
+TEST(KVStoreStorageTest, TestEvictionVolatileTtlAndRandom)
+{
+    kvstore::KVStoreOptions options = SingleShard(); // 各分片轮流淘汰，过期时间只在分片内比较
+    options.eviction_policy = kvstore::EvictionPolicy::kVolatileTtl;
+    int64_t now = kvstore::wall_clock_ms();
+    auto fill = [now](kvstore::KVStore &store)
+    {
+        PutKeys(store, "persistent", 200);
+        PutKeys(store, "hour", 50, now + 3600 * 1000);
+        PutKeys(store, "day", 50, now + 86400 * 1000);
+    };
+    options.max_memory_bytes = UsedAfter(options, fill);
+    {
+        kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+        fill(store);
+        PutKeys(store, "more", 30);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        ASSERT_EQ(CountKeys(store, "persistent", 200), 200);
+        ASSERT_EQ(CountKeys(store, "more", 30), 30);
+        ASSERT_EQ(CountKeys(store, "day", 50), 50);
+        ASSERT_LT(CountKeys(store, "hour", 50), 50);
+        ASSERT_GT(store.memory_stats().evicted_keys, 0u);
+    }
+
+    options.eviction_policy = kvstore::EvictionPolicy::kAllKeysRandom;
+    kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+    PutKeys(store, "key", 5000);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    kvstore::MemoryStats stats = store.memory_stats();
+    ASSERT_LE(stats.used_bytes, stats.max_bytes);
+    ASSERT_GT(stats.evicted_keys, 4000u);
+    ASSERT_GT(stats.evicted_bytes, 0u);
+    ASSERT_EQ(stats.rejected_writes, 0u);
+    ASSERT_EQ(stats.keys, 5000u - stats.evicted_keys);
+}
+
+// 值日志按位置读回追加的值，整理时能遍历条目，删除的段不能再读
+TEST(KVStoreStorageTest, TestValueLog)
+{
+    kvstore::ValueLogOptions options;
+    options.dir = (std::filesystem::temp_directory_path() / ("gtest_vlog_" + std::to_string(::getpid()))).string();
+    options.segment_bytes = 1024;
+    std::vector<kvstore::ValueLocator> locators;
+    {
+        kvstore::ValueLog log(options);
+        std::vector<std::string> values;
+        for (int i = 0; i < 40; i++)
+        {
+            values.push_back(std::string(50 + i, 'a' + i % 26));
+            log.append({{"key" + std::to_string(i), values.back()}}, locators);
+            ASSERT_EQ(locators.size(), 1u);
+            std::string value;
+            ASSERT_TRUE(log.read(locators[0], ("key" + std::to_string(i)).size(), values.back().size(), value));
+            ASSERT_EQ(value, values.back());
+        }
+        ASSERT_EQ(log.pick_compaction(), 0u);
+
+        // 第一段的条目全部无效后成为整理对象
+        std::vector<std::pair<std::string, kvstore::ValueLocator>> first;
+        log.for_each(1, [&](std::string_view key, std::string_view value, const kvstore::ValueLocator &locator)
+                     {
+            ASSERT_EQ(value, values[std::stoi(std::string(key.substr(3)))]);
+            first.emplace_back(std::string(key), locator); });
+        ASSERT_FALSE(first.empty());
+        for (const auto &entry : first)
+        {
+            log.discard(entry.second, entry.first.size(), values[std::stoi(entry.first.substr(3))].size());
+        }
+        ASSERT_EQ(log.pick_compaction(), 1u);
+        uint64_t bytes = log.bytes();
+        log.remove(1);
+        ASSERT_LT(log.bytes(), bytes);
+        std::string value;
+        ASSERT_FALSE(log.read(first[0].second, first[0].first.size(), 10, value));
+        ASSERT_EQ(log.live_bytes(), log.bytes());
+    }
+    std::filesystem::remove_all(options.dir);
+}
+
+// 内存中的值超过上限后冷值移到值日志，读、扫描、覆盖、删除、整理和重启恢复都不受影响
+TEST(KVStoreStorageTest, TestTieredStorage)
+{
+    std::string dir = (std::filesystem::temp_directory_path() / ("gtest_tiered_" + std::to_string(::getpid()))).string();
+    std::filesystem::remove_all(dir);
+    kvstore::KVStoreOptions options;
+    options.data_dir = dir;
+    options.sync_mode = kvstore::WalSyncMode::kNone;
+    options.snapshot_wal_bytes = 0;
+    options.max_hot_value_bytes = 64 << 10;
+    options.value_log_segment_bytes = 64 << 10;
+    auto value_of = [](int i, int round)
+    { return std::string(200 + i % 300, static_cast<char>('a' + (i + round) % 26)) + std::to_string(i); };
+    auto wait_until = [](const std::function<bool()> &done)
+    {
+        for (int i = 0; i < 300 && !done(); i++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return done();
+    };
+    std::string value;
+    int64_t version;
+    {
+        kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+        for (int i = 0; i < 2000; i++)
+        {
+            ASSERT_TRUE(store.put_if_newer("key" + std::to_string(i), value_of(i, 0), 1).applied);
+        }
+        ASSERT_TRUE(wait_until([&]
+                               { return store.memory_stats().hot_value_bytes <= options.max_hot_value_bytes; }));
+        kvstore::MemoryStats stats = store.memory_stats();
+        ASSERT_GT(stats.spilled_keys, 1500u);
+        ASSERT_GT(stats.value_log_bytes, stats.spilled_bytes);
+        for (int i = 0; i < 2000; i++)
+        {
+            ASSERT_TRUE(store.get("key" + std::to_string(i), value, version));
+            ASSERT_EQ(value, value_of(i, 0));
+        }
+        std::vector<kvstore::ValueRef> scanned;
+        store.scan("key", "kez", SIZE_MAX, scanned);
+        ASSERT_EQ(scanned.size(), 2000u);
+        for (const auto &ref : scanned)
+        {
+            ASSERT_EQ(ref.view(), value_of(std::stoi(std::string(ref.key().substr(3))), 0));
+        }
+        scanned.clear();
+
+        // 覆盖和删除使值日志中的大部分条目无效，整理后文件变小
+        uint64_t before = stats.value_log_bytes;
+        for (int i = 0; i < 2000; i++)
+        {
+            if (i % 10 == 0)
+            {
+                ASSERT_TRUE(store.put_if_newer("key" + std::to_string(i), value_of(i, 1), 2).applied);
+            }
+            else if (i % 10 >= 2)
+            {
+                ASSERT_TRUE(store.del("key" + std::to_string(i)));
+            }
+        }
+        ASSERT_TRUE(wait_until([&]
+                               { return store.memory_stats().value_log_bytes < before / 2; }));
+        stats = store.memory_stats();
+        ASSERT_GT(stats.spilled_keys, 0u);
+        for (int i = 0; i < 2000; i += 10)
+        {
+            kvstore::ValueRef ref;
+            ASSERT_TRUE(store.get("key" + std::to_string(i), ref, version));
+            ASSERT_EQ(ref.view(), value_of(i, 1));
+            ASSERT_EQ(version, 2);
+            ASSERT_TRUE(store.get("key" + std::to_string(i + 1), value, version));
+            ASSERT_EQ(value, value_of(i + 1, 0));
+            ASSERT_FALSE(store.get("key" + std::to_string(i + 2), value, version));
+        }
+        // 短时间内再次读到的值放回内存
+        for (int i = 1; i < 2000; i += 10)
+        {
+            ASSERT_TRUE(store.get("key" + std::to_string(i), value, version));
+        }
+        ASSERT_LT(store.memory_stats().spilled_keys, stats.spilled_keys);
+
+        for (int i = 0; i < 2000; i++)
+        {
+            ASSERT_TRUE(store.put_if_newer("more" + std::to_string(i), value_of(i, 2), 1).applied);
+        }
+        ASSERT_TRUE(store.snapshot());
+    }
+
+    // 恢复时内存中的值达到上限后，其余的值直接写入值日志
+    kvstore::KVStore store(kvstore::NodeInfo("node1", "localhost:0"), options);
+    ASSERT_GT(store.memory_stats().spilled_keys, 1500u);
+    for (int i = 0; i < 2000; i++)
+    {
+        ASSERT_TRUE(store.get("more" + std::to_string(i), value, version));
+        ASSERT_EQ(value, value_of(i, 2));
+        ASSERT_EQ(store.get("key" + std::to_string(i), value, version), i % 10 < 2);
+    }
+    std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include "test_cluster.h"
+#include "client.h"
+#include <future>
+
+// 在同一进程内启动单个节点，验证读租约与失效通知
+namespace
+{
+    using namespace kvstore_test;
+
+    std::unique_ptr<TestNode> StartLeaseNode(const std::string &address, int lease_ms, bool async = false)
+    {
+        kvstore::NodeInfo node("node1", address);
+        NodeOptions options;
+        options.leases.lease_ms = lease_ms;
+        options.async = async;
+        return StartNode(node, {node}, options);
+    }
+
+    std::unique_ptr<kvstore::KVClient> Connect(const std::string &address)
+    {
+        return std::make_unique<kvstore::KVClient>(grpc::CreateChannel(address, grpc::InsecureChannelCredentials()), 1 << 20);
+    }
+
+    // 持有租约的读取在缓存中命中；其他客户端写入后，失效通知在租约到期之前撤销缓存
+    void ExpectInvalidationBeforeExpiry(const std::string &address)
+    {
+        auto reader = Connect(address);
+        auto writer = Connect(address);
+        ASSERT_TRUE(writer->put("lease_key", "value1").ok());
+
+        std::string value;
+        int64_t version;
+        // 订阅建立之前服务端不授予租约，等到第二次读取命中缓存
+        ASSERT_TRUE(WaitFor([&]()
+                            {
+            uint64_t hits = reader->cache_stats().hits;
+            return reader->get("lease_key", value, version).ok() && reader->get("lease_key", value, version).ok() &&
+                   reader->cache_stats().hits > hits; }));
+        ASSERT_EQ(value, "value1");
+
+        auto start = std::chrono::steady_clock::now();
+        ASSERT_TRUE(writer->put("lease_key", "value2").ok());
+        ASSERT_TRUE(WaitFor([&]()
+                            { return reader->get("lease_key", value, version).ok() && value == "value2"; }))
+            << "cached value was not invalidated";
+        ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5)) << "waited for the lease to expire";
+
+        // 删除同样撤销租约
+        ASSERT_TRUE(reader->get("lease_key", value, version).ok());
+        ASSERT_TRUE(writer->del("lease_key").ok());
+        ASSERT_TRUE(WaitFor([&]()
+                            { return reader->get("lease_key", value, version).error_code() == grpc::StatusCode::NOT_FOUND; }));
+    }
+}
+
+TEST(LeaseTest, TestInvalidationBeforeExpiry)
+{
+    std::string address = "localhost:50111";
+    auto node = StartLeaseNode(address, 60000);
+    ExpectInvalidationBeforeExpiry(address);
+}
+
+// 异步模式下写操作在 CQ 上等待失效通知发出
+TEST(LeaseTest, TestInvalidationBeforeExpiryAsync)
+{
+    std::string address = "localhost:50113";
+    auto node = StartLeaseNode(address, 60000, true);
+    ExpectInvalidationBeforeExpiry(address);
+}
+
+// 服务端关闭租约时客户端缓存不再命中，每次读取都到服务端取最新值
+TEST(LeaseTest, TestLeasesDisabled)
+{
+    std::string address = "localhost:50112";
+    auto node = StartLeaseNode(address, 0);
+    auto client = Connect(address);
+    ASSERT_TRUE(client->put("lease_key", "value1").ok());
+
+    std::string value;
+    int64_t version;
+    for (int i = 0; i < 10; i++)
+    {
+        ASSERT_TRUE(client->get("lease_key", value, version).ok());
+        ASSERT_EQ(value, "value1");
+    }
+    ASSERT_EQ(client->cache_stats().hits, 0u);
+}
+
+// 仍有客户端订阅时关闭节点：先结束订阅流，服务端的 Shutdown 不会一直等待
+TEST(LeaseTest, TestShutdownWithSubscriber)
+{
+    std::string address = "localhost:50114";
+    auto node = StartLeaseNode(address, 60000);
+    auto reader = Connect(address);
+    ASSERT_TRUE(reader->put("lease_key", "value1").ok());
+    std::string value;
+    int64_t version;
+    ASSERT_TRUE(WaitFor([&]()
+                        {
+        uint64_t hits = reader->cache_stats().hits;
+        return reader->get("lease_key", value, version).ok() && reader->get("lease_key", value, version).ok() &&
+               reader->cache_stats().hits > hits; }));
+
+    auto stopped = std::async(std::launch::async, [&]()
+                              { node->stop(); });
+    ASSERT_EQ(stopped.wait_for(std::chrono::seconds(5)), std::future_status::ready) << "server shutdown waited for the subscriber";
+}
@@ -0,0 +1,214 @@
+#include <gtest/gtest.h>
+#include "test_cluster.h"
+#include <algorithm>
+#include <map>
+
+// 在同一进程内启动节点，验证加入、离开和故障移除后数据仍然可读且迁移到新的负责节点
+namespace
+{
+    using namespace kvstore_test;
+
+    kvstore_test::NodeOptions FastOptions(const std::string &seed = "")
+    {
+        kvstore_test::NodeOptions options;
+        options.membership.heartbeat_interval_ms = 100;
+        options.membership.failure_timeout_ms = 1000;
+        options.membership.migration_bytes_per_sec = 0;
+        options.membership.seed = seed;
+        return options;
+    }
+
+    int MemberCount(TestNode &node)
+    {
+        return node.service->membership().table()->view.members_size();
+    }
+
+    // 本节点本地存储中的键数
+    int LocalKeys(TestNode &node, const std::map<std::string, std::string> &data)
+    {
+        int count = 0;
+        std::string value;
+        for (const auto &entry : data)
+        {
+            if (Get(node, entry.first, value, true))
+                count++;
+        }
+        return count;
+    }
+
+    std::map<std::string, std::string> PutKeys(TestNode &node, int count)
+    {
+        std::map<std::string, std::string> data;
+        for (int i = 0; i < count; i++)
+        {
+            std::string key = "member_key" + std::to_string(i);
+            std::string value = "member_value" + std::to_string(i);
+            kvstore::PutRequest request;
+            request.set_key(key);
+            request.set_value(value);
+            request.set_version(1);
+            // 节点刚启动时对端连接可能还在重连退避中，转发失败则重试
+            EXPECT_TRUE(WaitFor([&]()
+                                {
+                kvstore::PutResponse response;
+                grpc::ClientContext context;
+                return node.stub->Put(&context, request, &response).ok() && response.success(); }))
+                << "PUT failed for key: " << key;
+            data[key] = value;
+        }
+        return data;
+    }
+
+    void ExpectReadable(TestNode &node, const std::map<std::string, std::string> &data)
+    {
+        for (const auto &entry : data)
+        {
+            std::string value;
+            ASSERT_TRUE(Get(node, entry.first, value)) << "GET failed for key: " << entry.first;
+            ASSERT_EQ(value, entry.second);
+        }
+    }
+}
+
+// 新节点通过 seed 加入后分到一部分键，离开的节点把数据全部迁出
+TEST(MembershipTest, TestJoinAndLeave)
+{
+    std::vector<kvstore::NodeInfo> nodes = {
+        kvstore::NodeInfo("node1", "localhost:50071"),
+        kvstore::NodeInfo("node2", "localhost:50072"),
+        kvstore::NodeInfo("node3", "localhost:50073")};
+    std::vector<std::unique_ptr<TestNode>> cluster;
+    for (const auto &node : nodes)
+    {
+        cluster.push_back(StartNode(node, nodes, FastOptions()));
+    }
+    auto data = PutKeys(*cluster[0], 200);
+
+    // node4 只知道自己和 seed
+    kvstore::NodeInfo node4("node4", "localhost:50074");
+    cluster.push_back(StartNode(node4, {node4}, FastOptions("localhost:50071")));
+
+    ASSERT_TRUE(WaitFor([&]()
+                        {
+        for (auto &node : cluster)
+        {
+            if (MemberCount(*node) != 4)
+                return false;
+        }
+        return true; }))
+        << "node4 did not join";
+    // 迁移期间的读取由新负责节点回读旧负责节点
+    for (auto &node : cluster)
+    {
+        ExpectReadable(*node, data);
+    }
+    ASSERT_TRUE(WaitFor([&]()
+                        { return LocalKeys(*cluster[3], data) > 0 &&
+                                 LocalKeys(*cluster[0], data) + LocalKeys(*cluster[1], data) + LocalKeys(*cluster[2], data) + LocalKeys(*cluster[3], data) == (int)data.size(); }))
+        << "keys were not migrated to node4";
+
+    // 在 node1 上请求 node2 离开
+    kvstore::LeaveRequest leave;
+    leave.set_name("node2");
+    kvstore::MembershipResponse response;
+    grpc::ClientContext context;
+    ASSERT_TRUE(cluster[0]->stub->Leave(&context, leave, &response).ok());
+
+    ASSERT_TRUE(WaitFor([&]()
+                        { return MemberCount(*cluster[0]) == 3 && MemberCount(*cluster[2]) == 3 && MemberCount(*cluster[3]) == 3; }))
+        << "node2 did not leave";
+    ASSERT_TRUE(WaitFor([&]()
+                        { return LocalKeys(*cluster[1], data) == 0; }))
+        << "node2 still holds keys";
+    cluster[1]->stop();
+    ExpectReadable(*cluster[0], data);
+    ExpectReadable(*cluster[2], data);
+    ExpectReadable(*cluster[3], data);
+}
+
+// 停止的节点在超时后被移出集群
+TEST(MembershipTest, TestFailureDetection)
+{
+    std::vector<kvstore::NodeInfo> nodes = {
+        kvstore::NodeInfo("node1", "localhost:50081"),
+        kvstore::NodeInfo("node2", "localhost:50082"),
+        kvstore::NodeInfo("node3", "localhost:50083")};
+    std::vector<std::unique_ptr<TestNode>> cluster;
+    for (const auto &node : nodes)
+    {
+        cluster.push_back(StartNode(node, nodes, FastOptions()));
+    }
+    ASSERT_EQ(MemberCount(*cluster[0]), 3);
+
+    cluster[2]->stop();
+    ASSERT_TRUE(WaitFor([&]()
+                        { return MemberCount(*cluster[0]) == 2 && MemberCount(*cluster[1]) == 2; }))
+        << "stopped node was not evicted";
+
+    // 剩余节点仍可读写
+    auto data = PutKeys(*cluster[0], 50);
+    ExpectReadable(*cluster[1], data);
+}
+
+// 批量请求中负责节点不可达的项各自记下错误码，本节点负责的项照常完成，整个请求不因此失败
+TEST(MembershipTest, TestBatchWithUnreachableOwner)
+{
+    std::vector<kvstore::NodeInfo> nodes = {
+        kvstore::NodeInfo("node1", "localhost:50091"),
+        kvstore::NodeInfo("node2", "localhost:50092")};
+    kvstore_test::NodeOptions options = FastOptions();
+    options.membership.failure_timeout_ms = 60000; // 停止的节点留在环上
+    std::vector<std::unique_ptr<TestNode>> cluster;
+    for (const auto &node : nodes)
+    {
+        cluster.push_back(StartNode(node, nodes, options));
+    }
+    cluster[1]->stop();
+
+    auto table = cluster[0]->service->membership().table();
+    kvstore::MultiPutRequest put_request;
+    kvstore::MultiGetRequest get_request;
+    std::vector<bool> local;
+    for (int i = 0; i < 40; i++)
+    {
+        std::string key = "batch_key" + std::to_string(i);
+        kvstore::PutRequest *entry = put_request.add_entries();
+        entry->set_key(key);
+        entry->set_value("v");
+        entry->set_version(1);
+        get_request.add_keys(key);
+        local.push_back(table->owner(key)->is_self);
+    }
+    ASSERT_NE(std::count(local.begin(), local.end(), true), 0);
+    ASSERT_NE(std::count(local.begin(), local.end(), false), 0);
+
+    kvstore::MultiPutResponse put_response;
+    grpc::ClientContext put_context;
+    put_context.set_deadline(std::chrono::system_clock::now() + std::chrono::seconds(5));
+    ASSERT_TRUE(cluster[0]->stub->MultiPut(&put_context, put_request, &put_response).ok());
+    kvstore::MultiGetResponse get_response;
+    grpc::ClientContext get_context;
+    ASSERT_TRUE(cluster[0]->stub->MultiGet(&get_context, get_request, &get_response).ok());
+    for (size_t i = 0; i < local.size(); i++)
+    {
+        ASSERT_EQ(put_response.results(i).success(), local[i]) << i;
+        ASSERT_EQ(put_response.results(i).error_code() == 0, local[i]) << i;
+        ASSERT_EQ(get_response.results(i).found(), local[i]) << i;
+        ASSERT_EQ(get_response.results(i).error_code() == 0, local[i]) << i;
+    }
+}
+
+// 节点换了地址后重新加入：连接池改连新地址，换下的连接仍然保留给旧路由表使用
+TEST(MembershipTest, TestPeerAddressChange)
+{
+    kvstore::PeerChannelPool pool({}, "node1");
+    kvstore::PeerChannelPool::Peer *old_peer = pool.add("node2", "localhost:50191");
+    ASSERT_EQ(pool.add("node2", "localhost:50191"), old_peer);
+
+    kvstore::PeerChannelPool::Peer *new_peer = pool.add("node2", "localhost:50192");
+    ASSERT_NE(new_peer, old_peer);
+    ASSERT_EQ(new_peer->address, "localhost:50192");
+    ASSERT_EQ(pool.find("node2"), new_peer);
+    ASSERT_EQ(old_peer->address, "localhost:50191");
+    ASSERT_NE(kvstore::PeerChannelPool::next_stub(old_peer), nullptr);
+}
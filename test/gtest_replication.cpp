@@ -0,0 +1,196 @@
+#include <gtest/gtest.h>
+#include "test_cluster.h"
+#include "client.h"
+#include <map>
+
+// 在同一进程内启动多副本的集群，验证副本写入、quorum 以及节点故障时的读取
+namespace
+{
+    using namespace kvstore_test;
+
+    std::vector<std::unique_ptr<TestNode>> StartCluster(const std::vector<kvstore::NodeInfo> &nodes, const kvstore::ReplicationOptions &replication)
+    {
+        kvstore_test::NodeOptions options;
+        options.membership.heartbeat_interval_ms = 100;
+        options.membership.failure_timeout_ms = 0; // 不自动移除节点，故障节点始终留在副本集合中
+        options.replication = replication;
+        return kvstore_test::StartCluster(nodes, options);
+    }
+
+    grpc::Status Put(TestNode &node, const std::string &key, const std::string &value, int64_t version, int write_quorum = 0)
+    {
+        kvstore::PutRequest request;
+        request.set_key(key);
+        request.set_value(value);
+        request.set_version(version);
+        request.set_write_quorum(write_quorum);
+        kvstore::PutResponse response;
+        grpc::ClientContext context;
+        grpc::Status status = node.stub->Put(&context, request, &response);
+        if (status.ok() && !response.success())
+            return grpc::Status(grpc::StatusCode::ABORTED, "Version conflict");
+        return status;
+    }
+
+    // 节点刚启动时对端连接可能还在重连退避中，失败则重试
+    std::map<std::string, std::string> PutKeys(TestNode &node, int count, int64_t version)
+    {
+        std::map<std::string, std::string> data;
+        for (int i = 0; i < count; i++)
+        {
+            std::string key = "replica_key" + std::to_string(i);
+            std::string value = "replica_value" + std::to_string(i) + "_" + std::to_string(version);
+            EXPECT_TRUE(WaitFor([&]()
+                                { return Put(node, key, value, version).ok(); }))
+                << "PUT failed for key: " << key;
+            data[key] = value;
+        }
+        return data;
+    }
+
+    bool AllReplicated(std::vector<std::unique_ptr<TestNode>> &cluster, const std::map<std::string, std::string> &data)
+    {
+        for (auto &node : cluster)
+        {
+            for (const auto &entry : data)
+            {
+                std::string value;
+                if (!Get(*node, entry.first, value, true) || value != entry.second)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    const std::string &Primary(TestNode &node, const std::string &key)
+    {
+        auto table = node.service->membership().table();
+        return table->routes[table->ring.getNode(key)].name;
+    }
+}
+
+// 写入在 3 个副本上都生效
+TEST(ReplicationTest, TestReplicasHoldCopies)
+{
+    std::vector<kvstore::NodeInfo> nodes = {
+        kvstore::NodeInfo("node1", "localhost:50091"),
+        kvstore::NodeInfo("node2", "localhost:50092"),
+        kvstore::NodeInfo("node3", "localhost:50093")};
+    kvstore::ReplicationOptions replication;
+    replication.replicas = 3;
+    replication.write_quorum = 2;
+    auto cluster = StartCluster(nodes, replication);
+    WarmUp(*cluster[0], cluster, 3);
+
+    auto data = PutKeys(*cluster[0], 30, 1);
+    ASSERT_TRUE(WaitFor([&]()
+                        { return AllReplicated(cluster, data); }))
+        << "writes did not reach every replica";
+
+    // 删除同样复制到所有副本
+    kvstore::DeleteRequest request;
+    request.set_key("replica_key0");
+    kvstore::DeleteResponse response;
+    grpc::ClientContext context;
+    ASSERT_TRUE(cluster[1]->stub->Del(&context, request, &response).ok());
+    ASSERT_TRUE(WaitFor([&]()
+                        {
+        std::string value;
+        for (auto &node : cluster)
+        {
+            if (Get(*node, "replica_key0", value, true))
+                return false;
+        }
+        return true; }));
+}
+
+// 一个副本停止后仍能读到全部键；写 quorum 包含故障节点时写入在主副本生效，但返回 DEADLINE_EXCEEDED，客户端不会改发其他节点
+TEST(ReplicationTest, TestNodeFailure)
+{
+    std::vector<kvstore::NodeInfo> nodes = {
+        kvstore::NodeInfo("node1", "localhost:50094"),
+        kvstore::NodeInfo("node2", "localhost:50095"),
+        kvstore::NodeInfo("node3", "localhost:50096")};
+    kvstore::ReplicationOptions replication;
+    replication.replicas = 3;
+    replication.write_quorum = 3;
+    replication.replica_timeout_ms = 500;
+    auto cluster = StartCluster(nodes, replication);
+    WarmUp(*cluster[0], cluster);
+
+    auto data = PutKeys(*cluster[0], 30, 1);
+    ASSERT_TRUE(WaitFor([&]()
+                        { return AllReplicated(cluster, data); }));
+    cluster[2]->stop();
+
+    // 主副本在 node3 上的键改读备份副本
+    for (const auto &entry : data)
+    {
+        std::string value;
+        ASSERT_TRUE(Get(*cluster[0], entry.first, value)) << "GET failed for key: " << entry.first;
+        ASSERT_EQ(value, entry.second);
+    }
+
+    for (const auto &entry : data)
+    {
+        if (Primary(*cluster[0], entry.first) == "node3")
+            continue;
+        grpc::Status status = Put(*cluster[0], entry.first, "updated", 2);
+        ASSERT_EQ(status.error_code(), grpc::StatusCode::DEADLINE_EXCEEDED) << "write quorum 3 should fail for key: " << entry.first;
+        // quorum 不足的写入已在主副本生效，版本 2 不能再写入
+        ASSERT_EQ(Put(*cluster[0], entry.first, "updated", 2, 2).error_code(), grpc::StatusCode::ABORTED) << entry.first;
+        // 按请求降低 quorum 后，两个存活副本足以确认
+        ASSERT_TRUE(Put(*cluster[0], entry.first, "updated", 3, 2).ok()) << "PUT failed for key: " << entry.first;
+        std::string value;
+        ASSERT_TRUE(Get(*cluster[1], entry.first, value));
+        ASSERT_EQ(value, "updated");
+    }
+}
+
+// 客户端的读 quorum 和允许读旧值的读取
+TEST(ReplicationTest, TestClientConsistency)
+{
+    std::vector<kvstore::NodeInfo> nodes = {
+        kvstore::NodeInfo("node1", "localhost:50097"),
+        kvstore::NodeInfo("node2", "localhost:50098"),
+        kvstore::NodeInfo("node3", "localhost:50099")};
+    kvstore::ReplicationOptions replication;
+    replication.replicas = 3;
+    replication.write_quorum = 3;
+    auto cluster = StartCluster(nodes, replication);
+    WarmUp(*cluster[0], cluster);
+
+    std::vector<kvstore::ClusterNode> client_nodes;
+    for (const auto &node : nodes)
+    {
+        client_nodes.push_back({node.get_name(), node.get_address()});
+    }
+    kvstore::KVClient writer(client_nodes, 1 << 20);
+    for (int i = 0; i < 20; i++)
+    {
+        ASSERT_TRUE(writer.put("client_key" + std::to_string(i), "client_value" + std::to_string(i)).ok());
+    }
+
+    kvstore::ConsistencyOptions options;
+    options.replicas = 3;
+    options.read_quorum = 2;
+    kvstore::KVClient quorum_reader(client_nodes, 1 << 20);
+    quorum_reader.set_consistency(options);
+
+    options.read_quorum = 0;
+    options.allow_stale = true;
+    kvstore::KVClient stale_reader(client_nodes, 1 << 20);
+    stale_reader.set_consistency(options);
+
+    // 写 quorum 为 3，写入返回时所有副本都已是最新值
+    for (int i = 0; i < 20; i++)
+    {
+        std::string key = "client_key" + std::to_string(i);
+        std::string value;
+        int64_t version;
+        ASSERT_TRUE(quorum_reader.get(key, value, version).ok()) << "GET failed for key: " << key;
+        ASSERT_EQ(value, "client_value" + std::to_string(i));
+        ASSERT_TRUE(stale_reader.get(key, value, version).ok()) << "stale GET failed for key: " << key;
+        ASSERT_EQ(value, "client_value" + std::to_string(i));
+    }
+}
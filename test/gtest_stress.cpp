@@ -44,7 +44,7 @@ void perform_del(kvstore::KVClient &client, const std::string &key) {
 // 测试 PUT 操作的并发压力
 TEST(KVStoreTest, TestPutPressure) {
     std::string server_address("localhost:50051");
-    kvstore::KVClient client(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 10);
+    kvstore::KVClient client(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
 
     std::vector<std::thread> threads;
 
@@ -66,7 +66,7 @@ TEST(KVStoreTest, TestPutPressure) {
 // 测试 GET 操作的并发压力
 TEST(KVStoreTest, TestGetPressure) {
     std::string server_address("localhost:50051");
-    kvstore::KVClient client(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 10);
+    kvstore::KVClient client(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
 
     std::vector<std::thread> threads;
 
@@ -88,7 +88,7 @@ TEST(KVStoreTest, TestGetPressure) {
 // 测试 DEL 操作的并发压力
 TEST(KVStoreTest, TestDelPressure) {
     std::string server_address("localhost:50051");
-    kvstore::KVClient client(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 10);
+    kvstore::KVClient client(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
 
     std::vector<std::thread> threads;
 
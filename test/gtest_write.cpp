@@ -47,9 +47,9 @@ void perform_get(kvstore::KVClient &client, const std::string &key, std::string
 TEST(KVStoreTest, TestMonotonicWrites)
 {
     std::string server_address("localhost:50051");
-    kvstore::KVClient client1(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 10);
-    kvstore::KVClient client2(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 10);
-    kvstore::KVClient client3(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 10);
+    kvstore::KVClient client1(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
+    kvstore::KVClient client2(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
+    kvstore::KVClient client3(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), 1 << 20);
 
     std::string key = "key1";
 
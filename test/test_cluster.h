@@ -0,0 +1,151 @@
+#ifndef TEST_CLUSTER_H
+#define TEST_CLUSTER_H
+
+#include <gtest/gtest.h>
+#include <grpcpp/grpcpp.h>
+#include "kvstore.grpc.pb.h"
+#include "server.h"
+#include "async_server.h"
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 在同一进程内启动节点的测试公共代码：每个节点是一个真实监听端口的 gRPC 服务端，测试通过 stub 或 KVClient 访问
+namespace kvstore_test
+{
+    struct TestNode
+    {
+        std::unique_ptr<kvstore::KVStoreServiceImpl> service;
+        std::unique_ptr<kvstore::KVStoreAsyncServer> async_server; // 仅异步模式
+        std::unique_ptr<grpc::Server> server;
+        std::unique_ptr<kvstore::KVStoreRPC::Stub> stub;
+
+        ~TestNode() { stop(); }
+
+        void stop()
+        {
+            if (server)
+            {
+                service->shutdown();
+                server->Shutdown();
+                server.reset();
+            }
+            // 服务端关闭后才能关闭 CQ
+            if (async_server)
+            {
+                async_server->shutdown();
+                async_server.reset();
+            }
+            service.reset();
+        }
+    };
+
+    // 节点的各项配置，未设置的与服务端的默认值相同
+    struct NodeOptions
+    {
+        kvstore::ChannelOptions channel;
+        kvstore::KVStoreOptions store;
+        kvstore::MembershipOptions membership;
+        kvstore::ReplicationOptions replication;
+        kvstore::LeaseOptions leases;
+        bool async = false; // 与 test_server --mode async 相同，Put/Get/Del 和副本写入由 CQ 轮询线程处理
+        int cq_count = 1;
+    };
+
+    inline std::unique_ptr<TestNode> StartNode(const kvstore::NodeInfo &node, const std::vector<kvstore::NodeInfo> &nodes, const NodeOptions &options)
+    {
+        auto result = std::make_unique<TestNode>();
+        result->service = std::make_unique<kvstore::KVStoreServiceImpl>(node, nodes, options.channel, options.store, options.membership,
+                                                                        options.replication, options.leases);
+        grpc::ServerBuilder builder;
+        kvstore::PeerChannelPool::apply_server_keepalive(builder, options.channel);
+        builder.AddListeningPort(node.get_address(), grpc::InsecureServerCredentials());
+        if (options.async)
+        {
+            result->async_server = std::make_unique<kvstore::KVStoreAsyncServer>(*result->service, options.cq_count);
+            result->async_server->register_with(builder);
+        }
+        else
+        {
+            builder.RegisterService(result->service.get());
+        }
+        result->server = builder.BuildAndStart();
+        if (result->async_server)
+        {
+            result->async_server->start();
+        }
+        result->stub = kvstore::KVStoreRPC::NewStub(grpc::CreateChannel(node.get_address(), grpc::InsecureChannelCredentials()));
+        return result;
+    }
+
+    // 按 nodes 的静态配置启动全部节点
+    inline std::vector<std::unique_ptr<TestNode>> StartCluster(const std::vector<kvstore::NodeInfo> &nodes, const NodeOptions &options)
+    {
+        std::vector<std::unique_ptr<TestNode>> cluster;
+        for (const auto &node : nodes)
+        {
+            cluster.push_back(StartNode(node, nodes, options));
+        }
+        return cluster;
+    }
+
+    inline bool WaitFor(const std::function<bool()> &condition, int timeout_ms = 15000)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            if (condition())
+                return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return condition();
+    }
+
+    // 节点刚启动时对端连接可能还在重连退避中，失败的副本写入不会重发；写入 quorum 不足时写入已经生效，重试同一版本只会得到冲突。
+    // 所以先经 entry 向每个节点负责的一个键反复写入递增的版本，直到写入得到 write_quorum 个副本的确认（0 表示节点的默认值），
+    // 写 quorum 等于副本数时转发和复制的连接全部就绪
+    inline void WarmUp(TestNode &entry, std::vector<std::unique_ptr<TestNode>> &cluster, int write_quorum = 0)
+    {
+        for (auto &node : cluster)
+        {
+            std::string key;
+            for (int i = 0; key.empty(); i++)
+            {
+                std::string candidate = "warm_up" + std::to_string(i);
+                if (node->service->membership().table()->owner(candidate)->is_self)
+                    key = candidate;
+            }
+            int64_t version = 0;
+            ASSERT_TRUE(WaitFor([&]()
+                                {
+                kvstore::PutRequest request;
+                request.set_key(key);
+                request.set_value("v");
+                request.set_version(++version);
+                request.set_write_quorum(write_quorum);
+                kvstore::PutResponse response;
+                grpc::ClientContext context;
+                return entry.stub->Put(&context, request, &response).ok() && response.success(); }))
+                << "cluster not ready for key: " << key;
+        }
+    }
+
+    // local_only 为 true 时只读该节点本地存储中的副本
+    inline bool Get(TestNode &node, const std::string &key, std::string &value, bool local_only = false)
+    {
+        kvstore::GetRequest request;
+        request.set_key(key);
+        request.set_local_only(local_only);
+        kvstore::GetResponse response;
+        grpc::ClientContext context;
+        if (!node.stub->Get(&context, request, &response).ok() || !response.found())
+            return false;
+        value = response.value();
+        return true;
+    }
+}
+
+#endif
@@ -1,40 +1,90 @@
 #include <grpcpp/grpcpp.h>
+#include <condition_variable>
+#include <csignal>
 #include <iostream>
+#include <mutex>
 #include <vector>
 #include <string>
 #include <thread>
+#include <pthread.h>
 #include "server.h"
+#include "async_server.h"
+
+// 收到 SIGINT 或 SIGTERM 后各节点先结束订阅流，再关闭服务端
+std::mutex g_stop_mutex;
+std::condition_variable g_stop_cv;
+bool g_stopping = false;
+
+void WaitForStop()
+{
+    std::unique_lock<std::mutex> lock(g_stop_mutex);
+    g_stop_cv.wait(lock, []()
+                   { return g_stopping; });
+}
 
 // 帮助信息
 void PrintUsage()
 {
-    std::cout << "Usage: ./server --node_count <node_count>" << std::endl;
+    std::cout << "Usage: ./server --node_count <node_count> [--channels_per_peer <count>] [--forward_timeout_ms <ms>] [--shards <count>] [--data_dir <dir>] [--sync always|interval|none] [--sync_interval_ms <ms>] [--snapshot_interval_s <s>] [--maxmemory <bytes>] [--eviction noeviction|allkeys-lru|allkeys-lfu|allkeys-random|volatile-ttl] [--max_hot_value_bytes <bytes> [--value_log_dir <dir>]] [--mode sync|async] [--cq_count <count>] [--heartbeat_ms <ms>] [--failure_timeout_ms <ms>] [--migration_bytes_per_sec <n>] [--join <seed_address> --node_offset <n>] [--replicas <n>] [--write_quorum <n>] [--read_quorum <n>] [--stale_reads] [--lease_ms <ms>]" << std::endl;
 }
 
-void StartServer(const std::string &node_name, const std::string &address, std::vector<kvstore::NodeInfo> other_nodes)
+void StartServer(const std::string &node_name, const std::string &address, std::vector<kvstore::NodeInfo> other_nodes, kvstore::ChannelOptions channel_options, kvstore::KVStoreOptions store_options, kvstore::MembershipOptions membership_options, kvstore::ReplicationOptions replication_options, kvstore::LeaseOptions lease_options, bool async_mode, int cq_count)
 {
     kvstore::NodeInfo node(node_name, address);
-    kvstore::KVStoreServiceImpl service(node, other_nodes);
+    if (!store_options.data_dir.empty())
+    {
+        store_options.data_dir += "/" + node_name; // 同一进程内的每个节点使用独立的数据目录
+    }
+    if (!store_options.value_log_dir.empty())
+    {
+        store_options.value_log_dir += "/" + node_name;
+    }
+    kvstore::KVStoreServiceImpl service(node, other_nodes, channel_options, store_options, membership_options, replication_options, lease_options);
 
     grpc::ServerBuilder builder;
+    kvstore::PeerChannelPool::apply_server_keepalive(builder, channel_options);
     builder.AddListeningPort(address, grpc::InsecureServerCredentials());
-    builder.RegisterService(&service);
 
-    std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
-    std::cout << "Server " << node_name << " listening on " << address << std::endl;
+    if (!async_mode)
+    {
+        builder.RegisterService(&service);
+        std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
+        std::cout << "Server " << node_name << " listening on " << address << std::endl;
+        WaitForStop();
+        service.shutdown();
+        server->Shutdown();
+        return;
+    }
 
-    server->Wait();
+    // 异步模式: Put/Get/Del 由 CQ 轮询线程处理
+    kvstore::KVStoreAsyncServer async_server(service, cq_count);
+    async_server.register_with(builder);
+    std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
+    async_server.start();
+    std::cout << "Server " << node_name << " listening on " << address << " (async)" << std::endl;
+    WaitForStop();
+    service.shutdown();
+    server->Shutdown();
+    async_server.shutdown();
 }
 
 int main(int argc, char **argv)
 {
-    if (argc != 3)
+    if (argc < 3)
     { // 检查参数数量
         PrintUsage();
         return -1;
     }
 
     int node_count = 0;
+    kvstore::ChannelOptions channel_options;
+    kvstore::KVStoreOptions store_options;
+    kvstore::MembershipOptions membership_options;
+    kvstore::ReplicationOptions replication_options;
+    kvstore::LeaseOptions lease_options;
+    int node_offset = 0;
+    bool async_mode = false;
+    int cq_count = 0;
     std::string host;
     int port = 0;
 
@@ -46,6 +96,142 @@ int main(int argc, char **argv)
             node_count = std::stoi(argv[i + 1]);
             i++;
         }
+        else if (std::string(argv[i]) == "--channels_per_peer" && i + 1 < argc)
+        {
+            channel_options.channels_per_peer = std::stoi(argv[i + 1]);
+            i++;
+        }
+        else if (std::string(argv[i]) == "--forward_timeout_ms" && i + 1 < argc)
+        {
+            channel_options.forward_timeout_ms = std::stoi(argv[i + 1]);
+            i++;
+        }
+        else if (std::string(argv[i]) == "--shards" && i + 1 < argc)
+        {
+            store_options.shard_count = std::stoul(argv[i + 1]);
+            i++;
+        }
+        else if (std::string(argv[i]) == "--data_dir" && i + 1 < argc)
+        {
+            store_options.data_dir = argv[i + 1];
+            i++;
+        }
+        else if (std::string(argv[i]) == "--sync" && i + 1 < argc)
+        {
+            std::string mode = argv[i + 1];
+            if (mode == "always")
+                store_options.sync_mode = kvstore::WalSyncMode::kAlways;
+            else if (mode == "interval")
+                store_options.sync_mode = kvstore::WalSyncMode::kInterval;
+            else if (mode == "none")
+                store_options.sync_mode = kvstore::WalSyncMode::kNone;
+            else
+            {
+                PrintUsage();
+                return -1;
+            }
+            i++;
+        }
+        else if (std::string(argv[i]) == "--sync_interval_ms" && i + 1 < argc)
+        {
+            store_options.sync_interval_ms = std::stoi(argv[i + 1]);
+            i++;
+        }
+        else if (std::string(argv[i]) == "--snapshot_interval_s" && i + 1 < argc)
+        {
+            store_options.snapshot_interval_s = std::stoi(argv[i + 1]);
+            i++;
+        }
+        else if (std::string(argv[i]) == "--maxmemory" && i + 1 < argc)
+        {
+            store_options.max_memory_bytes = std::stoull(argv[i + 1]);
+            i++;
+        }
+        else if (std::string(argv[i]) == "--eviction" && i + 1 < argc)
+        {
+            if (!kvstore::parse_eviction_policy(argv[i + 1], store_options.eviction_policy))
+            {
+                PrintUsage();
+                return -1;
+            }
+            i++;
+        }
+        else if (std::string(argv[i]) == "--max_hot_value_bytes" && i + 1 < argc)
+        {
+            store_options.max_hot_value_bytes = std::stoull(argv[i + 1]);
+            i++;
+        }
+        else if (std::string(argv[i]) == "--value_log_dir" && i + 1 < argc)
+        {
+            store_options.value_log_dir = argv[i + 1];
+            i++;
+        }
+        else if (std::string(argv[i]) == "--mode" && i + 1 < argc)
+        {
+            std::string mode = argv[i + 1];
+            if (mode == "async")
+                async_mode = true;
+            else if (mode != "sync")
+            {
+                PrintUsage();
+                return -1;
+            }
+            i++;
+        }
+        else if (std::string(argv[i]) == "--cq_count" && i + 1 < argc)
+        {
+            cq_count = std::stoi(argv[i + 1]);
+            i++;
+        }
+        else if (std::string(argv[i]) == "--heartbeat_ms" && i + 1 < argc)
+        {
+            membership_options.heartbeat_interval_ms = std::stoi(argv[i + 1]);
+            i++;
+        }
+        else if (std::string(argv[i]) == "--failure_timeout_ms" && i + 1 < argc)
+        {
+            membership_options.failure_timeout_ms = std::stoi(argv[i + 1]);
+            i++;
+        }
+        else if (std::string(argv[i]) == "--migration_bytes_per_sec" && i + 1 < argc)
+        {
+            membership_options.migration_bytes_per_sec = std::stoull(argv[i + 1]);
+            i++;
+        }
+        else if (std::string(argv[i]) == "--join" && i + 1 < argc)
+        {
+            membership_options.seed = argv[i + 1];
+            i++;
+        }
+        else if (std::string(argv[i]) == "--node_offset" && i + 1 < argc)
+        {
+            node_offset = std::stoi(argv[i + 1]);
+            i++;
+        }
+        else if (std::string(argv[i]) == "--replicas" && i + 1 < argc)
+        {
+            replication_options.replicas = std::stoi(argv[i + 1]);
+            i++;
+        }
+        else if (std::string(argv[i]) == "--write_quorum" && i + 1 < argc)
+        {
+            replication_options.write_quorum = std::stoi(argv[i + 1]);
+            i++;
+        }
+        else if (std::string(argv[i]) == "--read_quorum" && i + 1 < argc)
+        {
+            replication_options.read_quorum = std::stoi(argv[i + 1]);
+            i++;
+        }
+        else if (std::string(argv[i]) == "--stale_reads")
+        {
+            replication_options.stale_reads = true;
+        }
+        else if (std::string(argv[i]) == "--lease_ms" && i + 1 < argc)
+        {
+            lease_options.lease_ms = std::stoi(argv[i + 1]);
+            i++;
+        }
         else
         {
             PrintUsage();
@@ -53,15 +239,15 @@ int main(int argc, char **argv)
         }
     }
 
-    if (node_count <= 0)
+    if (node_count <= 0 || node_offset < 0 || membership_options.heartbeat_interval_ms <= 0 || channel_options.channels_per_peer <= 0 || store_options.shard_count == 0)
     {
         PrintUsage();
         return -1;
     }
 
-    // 创建节点名称的vector
+    // 创建节点名称的vector，--join 时从 node<node_offset + 1> 开始编号，加入 seed 所在的集群
     std::vector<kvstore::NodeInfo> nodes;
-    for (int i = 1; i <= node_count; ++i)
+    for (int i = node_offset + 1; i <= node_offset + node_count; ++i)
     {
         std::string node_name = "node" + std::to_string(i);
         std::string node_host = "localhost";
@@ -70,15 +256,30 @@ int main(int argc, char **argv)
         nodes.push_back(node); // 生成节点名称
     }
 
+    // 信号只由专门的线程接收，在启动节点之前屏蔽，节点和 gRPC 的线程都继承这个屏蔽字
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    std::thread signal_thread([signals]()
+                              {
+        int signal = 0;
+        sigwait(&signals, &signal);
+        std::lock_guard<std::mutex> lock(g_stop_mutex);
+        g_stopping = true;
+        g_stop_cv.notify_all(); });
+
     // 启动多个节点
     std::vector<std::thread> threads;
     for (int i = 0; i < node_count; ++i)
     {
         int node_port = port + i; // 为每个节点分配不同的端口
-        threads.push_back(std::thread(StartServer, nodes[i].get_name(), nodes[i].get_address(), nodes));
+        threads.push_back(std::thread(StartServer, nodes[i].get_name(), nodes[i].get_address(), nodes, channel_options, store_options, membership_options, replication_options, lease_options, async_mode, cq_count));
     }
 
     // 等待所有线程完成
+    signal_thread.join();
     for (auto &t : threads)
     {
         t.join();